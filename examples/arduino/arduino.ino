@@ -1,3 +1,5 @@
+/* ESP32C6 has no hardware FPU, use integer only arithmetic */
+#define TG3SPMC_FIXED_POINT
 #include "src/tg3spmc.h"
 #include "src/tg3spmc.logger.h"
 #include "delta_time.h"
@@ -8,7 +10,7 @@
 
 /******************************************************************************
  * SIMPLE TWAI ADAPTER FOR VARIOUS CAN RELATED PROJECTS (ESP32C6)
- * Preconfigured, default TWAI 500kbps, no filtering.
+ * Preconfigured, default TWAI 500kbps, single acceptance filter.
  *****************************************************************************/
 #include "driver/gpio.h"
 #include "driver/twai.h"
@@ -20,6 +22,10 @@ struct simple_twai
 
 	gpio_num_t tx;
 	gpio_num_t rx;
+
+	/* Standard ID acceptance filter (mask 0 accepts all) */
+	uint32_t filter_id;
+	uint32_t filter_mask; /* Bits that must match */
 };
 
 void simple_twai_init(struct simple_twai *self)
@@ -30,7 +36,14 @@ void simple_twai_init(struct simple_twai *self)
 		self->tx, self->rx, TWAI_MODE_NORMAL);
 	twai_timing_config_t t_config = TWAI_TIMING_CONFIG_500KBITS  ();
 	twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
-	
+
+	/* TWAI mask bits are inverted (1 - don't care), standard ID is
+	 * left aligned, RTR and data bytes are don't care */
+	f_config.acceptance_code = self->filter_id << 21;
+	f_config.acceptance_mask = ((~self->filter_mask & 0x7FFu) << 21) |
+				   0x1FFFFFu;
+	f_config.single_filter   = true;
+
 	g_config.controller_id = self->id;
 	code = twai_driver_install_v2(&g_config, &t_config, &f_config,
 		&self->bus);
@@ -52,7 +65,7 @@ void simple_twai_kill(struct simple_twai *self)
 }
 
 void simple_twai_send(struct simple_twai *self,
-		      struct SIMPLE_TWAI_FRAME_LABEL *frame)
+		      const struct SIMPLE_TWAI_FRAME_LABEL *frame)
 {
 	int8_t i;
 
@@ -121,6 +134,9 @@ void simple_twai_update(struct simple_twai *self)
 //struct simple_twai stw0;
 struct simple_twai stw1;
 
+/* Max RX frames drained from TWAI queue per loop() iteration */
+#define RX_BATCH_SIZE 16u
+
 /* Single Tesla one phase module */
 #define MOD1_PWRON_PIN 18u
 #define MOD1_CHGEN_PIN 19u
@@ -134,6 +150,16 @@ struct delta_time dt;
 /* Buffer for log */
 char log_buf[1024];
 
+/* Send binary telemetry records (24 bytes, see tg3spmc.logger.h) instead
+ * of text log. Host finds records by sync byte and CRC, decodes them with
+ * tg3spmc_telemetry_decode and prints with tg3spmc_telemetry_format. */
+/* #define LOG_BINARY_TELEMETRY */
+
+#if defined(LOG_BINARY_TELEMETRY)
+struct tg3spmc_telemetry telemetry;
+uint8_t telemetry_buf[TG3SPMC_TELEMETRY_SIZE];
+#endif
+
 void setup()
 {
 	delta_time_init(&dt);
@@ -152,17 +178,30 @@ void setup()
 	stw1.tx = GPIO_NUM_14;
 	stw1.rx = GPIO_NUM_15;
 
+	/* Accept module 1 frames only (3 of 2048 IDs falsely accepted) */
+	{
+		struct tg3spmc_can_filter filter;
+
+		tg3spmc_build_can_filters(1u << 1u, false, &filter, 1u);
+		stw1.filter_id   = filter.id;
+		stw1.filter_mask = filter.mask;
+	}
+
 	/* simple_twai_init(&stw0); */
 	simple_twai_init(&stw1);
 
 	/* Tesla module config */
-	config.rated_voltage_ac_V = 240.0f;
-	config.voltage_dc_V       = 390;
-	config.current_ac_A       = 4.0f;
+	config.rated_voltage_ac_mV = 240000u;
+	config.voltage_dc_mV       = 390000u;
+	config.current_ac_mA       =   4000u;
 
 	/* Init module 1 (0, *1, 2) */
 	tg3spmc_init(&mod1, 1u);
 	tg3spmc_set_config(&mod1, config);
+
+#if defined(LOG_BINARY_TELEMETRY)
+	tg3spmc_telemetry_init(&telemetry);
+#endif
 }
 
 void loop()
@@ -173,8 +212,11 @@ void loop()
 	/* Module event */
 	enum tg3spmc_event ev;
 
-	/* General purpose CAN frame */
-	struct tg3spmc_frame f;
+	/* Queued TX frames (zero-copy view) and drained RX frames */
+	const struct tg3spmc_frame *tx_frames;
+	struct tg3spmc_frame rx_frames[RX_BATCH_SIZE];
+	uint8_t n;
+	uint8_t k;
 
 	/* Measure delta time from past loop cycle (milliseconds) */
 	uint32_t delta_time_ms = delta_time_update_ms(&dt, millis());
@@ -186,13 +228,19 @@ void loop()
 	/* TESLA */
 	ev = tg3spmc_step(&mod1, delta_time_ms);
 
-	if (tg3spmc_get_tx_frame(&mod1, &f)) {
-		simple_twai_send(&stw1, &f);
+	/* Send all queued frames at once */
+	n = tg3spmc_view_tx_frames(&mod1, &tx_frames);
+	for (k = 0u; k < n; k++) {
+		simple_twai_send(&stw1, &tx_frames[k]);
 	}
+	tg3spmc_release_tx_frames(&mod1);
 
-	if (simple_twai_recv(&stw1, &f)) {
-		tg3spmc_put_rx_frame(&mod1, &f);
+	/* Drain TWAI RX queue, so it never backs up under load */
+	n = 0u;
+	while ((n < RX_BATCH_SIZE) && simple_twai_recv(&stw1, &rx_frames[n])) {
+		n++;
 	}
+	tg3spmc_put_rx_frames(&mod1, rx_frames, n);
 
 	digitalWrite(MOD1_PWRON_PIN, tg3spmc_get_pwron_pin_state(&mod1));
 	digitalWrite(MOD1_CHGEN_PIN, tg3spmc_get_chgen_pin_state(&mod1));
@@ -219,8 +267,16 @@ void loop()
 		 * possible solutions:
 		 * 	check value of tg3spmc_read_vars or update API */
 		if (mod1._io.rx.has_frames) {
+#if defined(LOG_BINARY_TELEMETRY)
+			if (tg3spmc_telemetry_encode(&telemetry, &mod1,
+				telemetry_buf, sizeof(telemetry_buf))) {
+				Serial.write(telemetry_buf,
+					     sizeof(telemetry_buf));
+			}
+#else
 			tg3spmc_log(&mod1, log_buf, 1024);
 			printf("%s\n\n", log_buf);
+#endif
 		}
 	}
 }
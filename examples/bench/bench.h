@@ -0,0 +1,91 @@
+#ifndef   BENCH_H
+#define   BENCH_H
+
+/* clock_gettime is POSIX, not C89 */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include "canary_log_reader.h"
+#include "tg3spmc.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/******************************************************************************
+ * BENCH HELPERS
+ *****************************************************************************/
+/** Canary capture recorded from real module (module ID 1) */
+#define BENCH_LOG_EMU_FILE "../log_emu/common_20251029_154131_tesla_bcb" \
+			   "_start_and_230_ac_387_DC_working_4A"       \
+			   "_but_unstable_as_hell.txt"
+
+/** Max frames loaded from a single capture */
+#define BENCH_MAX_FRAMES 32768u
+
+/* Monotonic time in nanoseconds */
+double bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((double)ts.tv_sec * 1e9) + (double)ts.tv_nsec;
+}
+
+/* CPU cycle counter (falls back to nanoseconds on non x86 hosts) */
+double bench_cycles(void)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	return (double)__builtin_ia32_rdtsc();
+#else
+	return bench_now_ns();
+#endif
+}
+
+/* Prevents compiler from optimizing away benchmarked results */
+volatile uint32_t bench_sink;
+
+/* Loads canary capture into frames array (timestamps are optional) */
+size_t bench_load_canary(const char *path, bool common_log,
+			 struct tg3spmc_frame *frames,
+			 uint32_t *timestamps_us, size_t max)
+{
+	int c;
+	size_t n = 0u;
+	struct canary_log_reader r;
+	FILE *file = fopen(path, "r");
+
+	if (file == NULL) {
+		printf("Can't open %s\n", path);
+		return 0u;
+	}
+
+	canary_log_reader_init(&r);
+	r.common_log = common_log;
+
+	c = getc(file);
+	while ((c != EOF) && (n < max)) {
+		if (canary_log_reader_putc(&r, c) ==
+		    CANARY_LOG_READER_EVENT_FRAME_READY) {
+			frames[n].id  = r._frame.id;
+			frames[n].len = r._frame.len;
+			memcpy(frames[n].data, r._frame.data, 8u);
+
+			if (timestamps_us != NULL) {
+				timestamps_us[n] = r._frame.timestamp_us;
+			}
+
+			n++;
+		}
+
+		c = getc(file);
+	}
+
+	fclose(file);
+
+	return n;
+}
+
+#endif /* BENCH_H */
@@ -0,0 +1,107 @@
+/* Binary capture vs text log: size and parse speed.
+ *
+ * TEXT:   canary_log_reader_read over canary text.
+ * BINARY: can_capture_read over the same frames, converted in memory. */
+#include "bench.h"
+#include "can_capture.h"
+
+#define GBT_FILE "../log_emu/canary_log_reader/gbt_working_sequence.txt"
+
+/* Each file is parsed this many times per method */
+#define CAN_CAPTURE_RUNS 50u
+
+/* Max capture size */
+#define CAN_CAPTURE_MAX_SIZE (4u * 1024u * 1024u)
+
+char    text[CAN_CAPTURE_MAX_SIZE];
+uint8_t capture[CAN_CAPTURE_MAX_SIZE];
+struct canary_log_reader_frame frames[BENCH_MAX_FRAMES];
+
+double parse_text(size_t size, bool common_log, size_t *n)
+{
+	struct canary_log_reader r;
+	size_t used;
+	uint32_t run;
+	double t0 = bench_now_ns();
+
+	for (run = 0u; run < CAN_CAPTURE_RUNS; run++) {
+		canary_log_reader_init(&r);
+		r.common_log = common_log;
+
+		*n = canary_log_reader_read(&r, text, size, frames,
+					    BENCH_MAX_FRAMES, &used);
+		bench_sink += frames[*n - 1u].id;
+	}
+
+	return (bench_now_ns() - t0) / CAN_CAPTURE_RUNS;
+}
+
+double parse_binary(size_t size, size_t *n)
+{
+	struct can_capture r;
+	size_t used;
+	uint32_t run;
+	double t0 = bench_now_ns();
+
+	for (run = 0u; run < CAN_CAPTURE_RUNS; run++) {
+		can_capture_init(&r);
+
+		*n = can_capture_read(&r, capture, size, frames,
+				      BENCH_MAX_FRAMES, &used);
+		bench_sink += frames[*n - 1u].id;
+	}
+
+	return (bench_now_ns() - t0) / CAN_CAPTURE_RUNS;
+}
+
+void bench_file(const char *name, const char *path, bool common_log)
+{
+	static struct can_capture w;
+	FILE  *file = fopen(path, "rb");
+	size_t text_size;
+	size_t cap_size;
+	size_t n_text;
+	size_t n_cap;
+	size_t k;
+	double text_ns;
+	double cap_ns;
+
+	if (file == NULL) {
+		printf("Can't open %s\n", path);
+		return;
+	}
+
+	text_size = fread(text, 1u, sizeof(text), file);
+	fclose(file);
+
+	text_ns = parse_text(text_size, common_log, &n_text);
+
+	can_capture_init(&w);
+	cap_size = can_capture_write_header(&w, capture);
+	for (k = 0u; k < n_text; k++) {
+		cap_size += can_capture_write(&w, &frames[k],
+					      &capture[cap_size]);
+	}
+
+	cap_ns = parse_binary(cap_size, &n_cap);
+	assert(n_cap == n_text);
+
+	printf("%s: %lu frames, %u IDs\n", name, (unsigned long)n_text,
+	       (unsigned)w._dict_len);
+	printf("  TEXT:   %8lu bytes, %8.1f us, %10.0f frames/s\n",
+	       (unsigned long)text_size, text_ns / 1e3,
+	       (double)n_text / text_ns * 1e9);
+	printf("  BINARY: %8lu bytes, %8.1f us, %10.0f frames/s "
+	       "(x%.2f smaller, x%.2f faster)\n",
+	       (unsigned long)cap_size, cap_ns / 1e3,
+	       (double)n_cap / cap_ns * 1e9,
+	       (double)text_size / (double)cap_size, text_ns / cap_ns);
+}
+
+int main(void)
+{
+	bench_file("gbt_working_sequence.txt", GBT_FILE, false);
+	bench_file("log_emu capture", BENCH_LOG_EMU_FILE, true);
+
+	return 0;
+}
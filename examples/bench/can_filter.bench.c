@@ -0,0 +1,48 @@
+/* Expected false-accept rate of generated acceptance filters.
+ *
+ * Rate is the share of foreign standard IDs (uniformly distributed)
+ * that pass the filters and wake the CPU for nothing. */
+#include "bench.h"
+
+int main(void)
+{
+	const uint8_t module_masks[3] = { 0x02u, 0x03u, 0x07u };
+	const uint8_t filter_counts[5] = { 1u, 2u, 4u, 8u,
+					   _TG3SPMC_FILTER_MAX_IDS };
+	struct tg3spmc_can_filter f[_TG3SPMC_FILTER_MAX_IDS];
+	uint32_t ids[_TG3SPMC_FILTER_MAX_IDS];
+	uint32_t false_accepts;
+	uint8_t  used;
+	uint8_t  side;
+	uint8_t  m;
+	uint8_t  c;
+	uint8_t  n;
+
+	printf("modules side  max  used  filters  false-accepts  rate\n");
+
+	for (m = 0u; m < 3u; m++) {
+	for (side = 0u; side < 2u; side++) {
+	for (c = 0u; c < 5u; c++) {
+		used = _tg3spmc_filter_collect_ids(module_masks[m],
+						   side != 0u, ids);
+		n = tg3spmc_build_can_filters(module_masks[m], side != 0u,
+					      f, filter_counts[c]);
+		false_accepts = tg3spmc_can_filters_false_accepts(
+				f, n, module_masks[m], side != 0u);
+
+		printf("  0x%02X   %-3s  %3u  %4u  %7u  %13lu  %5.2f%%\n",
+		       module_masks[m], (side != 0u) ? "yes" : "no",
+		       filter_counts[c], used, n,
+		       (unsigned long)false_accepts,
+		       100.0 * false_accepts / (2048.0 - used));
+	}
+	}
+	}
+
+	/* Single mask filter for module 1, ready for TWAI / SocketCAN */
+	n = tg3spmc_build_can_filters(0x02u, false, f, 1u);
+	printf("module 1, single filter: id 0x%03lX mask 0x%03lX\n",
+	       (unsigned long)f[0].id, (unsigned long)f[0].mask);
+
+	return 0;
+}
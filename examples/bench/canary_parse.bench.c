@@ -0,0 +1,158 @@
+/* Canary log parsing throughput.
+ *
+ * GETC:  canary_log_reader_putc fed by getc (as log_emu used to do).
+ * PUTC:  canary_log_reader_putc fed from memory (parser cost only).
+ * BULK:  canary_log_reader_read over the whole buffer, 64KiB chunks. */
+#include "bench.h"
+
+#define GBT_FILE "../log_emu/canary_log_reader/gbt_working_sequence.txt"
+
+/* Each file is parsed this many times per method */
+#define CANARY_PARSE_RUNS 20u
+
+/* Max capture size */
+#define CANARY_PARSE_MAX_SIZE (4u * 1024u * 1024u)
+
+/* Bulk chunk size */
+#define CANARY_PARSE_CHUNK (64u * 1024u)
+
+char buf[CANARY_PARSE_MAX_SIZE];
+struct canary_log_reader_frame frames[256];
+
+size_t parse_getc(const char *path, bool common_log)
+{
+	struct canary_log_reader r;
+	FILE *file = fopen(path, "r");
+	int c;
+
+	canary_log_reader_init(&r);
+	r.common_log = common_log;
+
+	c = getc(file);
+	while (c != EOF) {
+		if (canary_log_reader_putc(&r, (char)c) ==
+		    CANARY_LOG_READER_EVENT_FRAME_READY) {
+			bench_sink += r._frame.id;
+		}
+
+		c = getc(file);
+	}
+
+	fclose(file);
+
+	return r._total_frames;
+}
+
+size_t parse_putc(size_t size, bool common_log)
+{
+	struct canary_log_reader r;
+	size_t k;
+
+	canary_log_reader_init(&r);
+	r.common_log = common_log;
+
+	for (k = 0u; k < size; k++) {
+		if (canary_log_reader_putc(&r, buf[k]) ==
+		    CANARY_LOG_READER_EVENT_FRAME_READY) {
+			bench_sink += r._frame.id;
+		}
+	}
+
+	return r._total_frames;
+}
+
+size_t parse_bulk(size_t size, bool common_log)
+{
+	struct canary_log_reader r;
+	size_t pos = 0u;
+	size_t chunk;
+	size_t used;
+	size_t n;
+	size_t k;
+
+	canary_log_reader_init(&r);
+	r.common_log = common_log;
+
+	while (pos < size) {
+		chunk = size - pos;
+		if (chunk > CANARY_PARSE_CHUNK) {
+			chunk = CANARY_PARSE_CHUNK;
+		}
+
+		n = canary_log_reader_read(&r, &buf[pos], chunk, frames,
+					   sizeof(frames) / sizeof(frames[0]),
+					   &used);
+		for (k = 0u; k < n; k++) {
+			bench_sink += frames[k].id;
+		}
+
+		if (used == 0u) {
+			break; /* No newline at the end of file */
+		}
+
+		pos += used;
+	}
+
+	return r._total_frames;
+}
+
+void bench_file(const char *name, const char *path, bool common_log)
+{
+	FILE  *file = fopen(path, "rb");
+	size_t size;
+	size_t frames_n[3] = { 0u, 0u, 0u };
+	double ns[3];
+	double t0;
+	uint32_t run;
+	uint8_t  m;
+	const char *methods[3] = { "GETC", "PUTC", "BULK" };
+
+	if (file == NULL) {
+		printf("Can't open %s\n", path);
+		return;
+	}
+
+	size = fread(buf, 1u, sizeof(buf), file);
+	fclose(file);
+
+	for (m = 0u; m < 3u; m++) {
+		t0 = bench_now_ns();
+
+		for (run = 0u; run < CANARY_PARSE_RUNS; run++) {
+			switch (m) {
+			case 0u:
+				frames_n[m] = parse_getc(path, common_log);
+				break;
+			case 1u:
+				frames_n[m] = parse_putc(size, common_log);
+				break;
+			default:
+				frames_n[m] = parse_bulk(size, common_log);
+				break;
+			}
+		}
+
+		ns[m] = (bench_now_ns() - t0) / CANARY_PARSE_RUNS;
+	}
+
+	/* Same frames, whatever the method is */
+	assert(frames_n[0] == frames_n[2]);
+	assert(frames_n[1] == frames_n[2]);
+
+	printf("%s: %lu bytes, %lu frames\n", name, (unsigned long)size,
+	       (unsigned long)frames_n[2]);
+
+	for (m = 0u; m < 3u; m++) {
+		printf("  %s: %8.2f MB/s %10.0f frames/s (x%.2f)\n",
+		       methods[m], (double)size / ns[m] * 1e3,
+		       (double)frames_n[m] / ns[m] * 1e9, ns[0] / ns[m]);
+	}
+}
+
+int main(void)
+{
+	bench_file("gbt_working_sequence.txt", GBT_FILE, false);
+	bench_file("log_emu capture", BENCH_LOG_EMU_FILE, true);
+
+	return 0;
+}
@@ -0,0 +1,78 @@
+/* Foreign ID storm: rejected frames per second.
+ *
+ * SWITCH:   every frame is offered to all three modules
+ *           (tg3spmc_put_rx_frame, subtract-and-switch per module).
+ * DISPATCH: single tg3spmc_dispatch lookup serves all three modules.
+ *
+ * 100% load on 500kbps bus is ~10k frames/s for the shortest (DLC 0)
+ * standard frames, so both numbers are compared against that. */
+#include "bench.h"
+
+#define DISPATCH_STORM_FRAMES 65536u
+#define DISPATCH_STORM_REPEAT 200u
+
+/* Shortest standard frame: 47 bits + 3 bits interframe space */
+#define DISPATCH_STORM_BUS_FPS (500000.0 / 50.0)
+
+struct tg3spmc_frame storm[DISPATCH_STORM_FRAMES];
+
+int main(void)
+{
+	struct tg3spmc_dispatch d;
+	struct tg3spmc mods[3];
+	uint32_t seed = 12345u;
+	uint32_t i;
+	uint32_t r;
+	uint8_t  m;
+	double t0;
+	double switch_fps;
+	double dispatch_fps;
+
+	tg3spmc_dispatch_init(&d);
+	for (m = 0u; m < 3u; m++) {
+		tg3spmc_init(&mods[m], m);
+		tg3spmc_dispatch_attach(&d, &mods[m]);
+	}
+
+	/* Random foreign standard IDs (module IDs are skipped) */
+	for (i = 0u; i < DISPATCH_STORM_FRAMES; i++) {
+		do {
+			seed = (seed * 1103515245u) + 12345u;
+			storm[i].id = (seed >> 16u) & 0x7FFu;
+		} while (d._table[storm[i].id] != _TG3SPMC_DISPATCH_REJECT);
+
+		storm[i].len = 8u;
+		memset(storm[i].data, (int)i, 8u);
+	}
+
+	t0 = bench_now_ns();
+	for (r = 0u; r < DISPATCH_STORM_REPEAT; r++) {
+		for (i = 0u; i < DISPATCH_STORM_FRAMES; i++) {
+			for (m = 0u; m < 3u; m++) {
+				tg3spmc_put_rx_frame(&mods[m], &storm[i]);
+			}
+		}
+	}
+	switch_fps = (double)DISPATCH_STORM_FRAMES * DISPATCH_STORM_REPEAT /
+		     ((bench_now_ns() - t0) * 1e-9);
+
+	t0 = bench_now_ns();
+	for (r = 0u; r < DISPATCH_STORM_REPEAT; r++) {
+		for (i = 0u; i < DISPATCH_STORM_FRAMES; i++) {
+			bench_sink += (uint32_t)
+				tg3spmc_dispatch_put_rx_frame(&d, &storm[i]);
+		}
+	}
+	dispatch_fps = (double)DISPATCH_STORM_FRAMES * DISPATCH_STORM_REPEAT /
+		       ((bench_now_ns() - t0) * 1e-9);
+
+	assert(bench_sink == 0u);
+
+	printf("bus at 100%% load: %8.0f frames/s\n", DISPATCH_STORM_BUS_FPS);
+	printf("SWITCH:   %12.0f rejected frames/s (%.0fx bus load)\n",
+	       switch_fps, switch_fps / DISPATCH_STORM_BUS_FPS);
+	printf("DISPATCH: %12.0f rejected frames/s (%.0fx bus load)\n",
+	       dispatch_fps, dispatch_fps / DISPATCH_STORM_BUS_FPS);
+
+	return 0;
+}
@@ -0,0 +1,69 @@
+/* Decode/encode cost of float vs fixed point build.
+ *
+ * Built twice by makefile: default (float) and TG3SPMC_FIXED_POINT.
+ * Compare "cycles/pass" of both runs. On FPU-less targets the gap is
+ * much wider than on host, since every float operation is emulated. */
+#include "bench.h"
+
+#define FIXED_POINT_REPEAT 1000000u
+
+int main(void)
+{
+	struct tg3spmc mod;
+	struct tg3spmc_frame f;
+	uint8_t d[8] = { 0x00u, 0xA0u, 0x00u, 0x39u, 0x00u, 0x06u, 0x04u, 0x00u };
+	uint32_t i;
+	double c0;
+	double decode_cycles;
+	double encode_cycles;
+
+#if defined(TG3SPMC_FIXED_POINT)
+	struct tg3spmc_config_float config;
+	const char *mode = "FIXED";
+#else
+	struct tg3spmc_config config;
+	const char *mode = "FLOAT";
+#endif
+
+	config.rated_voltage_ac_V = 240.0f;
+	config.voltage_dc_V       = 390.0f;
+	config.current_ac_A       = 4.0f;
+
+	tg3spmc_init(&mod, 1u);
+#if defined(TG3SPMC_FIXED_POINT)
+	tg3spmc_set_config_float(&mod, config);
+#else
+	tg3spmc_set_config(&mod, config);
+#endif
+
+	/* Decode every signal carrying message */
+	c0 = bench_cycles();
+	for (i = 0u; i < FIXED_POINT_REPEAT; i++) {
+		d[2] = (uint8_t)i; /* Vary input a bit */
+		d[5] = (uint8_t)(i >> 3u);
+
+		bench_sink += _tg3spm_decode_ac_params(&mod._vars, d);
+		bench_sink += _tg3spm_decode_dc_params(&mod._vars, d);
+		bench_sink += _tg3spm_decode_limits(&mod._vars, d);
+
+		bench_sink += mod._vars.status + (uint32_t)mod._vars.ac_present;
+	}
+	decode_cycles = (bench_cycles() - c0) / FIXED_POINT_REPEAT;
+
+	/* Encode setpoint messages (both control byte paths) */
+	c0 = bench_cycles();
+	for (i = 0u; i < FIXED_POINT_REPEAT; i++) {
+		mod._hold_start = ((i & 1u) != 0u);
+
+		_tg3spmc_encode_frame_h42C(&mod, &f);
+		bench_sink += f.data[1];
+		_tg3spmc_encode_frame_h45C(&mod, &f);
+		bench_sink += f.data[0];
+	}
+	encode_cycles = (bench_cycles() - c0) / FIXED_POINT_REPEAT;
+
+	printf("%s: decode %6.2f cycles/pass, encode %6.2f cycles/pass\n",
+	       mode, decode_cycles, encode_cycles);
+
+	return 0;
+}
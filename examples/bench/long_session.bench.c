@@ -0,0 +1,209 @@
+/* Replay of a synthetic 12 hour session (canary text, 32 bit timer).
+ *
+ * The log_emu capture is repeated back to back for 12 hours and written
+ * with timestamps wrapped at 32 bit microseconds (as a CANARY logger with
+ * a 32 bit timer does, every ~71 minutes). Text is parsed in chunks by the
+ * bulk reader and replayed on a virtual clock, same as log_emu does.
+ *
+ * Timeline must stay monotonic, and parse + replay throughput must not
+ * depend on how far into the session it is. */
+#include "bench.h"
+
+/* Session length */
+#define LONG_SESSION_HOURS 12u
+#define LONG_SESSION_US ((uint64_t)LONG_SESSION_HOURS * 3600000000u)
+
+/* Text chunk size */
+#define LONG_SESSION_CHUNK (64u * 1024u)
+
+/* Max length of a single canary common log line */
+#define LONG_SESSION_LINE_MAX 64u
+
+struct canary_log_reader_frame src[BENCH_MAX_FRAMES];
+struct canary_log_reader_frame frames[256];
+char text[LONG_SESSION_CHUNK + LONG_SESSION_LINE_MAX];
+
+struct tg3spmc mod;
+uint64_t sim_time_ms;
+
+/* Loads log_emu capture, returns number of frames */
+size_t load_source(void)
+{
+	static char buf[4u * 1024u * 1024u];
+	struct canary_log_reader r;
+	FILE  *file = fopen(BENCH_LOG_EMU_FILE, "rb");
+	size_t size;
+	size_t used;
+
+	if (file == NULL) {
+		return 0u;
+	}
+
+	size = fread(buf, 1u, sizeof(buf), file);
+	fclose(file);
+
+	canary_log_reader_init(&r);
+	r.common_log = true;
+
+	return canary_log_reader_read(&r, buf, size, src, BENCH_MAX_FRAMES,
+				      &used);
+}
+
+/* Writes a line with timestamp as a 32 bit logger does */
+size_t print_frame(char *out, const struct canary_log_reader_frame *f,
+		   uint64_t timestamp_us)
+{
+	uint32_t t = (uint32_t)(timestamp_us % CANARY_LOG_READER_WRAP_US);
+	size_t   n;
+	uint8_t  i;
+
+	n = (size_t)sprintf(out, "%04u.%06u 0 %08X %02X %u",
+			    (unsigned)(t / 1000000u), (unsigned)(t % 1000000u),
+			    (unsigned)f->id, (unsigned)f->flags,
+			    (unsigned)f->len);
+
+	for (i = 0u; i < f->len; i++) {
+		n += (size_t)sprintf(&out[n], " %02X", (unsigned)f->data[i]);
+	}
+
+	out[n] = '\n';
+
+	return n + 1u;
+}
+
+void step(uint32_t delta_ms)
+{
+	struct tg3spmc_frame out[3];
+
+	sim_time_ms += delta_ms;
+	bench_sink += (uint32_t)tg3spmc_step(&mod, delta_ms);
+	bench_sink += tg3spmc_get_tx_frames(&mod, out, 3u);
+}
+
+/* Same as log_emu advance + replay_frame */
+void replay(const struct canary_log_reader_frame *frame)
+{
+	struct tg3spmc_frame f;
+	uint64_t time_ms = frame->timestamp_us / 1000u;
+	uint32_t deadline;
+
+	while (time_ms > sim_time_ms) {
+		deadline = tg3spmc_next_deadline_ms(&mod);
+
+		if (deadline > (time_ms - sim_time_ms)) {
+			deadline = (uint32_t)(time_ms - sim_time_ms);
+		}
+
+		step(deadline);
+	}
+
+	f.id  = frame->id;
+	f.len = frame->len;
+	memcpy(f.data, frame->data, f.len);
+
+	tg3spmc_put_rx_frame(&mod, &f);
+	step(0u);
+}
+
+int main(void)
+{
+	struct tg3spmc_config config;
+	struct canary_log_reader r;
+	size_t   n_src = load_source();
+	size_t   k = 0u;
+	size_t   len = 0u;
+	size_t   used;
+	size_t   n;
+	size_t   i;
+	uint64_t base_us = 0u;
+	uint64_t last_us = 0u;
+	uint64_t total = 0u;
+	uint64_t hour_frames[LONG_SESSION_HOURS];
+	double   hour_ns[LONG_SESSION_HOURS];
+	double   min_fps = 0.0;
+	double   max_fps = 0.0;
+	double   fps;
+	double   t0;
+	uint32_t hour = 0u;
+
+	if (n_src == 0u) {
+		printf("Can't open %s\n", BENCH_LOG_EMU_FILE);
+		return 0;
+	}
+
+	config.rated_voltage_ac_V = 240.0f;
+	config.voltage_dc_V       = 390.0f;
+	config.current_ac_A       = 4.0f;
+
+	tg3spmc_init(&mod, 1u);
+	tg3spmc_set_config(&mod, config);
+	sim_time_ms = 0u;
+
+	canary_log_reader_init(&r);
+	r.common_log = true;
+
+	memset(hour_frames, 0, sizeof(hour_frames));
+	memset(hour_ns, 0, sizeof(hour_ns));
+
+	while ((base_us + src[k].timestamp_us) < LONG_SESSION_US) {
+		/* Generate a chunk of text (not measured) */
+		while (len < LONG_SESSION_CHUNK) {
+			len += print_frame(&text[len], &src[k],
+					   base_us + src[k].timestamp_us);
+
+			k++;
+			if (k >= n_src) {
+				/* Next repetition 1s after the last frame */
+				base_us += src[n_src - 1u].timestamp_us +
+					   1000000u;
+				k = 0u;
+			}
+		}
+
+		/* Parse and replay */
+		t0 = bench_now_ns();
+
+		do {
+			n = canary_log_reader_read(&r, text, len, frames,
+				sizeof(frames) / sizeof(frames[0]), &used);
+
+			for (i = 0u; i < n; i++) {
+				assert(frames[i].timestamp_us >= last_us);
+				last_us = frames[i].timestamp_us;
+				replay(&frames[i]);
+			}
+
+			total += n;
+			hour_frames[hour] += n;
+			len -= used;
+			memmove(text, &text[used], len);
+		} while (n > 0u);
+
+		hour_ns[hour] += bench_now_ns() - t0;
+		hour = (uint32_t)(last_us / 3600000000u);
+		if (hour >= LONG_SESSION_HOURS) {
+			hour = LONG_SESSION_HOURS - 1u;
+		}
+	}
+
+	assert(r._total_errors == 0u);
+
+	printf("%u hours, %lu frames, last frame at %lu.%06lus, "
+	       "%lu timer wraps unwrapped\n", LONG_SESSION_HOURS,
+	       (unsigned long)total, (unsigned long)(last_us / 1000000u),
+	       (unsigned long)(last_us % 1000000u),
+	       (unsigned long)(r._wrap_us / CANARY_LOG_READER_WRAP_US));
+
+	for (hour = 0u; hour < LONG_SESSION_HOURS; hour++) {
+		fps = (double)hour_frames[hour] / hour_ns[hour] * 1e9;
+		min_fps = ((hour == 0u) || (fps < min_fps)) ? fps : min_fps;
+		max_fps = ((hour == 0u) || (fps > max_fps)) ? fps : max_fps;
+
+		printf("  hour %2u: %8lu frames, %10.0f frames/s\n",
+		       hour + 1u, (unsigned long)hour_frames[hour], fps);
+	}
+
+	printf("  min/max: x%.2f\n", min_fps / max_fps);
+
+	return 0;
+}
@@ -0,0 +1,193 @@
+/* Flight recorder: recording cost per frame, RAM vs history depth.
+ *
+ * COST: tg3spmc_put_rx_frame alone vs tg3spmc_recorder_rx, cycles per
+ *       frame over the log_emu capture.
+ * DEPTH: capture is replayed on a virtual clock (as log_emu does) with
+ *        RX/TX/steps recorded until the first fault. Frozen recorder is
+ *        exported, parsed back by canary_log_reader and must give the
+ *        recorded frames. */
+
+/* snprintf is C99, tg3spmc.logger.h uses it */
+#define _ISOC99_SOURCE
+
+#include "bench.h"
+#include "tg3spmc.logger.h"
+
+/* Each method runs over the whole capture this many times */
+#define RECORDER_RUNS 64u
+
+/* Largest benchmarked depth */
+#define RECORDER_MAX_DEPTH 4096u
+
+struct tg3spmc_frame frames[BENCH_MAX_FRAMES];
+uint32_t timestamps_us[BENCH_MAX_FRAMES];
+
+struct tg3spmc_recorder_entry entries[RECORDER_MAX_DEPTH];
+struct canary_log_reader_frame parsed[RECORDER_MAX_DEPTH];
+char text[RECORDER_MAX_DEPTH * TG3SPMC_RECORDER_LINE_MAX];
+
+struct tg3spmc mod;
+struct tg3spmc_recorder rec;
+uint32_t sim_time_ms;
+
+void bench_cost(size_t n)
+{
+	uint32_t run;
+	size_t   i;
+	double   c0;
+	double   rx_cycles;
+	double   rec_cycles;
+
+	tg3spmc_init(&mod, 1u);
+	tg3spmc_recorder_init(&rec, entries, 256u);
+
+	c0 = bench_cycles();
+	for (run = 0u; run < RECORDER_RUNS; run++) {
+		for (i = 0u; i < n; i++) {
+			tg3spmc_put_rx_frame(&mod, &frames[i]);
+		}
+	}
+	rx_cycles = (bench_cycles() - c0) / (double)(n * RECORDER_RUNS);
+
+	c0 = bench_cycles();
+	for (run = 0u; run < RECORDER_RUNS; run++) {
+		for (i = 0u; i < n; i++) {
+			tg3spmc_recorder_rx(&rec, &mod, &frames[i]);
+		}
+	}
+	rec_cycles = (bench_cycles() - c0) / (double)(n * RECORDER_RUNS);
+
+	bench_sink += entries[rec._head].id;
+
+	printf("put_rx_frame: %5.1f cycles/frame, recorder_rx: %5.1f "
+	       "cycles/frame (x%.2f of put_rx_frame)\n", rx_cycles,
+	       rec_cycles, rec_cycles / rx_cycles);
+}
+
+void step(uint32_t delta_ms)
+{
+	struct tg3spmc_frame out[3];
+	enum tg3spmc_event ev;
+	uint8_t n;
+	uint8_t k;
+
+	sim_time_ms += delta_ms;
+	ev = tg3spmc_step(&mod, delta_ms);
+	tg3spmc_recorder_step(&rec, &mod, delta_ms, ev);
+
+	n = tg3spmc_get_tx_frames(&mod, out, 3u);
+	for (k = 0u; k < n; k++) {
+		tg3spmc_recorder_tx(&rec, &mod, &out[k]);
+	}
+}
+
+/* Replays capture until the first fault, returns log time of the fault */
+uint32_t replay(size_t n)
+{
+	struct tg3spmc_config config;
+	uint32_t time_ms;
+	uint32_t deadline;
+	size_t   i;
+
+	config.rated_voltage_ac_V = 240.0f;
+	config.voltage_dc_V       = 390.0f;
+	config.current_ac_A       = 4.0f;
+
+	tg3spmc_init(&mod, 1u);
+	tg3spmc_set_config(&mod, config);
+	sim_time_ms = 0u;
+	step(0u);
+
+	for (i = 0u; (i < n) && !rec.frozen; i++) {
+		time_ms = timestamps_us[i] / 1000u;
+
+		while ((time_ms > sim_time_ms) && !rec.frozen) {
+			deadline = tg3spmc_next_deadline_ms(&mod);
+
+			if (deadline > (time_ms - sim_time_ms)) {
+				deadline = time_ms - sim_time_ms;
+			}
+
+			step(deadline);
+		}
+
+		tg3spmc_put_rx_frame(&mod, &frames[i]);
+		tg3spmc_recorder_rx(&rec, &mod, &frames[i]);
+		step(0u);
+	}
+
+	return sim_time_ms;
+}
+
+void bench_depth(size_t n, uint32_t depth)
+{
+	const struct tg3spmc_recorder_entry *e;
+	struct canary_log_reader r;
+	uint32_t fault_ms;
+	uint32_t line;
+	uint32_t k;
+	size_t   len = 0u;
+	size_t   used;
+	size_t   n_parsed;
+	size_t   n_frames = 0u;
+
+	tg3spmc_recorder_init(&rec, entries, depth);
+	fault_ms = replay(n);
+	assert(rec.frozen);
+
+	for (line = 0u; line < tg3spmc_recorder_lines(&rec); line++) {
+		assert(tg3spmc_recorder_export(&rec, line, &text[len],
+					       TG3SPMC_RECORDER_LINE_MAX));
+		len += strlen(&text[len]);
+	}
+
+	canary_log_reader_init(&r);
+	r.common_log = true;
+	n_parsed = canary_log_reader_read(&r, text, len, parsed, depth, &used);
+	assert(r._total_errors == 0u);
+
+	/* Parsed frames are recorded RX/TX entries, in the same order */
+	for (k = 0u; k < rec._len; k++) {
+		e = &entries[(rec._head - rec._len + k) & rec._mask];
+
+		if (e->kind > (uint8_t)TG3SPMC_RECORDER_KIND_TX) {
+			continue;
+		}
+
+		assert(n_frames < n_parsed);
+		assert(parsed[n_frames].id == e->id);
+		assert(parsed[n_frames].len == e->len);
+		assert(memcmp(parsed[n_frames].data, e->data, e->len) == 0);
+		n_frames++;
+	}
+
+	assert(n_frames == n_parsed);
+
+	e = &entries[(rec._head - rec._len) & rec._mask];
+	printf("  depth %4u: %6lu bytes RAM, %4lu frames, %5lu ms before "
+	       "fault at %lu ms, %6lu bytes exported\n", (unsigned)depth,
+	       (unsigned long)TG3SPMC_RECORDER_RAM(depth),
+	       (unsigned long)n_frames,
+	       (unsigned long)(fault_ms - e->time_ms),
+	       (unsigned long)fault_ms, (unsigned long)len);
+}
+
+int main(void)
+{
+	uint32_t depth;
+	size_t   n = bench_load_canary(BENCH_LOG_EMU_FILE, true, frames,
+				       timestamps_us, BENCH_MAX_FRAMES);
+
+	assert(n > 0u);
+
+	bench_cost(n);
+
+	printf("entry: %lu bytes, history kept by the frozen recorder:\n",
+	       (unsigned long)sizeof(struct tg3spmc_recorder_entry));
+
+	for (depth = 64u; depth <= RECORDER_MAX_DEPTH; depth *= 4u) {
+		bench_depth(n, depth);
+	}
+
+	return 0;
+}
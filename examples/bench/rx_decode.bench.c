@@ -0,0 +1,156 @@
+/* RX path cost per frame on recorded Canary log.
+ *
+ * EAGER: every frame is decoded as it arrives, by a copy of the decoder
+ *        the library had before lazy decoding (previous behaviour).
+ * LAZY:  frames are stored raw, decoded by tg3spmc_read_vars every 500ms
+ *        of log time (typical application read rate). */
+#include "bench.h"
+
+#define RX_DECODE_REPEAT 100u
+#define RX_DECODE_READ_PERIOD_US 500000u
+
+struct tg3spmc_frame frames[BENCH_MAX_FRAMES];
+uint32_t timestamps_us[BENCH_MAX_FRAMES];
+
+/* Previous RX path: decoder state of the controller */
+struct eager {
+	uint8_t  id;
+	uint8_t  recv_flags;
+	bool     has_frames;
+	uint32_t timer_ms;
+	struct tg3spmc_vars vars;
+};
+
+/* Previous _tg3spmc_decode_frame, as it was before lazy decoding */
+void eager_decode_frame(struct eager *self, struct tg3spmc_frame *f)
+{
+	struct tg3spmc_vars *v = &self->vars;
+
+	bool valid_frame = true;
+
+	uint32_t base_id = f->id - (self->id * 2u);
+
+	switch (base_id) {
+	case 0x207u:
+		v->voltage_ac_V = f->data[1];
+		v->ac_present = (v->voltage_ac_V > 70u) ? true : false;
+		v->current_ac_A = 0.070710678118f *
+			((((f->data[6] & 0x0003u) << 8u) | f->data[5]) >> 1u);
+		v->en_present = ((f->data[2] & 0x02u) != 0u) ? true : false;
+		v->fault = ((f->data[2] & 0x04u) != 0u) ? true : false;
+
+		self->recv_flags |= (1u << 0u);
+		break;
+	case 0x217u:
+		v->status = f->data[0];
+
+		self->recv_flags |= (1u << 1u);
+		break;
+	case 0x227u:
+		v->voltage_dc_V =
+			((f->data[3] << 8u) | f->data[2]) * 700.0f/0xFFFF;
+		v->current_dc_A =
+			((f->data[5] << 8u) | f->data[4]) * 50.0f/0xFFFF;
+
+		self->recv_flags |= (1u << 2u);
+		break;
+	case 0x237u:
+		v->temp1_C = (int16_t)f->data[0] - 40;
+		v->temp2_C = (int16_t)f->data[1] - 40;
+		v->inlet_target_temp_C = (int16_t)f->data[5] - 40;
+
+		self->recv_flags |= (1u << 3u);
+		break;
+	case 0x247u:
+		v->current_limit_due_temp_A = f->data[0] * 0.234375;
+
+		self->recv_flags |= (1u << 4u);
+		break;
+	case 0x347u:
+	case 0x467u:
+	case 0x537u:
+	case 0x717u:
+		break;
+	default:
+		valid_frame = false;
+		break;
+	}
+
+	if (valid_frame && (self->recv_flags == ((1u << 5u) - 1u))) {
+		self->has_frames = true;
+		self->timer_ms   = 0u;
+	}
+}
+
+/* Previous tg3spmc_read_vars: copy of the decoded variables */
+bool eager_read_vars(struct eager *self, struct tg3spmc_vars *v)
+{
+	if (self->has_frames) {
+		*v = self->vars;
+	}
+
+	return self->has_frames;
+}
+
+double bench_rx(size_t n, bool eager)
+{
+	struct tg3spmc mod;
+	struct eager old;
+	struct tg3spmc_vars v;
+	size_t i;
+	uint32_t r;
+	double t0;
+
+	tg3spmc_init(&mod, 1u);
+	memset(&old, 0, sizeof(old));
+	old.id = 1u;
+
+	t0 = bench_now_ns();
+
+	for (r = 0u; r < RX_DECODE_REPEAT; r++) {
+		uint32_t read_time_us = 0u;
+
+		for (i = 0u; i < n; i++) {
+			if (eager) {
+				eager_decode_frame(&old, &frames[i]);
+			} else {
+				tg3spmc_put_rx_frame(&mod, &frames[i]);
+			}
+
+			if ((timestamps_us[i] - read_time_us) <
+			    RX_DECODE_READ_PERIOD_US) {
+				continue;
+			}
+
+			read_time_us = timestamps_us[i];
+			if (eager ? eager_read_vars(&old, &v) :
+				    tg3spmc_read_vars(&mod, &v)) {
+				bench_sink += v.status;
+			}
+		}
+	}
+
+	return (bench_now_ns() - t0) / (double)(n * RX_DECODE_REPEAT);
+}
+
+int main(void)
+{
+	double eager_ns;
+	double lazy_ns;
+	size_t n = bench_load_canary(BENCH_LOG_EMU_FILE, true, frames,
+				     timestamps_us, BENCH_MAX_FRAMES);
+
+	assert(n > 0u);
+
+	/* Warm up */
+	(void)bench_rx(n, false);
+
+	eager_ns = bench_rx(n, true);
+	lazy_ns  = bench_rx(n, false);
+
+	printf("frames: %lu (x%u)\n", (unsigned long)n, RX_DECODE_REPEAT);
+	printf("EAGER: %6.2f ns/frame\n", eager_ns);
+	printf("LAZY:  %6.2f ns/frame (x%.2f)\n", lazy_ns, eager_ns / lazy_ns);
+
+	return 0;
+}
@@ -0,0 +1,162 @@
+/* SavvyCAN export parsing throughput.
+ *
+ * STRTOUL: fgets + strtoul per field (as can_capture_convert used to do).
+ * PUTC:    savvy_log_reader_putc fed from memory.
+ * BULK:    savvy_log_reader_read over the whole buffer, 64KiB chunks. */
+#include "bench.h"
+#include "savvy_log_reader.h"
+
+#define SAVVY_FILE "../../savvyCAN/" \
+		   "charging__237_VAC_4A__387_VDC__unknown_fault_at_end.csv"
+
+/* File is parsed this many times per method */
+#define SAVVY_PARSE_RUNS 20u
+
+/* Max capture size */
+#define SAVVY_PARSE_MAX_SIZE (4u * 1024u * 1024u)
+
+/* Bulk chunk size */
+#define SAVVY_PARSE_CHUNK (64u * 1024u)
+
+char buf[SAVVY_PARSE_MAX_SIZE];
+struct canary_log_reader_frame frames[256];
+
+size_t parse_strtoul(const char *path)
+{
+	struct canary_log_reader_frame f;
+	char   line[256];
+	char  *end;
+	size_t n = 0u;
+	unsigned long sec;
+	uint8_t i;
+	FILE *file = fopen(path, "r");
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+		sec = strtoul(line, &end, 10);
+		if (*end != '.') {
+			continue;
+		}
+
+		f.timestamp_us = (uint32_t)((sec * 1000000ul) +
+					    strtoul(end + 1, &end, 10));
+		f.id  = (uint32_t)strtoul(end, &end, 16);
+		f.len = (uint8_t)strtoul(end, &end, 10);
+
+		for (i = 0u; (i < f.len) && (i < 8u); i++) {
+			f.data[i] = (uint8_t)strtoul(end, &end, 16);
+		}
+
+		bench_sink += f.id;
+		n++;
+	}
+
+	fclose(file);
+
+	return n;
+}
+
+size_t parse_putc(size_t size)
+{
+	struct savvy_log_reader r;
+	size_t k;
+
+	savvy_log_reader_init(&r);
+
+	for (k = 0u; k < size; k++) {
+		if (savvy_log_reader_putc(&r, buf[k]) ==
+		    CANARY_LOG_READER_EVENT_FRAME_READY) {
+			bench_sink += r._frame.id;
+		}
+	}
+
+	return r._total_frames;
+}
+
+size_t parse_bulk(size_t size)
+{
+	struct savvy_log_reader r;
+	size_t pos = 0u;
+	size_t chunk;
+	size_t used;
+	size_t n;
+	size_t k;
+
+	savvy_log_reader_init(&r);
+
+	while (pos < size) {
+		chunk = size - pos;
+		if (chunk > SAVVY_PARSE_CHUNK) {
+			chunk = SAVVY_PARSE_CHUNK;
+		}
+
+		n = savvy_log_reader_read(&r, &buf[pos], chunk, frames,
+					  sizeof(frames) / sizeof(frames[0]),
+					  &used);
+		for (k = 0u; k < n; k++) {
+			bench_sink += frames[k].id;
+		}
+
+		if (used == 0u) {
+			break; /* No newline at the end of file */
+		}
+
+		pos += used;
+	}
+
+	return r._total_frames;
+}
+
+int main(void)
+{
+	FILE  *file = fopen(SAVVY_FILE, "rb");
+	size_t size;
+	size_t frames_n[3] = { 0u, 0u, 0u };
+	double ns[3];
+	double t0;
+	uint32_t run;
+	uint8_t  m;
+	const char *methods[3] = { "STRTOUL", "PUTC", "BULK" };
+
+	if (file == NULL) {
+		printf("Can't open %s\n", SAVVY_FILE);
+		return 0;
+	}
+
+	size = fread(buf, 1u, sizeof(buf), file);
+	fclose(file);
+
+	for (m = 0u; m < 3u; m++) {
+		t0 = bench_now_ns();
+
+		for (run = 0u; run < SAVVY_PARSE_RUNS; run++) {
+			switch (m) {
+			case 0u:
+				frames_n[m] = parse_strtoul(SAVVY_FILE);
+				break;
+			case 1u:
+				frames_n[m] = parse_putc(size);
+				break;
+			default:
+				frames_n[m] = parse_bulk(size);
+				break;
+			}
+		}
+
+		ns[m] = (bench_now_ns() - t0) / SAVVY_PARSE_RUNS;
+	}
+
+	/* Same frames, whatever the method is */
+	assert(frames_n[0] == frames_n[2]);
+	assert(frames_n[1] == frames_n[2]);
+
+	printf("SavvyCAN charging session: %lu bytes, %lu frames\n",
+	       (unsigned long)size, (unsigned long)frames_n[2]);
+
+	for (m = 0u; m < 3u; m++) {
+		printf("  %-7s: %8.2f MB/s %10.0f frames/s (x%.2f)\n",
+		       methods[m], (double)size / ns[m] * 1e3,
+		       (double)frames_n[m] / ns[m] * 1e9, ns[0] / ns[m]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,99 @@
+/* Text log vs binary telemetry, bytes and cycles per record.
+ *
+ * Recorded log is replayed, every 500ms of log time module state is
+ * logged by both:
+ * TEXT:   tg3spmc_log (snprintf, 4 lines).
+ * BINARY: tg3spmc_telemetry_encode (fixed 24 byte record).
+ *
+ * Every record is decoded back and must read the same as the text log. */
+
+/* snprintf is C99, tg3spmc.logger.h uses it */
+#define _ISOC99_SOURCE
+
+#include "bench.h"
+#include "tg3spmc.logger.h"
+
+/* Each record is produced this many times per method */
+#define TELEMETRY_REPEAT 64u
+#define TELEMETRY_PERIOD_US 500000u
+
+struct tg3spmc_frame frames[BENCH_MAX_FRAMES];
+uint32_t timestamps_us[BENCH_MAX_FRAMES];
+
+int main(void)
+{
+	struct tg3spmc mod;
+	struct tg3spmc_telemetry t;
+	struct tg3spmc_telemetry_record r;
+	uint8_t  rec[TG3SPMC_TELEMETRY_SIZE];
+	char     text[1024];
+	char     decoded[1024];
+	uint32_t read_time_us = 0u;
+	uint32_t k;
+	size_t   records = 0u;
+	size_t   mismatches = 0u;
+	size_t   text_bytes = 0u;
+	size_t   i;
+	double   text_cycles = 0.0;
+	double   bin_cycles = 0.0;
+	double   c0;
+	size_t   n = bench_load_canary(BENCH_LOG_EMU_FILE, true, frames,
+				       timestamps_us, BENCH_MAX_FRAMES);
+
+	assert(n > 0u);
+
+	tg3spmc_init(&mod, 1u);
+	tg3spmc_telemetry_init(&t);
+
+	for (i = 0u; i < n; i++) {
+		tg3spmc_put_rx_frame(&mod, &frames[i]);
+
+		if ((timestamps_us[i] - read_time_us) < TELEMETRY_PERIOD_US) {
+			continue;
+		}
+
+		read_time_us = timestamps_us[i];
+
+		c0 = bench_cycles();
+		for (k = 0u; k < TELEMETRY_REPEAT; k++) {
+			bench_sink += (uint32_t)tg3spmc_log(&mod, text,
+							    sizeof(text));
+		}
+		text_cycles += bench_cycles() - c0;
+
+		c0 = bench_cycles();
+		for (k = 0u; k < TELEMETRY_REPEAT; k++) {
+			bench_sink += (uint32_t)tg3spmc_telemetry_encode(&t,
+							&mod, rec, sizeof(rec));
+		}
+		bin_cycles += bench_cycles() - c0;
+
+		/* Text log is sent with "\n\n" */
+		text_bytes += strlen(text) + 2u;
+		records++;
+
+		if (!tg3spmc_telemetry_decode(rec, &r) ||
+		    !tg3spmc_telemetry_format(&r, decoded, sizeof(decoded)) ||
+		    (strcmp(text, decoded) != 0)) {
+			mismatches++;
+		}
+	}
+
+	assert(records > 0u);
+
+	text_cycles /= (double)(records * TELEMETRY_REPEAT);
+	bin_cycles  /= (double)(records * TELEMETRY_REPEAT);
+
+	printf("records: %lu (every %ums of log), decoded != text: %lu\n",
+	       (unsigned long)records, TELEMETRY_PERIOD_US / 1000u,
+	       (unsigned long)mismatches);
+	printf("TEXT:   %6.1f bytes/record, %8.1f cycles/record\n",
+	       (double)text_bytes / (double)records, text_cycles);
+	printf("BINARY: %6.1f bytes/record, %8.1f cycles/record "
+	       "(x%.1f smaller, x%.1f faster)\n",
+	       (double)TG3SPMC_TELEMETRY_SIZE, bin_cycles,
+	       (double)text_bytes / (double)records /
+	       (double)TG3SPMC_TELEMETRY_SIZE, text_cycles / bin_cycles);
+
+	return 0;
+}
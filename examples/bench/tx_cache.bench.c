@@ -0,0 +1,156 @@
+/* TX encode cost per period, and step cost over a long RUNNING period
+ * (1ms steps, RX every 100ms).
+ *
+ * REENCODE: every TX period re-encodes all fields (previous behaviour,
+ *           emulated by invalidating the whole writer cache each period).
+ * CACHED:   fields are re-encoded only when config or state changes.
+ *
+ * Per period, encoding is measured while started and during hold-start
+ * (control bytes use rated_voltage_ac_V / 1.2). Per step, the saved work
+ * is spread over the 90 steps of a TX period.
+ *
+ * Built twice by makefile: host float and BENCH_SOFT_FLOAT. The latter
+ * emulates an FPU-less target: the library float type is replaced by
+ * __float128, which gcc implements in software only (libgcc soft-fp, the
+ * same code behind -mfloat-abi=soft). Quad precision costs more than single
+ * precision soft-float, so that run is an upper bound of the saved work. */
+#if defined(BENCH_SOFT_FLOAT)
+/* System headers keep the real float */
+#define _POSIX_C_SOURCE 199309L
+#include <assert.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+__extension__ typedef __float128 bench_soft_float;
+#define float bench_soft_float
+#endif
+
+#include "bench.h"
+
+/* One hour of RUNNING state */
+#define TX_CACHE_STEPS 3600000u
+
+#define TX_CACHE_PERIODS 1000000u
+
+struct tg3spmc_frame rx[5] = {
+	{0x209, 8, {0x00, 0xE6, 0x00, 0x00, 0xC8, 0x00, 0x04, 0x00}},
+	{0x219, 8, {0x00, 0x00, 0x01, 0xFC, 0x9C, 0x02, 0x00, 0x00}},
+	{0x229, 8, {0x00, 0x00, 0x1C, 0x7F, 0x03, 0x00, 0x1F, 0xC5}},
+	{0x239, 8, {0x3C, 0x41, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}},
+	{0x249, 8, {0x44, 0x7D, 0x08, 0x02, 0x00, 0x00, 0x20, 0x00}}
+};
+
+/* Module in RUNNING state */
+void bench_start(struct tg3spmc *mod)
+{
+	struct tg3spmc_config config;
+
+	config.rated_voltage_ac_V = 240.0f;
+	config.voltage_dc_V       = 390.0f;
+	config.current_ac_A       = 4.0f;
+
+	tg3spmc_init(mod, 1u);
+	tg3spmc_set_config(mod, config);
+	(void)tg3spmc_step(mod, 0u);
+	(void)tg3spmc_step(mod, TG3SPMC_CONST_BOOT_TIME_MS);
+
+	assert(mod->_state == (uint8_t)_TG3SPMC_STATE_RUNNING);
+}
+
+/* Cycles per TX period spent queueing (and encoding) frames */
+double bench_encode(bool reencode, bool hold_start)
+{
+	struct tg3spmc mod;
+	uint32_t k;
+	double c0;
+
+	bench_start(&mod);
+	mod._hold_start = hold_start;
+
+	c0 = bench_cycles();
+
+	for (k = 0u; k < TX_CACHE_PERIODS; k++) {
+		if (reencode) {
+			mod._io.tx.dirty = (uint8_t)
+					   (_TG3SPMC_WRITER_DIRTY_SETPOINT |
+					    _TG3SPMC_WRITER_DIRTY_CONTROL);
+		}
+
+		_tg3spmc_queue_tx(&mod);
+		bench_sink += mod._io.tx.frames[0].data[2];
+	}
+
+	return (bench_cycles() - c0) / (double)TX_CACHE_PERIODS;
+}
+
+double bench_steps(bool reencode)
+{
+	struct tg3spmc mod;
+	struct tg3spmc_frame out[3];
+	uint32_t t;
+	double t0;
+
+	bench_start(&mod);
+
+	t0 = bench_now_ns();
+
+	for (t = 0u; t < TX_CACHE_STEPS; t++) {
+		if ((t % 100u) == 0u) {
+			tg3spmc_put_rx_frames(&mod, rx, 5u);
+		}
+
+		if (reencode) {
+			mod._io.tx.dirty = (uint8_t)
+					   (_TG3SPMC_WRITER_DIRTY_SETPOINT |
+					    _TG3SPMC_WRITER_DIRTY_CONTROL);
+		}
+
+		bench_sink += (uint32_t)tg3spmc_step(&mod, 1u);
+		bench_sink += tg3spmc_get_tx_frames(&mod, out, 3u);
+	}
+
+	/* Must stay in RUNNING state all the time */
+	assert(mod._state == (uint8_t)_TG3SPMC_STATE_RUNNING);
+
+	return (bench_now_ns() - t0) / (double)TX_CACHE_STEPS;
+}
+
+int main(void)
+{
+	double reencode_ns;
+	double cached_ns;
+	double reencode_cycles;
+	double cached_cycles;
+	double hold_cycles;
+
+#if defined(BENCH_SOFT_FLOAT)
+	const char *mode = "SOFT FLOAT";
+#else
+	const char *mode = "HOST FLOAT";
+#endif
+
+	(void)bench_steps(false); /* Warm up */
+
+	reencode_cycles = bench_encode(true, false);
+	hold_cycles     = bench_encode(true, true);
+	cached_cycles   = bench_encode(false, false);
+
+	reencode_ns = bench_steps(true);
+	cached_ns   = bench_steps(false);
+
+	printf("%s, TX every %ums\n", mode, TG3SPMC_CONST_CAN_TX_PERIOD_MS);
+	printf("REENCODE: %6.1f cycles/TX period (%.1f in hold-start), "
+	       "%6.2f ns/step\n", reencode_cycles, hold_cycles, reencode_ns);
+	printf("CACHED:   %6.1f cycles/TX period (x%.1f), "
+	       "%6.2f ns/step (x%.2f, %u steps)\n", cached_cycles,
+	       reencode_cycles / cached_cycles, cached_ns,
+	       reencode_ns / cached_ns, TX_CACHE_STEPS);
+
+	return 0;
+}
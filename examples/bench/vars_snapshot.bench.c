@@ -0,0 +1,212 @@
+/* Concurrent readers of module variables, 1 to SNAPSHOT_MAX_READERS.
+ *
+ * Writer thread decodes 0x227/0x237 frames and publishes variables as
+ * fast as it can, reader threads copy them as fast as they can:
+ * SEQLOCK: tg3spmc_publish_vars / tg3spmc_snapshot_vars.
+ * MUTEX:   tg3spmc_read_vars into a shared copy / copy, under a mutex.
+ *
+ * Every copy is checked for consistency (fields come from one counter).
+ * Throughput depends on the number of host cores. */
+
+/* Threads are POSIX, not C89 */
+#define _POSIX_C_SOURCE 200112L
+
+#include "bench.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#define SNAPSHOT_MAX_READERS 8u
+
+/* Wall time per configuration (ns) */
+#define SNAPSHOT_RUN_NS 200e6
+
+struct tg3spmc mod;
+
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+struct tg3spmc_vars shared;
+bool mutex_mode;
+
+int running;
+int stop;
+
+/* Counters per thread, read after join */
+uint32_t writes;
+uint32_t reads[SNAPSHOT_MAX_READERS];
+
+void frames_of(uint8_t n, struct tg3spmc_frame *dc,
+	       struct tg3spmc_frame *sensors)
+{
+	memset(dc, 0, sizeof(*dc));
+	dc->id  = 0x229u;
+	dc->len = 8u;
+	dc->data[2] = n;
+	dc->data[4] = n;
+
+	memset(sensors, 0, sizeof(*sensors));
+	sensors->id  = 0x239u;
+	sensors->len = 8u;
+	sensors->data[0] = n;
+	sensors->data[1] = n;
+	sensors->data[5] = n;
+}
+
+void check(const struct tg3spmc_vars *v)
+{
+	unsigned n = (unsigned)(v->temp1_C + 40);
+
+	assert(v->temp2_C == v->temp1_C);
+	assert(v->voltage_dc_V == (n * 700.0f/0xFFFF));
+	assert(v->current_dc_A == (n * 50.0f/0xFFFF));
+}
+
+void *writer(void *arg)
+{
+	struct tg3spmc_frame dc;
+	struct tg3spmc_frame sensors;
+	uint32_t k = 0u;
+
+	(void)arg;
+
+	while (TG3SPMC_LOAD_ACQUIRE(&stop) == 0) {
+		k++;
+		frames_of((uint8_t)k, &dc, &sensors);
+		tg3spmc_put_rx_frame(&mod, &dc);
+		tg3spmc_put_rx_frame(&mod, &sensors);
+
+		if (mutex_mode) {
+			pthread_mutex_lock(&mutex);
+			(void)tg3spmc_read_vars(&mod, &shared);
+			pthread_mutex_unlock(&mutex);
+		} else {
+			tg3spmc_publish_vars(&mod);
+		}
+	}
+
+	writes = k;
+
+	return NULL;
+}
+
+void *reader(void *arg)
+{
+	struct tg3spmc_vars v;
+	uint32_t *n = (uint32_t *)arg;
+	uint32_t k = 0u;
+
+	while (TG3SPMC_LOAD_ACQUIRE(&stop) == 0) {
+		if (mutex_mode) {
+			pthread_mutex_lock(&mutex);
+			v = shared;
+			pthread_mutex_unlock(&mutex);
+		} else {
+			(void)tg3spmc_snapshot_vars(&mod, &v);
+		}
+
+		check(&v);
+		k++;
+	}
+
+	*n = k;
+
+	return NULL;
+}
+
+/* Returns writer and total reader throughput (per second) */
+/* Thread calls are checked even with NDEBUG, assert() would drop them */
+void thread_start(pthread_t *t, void *(*fn)(void *), void *arg)
+{
+	int err = pthread_create(t, NULL, fn, arg);
+
+	if (err != 0) {
+		fprintf(stderr, "pthread_create: %s\n", strerror(err));
+		exit(EXIT_FAILURE);
+	}
+}
+
+void thread_join(pthread_t t)
+{
+	int err = pthread_join(t, NULL);
+
+	if (err != 0) {
+		fprintf(stderr, "pthread_join: %s\n", strerror(err));
+		exit(EXIT_FAILURE);
+	}
+}
+
+void bench_readers(uint32_t n_readers, bool use_mutex, double *w_per_s,
+		   double *r_per_s)
+{
+	static const uint32_t ids[5] = {
+		0x209u, 0x219u, 0x229u, 0x239u, 0x249u
+	};
+	struct tg3spmc_frame dc;
+	struct tg3spmc_frame sensors;
+	pthread_t w;
+	pthread_t r[SNAPSHOT_MAX_READERS];
+	uint32_t  total = 0u;
+	uint32_t  k;
+	double    t0;
+	double    t;
+
+	tg3spmc_init(&mod, 1u);
+
+	/* All messages once, then counter 0 is published */
+	frames_of(0u, &dc, &sensors);
+	for (k = 0u; k < 5u; k++) {
+		dc.id = ids[k];
+		tg3spmc_put_rx_frame(&mod, &dc);
+	}
+
+	tg3spmc_publish_vars(&mod);
+	(void)tg3spmc_read_vars(&mod, &shared);
+
+	mutex_mode = use_mutex;
+	stop = 0;
+
+	t0 = bench_now_ns();
+	thread_start(&w, writer, NULL);
+	for (k = 0u; k < n_readers; k++) {
+		thread_start(&r[k], reader, &reads[k]);
+	}
+
+	while ((bench_now_ns() - t0) < SNAPSHOT_RUN_NS) {
+		sched_yield();
+	}
+
+	TG3SPMC_STORE_RELEASE(&stop, 1);
+
+	thread_join(w);
+	for (k = 0u; k < n_readers; k++) {
+		thread_join(r[k]);
+		total += reads[k];
+	}
+
+	t = (bench_now_ns() - t0) / 1e9;
+
+	*w_per_s = (double)writes / t;
+	*r_per_s = (double)total / t;
+}
+
+int main(void)
+{
+	uint32_t n;
+	double   seq_w;
+	double   seq_r;
+	double   mtx_w;
+	double   mtx_r;
+
+	printf("readers | SEQLOCK writes/s   reads/s | MUTEX writes/s   "
+	       "reads/s\n");
+
+	for (n = 1u; n <= SNAPSHOT_MAX_READERS; n *= 2u) {
+		bench_readers(n, false, &seq_w, &seq_r);
+		bench_readers(n, true, &mtx_w, &mtx_r);
+
+		printf("%7u | %16.0f %9.0f | %14.0f %9.0f\n", n, seq_w, seq_r,
+		       mtx_w, mtx_r);
+	}
+
+	return 0;
+}
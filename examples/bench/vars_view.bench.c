@@ -0,0 +1,172 @@
+/* Reading changed variables: copy + diff vs zero-copy view + changed mask.
+ *
+ * Capture is replayed, every 100ms of log time application reads the
+ * variables and looks for what changed (as a telemetry uplink does):
+ * COPY: tg3spmc_read_vars, then field by field diff against previous copy.
+ * VIEW: tg3spmc_vars_changed, tg3spmc_view_vars, tg3spmc_release_vars.
+ *
+ * Both must find the same changes. Uplink bytes are given for sending the
+ * whole struct vs changed fields only (plus 2 byte mask). */
+#include "bench.h"
+
+/* Whole capture is replayed this many times per method */
+#define VARS_VIEW_RUNS 64u
+#define VARS_VIEW_PERIOD_US 100000u
+
+struct tg3spmc_frame frames[BENCH_MAX_FRAMES];
+uint32_t timestamps_us[BENCH_MAX_FRAMES];
+
+/* Field by field diff, as done by the caller without changed mask */
+uint16_t diff_vars(const struct tg3spmc_vars *a, const struct tg3spmc_vars *b)
+{
+	uint16_t changed = 0u;
+
+	changed |= (a->voltage_dc_V != b->voltage_dc_V) ?
+		   TG3SPMC_VAR_FLAG_VOLTAGE_DC : 0u;
+	changed |= (a->voltage_ac_V != b->voltage_ac_V) ?
+		   TG3SPMC_VAR_FLAG_VOLTAGE_AC : 0u;
+	changed |= (a->current_dc_A != b->current_dc_A) ?
+		   TG3SPMC_VAR_FLAG_CURRENT_DC : 0u;
+	changed |= (a->current_ac_A != b->current_ac_A) ?
+		   TG3SPMC_VAR_FLAG_CURRENT_AC : 0u;
+	changed |= (a->inlet_target_temp_C != b->inlet_target_temp_C) ?
+		   TG3SPMC_VAR_FLAG_INLET_TARGET_TEMP : 0u;
+	changed |= (a->current_limit_due_temp_A !=
+		    b->current_limit_due_temp_A) ?
+		   TG3SPMC_VAR_FLAG_CURRENT_LIMIT : 0u;
+	changed |= (a->temp1_C != b->temp1_C) ? TG3SPMC_VAR_FLAG_TEMP1 : 0u;
+	changed |= (a->temp2_C != b->temp2_C) ? TG3SPMC_VAR_FLAG_TEMP2 : 0u;
+	changed |= (a->ac_present != b->ac_present) ?
+		   TG3SPMC_VAR_FLAG_AC_PRESENT : 0u;
+	changed |= (a->en_present != b->en_present) ?
+		   TG3SPMC_VAR_FLAG_EN_PRESENT : 0u;
+	changed |= (a->fault != b->fault) ? TG3SPMC_VAR_FLAG_FAULT : 0u;
+	changed |= (a->status != b->status) ? TG3SPMC_VAR_FLAG_STATUS : 0u;
+
+	return changed;
+}
+
+/* Bytes of changed fields */
+size_t changed_bytes(uint16_t changed)
+{
+	static const size_t sizes[12] = {
+		sizeof(float), sizeof(uint8_t), sizeof(float), sizeof(float),
+		sizeof(int16_t), sizeof(float), sizeof(int16_t),
+		sizeof(int16_t), sizeof(bool), sizeof(bool), sizeof(bool),
+		sizeof(uint8_t)
+	};
+	size_t  bytes = 0u;
+	uint8_t k;
+
+	for (k = 0u; k < 12u; k++) {
+		if ((changed & (1u << k)) != 0u) {
+			bytes += sizes[k];
+		}
+	}
+
+	return bytes;
+}
+
+/* Returns cycles per read, fills changed mask of every read */
+double bench_reads(size_t n, bool view, uint16_t *masks, size_t *reads)
+{
+	const struct tg3spmc_vars *p;
+	struct tg3spmc mod;
+	struct tg3spmc_vars prev;
+	struct tg3spmc_vars v;
+	uint32_t read_time_us;
+	uint32_t run;
+	uint16_t changed;
+	size_t   i;
+	size_t   k;
+	double   c0;
+	double   cycles = 0.0;
+
+	for (run = 0u; run < VARS_VIEW_RUNS; run++) {
+		tg3spmc_init(&mod, 1u);
+		prev = mod._vars;
+		read_time_us = 0u;
+		k = 0u;
+
+		for (i = 0u; i < n; i++) {
+			tg3spmc_put_rx_frame(&mod, &frames[i]);
+
+			if ((timestamps_us[i] - read_time_us) <
+			    VARS_VIEW_PERIOD_US) {
+				continue;
+			}
+
+			read_time_us = timestamps_us[i];
+
+			c0 = bench_cycles();
+			if (view) {
+				changed = tg3spmc_vars_changed(&mod);
+				p = tg3spmc_view_vars(&mod);
+				if (p != NULL) {
+					bench_sink += p->status;
+					tg3spmc_release_vars(&mod);
+				}
+			} else if (tg3spmc_read_vars(&mod, &v)) {
+				changed = diff_vars(&prev, &v);
+				prev = v;
+				bench_sink += v.status;
+			} else {
+				changed = 0u;
+			}
+			cycles += bench_cycles() - c0;
+
+			masks[k] = changed;
+			k++;
+		}
+	}
+
+	*reads = k;
+
+	return cycles / (double)(k * VARS_VIEW_RUNS);
+}
+
+int main(void)
+{
+	static uint16_t copy_masks[BENCH_MAX_FRAMES];
+	static uint16_t view_masks[BENCH_MAX_FRAMES];
+	size_t copy_reads;
+	size_t view_reads;
+	size_t fields = 0u;
+	size_t bytes = 0u;
+	size_t k;
+	double copy_cycles;
+	double view_cycles;
+	size_t n = bench_load_canary(BENCH_LOG_EMU_FILE, true, frames,
+				     timestamps_us, BENCH_MAX_FRAMES);
+
+	assert(n > 0u);
+
+	copy_cycles = bench_reads(n, false, copy_masks, &copy_reads);
+	view_cycles = bench_reads(n, true, view_masks, &view_reads);
+
+	assert(copy_reads == view_reads);
+
+	for (k = 0u; k < view_reads; k++) {
+		assert(copy_masks[k] == view_masks[k]);
+		bytes += 2u + changed_bytes(view_masks[k]);
+
+		while (view_masks[k] != 0u) {
+			view_masks[k] &= (uint16_t)(view_masks[k] - 1u);
+			fields++;
+		}
+	}
+
+	printf("reads: %lu (every %ums of log), changed fields: %.2f of 12 "
+	       "per read\n", (unsigned long)view_reads,
+	       VARS_VIEW_PERIOD_US / 1000u,
+	       (double)fields / (double)view_reads);
+	printf("COPY: %6.1f cycles/read, %2lu bytes/read uplink\n",
+	       copy_cycles, (unsigned long)sizeof(struct tg3spmc_vars));
+	printf("VIEW: %6.1f cycles/read, %4.1f bytes/read uplink "
+	       "(x%.2f faster, x%.1f smaller)\n", view_cycles,
+	       (double)bytes / (double)view_reads, copy_cycles / view_cycles,
+	       (double)sizeof(struct tg3spmc_vars) * (double)view_reads /
+	       (double)bytes);
+
+	return 0;
+}
@@ -0,0 +1,456 @@
+/* Multi-threaded stress test of tg3spmc frame queues (built with TSan).
+ *
+ * RAW: producer and consumer threads hammer a single tg3spmc_queue. Every
+ *      frame must come out once, in order and intact, or be counted as
+ *      dropped.
+ * CONTROLLER: threads play the roles of an ESP32 firmware:
+ *      RX thread (CAN RX ISR) replays the log_emu capture, all IDs, with
+ *      tg3spmc_isr_put_rx_frame, SPEEDUP times faster than recorded;
+ *      TX thread (CAN TX ISR) sends frames from tg3spmc_isr_get_tx_frame;
+ *      main thread (loop) steps the controller on wall clock and reads
+ *      variables, frames are never touched by it.
+ * SNAPSHOT: main thread decodes frames and publishes variables as fast as
+ *      it can, reader threads take snapshots. Every snapshot must be
+ *      consistent: DC voltage, current and temperatures come from the
+ *      same counter, a torn copy mixes two of them. */
+
+/* Threads, clock_gettime and nanosleep are POSIX, not C89 */
+#define _POSIX_C_SOURCE 200112L
+
+#include "canary_log_reader.h"
+#include "tg3spmc.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Canary capture recorded from real module (module ID 1) */
+#define LOG_FILE "../log_emu/common_20251029_154131_tesla_bcb" \
+		 "_start_and_230_ac_387_DC_working_4A"       \
+		 "_but_unstable_as_hell.txt"
+
+#define MAX_FRAMES 32768u
+
+/* Frames pushed through the raw queue */
+#define RAW_FRAMES 1000000u
+
+/* Capture is replayed this many times faster than recorded */
+#define SPEEDUP 10u
+
+/* Loop period (wall clock, microseconds) */
+#define LOOP_PERIOD_US 100u
+
+/* Publications of the snapshot test, and its reader threads */
+#define SNAPSHOT_PUBLICATIONS 200000u
+#define SNAPSHOT_READERS 3u
+
+struct canary_log_reader_frame frames[MAX_FRAMES];
+size_t n_frames;
+
+struct tg3spmc_queue raw_queue;
+struct tg3spmc mod;
+
+/* Set by one thread, polled by another */
+int raw_done;
+int rx_done;
+int tx_stop;
+int snapshot_done;
+
+/* Owned by a single thread, read after join */
+uint32_t raw_received;
+uint32_t rx_module_frames;
+uint32_t rx_queued_frames;
+uint32_t tx_frames;
+
+uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000u) +
+	       ((uint64_t)ts.tv_nsec / 1000u);
+}
+
+void sleep_us(uint32_t us)
+{
+	struct timespec ts;
+
+	ts.tv_sec  = (time_t)(us / 1000000u);
+	ts.tv_nsec = (long)(us % 1000000u) * 1000L;
+
+	nanosleep(&ts, NULL);
+}
+
+size_t load_capture(void)
+{
+	static char buf[4u * 1024u * 1024u];
+	struct canary_log_reader r;
+	FILE  *file = fopen(LOG_FILE, "rb");
+	size_t size;
+	size_t used;
+
+	if (file == NULL) {
+		printf("Can't open %s\n", LOG_FILE);
+		return 0u;
+	}
+
+	size = fread(buf, 1u, sizeof(buf), file);
+	fclose(file);
+
+	canary_log_reader_init(&r);
+	r.common_log = true;
+
+	return canary_log_reader_read(&r, buf, size, frames, MAX_FRAMES, &used);
+}
+
+/******************************************************************************
+ * RAW
+ *****************************************************************************/
+void *raw_producer(void *arg)
+{
+	struct tg3spmc_frame f;
+	uint32_t seq;
+
+	(void)arg;
+
+	for (seq = 0u; seq < RAW_FRAMES; seq++) {
+		f.id  = seq;
+		f.len = 8u;
+		memset(f.data, (int)(seq & 0xFFu), sizeof(f.data));
+
+		/* ISR never waits, full queue counts a drop */
+		(void)tg3spmc_queue_put(&raw_queue, &f);
+
+		if ((seq % 64u) == 0u) {
+			sched_yield();
+		}
+	}
+
+	TG3SPMC_STORE_RELEASE(&raw_done, 1);
+
+	return NULL;
+}
+
+void *raw_consumer(void *arg)
+{
+	struct tg3spmc_frame f;
+	uint32_t next = 0u;
+	uint8_t  k;
+	int      done;
+
+	(void)arg;
+
+	do {
+		/* Producer may finish while the queue is drained */
+		done = TG3SPMC_LOAD_ACQUIRE(&raw_done);
+
+		while (tg3spmc_queue_get(&raw_queue, &f)) {
+			assert(f.id >= next);
+			assert(f.len == 8u);
+
+			for (k = 0u; k < 8u; k++) {
+				assert(f.data[k] == (uint8_t)f.id);
+			}
+
+			next = f.id + 1u;
+			raw_received++;
+		}
+
+		sched_yield();
+	} while (done == 0);
+
+	return NULL;
+}
+
+/* Thread calls are checked even with NDEBUG, assert() would drop them */
+void thread_start(pthread_t *t, void *(*fn)(void *), void *arg)
+{
+	int err = pthread_create(t, NULL, fn, arg);
+
+	if (err != 0) {
+		fprintf(stderr, "pthread_create: %s\n", strerror(err));
+		exit(EXIT_FAILURE);
+	}
+}
+
+void thread_join(pthread_t t)
+{
+	int err = pthread_join(t, NULL);
+
+	if (err != 0) {
+		fprintf(stderr, "pthread_join: %s\n", strerror(err));
+		exit(EXIT_FAILURE);
+	}
+}
+
+void test_raw(void)
+{
+	pthread_t producer;
+	pthread_t consumer;
+
+	tg3spmc_queue_init(&raw_queue);
+
+	thread_start(&consumer, raw_consumer, NULL);
+	thread_start(&producer, raw_producer, NULL);
+	thread_join(producer);
+	thread_join(consumer);
+
+	printf("RAW: %lu frames, %lu received, %lu dropped\n",
+	       (unsigned long)RAW_FRAMES, (unsigned long)raw_received,
+	       (unsigned long)tg3spmc_queue_drops(&raw_queue));
+
+	assert((raw_received + tg3spmc_queue_drops(&raw_queue)) == RAW_FRAMES);
+}
+
+/******************************************************************************
+ * CONTROLLER
+ *****************************************************************************/
+void *rx_isr(void *arg)
+{
+	struct tg3spmc_frame f;
+	uint64_t t0 = now_us();
+	uint64_t t;
+	size_t   i;
+	bool     module;
+
+	(void)arg;
+
+	for (i = 0u; i < n_frames; i++) {
+		t = (frames[i].timestamp_us - frames[0].timestamp_us) / SPEEDUP;
+		while ((now_us() - t0) < t) {
+			sleep_us(LOOP_PERIOD_US);
+		}
+
+		f.id  = frames[i].id;
+		f.len = frames[i].len;
+		memcpy(f.data, frames[i].data, sizeof(f.data));
+
+		module = _tg3spm_msg_from_base_id(f.id - 2u) !=
+			 (uint8_t)_TG3SPM_MSG_NONE;
+		rx_module_frames += module ? 1u : 0u;
+
+		if (tg3spmc_isr_put_rx_frame(&mod, &f) && module) {
+			rx_queued_frames++;
+		}
+	}
+
+	TG3SPMC_STORE_RELEASE(&rx_done, 1);
+
+	return NULL;
+}
+
+void *tx_isr(void *arg)
+{
+	struct tg3spmc_frame f;
+	int stop;
+
+	(void)arg;
+
+	do {
+		stop = TG3SPMC_LOAD_ACQUIRE(&tx_stop);
+
+		while (tg3spmc_isr_get_tx_frame(&mod, &f)) {
+			assert((f.id == 0x43Cu) || (f.id == 0x45Cu) ||
+			       (f.id == 0x368u));
+			assert(f.len == 8u);
+			tx_frames++;
+		}
+
+		sleep_us(LOOP_PERIOD_US);
+	} while (stop == 0);
+
+	return NULL;
+}
+
+void test_controller(void)
+{
+	struct tg3spmc_config config;
+	const struct tg3spmc_vars *v;
+	pthread_t rx;
+	pthread_t tx;
+	uint64_t last_us;
+	uint64_t elapsed_us = 0u;
+	uint64_t t;
+	uint32_t delta_ms;
+	uint32_t steps = 0u;
+	uint32_t reads = 0u;
+	uint32_t events[TG3SPMC_EVENT_RECOVERY + 1];
+
+	memset(events, 0, sizeof(events));
+
+	config.rated_voltage_ac_V = 240.0f;
+	config.voltage_dc_V       = 390.0f;
+	config.current_ac_A       = 4.0f;
+
+	tg3spmc_init(&mod, 1u);
+	tg3spmc_set_config(&mod, config);
+	tg3spmc_set_tx_queue(&mod, true);
+
+	thread_start(&tx, tx_isr, NULL);
+	thread_start(&rx, rx_isr, NULL);
+
+	last_us = now_us();
+
+	while (TG3SPMC_LOAD_ACQUIRE(&rx_done) == 0) {
+		t = now_us();
+		elapsed_us += (t - last_us) * SPEEDUP;
+		last_us = t;
+
+		delta_ms = (uint32_t)(elapsed_us / 1000u);
+		elapsed_us -= (uint64_t)delta_ms * 1000u;
+
+		events[tg3spmc_step(&mod, delta_ms)]++;
+		steps++;
+
+		v = tg3spmc_view_vars(&mod);
+		if (v != NULL) {
+			reads += (tg3spmc_vars_changed(&mod) != 0u) ? 1u : 0u;
+			tg3spmc_release_vars(&mod);
+		}
+
+		sleep_us(LOOP_PERIOD_US);
+	}
+
+	thread_join(rx);
+
+	/* Frames queued after the last step */
+	events[tg3spmc_step(&mod, 0u)]++;
+	assert(tg3spmc_queue_is_empty(&mod._rx_queue));
+
+	TG3SPMC_STORE_RELEASE(&tx_stop, 1);
+	thread_join(tx);
+
+	printf("CONTROLLER: %lu steps, %lu reads with changes, %lu charge "
+	       "enabled, %lu faults\n", (unsigned long)steps,
+	       (unsigned long)reads,
+	       (unsigned long)events[TG3SPMC_EVENT_CHARGE_ENABLED],
+	       (unsigned long)events[TG3SPMC_EVENT_FAULT]);
+	printf("  RX: %lu module frames, %lu queued, %lu dropped\n",
+	       (unsigned long)rx_module_frames,
+	       (unsigned long)rx_queued_frames,
+	       (unsigned long)tg3spmc_get_rx_drops(&mod));
+	printf("  TX: %lu frames sent, %lu dropped\n",
+	       (unsigned long)tx_frames,
+	       (unsigned long)tg3spmc_get_tx_drops(&mod));
+
+	assert((rx_queued_frames + tg3spmc_get_rx_drops(&mod)) ==
+	       rx_module_frames);
+	assert(events[TG3SPMC_EVENT_CHARGE_ENABLED] > 0u);
+	assert(tx_frames > 0u);
+}
+
+/******************************************************************************
+ * SNAPSHOT
+ *****************************************************************************/
+/* Counter `n` as 0x229 (DC params) and 0x239 (sensors) of module 1 */
+void snapshot_frames(uint8_t n, struct tg3spmc_frame *dc,
+		     struct tg3spmc_frame *sensors)
+{
+	memset(dc, 0, sizeof(*dc));
+	dc->id  = 0x229u;
+	dc->len = 8u;
+	dc->data[2] = n; /* Voltage */
+	dc->data[4] = n; /* Current */
+
+	memset(sensors, 0, sizeof(*sensors));
+	sensors->id  = 0x239u;
+	sensors->len = 8u;
+	sensors->data[0] = n; /* temp1_C */
+	sensors->data[1] = n; /* temp2_C */
+	sensors->data[5] = n; /* inlet_target_temp_C */
+}
+
+void *snapshot_reader(void *arg)
+{
+	struct tg3spmc_vars v;
+	uint32_t *snapshots = (uint32_t *)arg;
+	unsigned n;
+	int done;
+
+	do {
+		done = TG3SPMC_LOAD_ACQUIRE(&snapshot_done);
+
+		if (!tg3spmc_snapshot_vars(&mod, &v)) {
+			continue;
+		}
+
+		/* Same expressions as in decoder, so results are exact */
+		n = (unsigned)(v.temp1_C + 40);
+		assert(v.temp2_C == v.temp1_C);
+		assert(v.inlet_target_temp_C == v.temp1_C);
+		assert(v.voltage_dc_V == (n * 700.0f/0xFFFF));
+		assert(v.current_dc_A == (n * 50.0f/0xFFFF));
+
+		(*snapshots)++;
+	} while (done == 0);
+
+	return NULL;
+}
+
+void test_snapshot(void)
+{
+	static const uint32_t ids[5] = {
+		0x209u, 0x219u, 0x229u, 0x239u, 0x249u
+	};
+	struct tg3spmc_frame dc;
+	struct tg3spmc_frame sensors;
+	pthread_t readers[SNAPSHOT_READERS];
+	uint32_t  snapshots[SNAPSHOT_READERS];
+	uint32_t  total = 0u;
+	uint32_t  k;
+
+	tg3spmc_init(&mod, 1u);
+
+	/* All messages once, so variables can be read */
+	snapshot_frames(0u, &dc, &sensors);
+	for (k = 0u; k < 5u; k++) {
+		dc.id = ids[k];
+		tg3spmc_put_rx_frame(&mod, &dc);
+	}
+
+	for (k = 0u; k < SNAPSHOT_READERS; k++) {
+		snapshots[k] = 0u;
+		thread_start(&readers[k], snapshot_reader, &snapshots[k]);
+	}
+
+	for (k = 1u; k <= SNAPSHOT_PUBLICATIONS; k++) {
+		snapshot_frames((uint8_t)k, &dc, &sensors);
+		tg3spmc_put_rx_frame(&mod, &dc);
+		tg3spmc_put_rx_frame(&mod, &sensors);
+		tg3spmc_publish_vars(&mod);
+	}
+
+	TG3SPMC_STORE_RELEASE(&snapshot_done, 1);
+
+	for (k = 0u; k < SNAPSHOT_READERS; k++) {
+		thread_join(readers[k]);
+		total += snapshots[k];
+	}
+
+	printf("SNAPSHOT: %lu publications, %lu consistent snapshots by %u "
+	       "readers\n", (unsigned long)(mod._snapshot.seq / 2u),
+	       (unsigned long)total, SNAPSHOT_READERS);
+
+	assert(mod._snapshot.seq == (2u * SNAPSHOT_PUBLICATIONS));
+	assert(total > 0u);
+}
+
+int main(void)
+{
+	n_frames = load_capture();
+	if (n_frames == 0u) {
+		return 1;
+	}
+
+	test_raw();
+	test_controller();
+	test_snapshot();
+
+	printf("FINISHED\n");
+
+	return 0;
+}
@@ -0,0 +1,224 @@
+/* Replays a canary capture onto a CAN interface (e.g. vcan0).
+ *
+ * Real time (default): frames are sent at their log timestamps, frames due
+ * at the same time go out in one sendmmsg.
+ * Flood (-f): capture is sent in a loop as fast as the interface takes it,
+ * in sendmmsg batches, to load the daemon with a full speed RX stream.
+ *
+ * Stops at the end of the capture (real time) or after -t seconds. */
+
+/* sendmmsg and clock_nanosleep are not C89 */
+#define _GNU_SOURCE
+
+#include "canary_log_reader.h"
+
+#include <errno.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#define REPLAY_MAX_FRAMES 400000u
+
+/* Frames per sendmmsg call */
+#define BATCH 32u
+
+struct can_frame frames[REPLAY_MAX_FRAMES];
+uint64_t timestamps_us[REPLAY_MAX_FRAMES];
+
+uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000u) + (uint64_t)ts.tv_nsec;
+}
+
+size_t load(const char *path)
+{
+	int c;
+	size_t n = 0u;
+	struct canary_log_reader r;
+	FILE *file = fopen(path, "r");
+
+	if (file == NULL) {
+		perror(path);
+		return 0u;
+	}
+
+	canary_log_reader_init(&r);
+	r.common_log = true;
+
+	c = getc(file);
+	while ((c != EOF) && (n < REPLAY_MAX_FRAMES)) {
+		if (canary_log_reader_putc(&r, c) ==
+		    CANARY_LOG_READER_EVENT_FRAME_READY) {
+			memset(&frames[n], 0, sizeof(frames[n]));
+			frames[n].can_id  = r._frame.id;
+			frames[n].can_dlc = r._frame.len;
+			memcpy(frames[n].data, r._frame.data, 8u);
+			timestamps_us[n] = r._frame.timestamp_us;
+			n++;
+		}
+
+		c = getc(file);
+	}
+
+	fclose(file);
+
+	return n;
+}
+
+int can_open(const char *ifname)
+{
+	struct sockaddr_can addr;
+	int fd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
+
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	/* Send only */
+	memset(&addr, 0, sizeof(addr));
+	addr.can_family  = AF_CAN;
+	addr.can_ifindex = (int)if_nametoindex(ifname);
+
+	if ((addr.can_ifindex == 0) ||
+	    (setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0) < 0) ||
+	    (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)) {
+		perror(ifname);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Sends n frames, waits for room in the TX queue when full */
+size_t send_frames(int fd, struct can_frame *f, size_t n, uint64_t end_ns)
+{
+	struct mmsghdr msgs[BATCH];
+	struct iovec   iov[BATCH];
+	struct pollfd  p;
+	size_t sent = 0u;
+	size_t k;
+	int    rc;
+
+	p.fd     = fd;
+	p.events = POLLOUT;
+
+	while ((sent < n) && (now_ns() < end_ns)) {
+		size_t batch = ((n - sent) < BATCH) ? (n - sent) : BATCH;
+
+		memset(msgs, 0, batch * sizeof(msgs[0]));
+		for (k = 0u; k < batch; k++) {
+			iov[k].iov_base = &f[sent + k];
+			iov[k].iov_len  = sizeof(f[0]);
+			msgs[k].msg_hdr.msg_iov    = &iov[k];
+			msgs[k].msg_hdr.msg_iovlen = 1u;
+		}
+
+		rc = sendmmsg(fd, msgs, (unsigned)batch, 0);
+
+		if (rc > 0) {
+			sent += (size_t)rc;
+		} else if ((errno == ENOBUFS) || (errno == EAGAIN)) {
+			(void)poll(&p, 1u, 10);
+		} else {
+			perror("sendmmsg");
+			break;
+		}
+	}
+
+	return sent;
+}
+
+void sleep_until(uint64_t t_ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec  = (time_t)(t_ns / 1000000000u);
+	ts.tv_nsec = (long)(t_ns % 1000000000u);
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR) {
+	}
+}
+
+void usage(void)
+{
+	printf("Usage: replay [-f] [-t seconds] ifname capture.txt\n");
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t start_ns;
+	uint64_t end_ns = UINT64_MAX;
+	uint64_t sent = 0u;
+	size_t   n;
+	size_t   i;
+	size_t   j;
+	double   t;
+	bool     flood = false;
+	int      fd;
+	int      opt;
+
+	while ((opt = getopt(argc, argv, "ft:")) != -1) {
+		switch (opt) {
+		case 'f': flood = true; break;
+		case 't': end_ns = (uint64_t)(atof(optarg) * 1e9); break;
+		default: usage(); return 1;
+		}
+	}
+
+	if ((optind + 2) > argc) {
+		usage();
+		return 1;
+	}
+
+	fd = can_open(argv[optind]);
+	n  = load(argv[optind + 1]);
+
+	if ((fd < 0) || (n == 0u)) {
+		return 1;
+	}
+
+	start_ns = now_ns();
+	end_ns = (end_ns == UINT64_MAX) ? end_ns : (start_ns + end_ns);
+
+	if (flood) {
+		while (now_ns() < end_ns) {
+			sent += send_frames(fd, frames, n, end_ns);
+		}
+	} else {
+		for (i = 0u; (i < n) && (now_ns() < end_ns); i = j) {
+			/* Frames due in the same millisecond are one batch */
+			for (j = i + 1u; (j < n) &&
+			     ((timestamps_us[j] - timestamps_us[i]) < 1000u);
+			     j++) {
+			}
+
+			sleep_until(start_ns + ((timestamps_us[i] -
+						 timestamps_us[0]) * 1000u));
+			sent += send_frames(fd, &frames[i], j - i, end_ns);
+		}
+	}
+
+	t = (double)(now_ns() - start_ns) / 1e9;
+	printf("replay: %lu frames in %.1fs (%.0f frames/s)\n",
+	       (unsigned long)sent, t, (double)sent / t);
+
+	close(fd);
+
+	return 0;
+}
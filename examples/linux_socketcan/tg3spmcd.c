@@ -0,0 +1,516 @@
+/* Linux SocketCAN host for a single phase module (reference daemon).
+ *
+ * Single thread, single epoll loop:
+ * - raw CAN socket with kernel acceptance filters (tg3spmc_build_can_filters),
+ *   frames are received in batches with recvmmsg and sent with sendmmsg;
+ * - timerfd armed to tg3spmc_next_deadline_ms, so the state machine is
+ *   stepped at its deadlines and at frame arrival only, never polled;
+ * - timerfd for periodic statistics, signalfd for clean shutdown.
+ *
+ * Statistics per period: RX/TX frames, RX batch size, kernel drops
+ * (SO_RXQ_OVFL), RX latency (kernel timestamp to frame handled and TX
+ * sent), timer latency (deadline to wakeup) and CPU usage.
+ *
+ * Pins are printed on change, mapping them to GPIO is board specific. */
+
+/* recvmmsg, sendmmsg, signalfd and timerfd are Linux specific */
+#define _GNU_SOURCE
+
+#include "tg3spmc.h"
+#include "tg3spmc.logger.h"
+
+#include <errno.h>
+#include <net/if.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+/* Frames per recvmmsg/sendmmsg call */
+#define BATCH 32u
+
+/* Control messages of a received frame: timestamp and drop counter */
+#define CONTROL_SIZE (CMSG_SPACE(sizeof(struct timespec)) + \
+		      CMSG_SPACE(sizeof(uint32_t)))
+
+struct latency {
+	double   min_us;
+	double   max_us;
+	double   sum_us;
+	uint32_t n;
+};
+
+struct daemon {
+	struct tg3spmc mod;
+
+	int can_fd;
+	int timer_fd;
+	int stats_fd;
+	int run_fd;
+	int signal_fd;
+	int epoll_fd;
+
+	uint64_t last_ns;     /* Monotonic time of the last step */
+	uint64_t deadline_ns; /* Armed deadline, 0 if disarmed */
+	bool     pwron;
+	bool     chgen;
+
+	/* Statistics of the current period */
+	uint64_t period_ns;
+	uint64_t stats_ns;
+	double   cpu_s;
+	uint32_t rx_frames;
+	uint32_t rx_batches;
+	uint32_t tx_frames;
+	uint32_t tx_errors;
+	uint32_t steps;
+	uint32_t drops;       /* SO_RXQ_OVFL, cumulative */
+	uint32_t drops_shown;
+	struct latency rx_latency;
+	struct latency timer_latency;
+
+	/* recvmmsg buffers */
+	struct mmsghdr   msgs[BATCH];
+	struct iovec     iov[BATCH];
+	struct can_frame frames[BATCH];
+	char             control[BATCH][CONTROL_SIZE];
+};
+
+uint64_t now_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000u) + (uint64_t)ts.tv_nsec;
+}
+
+double cpu_s(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	return (double)ru.ru_utime.tv_sec + (ru.ru_utime.tv_usec / 1e6) +
+	       (double)ru.ru_stime.tv_sec + (ru.ru_stime.tv_usec / 1e6);
+}
+
+void latency_add(struct latency *l, double us)
+{
+	l->min_us  = ((l->n == 0u) || (us < l->min_us)) ? us : l->min_us;
+	l->max_us  = ((l->n == 0u) || (us > l->max_us)) ? us : l->max_us;
+	l->sum_us += us;
+	l->n++;
+}
+
+void latency_print(const char *name, struct latency *l)
+{
+	if (l->n > 0u) {
+		printf(" %s %.0f/%.0f/%.0fus", name, l->min_us,
+		       l->sum_us / l->n, l->max_us);
+	} else {
+		printf(" %s -", name);
+	}
+
+	memset(l, 0, sizeof(*l));
+}
+
+/******************************************************************************
+ * CAN
+ *****************************************************************************/
+int can_open(const char *ifname, uint8_t id)
+{
+	struct tg3spmc_can_filter f[_TG3SPMC_FILTER_MAX_IDS];
+	struct can_filter filters[_TG3SPMC_FILTER_MAX_IDS];
+	struct sockaddr_can addr;
+	uint8_t n;
+	uint8_t k;
+	int     on = 1;
+	int     fd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
+
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	/* Exact filters for the module, side channels included */
+	n = tg3spmc_build_can_filters((uint8_t)(1u << id), true, f,
+				      _TG3SPMC_FILTER_MAX_IDS);
+
+	for (k = 0u; k < n; k++) {
+		filters[k].can_id   = f[k].id;
+		filters[k].can_mask = f[k].mask | CAN_EFF_FLAG | CAN_RTR_FLAG;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.can_family  = AF_CAN;
+	addr.can_ifindex = (int)if_nametoindex(ifname);
+
+	if ((addr.can_ifindex == 0) ||
+	    (setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, filters,
+			n * sizeof(filters[0])) < 0) ||
+	    (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on,
+			sizeof(on)) < 0) ||
+	    (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) < 0) ||
+	    (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)) {
+		perror(ifname);
+		close(fd);
+		return -1;
+	}
+
+	printf("%s: %u kernel filters for module %u\n", ifname, n, id);
+
+	return fd;
+}
+
+void can_send_tx(struct daemon *d)
+{
+	struct tg3spmc_frame f[3];
+	struct can_frame     frames[3];
+	struct mmsghdr       msgs[3];
+	struct iovec         iov[3];
+	uint8_t n = tg3spmc_get_tx_frames(&d->mod, f, 3u);
+	uint8_t k;
+	int     sent;
+
+	memset(msgs, 0, sizeof(msgs));
+
+	for (k = 0u; k < n; k++) {
+		memset(&frames[k], 0, sizeof(frames[k]));
+		frames[k].can_id  = f[k].id;
+		frames[k].can_dlc = f[k].len;
+		memcpy(frames[k].data, f[k].data, f[k].len);
+
+		iov[k].iov_base = &frames[k];
+		iov[k].iov_len  = sizeof(frames[k]);
+		msgs[k].msg_hdr.msg_iov    = &iov[k];
+		msgs[k].msg_hdr.msg_iovlen = 1u;
+	}
+
+	sent = (n > 0u) ? sendmmsg(d->can_fd, msgs, n, 0) : 0;
+	sent = (sent < 0) ? 0 : sent;
+
+	d->tx_frames += (uint32_t)sent;
+	d->tx_errors += n - (uint32_t)sent;
+}
+
+/******************************************************************************
+ * STATE MACHINE
+ *****************************************************************************/
+void step(struct daemon *d, uint64_t now)
+{
+	enum tg3spmc_event ev;
+	uint32_t delta_ms = (uint32_t)((now - d->last_ns) / 1000000u);
+
+	/* Keep the remainder for the next step */
+	d->last_ns += (uint64_t)delta_ms * 1000000u;
+
+	ev = tg3spmc_step(&d->mod, delta_ms);
+	d->steps++;
+
+	if (ev != TG3SPMC_EVENT_NONE) {
+		printf("EVENT %s", tg3spmc_get_event_name((uint8_t)ev));
+		if (ev == TG3SPMC_EVENT_FAULT) {
+			printf(", CAUSE %s", tg3spmc_get_fault_cause_name(
+						d->mod.fault_cause));
+		}
+		printf("\n");
+	}
+
+	if ((tg3spmc_get_pwron_pin_state(&d->mod) != d->pwron) ||
+	    (tg3spmc_get_chgen_pin_state(&d->mod) != d->chgen)) {
+		d->pwron = tg3spmc_get_pwron_pin_state(&d->mod);
+		d->chgen = tg3spmc_get_chgen_pin_state(&d->mod);
+		printf("PINS pwron=%u chgen=%u\n", d->pwron, d->chgen);
+	}
+
+	can_send_tx(d);
+}
+
+/* Steps while required, then arms the timer to the next deadline */
+void service(struct daemon *d, uint64_t now)
+{
+	struct itimerspec its;
+	uint32_t deadline_ms = 0u;
+	uint8_t  k;
+
+	step(d, now);
+
+	for (k = 0u; k < 4u; k++) {
+		deadline_ms = tg3spmc_next_deadline_ms(&d->mod);
+		if (deadline_ms != 0u) {
+			break;
+		}
+
+		step(d, now);
+	}
+
+	memset(&its, 0, sizeof(its));
+	d->deadline_ns = 0u;
+
+	if (deadline_ms != TG3SPMC_DEADLINE_NONE) {
+		d->deadline_ns = d->last_ns +
+				 ((uint64_t)deadline_ms * 1000000u);
+		its.it_value.tv_sec  = (time_t)(d->deadline_ns / 1000000000u);
+		its.it_value.tv_nsec = (long)(d->deadline_ns % 1000000000u);
+	}
+
+	timerfd_settime(d->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/******************************************************************************
+ * EVENTS
+ *****************************************************************************/
+void on_can(struct daemon *d)
+{
+	struct tg3spmc_frame f;
+	struct cmsghdr *c;
+	struct timespec ts;
+	uint64_t done_ns;
+	uint64_t rx_ns;
+	uint32_t k;
+	int      n;
+
+	do {
+		n = recvmmsg(d->can_fd, d->msgs, BATCH, MSG_DONTWAIT, NULL);
+		if (n <= 0) {
+			break;
+		}
+
+		/* Advance time first, then put frames and step with zero */
+		step(d, now_ns(CLOCK_MONOTONIC));
+
+		for (k = 0u; k < (uint32_t)n; k++) {
+			f.id  = d->frames[k].can_id & CAN_SFF_MASK;
+			f.len = d->frames[k].can_dlc;
+			memcpy(f.data, d->frames[k].data, sizeof(f.data));
+			tg3spmc_put_rx_frame(&d->mod, &f);
+		}
+
+		service(d, now_ns(CLOCK_MONOTONIC));
+		done_ns = now_ns(CLOCK_REALTIME);
+
+		for (k = 0u; k < (uint32_t)n; k++) {
+			struct msghdr *h = &d->msgs[k].msg_hdr;
+
+			for (c = CMSG_FIRSTHDR(h); c != NULL;
+			     c = CMSG_NXTHDR(h, c)) {
+				if (c->cmsg_level != SOL_SOCKET) {
+					continue;
+				}
+
+				if (c->cmsg_type == SO_TIMESTAMPNS) {
+					memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+					rx_ns = ((uint64_t)ts.tv_sec *
+						 1000000000u) +
+						(uint64_t)ts.tv_nsec;
+					latency_add(&d->rx_latency,
+						    (double)(done_ns - rx_ns) /
+						    1e3);
+				} else if (c->cmsg_type == SO_RXQ_OVFL) {
+					memcpy(&d->drops, CMSG_DATA(c),
+					       sizeof(d->drops));
+				}
+			}
+
+			/* Control buffer length is updated by the kernel */
+			h->msg_controllen = CONTROL_SIZE;
+		}
+
+		d->rx_frames += (uint32_t)n;
+		d->rx_batches++;
+	} while (n == (int)BATCH);
+}
+
+void on_timer(struct daemon *d)
+{
+	uint64_t expirations;
+	uint64_t now = now_ns(CLOCK_MONOTONIC);
+
+	/* Spurious wakeup if already re-armed by received frames */
+	if (read(d->timer_fd, &expirations, sizeof(expirations)) > 0) {
+		if (d->deadline_ns != 0u) {
+			latency_add(&d->timer_latency,
+				    (double)(now - d->deadline_ns) / 1e3);
+		}
+
+		service(d, now);
+	}
+}
+
+void on_stats(struct daemon *d)
+{
+	uint64_t expirations;
+	uint64_t now = now_ns(CLOCK_MONOTONIC);
+	double   cpu = cpu_s();
+	double   t = (double)(now - d->stats_ns) / 1e9;
+
+	(void)read(d->stats_fd, &expirations, sizeof(expirations));
+
+	printf("STATS rx %.0f/s (batch %.1f) tx %.0f/s (%u err) steps %.0f/s "
+	       "drops %u", d->rx_frames / t,
+	       (d->rx_batches > 0u) ? ((double)d->rx_frames / d->rx_batches) :
+				      0.0,
+	       d->tx_frames / t, d->tx_errors, d->steps / t,
+	       d->drops - d->drops_shown);
+	latency_print("rx", &d->rx_latency);
+	latency_print("timer", &d->timer_latency);
+	printf(" cpu %.1f%%\n", (cpu - d->cpu_s) / t * 100.0);
+	fflush(stdout);
+
+	d->stats_ns    = now;
+	d->cpu_s       = cpu;
+	d->rx_frames   = 0u;
+	d->rx_batches  = 0u;
+	d->tx_frames   = 0u;
+	d->tx_errors   = 0u;
+	d->steps       = 0u;
+	d->drops_shown = d->drops;
+}
+
+/******************************************************************************
+ * MAIN
+ *****************************************************************************/
+int timer_open(uint32_t period_ms)
+{
+	struct itimerspec its;
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+
+	if ((fd >= 0) && (period_ms > 0u)) {
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec     = (time_t)(period_ms / 1000u);
+		its.it_value.tv_nsec    = (long)(period_ms % 1000u) * 1000000L;
+		its.it_interval         = its.it_value;
+		timerfd_settime(fd, 0, &its, NULL);
+	}
+
+	return fd;
+}
+
+int epoll_add(int epoll_fd, int fd)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events  = EPOLLIN;
+	ev.data.fd = fd;
+
+	return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+void usage(void)
+{
+	printf("Usage: tg3spmcd [-m id] [-v dc_V] [-c ac_A] [-a rated_ac_V] "
+	       "[-s stats_s] [-t run_s] ifname\n");
+}
+
+int main(int argc, char **argv)
+{
+	static struct daemon d;
+	struct tg3spmc_config config;
+	struct epoll_event events[5];
+	sigset_t signals;
+	uint32_t stats_ms = 1000u;
+	uint32_t run_ms = 0u;
+	uint8_t  id = 1u;
+	uint32_t k;
+	bool     running = true;
+	int      n;
+	int      opt;
+
+	config.rated_voltage_ac_V = 240.0f;
+	config.voltage_dc_V       = 390.0f;
+	config.current_ac_A       = 4.0f;
+
+	while ((opt = getopt(argc, argv, "m:v:c:a:s:t:")) != -1) {
+		switch (opt) {
+		case 'm': id = (uint8_t)atoi(optarg); break;
+		case 'v': config.voltage_dc_V = (float)atof(optarg); break;
+		case 'c': config.current_ac_A = (float)atof(optarg); break;
+		case 'a': config.rated_voltage_ac_V = (float)atof(optarg);
+			  break;
+		case 's': stats_ms = (uint32_t)(atof(optarg) * 1000.0); break;
+		case 't': run_ms = (uint32_t)(atof(optarg) * 1000.0); break;
+		default: usage(); return 1;
+		}
+	}
+
+	if ((optind >= argc) || (id > 2u)) {
+		usage();
+		return 1;
+	}
+
+	/* Signals are handled in the loop */
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigprocmask(SIG_BLOCK, &signals, NULL);
+
+	d.can_fd    = can_open(argv[optind], id);
+	d.timer_fd  = timer_open(0u);
+	d.stats_fd  = timer_open(stats_ms);
+	d.run_fd    = timer_open(run_ms);
+	d.signal_fd = signalfd(-1, &signals, SFD_NONBLOCK);
+	d.epoll_fd  = epoll_create1(0);
+
+	if ((d.can_fd < 0) || (d.timer_fd < 0) || (d.stats_fd < 0) ||
+	    (d.run_fd < 0) || (d.signal_fd < 0) || (d.epoll_fd < 0) ||
+	    (epoll_add(d.epoll_fd, d.can_fd) < 0) ||
+	    (epoll_add(d.epoll_fd, d.timer_fd) < 0) ||
+	    (epoll_add(d.epoll_fd, d.stats_fd) < 0) ||
+	    (epoll_add(d.epoll_fd, d.run_fd) < 0) ||
+	    (epoll_add(d.epoll_fd, d.signal_fd) < 0)) {
+		perror("tg3spmcd");
+		return 1;
+	}
+
+	for (k = 0u; k < BATCH; k++) {
+		d.iov[k].iov_base = &d.frames[k];
+		d.iov[k].iov_len  = sizeof(d.frames[k]);
+		d.msgs[k].msg_hdr.msg_iov        = &d.iov[k];
+		d.msgs[k].msg_hdr.msg_iovlen     = 1u;
+		d.msgs[k].msg_hdr.msg_control    = d.control[k];
+		d.msgs[k].msg_hdr.msg_controllen = CONTROL_SIZE;
+	}
+
+	tg3spmc_init(&d.mod, id);
+	tg3spmc_set_config(&d.mod, config);
+
+	d.last_ns  = now_ns(CLOCK_MONOTONIC);
+	d.stats_ns = d.last_ns;
+	d.cpu_s    = cpu_s();
+	service(&d, d.last_ns);
+
+	while (running) {
+		n = epoll_wait(d.epoll_fd, events, 5, -1);
+
+		for (k = 0u; (n > 0) && (k < (uint32_t)n); k++) {
+			if (events[k].data.fd == d.can_fd) {
+				on_can(&d);
+			} else if (events[k].data.fd == d.timer_fd) {
+				on_timer(&d);
+			} else if (events[k].data.fd == d.stats_fd) {
+				on_stats(&d);
+			} else {
+				/* Run time elapsed or SIGINT/SIGTERM */
+				running = false;
+			}
+		}
+	}
+
+	/* Pins are released on exit, module powers off */
+	printf("EXIT\n");
+	close(d.can_fd);
+
+	return 0;
+}
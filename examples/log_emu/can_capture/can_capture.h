@@ -0,0 +1,358 @@
+#ifndef   CAN_CAPTURE_H
+#define   CAN_CAPTURE_H
+
+#include "canary_log_reader.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/******************************************************************************
+ * CAN CAPTURE
+ *
+ * Compact binary capture format:
+ *
+ *   header: "TG3C" magic, version byte
+ *   record: varint delta timestamp (us, LEB128, up to 64 bit), key byte,
+ *           payload
+ *
+ * Key byte selects a dictionary entry (id, len, flags), assigned in order of
+ * first appearance. Payload length is taken from the entry, so a typical
+ * frame costs 1-2 bytes of timestamp, 1 byte of key and its data bytes.
+ *   0x00-0xFD: dictionary entry
+ *   0xFE:      new entry follows (varint id, len, flags), then payload
+ *   0xFF:      literal (same as new entry, but not stored, dictionary full)
+ *****************************************************************************/
+#define CAN_CAPTURE_MAGIC "TG3C"
+#define CAN_CAPTURE_VERSION 1u
+
+/* Magic + version */
+#define CAN_CAPTURE_HEADER_SIZE 5u
+
+/* Max number of dictionary entries */
+#define CAN_CAPTURE_DICT_SIZE 0xFEu
+
+/* Largest record: 10 (varint) + 1 + 5 (varint id) + 2 + 8 */
+#define CAN_CAPTURE_RECORD_MAX 26u
+
+enum can_capture_key {
+	CAN_CAPTURE_KEY_NEW     = 0xFE,
+	CAN_CAPTURE_KEY_LITERAL = 0xFF
+};
+
+enum can_capture_eflags {
+	/* Not a capture file, or unsupported version */
+	CAN_CAPTURE_EFLAG_BAD_HEADER = 1,
+
+	/* Record refers to unknown entry, or has invalid length */
+	CAN_CAPTURE_EFLAG_CORRUPT    = 2
+};
+
+struct can_capture_entry {
+	uint32_t id;
+	uint8_t  len;
+	uint8_t  flags;
+};
+
+/* Reader or writer state, both sides build the same dictionary */
+struct can_capture {
+	struct can_capture_entry _dict[CAN_CAPTURE_DICT_SIZE];
+	uint8_t _dict_len;
+
+	/* Writer lookup (entry index + 1, 0 if empty) */
+	uint8_t _hash[256u];
+
+	uint64_t _timestamp_us;
+
+	bool    _header;
+	uint8_t _eflags;
+
+	size_t _total_frames;
+};
+
+void can_capture_init(struct can_capture *self)
+{
+	self->_dict_len = 0u;
+	memset(self->_hash, 0, sizeof(self->_hash));
+
+	self->_timestamp_us = 0u;
+
+	self->_header = false;
+	self->_eflags = 0u;
+
+	self->_total_frames = 0u;
+}
+
+/******************************************************************************
+ * CAN CAPTURE PRIVATE
+ *****************************************************************************/
+uint8_t _can_capture_hash(uint32_t id, uint8_t len, uint8_t flags)
+{
+	uint32_t h = (id * 2654435761u) ^ ((uint32_t)len << 8u) ^ flags;
+
+	return (uint8_t)(h >> 24u);
+}
+
+size_t _can_capture_put_varint(uint8_t *out, uint64_t v)
+{
+	size_t n = 0u;
+
+	while (v >= 0x80u) {
+		out[n] = (uint8_t)(v | 0x80u);
+		v >>= 7u;
+		n++;
+	}
+
+	out[n] = (uint8_t)v;
+
+	return n + 1u;
+}
+
+/* _can_capture_get_varint result for a value wider than 64 bit */
+#define _CAN_CAPTURE_VARINT_CORRUPT ((size_t)-1)
+
+/* Returns bytes used, 0 if buffer ends in the middle of varint.
+ * Value wider than 64 bit sets CAN_CAPTURE_EFLAG_CORRUPT and returns
+ * _CAN_CAPTURE_VARINT_CORRUPT. */
+size_t _can_capture_get_varint(struct can_capture *self,
+			       const uint8_t *s, const uint8_t *end,
+			       uint64_t *v)
+{
+	size_t  n = 0u;
+	size_t  used = 0u;
+	uint8_t shift = 0u;
+
+	*v = 0u;
+
+	while ((used == 0u) && ((s + n) < end)) {
+		/* Only the lowest bit of the 10th byte fits into 64 bit */
+		if ((shift > 63u) ||
+		    ((shift == 63u) && ((s[n] & 0x7Eu) != 0u))) {
+			self->_eflags |= CAN_CAPTURE_EFLAG_CORRUPT;
+			used = _CAN_CAPTURE_VARINT_CORRUPT;
+		} else {
+			*v |= (uint64_t)(s[n] & 0x7Fu) << shift;
+			shift += 7u;
+			n++;
+
+			if ((s[n - 1u] & 0x80u) == 0u) {
+				used = n;
+			}
+		}
+	}
+
+	return used;
+}
+
+/* Finds dictionary entry, or adds a new one. Returns key byte. */
+uint8_t _can_capture_lookup(struct can_capture *self,
+			    const struct canary_log_reader_frame *f)
+{
+	uint8_t h = _can_capture_hash(f->id, f->len, f->flags);
+	uint8_t i;
+	const struct can_capture_entry *e;
+
+	/* Open addressing, table never gets full (254 of 256) */
+	while (self->_hash[h] != 0u) {
+		i = (uint8_t)(self->_hash[h] - 1u);
+		e = &self->_dict[i];
+
+		if ((e->id == f->id) && (e->len == f->len) &&
+		    (e->flags == f->flags)) {
+			return i;
+		}
+
+		h++;
+	}
+
+	if (self->_dict_len >= CAN_CAPTURE_DICT_SIZE) {
+		return CAN_CAPTURE_KEY_LITERAL;
+	}
+
+	self->_dict[self->_dict_len].id    = f->id;
+	self->_dict[self->_dict_len].len   = f->len;
+	self->_dict[self->_dict_len].flags = f->flags;
+	self->_dict_len++;
+	self->_hash[h] = self->_dict_len;
+
+	return CAN_CAPTURE_KEY_NEW;
+}
+
+/******************************************************************************
+ * CAN CAPTURE WRITER
+ *****************************************************************************/
+/* Writes file header (CAN_CAPTURE_HEADER_SIZE bytes) */
+size_t can_capture_write_header(struct can_capture *self, uint8_t *out)
+{
+	memcpy(out, CAN_CAPTURE_MAGIC, 4u);
+	out[4] = CAN_CAPTURE_VERSION;
+
+	self->_header = true;
+
+	return CAN_CAPTURE_HEADER_SIZE;
+}
+
+/* Encodes a single frame into `out` (at least CAN_CAPTURE_RECORD_MAX
+ * bytes). Timestamps should not go backwards (delta is modulo 2^64, so
+ * it still decodes, but takes 10 bytes). Returns bytes written. */
+size_t can_capture_write(struct can_capture *self,
+			 const struct canary_log_reader_frame *f, uint8_t *out)
+{
+	size_t  n;
+	uint8_t key;
+
+	assert(f->len <= 8u);
+
+	n = _can_capture_put_varint(out, f->timestamp_us -
+					 self->_timestamp_us);
+	self->_timestamp_us = f->timestamp_us;
+
+	key = _can_capture_lookup(self, f);
+	out[n] = key;
+	n++;
+
+	if (key >= (uint8_t)CAN_CAPTURE_KEY_NEW) {
+		n += _can_capture_put_varint(&out[n], f->id);
+		out[n]      = f->len;
+		out[n + 1u] = f->flags;
+		n += 2u;
+	}
+
+	memcpy(&out[n], f->data, f->len);
+	n += f->len;
+
+	self->_total_frames++;
+
+	return n;
+}
+
+/******************************************************************************
+ * CAN CAPTURE READER
+ *****************************************************************************/
+/* Decodes a single record, returns bytes used (0 if incomplete) */
+size_t _can_capture_read_record(struct can_capture *self,
+				const uint8_t *s, const uint8_t *end,
+				struct canary_log_reader_frame *f)
+{
+	struct can_capture_entry e;
+	uint64_t delta;
+	uint64_t id;
+	size_t   n;
+	size_t   k;
+	uint8_t  key;
+
+	n = _can_capture_get_varint(self, s, end, &delta);
+	if ((n == 0u) || (n == _CAN_CAPTURE_VARINT_CORRUPT) ||
+	    ((s + n) >= end)) {
+		return 0u;
+	}
+
+	key = s[n];
+	n++;
+
+	if (key >= (uint8_t)CAN_CAPTURE_KEY_NEW) {
+		k = _can_capture_get_varint(self, &s[n], end, &id);
+		if ((k == 0u) || (k == _CAN_CAPTURE_VARINT_CORRUPT) ||
+		    ((s + n + k + 2u) > end)) {
+			return 0u;
+		}
+
+		n += k;
+		e.id    = (uint32_t)id;
+		e.len   = s[n];
+		e.flags = s[n + 1u];
+		n += 2u;
+
+		if (e.len > 8u) {
+			self->_eflags |= CAN_CAPTURE_EFLAG_CORRUPT;
+			return 0u;
+		}
+	} else if (key < self->_dict_len) {
+		e = self->_dict[key];
+	} else {
+		self->_eflags |= CAN_CAPTURE_EFLAG_CORRUPT;
+		return 0u;
+	}
+
+	if ((s + n + e.len) > end) {
+		return 0u;
+	}
+
+	/* Entry is stored only after the whole record is there */
+	if (key == (uint8_t)CAN_CAPTURE_KEY_NEW) {
+		if (self->_dict_len >= CAN_CAPTURE_DICT_SIZE) {
+			self->_eflags |= CAN_CAPTURE_EFLAG_CORRUPT;
+			return 0u;
+		}
+
+		self->_dict[self->_dict_len] = e;
+		self->_dict_len++;
+	}
+
+	self->_timestamp_us += delta;
+
+	f->timestamp_us = self->_timestamp_us;
+	f->id    = e.id;
+	f->len   = e.len;
+	f->flags = e.flags;
+	memcpy(f->data, &s[n], e.len);
+
+	return n + e.len;
+}
+
+/* Decodes whole records out of `buf` straight into `frames` (up to
+ * `max_frames`). Streaming: `consumed` tells how many bytes were used,
+ * unused tail (incomplete record) must be passed again with the next
+ * chunk. Stops on error, see _eflags.
+ *
+ * Returns the number of frames written. */
+size_t can_capture_read(struct can_capture *self,
+			const uint8_t *buf, size_t size,
+			struct canary_log_reader_frame *frames,
+			size_t max_frames, size_t *consumed)
+{
+	const uint8_t *s   = buf;
+	const uint8_t *end = buf + size;
+	size_t n = 0u;
+	size_t k;
+
+	*consumed = 0u;
+
+	if (!self->_header) {
+		if (size < CAN_CAPTURE_HEADER_SIZE) {
+			return 0u;
+		}
+
+		if ((memcmp(buf, CAN_CAPTURE_MAGIC, 4u) != 0) ||
+		    (buf[4] != CAN_CAPTURE_VERSION)) {
+			self->_eflags |= CAN_CAPTURE_EFLAG_BAD_HEADER;
+			return 0u;
+		}
+
+		self->_header = true;
+		s += CAN_CAPTURE_HEADER_SIZE;
+	}
+
+	while ((n < max_frames) && (self->_eflags == 0u)) {
+		k = _can_capture_read_record(self, s, end, &frames[n]);
+		if (k == 0u) {
+			break;
+		}
+
+		s += k;
+		n++;
+	}
+
+	self->_total_frames += n;
+	*consumed = (size_t)(s - buf);
+
+	return n;
+}
+
+/* True if buffer starts with capture magic */
+bool can_capture_is_capture(const uint8_t *buf, size_t size)
+{
+	return (size >= 4u) && (memcmp(buf, CAN_CAPTURE_MAGIC, 4u) == 0);
+}
+
+#endif /* CAN_CAPTURE_H */
@@ -0,0 +1,329 @@
+#include "can_capture.h"
+#include "can_capture_index.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define GBT_FILE "../canary_log_reader/gbt_working_sequence.txt"
+
+struct canary_log_reader_frame ref[4096];
+uint8_t capture[4096u * CAN_CAPTURE_RECORD_MAX];
+
+size_t load_canary(void)
+{
+	static char buf[200000];
+	struct canary_log_reader r;
+	size_t used;
+	size_t size;
+	FILE  *file = fopen(GBT_FILE, "rb");
+
+	assert(file);
+	size = fread(buf, 1u, sizeof(buf), file);
+	fclose(file);
+
+	canary_log_reader_init(&r);
+
+	return canary_log_reader_read(&r, buf, size, ref, 4096u, &used);
+}
+
+/* Decoded capture must be the same as source, for any chunk size */
+void can_capture_test_roundtrip(size_t n_ref, size_t size, size_t chunk)
+{
+	struct canary_log_reader_frame frames[5];
+	struct can_capture r;
+	size_t pos = 0u;
+	size_t avail;
+	size_t used;
+	size_t total = 0u;
+	size_t n;
+	size_t k;
+
+	can_capture_init(&r);
+
+	/* Reader sees only `chunk` new bytes at a time */
+	for (avail = 0u; pos < size; ) {
+		avail = (avail + chunk < size - pos) ? (avail + chunk) :
+						       (size - pos);
+
+		n = can_capture_read(&r, &capture[pos], avail, frames, 5u,
+				     &used);
+		assert(r._eflags == 0u);
+
+		for (k = 0u; k < n; k++, total++) {
+			assert(frames[k].timestamp_us ==
+			       ref[total].timestamp_us);
+			assert(frames[k].id    == ref[total].id);
+			assert(frames[k].flags == ref[total].flags);
+			assert(frames[k].len   == ref[total].len);
+			assert(memcmp(frames[k].data, ref[total].data,
+				      frames[k].len) == 0);
+		}
+
+		pos   += used;
+		avail -= used;
+	}
+
+	assert(total == n_ref);
+	assert(r._total_frames == n_ref);
+}
+
+void can_capture_test_errors(size_t size)
+{
+	struct canary_log_reader_frame frames[4];
+	struct can_capture r;
+	uint8_t bad[CAN_CAPTURE_HEADER_SIZE + 3u];
+	uint8_t long_delta[CAN_CAPTURE_HEADER_SIZE + 12u];
+	uint64_t delta;
+	size_t used;
+
+	/* Not a capture */
+	can_capture_init(&r);
+	assert(can_capture_read(&r, (const uint8_t *)"TG3X\1", 5u, frames, 4u,
+				&used) == 0u);
+	assert(r._eflags == CAN_CAPTURE_EFLAG_BAD_HEADER);
+
+	/* Unknown dictionary entry */
+	memcpy(bad, capture, CAN_CAPTURE_HEADER_SIZE);
+	bad[CAN_CAPTURE_HEADER_SIZE]      = 0x00u; /* delta */
+	bad[CAN_CAPTURE_HEADER_SIZE + 1u] = 0x05u; /* key */
+	bad[CAN_CAPTURE_HEADER_SIZE + 2u] = 0x00u;
+	can_capture_init(&r);
+	assert(can_capture_read(&r, bad, sizeof(bad), frames, 4u, &used) ==
+	       0u);
+	assert(r._eflags == CAN_CAPTURE_EFLAG_CORRUPT);
+
+	/* Delta timestamp wider than 64 bit */
+	can_capture_init(&r);
+	memset(long_delta, 0xFF, sizeof(long_delta));
+	memcpy(long_delta, capture, CAN_CAPTURE_HEADER_SIZE);
+	assert(can_capture_read(&r, long_delta, sizeof(long_delta), frames,
+				4u, &used) == 0u);
+	assert(r._eflags == CAN_CAPTURE_EFLAG_CORRUPT);
+
+	/* Largest delta still fits: 9 x 0xFF, 0x01 */
+	can_capture_init(&r);
+	long_delta[CAN_CAPTURE_HEADER_SIZE + 9u] = 0x01u;
+	assert(_can_capture_get_varint(&r, &long_delta[CAN_CAPTURE_HEADER_SIZE],
+				       &long_delta[sizeof(long_delta)],
+				       &delta) == 10u);
+	assert((delta == ~(uint64_t)0u) && (r._eflags == 0u));
+
+	/* Truncated capture is not an error, just incomplete */
+	can_capture_init(&r);
+	assert(can_capture_read(&r, capture, size - 1u, frames, 4u, &used) ==
+	       4u);
+	assert(r._eflags == 0u);
+}
+
+/* Dictionary overflow goes to literal records */
+void can_capture_test_literal(void)
+{
+	static struct can_capture_index idx;
+	static struct can_capture_checkpoint cps[4];
+	static struct can_capture_occurrence occ[300];
+	const struct can_capture_occurrence *o;
+	struct canary_log_reader_frame f;
+	struct canary_log_reader_frame out[4];
+	struct can_capture w;
+	struct can_capture r;
+	size_t size;
+	size_t used;
+	size_t pos = 0u;
+	uint32_t id;
+
+	memset(&f, 0, sizeof(f));
+	f.len = 1u;
+
+	can_capture_init(&w);
+	size = can_capture_write_header(&w, capture);
+
+	for (id = 0u; id < 300u; id++) {
+		f.id = id;
+		f.data[0] = (uint8_t)id;
+		f.timestamp_us = id * 1000u;
+		size += can_capture_write(&w, &f, &capture[size]);
+	}
+
+	assert(w._dict_len == CAN_CAPTURE_DICT_SIZE);
+
+	can_capture_init(&r);
+	for (id = 0u; id < 300u; id++) {
+		assert(can_capture_read(&r, &capture[pos], size - pos, out, 1u,
+					&used) == 1u);
+		assert(out[0].id == id);
+		assert(out[0].data[0] == (uint8_t)id);
+		assert(out[0].timestamp_us == id * 1000u);
+		pos += used;
+	}
+
+	/* More IDs than index slots, the rest is left unindexed */
+	can_capture_index_init(&idx, 1000000u, cps, 4u, occ, 300u);
+	assert(can_capture_index_update(&idx, capture, size) == size);
+	assert(idx.ids_overflow);
+	assert(idx.occurrences_len == CAN_CAPTURE_INDEX_MAX_IDS);
+
+	id = CAN_CAPTURE_INDEX_MAX_IDS - 1u;
+	o  = can_capture_index_first(&idx, id);
+	assert(o != NULL);
+	assert(can_capture_index_decode(&idx, o, &capture[o->offset],
+					size - o->offset, &out[0]));
+	assert(out[0].id == id);
+	assert(can_capture_index_next(&idx, o) == NULL);
+	assert(can_capture_index_first(&idx, id + 1u) == NULL);
+	assert(can_capture_index_first(&idx, 299u) == NULL);
+}
+
+/* Index built incrementally must allow seek and per-ID lookup */
+void can_capture_test_index(size_t n_ref, size_t size)
+{
+	static struct can_capture_index idx;
+	static struct can_capture_checkpoint cps[8];
+	static struct can_capture_occurrence occ[4096];
+	struct canary_log_reader_frame f;
+	struct can_capture r;
+	const struct can_capture_occurrence *o;
+	uint64_t last_us = 0u;
+	uint64_t target;
+	uint32_t offset;
+	size_t pos = 0u;
+	size_t avail = 0u;
+	size_t used;
+	size_t n;
+	size_t k;
+
+	can_capture_index_init(&idx, 1000000u, cps, 8u, occ, 4096u);
+
+	/* Capture grows by 13 bytes at a time */
+	while (pos < size) {
+		avail = (avail + 13u < size - pos) ? (avail + 13u) :
+						     (size - pos);
+		used = can_capture_index_update(&idx, &capture[pos], avail);
+		pos   += used;
+		avail -= used;
+	}
+
+	assert(idx._offset == size);
+	assert(idx.occurrences_len == n_ref);
+	assert(!idx.truncated);
+
+	/* Checkpoints were thinned to fit, still sorted */
+	assert(idx.period_us > 1000000u);
+	for (k = 1u; k < idx.checkpoints_len; k++) {
+		assert(cps[k].timestamp_us >= cps[k - 1u].timestamp_us);
+		assert(cps[k].offset > cps[k - 1u].offset);
+	}
+
+	/* Seek: reader continues from checkpoint, frames are the same */
+	for (target = 0u; target < ref[n_ref - 1u].timestamp_us;
+	     target += 7777777u) {
+		offset = can_capture_index_seek(&idx, target, &r);
+		k = r._total_frames;
+		assert(k < n_ref);
+		assert((k == 0u) || (ref[k - 1u].timestamp_us <= target));
+
+		n = can_capture_read(&r, &capture[offset], size - offset, &f,
+				     1u, &used);
+		assert(n == 1u);
+		assert(f.timestamp_us == ref[k].timestamp_us);
+		assert(f.id == ref[k].id);
+		assert(memcmp(f.data, ref[k].data, f.len) == 0);
+	}
+
+	/* Per-ID occurrences */
+	n = 0u;
+	for (o = can_capture_index_first(&idx, ref[0].id); o != NULL;
+	     o = can_capture_index_next(&idx, o)) {
+		assert(can_capture_index_decode(&idx, o, &capture[o->offset],
+						size - o->offset, &f));
+		assert(f.id == ref[0].id);
+		assert(f.timestamp_us >= last_us);
+		last_us = f.timestamp_us;
+		n++;
+	}
+
+	for (k = 0u; k < n_ref; k++) {
+		if (ref[k].id == ref[0].id) {
+			n--;
+		}
+	}
+
+	assert(n == 0u);
+	assert(can_capture_index_first(&idx, 0x7FFu) == NULL);
+}
+
+/* 64 bit timeline: gaps beyond 32 bit, index seek past 71 minutes */
+void can_capture_test_timeline(void)
+{
+	static struct can_capture_index idx;
+	static struct can_capture_checkpoint cps[4];
+	static struct can_capture_occurrence occ[64];
+	struct canary_log_reader_frame f;
+	struct can_capture w;
+	struct can_capture r;
+	uint64_t t = 0u;
+	uint32_t offset;
+	size_t size;
+	size_t used;
+	uint32_t k;
+
+	memset(&f, 0, sizeof(f));
+	f.id  = 0x209u;
+	f.len = 1u;
+
+	can_capture_init(&w);
+	size = can_capture_write_header(&w, capture);
+
+	for (k = 0u; k < 64u; k++) {
+		t += (k == 10u) ? ((uint64_t)5000u * 1000000u) : 700000000u;
+		f.timestamp_us = t;
+		f.data[0] = (uint8_t)k;
+		size += can_capture_write(&w, &f, &capture[size]);
+	}
+
+	can_capture_index_init(&idx, 1000000u, cps, 4u, occ, 64u);
+	assert(can_capture_index_update(&idx, capture, size) == size);
+
+	/* Frame 40 is at 41 * 700 s, plus 4300 s of extra gap */
+	offset = can_capture_index_seek(&idx, (uint64_t)33000u * 1000000u,
+					&r);
+	for (k = (uint32_t)r._total_frames; k <= 40u; k++) {
+		assert(can_capture_read(&r, &capture[offset], size - offset,
+					&f, 1u, &used) == 1u);
+		offset += (uint32_t)used;
+	}
+
+	assert(f.data[0] == 40u);
+	assert(f.timestamp_us == ((uint64_t)33000u * 1000000u));
+}
+
+int main()
+{
+	struct can_capture w;
+	size_t n_ref = load_canary();
+	size_t size;
+	size_t k;
+
+	assert(n_ref == 3898u);
+
+	can_capture_init(&w);
+	size = can_capture_write_header(&w, capture);
+	for (k = 0u; k < n_ref; k++) {
+		size += can_capture_write(&w, &ref[k], &capture[size]);
+	}
+
+	printf("gbt_working_sequence.txt: %lu frames -> %lu bytes\n",
+	       (unsigned long)n_ref, (unsigned long)size);
+
+	can_capture_test_roundtrip(n_ref, size, size);
+	can_capture_test_roundtrip(n_ref, size, 1u);
+	can_capture_test_roundtrip(n_ref, size, 7u);
+	can_capture_test_errors(size);
+	can_capture_test_index(n_ref, size);
+	can_capture_test_literal();
+	can_capture_test_timeline();
+
+	printf("FINISHED\n");
+
+	return 0;
+}
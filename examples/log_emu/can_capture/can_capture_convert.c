@@ -0,0 +1,125 @@
+/* Converts text CAN logs into binary capture (see can_capture.h).
+ *
+ * Usage: can_capture_convert <canary|common|savvy> <input> <output>
+ *   canary: CANARY log
+ *   common: CANARY common log (with bus number column)
+ *   savvy:  SavvyCAN export (see savvy_log_reader.h) */
+#include "can_capture.h"
+#include "savvy_log_reader.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+struct can_capture cap;
+
+FILE  *out_file;
+size_t out_size;
+
+void write_frame(const struct canary_log_reader_frame *f)
+{
+	uint8_t rec[CAN_CAPTURE_RECORD_MAX];
+	size_t  n = can_capture_write(&cap, f, rec);
+
+	out_size += fwrite(rec, 1u, n, out_file);
+}
+
+size_t convert_canary(FILE *in, bool common_log)
+{
+	static char buf[4096];
+	struct canary_log_reader_frame frames[64];
+	struct canary_log_reader r;
+	size_t len = 0u;
+	size_t used;
+	size_t n;
+	size_t k;
+
+	canary_log_reader_init(&r);
+	r.common_log = common_log;
+
+	do {
+		len += fread(&buf[len], 1u, sizeof(buf) - len, in);
+
+		do {
+			n = canary_log_reader_read(&r, buf, len, frames, 64u,
+						   &used);
+			for (k = 0u; k < n; k++) {
+				write_frame(&frames[k]);
+			}
+
+			len -= used;
+			memmove(buf, &buf[used], len);
+		} while (n > 0u);
+	} while (!feof(in));
+
+	return r._total_frames;
+}
+
+size_t convert_savvy(FILE *in)
+{
+	static char buf[4096];
+	struct canary_log_reader_frame frames[64];
+	struct savvy_log_reader r;
+	size_t len = 0u;
+	size_t used;
+	size_t n;
+	size_t k;
+
+	savvy_log_reader_init(&r);
+
+	do {
+		len += fread(&buf[len], 1u, sizeof(buf) - len, in);
+
+		do {
+			n = savvy_log_reader_read(&r, buf, len, frames, 64u,
+						  &used);
+			for (k = 0u; k < n; k++) {
+				write_frame(&frames[k]);
+			}
+
+			len -= used;
+			memmove(buf, &buf[used], len);
+		} while (n > 0u);
+	} while (!feof(in));
+
+	return r._total_frames;
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t header[CAN_CAPTURE_HEADER_SIZE];
+	FILE  *in;
+	long   in_size;
+	size_t frames;
+
+	if (argc != 4) {
+		printf("Usage: %s <canary|common|savvy> <input> <output>\n",
+		       argv[0]);
+		return 1;
+	}
+
+	in       = fopen(argv[2], "rb");
+	out_file = fopen(argv[3], "wb");
+	assert(in && out_file);
+
+	can_capture_init(&cap);
+	out_size = fwrite(header, 1u, can_capture_write_header(&cap, header),
+			  out_file);
+
+	if (strcmp(argv[1], "savvy") == 0) {
+		frames = convert_savvy(in);
+	} else {
+		frames = convert_canary(in, strcmp(argv[1], "common") == 0);
+	}
+
+	in_size = ftell(in);
+
+	printf("%lu frames, %ld -> %lu bytes (x%.2f smaller), %u IDs\n",
+	       (unsigned long)frames, in_size, (unsigned long)out_size,
+	       (double)in_size / (double)out_size, (unsigned)cap._dict_len);
+
+	fclose(in);
+	fclose(out_file);
+
+	return 0;
+}
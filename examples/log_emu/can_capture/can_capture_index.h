@@ -0,0 +1,356 @@
+#ifndef   CAN_CAPTURE_INDEX_H
+#define   CAN_CAPTURE_INDEX_H
+
+#include "can_capture.h"
+
+/******************************************************************************
+ * CAN CAPTURE INDEX
+ *
+ * Index over a binary capture (can_capture.h):
+ * - sparse checkpoints (time -> byte offset, with reader state), so replay
+ *   can start anywhere without decoding the capture from the beginning;
+ * - per-ID occurrence lists (offset and time of every frame), so frames of
+ *   a single ID can be pulled without scanning the capture.
+ *
+ * Index is incremental: it keeps scanner state and accepts capture bytes
+ * as they are appended. Storage is provided by the caller.
+ *****************************************************************************/
+/* Max number of distinct IDs (same as dictionary size) */
+#define CAN_CAPTURE_INDEX_MAX_IDS CAN_CAPTURE_DICT_SIZE
+
+/* ID slot of frames left unindexed (more IDs than slots) */
+#define _CAN_CAPTURE_INDEX_NO_SLOT 0xFFu
+
+/* Reader state at a record boundary */
+struct can_capture_checkpoint {
+	uint64_t timestamp_us; /* Reader time before the record */
+	uint32_t offset;       /* Byte offset of the record in capture */
+	uint32_t frame;        /* Number of frames before the record */
+	uint8_t  dict_len;     /* Dictionary size before the record */
+};
+
+/* Single frame occurrence */
+struct can_capture_occurrence {
+	uint64_t timestamp_us; /* Frame time */
+	uint32_t offset;       /* Byte offset of the record in capture */
+	uint32_t next;         /* Next occurrence of the ID (index + 1) */
+};
+
+struct can_capture_index {
+	/* Scanner state, holds the whole dictionary */
+	struct can_capture _scan;
+
+	/* Capture bytes indexed so far */
+	uint32_t _offset;
+
+	/* Checkpoint period, doubled each time checkpoints are full */
+	uint64_t period_us;
+	uint64_t _next_us;
+
+	struct can_capture_checkpoint *checkpoints;
+	uint32_t checkpoints_max;
+	uint32_t checkpoints_len;
+
+	struct can_capture_occurrence *occurrences;
+	uint32_t occurrences_max;
+	uint32_t occurrences_len;
+
+	/* Occurrences did not fit, lists are incomplete */
+	bool truncated;
+
+	/* More distinct IDs than slots (literal records), frames of IDs
+	 * without a slot are not indexed */
+	bool ids_overflow;
+
+	/* Per-ID lists (occurrence index + 1, 0 if none) */
+	uint32_t _ids[CAN_CAPTURE_INDEX_MAX_IDS];
+	uint32_t _head[CAN_CAPTURE_INDEX_MAX_IDS];
+	uint32_t _tail[CAN_CAPTURE_INDEX_MAX_IDS];
+	uint8_t  _ids_len;
+
+	/* Dictionary entry to ID slot */
+	uint8_t  _entry_slot[CAN_CAPTURE_DICT_SIZE];
+};
+
+void can_capture_index_init(struct can_capture_index *self,
+			    uint64_t period_us,
+			    struct can_capture_checkpoint *checkpoints,
+			    uint32_t checkpoints_max,
+			    struct can_capture_occurrence *occurrences,
+			    uint32_t occurrences_max)
+{
+	assert(checkpoints_max >= 2u);
+
+	can_capture_init(&self->_scan);
+
+	self->_offset = 0u;
+
+	self->period_us = period_us;
+	self->_next_us  = 0u;
+
+	self->checkpoints     = checkpoints;
+	self->checkpoints_max = checkpoints_max;
+	self->checkpoints_len = 0u;
+
+	self->occurrences     = occurrences;
+	self->occurrences_max = occurrences_max;
+	self->occurrences_len = 0u;
+
+	self->truncated    = false;
+	self->ids_overflow = false;
+
+	self->_ids_len = 0u;
+}
+
+/******************************************************************************
+ * CAN CAPTURE INDEX PRIVATE
+ *****************************************************************************/
+/* Returns ID slot, _CAN_CAPTURE_INDEX_NO_SLOT if all slots are taken */
+uint8_t _can_capture_index_slot(struct can_capture_index *self, uint32_t id)
+{
+	uint8_t i = 0u;
+
+	while ((i < self->_ids_len) && (self->_ids[i] != id)) {
+		i++;
+	}
+
+	/* Never more IDs than entries, literals aside */
+	if (i < self->_ids_len) {
+	} else if (self->_ids_len >= CAN_CAPTURE_INDEX_MAX_IDS) {
+		self->ids_overflow = true;
+		i = _CAN_CAPTURE_INDEX_NO_SLOT;
+	} else {
+		self->_ids[i]  = id;
+		self->_head[i] = 0u;
+		self->_tail[i] = 0u;
+		self->_ids_len++;
+	}
+
+	return i;
+}
+
+/* Keeps every other checkpoint, so there is room for more */
+void _can_capture_index_thin(struct can_capture_index *self)
+{
+	uint32_t i;
+
+	for (i = 0u; (i * 2u) < self->checkpoints_len; i++) {
+		self->checkpoints[i] = self->checkpoints[i * 2u];
+	}
+
+	self->checkpoints_len = i;
+	self->period_us *= 2u;
+	self->_next_us = self->checkpoints[i - 1u].timestamp_us +
+			 self->period_us;
+}
+
+void _can_capture_index_add(struct can_capture_index *self, uint8_t slot,
+			    uint32_t offset, uint64_t timestamp_us)
+{
+	struct can_capture_occurrence *o;
+
+	if (self->occurrences_len >= self->occurrences_max) {
+		self->truncated = true;
+		return;
+	}
+
+	o = &self->occurrences[self->occurrences_len];
+	o->offset       = offset;
+	o->timestamp_us = timestamp_us;
+	o->next         = 0u;
+	self->occurrences_len++;
+
+	if (self->_tail[slot] == 0u) {
+		self->_head[slot] = self->occurrences_len;
+	} else {
+		self->occurrences[self->_tail[slot] - 1u].next =
+							self->occurrences_len;
+	}
+
+	self->_tail[slot] = self->occurrences_len;
+}
+
+/******************************************************************************
+ * CAN CAPTURE INDEX PUBLIC
+ *****************************************************************************/
+/* Indexes capture bytes appended since the last call. `buf` must start at
+ * capture offset `_offset` (from the beginning of file on first call).
+ * Returns bytes consumed, incomplete tail must be passed again once the
+ * capture grows. Stops on capture error (see _scan._eflags). */
+size_t can_capture_index_update(struct can_capture_index *self,
+				const uint8_t *buf, size_t size)
+{
+	struct can_capture *scan = &self->_scan;
+	struct canary_log_reader_frame f;
+	struct can_capture_checkpoint *cp;
+	size_t   pos = 0u;
+	size_t   k;
+	uint64_t base_us;
+	uint8_t  dict_len;
+	uint8_t  key;
+	uint8_t  slot;
+
+	if (!scan->_header) {
+		(void)can_capture_read(scan, buf, size, &f, 0u, &pos);
+		if (!scan->_header) {
+			self->_offset += (uint32_t)pos;
+			return pos;
+		}
+	}
+
+	while (scan->_eflags == 0u) {
+		base_us  = scan->_timestamp_us;
+		dict_len = scan->_dict_len;
+
+		k = _can_capture_read_record(scan, &buf[pos], &buf[size], &f);
+		if (k == 0u) {
+			break;
+		}
+
+		/* Key byte follows varint timestamp */
+		key = 0u;
+		while ((buf[pos + key] & 0x80u) != 0u) {
+			key++; /* Used as varint length here */
+		}
+
+		key = buf[pos + key + 1u];
+
+		/* Checkpoint at the first record past the period */
+		if ((self->checkpoints_len == 0u) ||
+		    (f.timestamp_us >= self->_next_us)) {
+			if (self->checkpoints_len >= self->checkpoints_max) {
+				_can_capture_index_thin(self);
+			}
+
+			cp = &self->checkpoints[self->checkpoints_len];
+			cp->offset       = self->_offset + (uint32_t)pos;
+			cp->timestamp_us = base_us;
+			cp->frame        = (uint32_t)scan->_total_frames;
+			cp->dict_len     = dict_len;
+			self->checkpoints_len++;
+
+			self->_next_us = f.timestamp_us + self->period_us;
+		}
+
+		/* Entries are mapped to ID slot once */
+		if (key < (uint8_t)CAN_CAPTURE_KEY_NEW) {
+			slot = self->_entry_slot[key];
+		} else {
+			slot = _can_capture_index_slot(self, f.id);
+
+			if (key == (uint8_t)CAN_CAPTURE_KEY_NEW) {
+				self->_entry_slot[dict_len] = slot;
+			}
+		}
+
+		if (slot != _CAN_CAPTURE_INDEX_NO_SLOT) {
+			_can_capture_index_add(self, slot, self->_offset +
+					       (uint32_t)pos, f.timestamp_us);
+		}
+
+		scan->_total_frames++;
+		pos += k;
+	}
+
+	self->_offset += (uint32_t)pos;
+
+	return pos;
+}
+
+/* Primes `reader` to continue from the last checkpoint at or before
+ * `timestamp_us`. Returns capture offset to read from, frames before
+ * `timestamp_us` are still there and must be skipped by caller. */
+uint32_t can_capture_index_seek(const struct can_capture_index *self,
+				uint64_t timestamp_us,
+				struct can_capture *reader)
+{
+	const struct can_capture_checkpoint *cp = self->checkpoints;
+	uint32_t lo = 0u;
+	uint32_t hi = self->checkpoints_len;
+	uint32_t mid;
+
+	can_capture_init(reader);
+
+	if (self->checkpoints_len == 0u) {
+		return 0u;
+	}
+
+	/* Last checkpoint with time <= timestamp_us */
+	while ((hi - lo) > 1u) {
+		mid = lo + ((hi - lo) / 2u);
+
+		if (cp[mid].timestamp_us <= timestamp_us) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	cp = &cp[lo];
+
+	memcpy(reader->_dict, self->_scan._dict,
+	       cp->dict_len * sizeof(reader->_dict[0]));
+	reader->_dict_len     = cp->dict_len;
+	reader->_timestamp_us = cp->timestamp_us;
+	reader->_header       = true;
+	reader->_total_frames = cp->frame;
+
+	return cp->offset;
+}
+
+/* First occurrence of `id`, NULL if none */
+const struct can_capture_occurrence *can_capture_index_first(
+		       const struct can_capture_index *self, uint32_t id)
+{
+	uint8_t i;
+
+	for (i = 0u; i < self->_ids_len; i++) {
+		if ((self->_ids[i] == id) && (self->_head[i] != 0u)) {
+			return &self->occurrences[self->_head[i] - 1u];
+		}
+	}
+
+	return NULL;
+}
+
+/* Next occurrence of the same ID, NULL if none */
+const struct can_capture_occurrence *can_capture_index_next(
+		       const struct can_capture_index *self,
+		       const struct can_capture_occurrence *o)
+{
+	return (o->next != 0u) ? &self->occurrences[o->next - 1u] : NULL;
+}
+
+/* Decodes a single record at occurrence (`rec` points to its offset) */
+bool can_capture_index_decode(const struct can_capture_index *self,
+			      const struct can_capture_occurrence *o,
+			      const uint8_t *rec, size_t size,
+			      struct canary_log_reader_frame *f)
+{
+	struct can_capture r;
+	size_t k = 0u;
+
+	while ((k < size) && ((rec[k] & 0x80u) != 0u)) {
+		k++;
+	}
+
+	if ((k + 1u) >= size) {
+		return false;
+	}
+
+	/* Whole dictionary is known, but new entry must not overflow it */
+	can_capture_init(&r);
+	memcpy(r._dict, self->_scan._dict, sizeof(r._dict));
+	r._dict_len = (rec[k + 1u] == (uint8_t)CAN_CAPTURE_KEY_NEW) ?
+		      0u : self->_scan._dict_len;
+
+	if (_can_capture_read_record(&r, rec, &rec[size], f) == 0u) {
+		return false;
+	}
+
+	f->timestamp_us = o->timestamp_us;
+
+	return true;
+}
+
+#endif /* CAN_CAPTURE_INDEX_H */
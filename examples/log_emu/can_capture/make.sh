@@ -0,0 +1,8 @@
+gcc -I../canary_log_reader can_capture.test.c -Wall -Wextra -g -std=c89 \
+    -pedantic -o can_capture_test
+./can_capture_test
+
+rm can_capture_test
+
+gcc -I../canary_log_reader -I../savvy_log_reader can_capture_convert.c \
+    -Wall -Wextra -O2 -std=c89 -pedantic -o can_capture_convert
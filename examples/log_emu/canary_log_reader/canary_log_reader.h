@@ -6,6 +6,8 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <errno.h>
+#include <string.h>
 
 /******************************************************************************
  * CANARY
@@ -37,8 +39,14 @@ enum canary_log_reader_state {
 	CANARY_LOG_READER_STATE_PARSE_DATA
 };
 
+/* Timestamps written by a 32 bit microsecond timer wrap every ~71 minutes */
+#define CANARY_LOG_READER_WRAP_US ((uint64_t)1u << 32u)
+
+/* Max timestamp digits (64 bit microseconds) */
+#define CANARY_LOG_READER_TIMESTAMP_MAX_LEN 19u
+
 struct canary_log_reader_frame {
-	uint32_t timestamp_us;
+	uint64_t timestamp_us;
 
 	uint32_t id;
 	uint8_t  len;
@@ -59,6 +67,11 @@ struct canary_log_reader {
 	uint8_t _len;
 
 	size_t _total_frames;
+	size_t _total_errors;
+
+	/* Timeline unwrapping, see _canary_log_reader_unwrap */
+	uint64_t _wrap_us;
+	uint64_t _last_us;
 
 	struct canary_log_reader_frame _frame;
 
@@ -78,6 +91,10 @@ void canary_log_reader_init(struct canary_log_reader *self)
 	self->_len     =   0u;
 
 	self->_total_frames = 0u;
+	self->_total_errors = 0u;
+
+	self->_wrap_us = 0u;
+	self->_last_us = 0u;
 
 	/* self->frame ... */
 	self->_frame.timestamp_us = 0u;
@@ -121,6 +138,55 @@ uint32_t _canary_log_reader_parse_num(struct canary_log_reader *self,
 	return result;
 }
 
+/* TRY parse decimal 64 bit number (timestamp) and terminate token,
+ * Set eflags to INCOMPLETE if less characters than expected, or if any
+ * of them is not a digit. */
+uint64_t _canary_log_reader_parse_u64(struct canary_log_reader *self,
+				      uint8_t min_len)
+{
+	uint64_t result = 0u;
+	uint8_t  i;
+
+	if (self->_len < min_len) {
+		self->_eflags |= CANARY_LOG_READER_EFLAG_INCOMPLETE;
+	} else {
+		for (i = 0u; i < self->_len; i++) {
+			if (isdigit((unsigned char)self->_tok[i]) == 0) {
+				self->_eflags |=
+					CANARY_LOG_READER_EFLAG_INCOMPLETE;
+			}
+
+			result = (result * 10u) +
+				 (uint64_t)(self->_tok[i] - '0');
+		}
+	}
+
+	self->_len = 0u;
+
+	return result;
+}
+
+/* Logs written with a 32 bit timer go back to 0 every ~71 minutes. Time
+ * going back by more than half of the timer range is taken as a wrap, so
+ * the timeline stays monotonic. 64 bit timestamps are never unwrapped. */
+uint64_t _canary_log_reader_unwrap(uint64_t *wrap_us, uint64_t *last_us,
+				   uint64_t timestamp_us)
+{
+	if (timestamp_us < CANARY_LOG_READER_WRAP_US) {
+		timestamp_us += *wrap_us;
+
+		if ((timestamp_us + (CANARY_LOG_READER_WRAP_US / 2u)) <
+		    *last_us) {
+			*wrap_us     += CANARY_LOG_READER_WRAP_US;
+			timestamp_us += CANARY_LOG_READER_WRAP_US;
+		}
+	}
+
+	*last_us = timestamp_us;
+
+	return timestamp_us;
+}
+
 void _canary_log_reader_parse_timestamp_us(
 				  struct canary_log_reader *self, const char c)
 {
@@ -134,10 +200,12 @@ void _canary_log_reader_parse_timestamp_us(
 			self->_state = CANARY_LOG_READER_STATE_PARSE_ID;
 		}
 
+		/* Unwrapped once the whole line is accepted */
 		self->_frame.timestamp_us =
-			_canary_log_reader_parse_num(self, 10u, 10u);
+			_canary_log_reader_parse_u64(self, 10u);
 	} else {
-		_canary_log_reader_consume_char(self, c, 10u);
+		_canary_log_reader_consume_char(self, c,
+					CANARY_LOG_READER_TIMESTAMP_MAX_LEN);
 	}
 }
 
@@ -217,6 +285,10 @@ enum canary_log_reader_event _canary_log_reader_parse_data(
 		self->_i++;
 
 		if (self->_i >= self->_frame.len) {
+			self->_frame.timestamp_us = _canary_log_reader_unwrap(
+				&self->_wrap_us, &self->_last_us,
+				self->_frame.timestamp_us);
+
 			self->_total_frames++;
 			ev = CANARY_LOG_READER_EVENT_FRAME_READY;
 			self->_state = CANARY_LOG_READER_STATE_PARSE_TIMESTAMP;
@@ -289,9 +361,249 @@ enum canary_log_reader_event canary_log_reader_putc(
 		}
 
 		ev = CANARY_LOG_READER_EVENT_ERROR;
+		self->_total_errors++;
 	}
 
 	return ev;
 }
 
+/******************************************************************************
+ * CANARY BULK
+ *****************************************************************************/
+/* Character classes, digit value (0-15) for hex/decimal digits */
+enum _canary_log_reader_chr {
+	_CANARY_LOG_READER_CHR_SPACE = 0x10,
+	_CANARY_LOG_READER_CHR_DOT   = 0x11,
+	_CANARY_LOG_READER_CHR_OTHER = 0xFF
+};
+
+const uint8_t _canary_log_reader_chr_table[256u] = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0x10, 0x10, 0x10, 0x10, 0x10, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0x10, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x11, 0xFF,
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+	0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+/* Field layout of a single line, data field repeats `len` times */
+struct _canary_log_reader_field {
+	uint8_t state; /* enum canary_log_reader_state, reported on error */
+	uint8_t base;
+	uint8_t min_len;
+	uint8_t max_len;
+};
+
+const struct _canary_log_reader_field _canary_log_reader_fields[] = {
+	{ CANARY_LOG_READER_STATE_PARSE_TIMESTAMP, 10u, 10u,
+	  CANARY_LOG_READER_TIMESTAMP_MAX_LEN },
+	{ CANARY_LOG_READER_STATE_PARSE_BUS_NUM,   10u,  1u,  1u },
+	{ CANARY_LOG_READER_STATE_PARSE_ID,        16u,  8u,  8u },
+	{ CANARY_LOG_READER_STATE_PARSE_FLAGS,     16u,  2u,  2u },
+	{ CANARY_LOG_READER_STATE_PARSE_LEN,       10u,  1u,  1u },
+	{ CANARY_LOG_READER_STATE_PARSE_DATA,      16u,  2u,  2u }
+};
+
+/* Scans a single field in place, without copying it.
+ * Dots are skipped (only timestamp has them). Returns eflags. */
+uint8_t _canary_log_reader_scan_field(const char **p, const char *end,
+				const struct _canary_log_reader_field *field,
+				uint64_t *out)
+{
+	const char *s = *p;
+	uint64_t result = 0u;
+	uint8_t  len    = 0u;
+	uint8_t  eflags = 0u;
+	uint8_t  v;
+
+	while ((s < end) && (_canary_log_reader_chr_table[(uint8_t)*s] ==
+			     (uint8_t)_CANARY_LOG_READER_CHR_SPACE)) {
+		s++;
+	}
+
+	if (s == end) {
+		eflags |= CANARY_LOG_READER_EFLAG_UNEXP_NEWL;
+	}
+
+	for (; s < end; s++) {
+		v = _canary_log_reader_chr_table[(uint8_t)*s];
+
+		if (v == (uint8_t)_CANARY_LOG_READER_CHR_SPACE) {
+			break;
+		} else if (v == (uint8_t)_CANARY_LOG_READER_CHR_DOT) {
+			/* Skip dots */
+		} else if (v >= field->base) {
+			eflags |= CANARY_LOG_READER_EFLAG_INCOMPLETE;
+		} else if (len >= field->max_len) {
+			eflags |= CANARY_LOG_READER_EFLAG_OVERFLOW;
+		} else {
+			result = (result * field->base) + v;
+			len++;
+		}
+	}
+
+	if ((eflags == 0u) && (len < field->min_len)) {
+		eflags |= CANARY_LOG_READER_EFLAG_INCOMPLETE;
+	}
+
+	*p   = s;
+	*out = result;
+
+	return eflags;
+}
+
+/* Parses a single line (without newline) straight into frame.
+ * On error, sets _estate and _eflags to the failed field and its flags. */
+bool _canary_log_reader_parse_line(struct canary_log_reader *self,
+				   const char *s, const char *end,
+				   struct canary_log_reader_frame *frame)
+{
+	const struct _canary_log_reader_field *field =
+						 _canary_log_reader_fields;
+	uint64_t v;
+	uint8_t  eflags = 0u;
+	uint8_t  estate = 0u;
+	uint8_t  i      = 0u;
+
+	frame->len = 0u;
+
+	while ((eflags == 0u) &&
+	       ((field->state != CANARY_LOG_READER_STATE_PARSE_DATA) ||
+		(i < frame->len))) {
+		estate = field->state;
+		eflags = _canary_log_reader_scan_field(&s, end, field, &v);
+
+		switch (field->state) {
+		case CANARY_LOG_READER_STATE_PARSE_TIMESTAMP:
+			frame->timestamp_us = v;
+			break;
+
+		case CANARY_LOG_READER_STATE_PARSE_ID:
+			frame->id = (uint32_t)v;
+			break;
+
+		case CANARY_LOG_READER_STATE_PARSE_FLAGS:
+			frame->flags = (uint8_t)v;
+			break;
+
+		case CANARY_LOG_READER_STATE_PARSE_LEN:
+			if (v > 8u) {
+				eflags |= CANARY_LOG_READER_EFLAG_OVERFLOW;
+			} else {
+				frame->len = (uint8_t)v;
+			}
+
+			break;
+
+		case CANARY_LOG_READER_STATE_PARSE_DATA:
+			frame->data[i] = (uint8_t)v;
+			i++;
+			break;
+
+		default:
+			break;
+		}
+
+		/* Bus number column is only present in common logs */
+		if ((field->state == CANARY_LOG_READER_STATE_PARSE_TIMESTAMP) &&
+		    !self->common_log) {
+			field++;
+		}
+
+		if (field->state != CANARY_LOG_READER_STATE_PARSE_DATA) {
+			field++;
+		}
+	}
+
+	/* Anything but whitespace after data is more than `len` bytes */
+	while ((eflags == 0u) && (s < end)) {
+		if (_canary_log_reader_chr_table[(uint8_t)*s] !=
+		    (uint8_t)_CANARY_LOG_READER_CHR_SPACE) {
+			eflags |= CANARY_LOG_READER_EFLAG_OVERFLOW;
+		}
+
+		s++;
+	}
+
+	if (eflags != 0u) {
+		self->_estate = estate;
+		self->_eflags = eflags;
+	} else {
+		frame->timestamp_us = _canary_log_reader_unwrap(
+			&self->_wrap_us, &self->_last_us, frame->timestamp_us);
+	}
+
+	return (eflags == 0u);
+}
+
+/* Parses whole lines out of `buf` straight into `frames` (up to
+ * `max_frames`), tokens are never copied. Comments and empty lines are
+ * skipped, lines with errors are counted in _total_errors.
+ *
+ * Parsing stops at the last complete line, `consumed` tells how many bytes
+ * were used. Unused tail must be passed again with the next chunk. A
+ * memory mapped file can be passed at once, if it ends with a newline.
+ *
+ * Returns the number of frames written. */
+size_t canary_log_reader_read(struct canary_log_reader *self,
+			      const char *buf, size_t size,
+			      struct canary_log_reader_frame *frames,
+			      size_t max_frames, size_t *consumed)
+{
+	const char *s   = buf;
+	const char *end = buf + size;
+	const char *nl;
+	size_t n = 0u;
+
+	while (n < max_frames) {
+		nl = (const char *)memchr(s, '\n', (size_t)(end - s));
+		if (nl == NULL) {
+			break;
+		}
+
+		/* Skip comments and empty lines (CRLF included) */
+		if ((*s == ';') || (s == nl) || ((*s == '\r') &&
+						 ((s + 1) == nl))) {
+		} else if (_canary_log_reader_parse_line(self, s, nl,
+							 &frames[n])) {
+			n++;
+			self->_total_frames++;
+		} else {
+			self->_total_errors++;
+		}
+
+		s = nl + 1;
+	}
+
+	*consumed = (size_t)(s - buf);
+
+	return n;
+}
+
 #endif /* CAN_LOG_READER_H */
@@ -2,6 +2,7 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 
 void canary_print_header()
 {
@@ -12,8 +13,8 @@ void canary_print_frame(struct canary_log_reader *self)
 {
 	int i;
 			
-	printf("%011u %08X %02X %i",
-	       self->_frame.timestamp_us, self->_frame.id,
+	printf("%011lu %08X %02X %i",
+	       (unsigned long)self->_frame.timestamp_us, self->_frame.id,
 	       self->_frame.flags, self->_frame.len);
 	       
 	for (i = 0; i < self->_frame.len; i++)
@@ -21,6 +22,178 @@ void canary_print_frame(struct canary_log_reader *self)
 	printf("\n");
 }
 
+/* Bulk reader must produce the same frames as putc,
+ * regardless of how the file is split into chunks */
+void canary_test_bulk(void)
+{
+	static struct canary_log_reader_frame ref[4096];
+	struct canary_log_reader_frame frames[7];
+	struct canary_log_reader r;
+	char   buf[100];
+	size_t len = 0u;
+	size_t used;
+	size_t total = 0u;
+	size_t n;
+	size_t k;
+	int    c;
+
+	FILE *file = fopen("gbt_working_sequence.txt", "r");
+
+	assert(file);
+
+	canary_log_reader_init(&r);
+	c = getc(file);
+	while (!feof(file)) {
+		if (canary_log_reader_putc(&r, c) ==
+		    CANARY_LOG_READER_EVENT_FRAME_READY) {
+			ref[r._total_frames - 1u] = r._frame;
+		}
+
+		c = getc(file);
+	}
+
+	rewind(file);
+	canary_log_reader_init(&r);
+
+	do {
+		len += fread(&buf[len], 1u, sizeof(buf) - len, file);
+
+		do {
+			n = canary_log_reader_read(&r, buf, len, frames, 7u,
+						   &used);
+			for (k = 0u; k < n; k++, total++) {
+				assert(frames[k].timestamp_us ==
+				       ref[total].timestamp_us);
+				assert(frames[k].id    == ref[total].id);
+				assert(frames[k].flags == ref[total].flags);
+				assert(frames[k].len   == ref[total].len);
+				assert(memcmp(frames[k].data, ref[total].data,
+					      frames[k].len) == 0);
+			}
+
+			/* Keep incomplete line for the next chunk */
+			len -= used;
+			memmove(buf, &buf[used], len);
+		} while (n > 0u);
+	} while (!feof(file));
+
+	fclose(file);
+
+	assert(total == 3898u);
+	assert(r._total_frames == 3898u);
+	assert(r._total_errors == 0u);
+}
+
+void canary_test_bulk_errors(void)
+{
+	const char log[] =
+		";comment\r\n"
+		"\r\n"
+		"0001.000000 0 00000209 00 2 01 02\r\n"
+		"0001.0 0 00000209 00 2 01 02\n"       /* short timestamp */
+		"0001.000000 0 00000209 00 9 01 02\n"  /* len > 8 */
+		"0001.000000 0 00000209 00 2 01\n"     /* data missing */
+		"0001.000000 0 00000209 00 2 01 02 03\n" /* extra data */
+		"0001.000000 0 0000020G 00 1 01\n"     /* not a hex */
+		"0002.000000 1 000000AB 80 0\n"
+		"0003.000000 0 00000209 00 1 FF"; /* no newline yet */
+
+	struct canary_log_reader_frame frames[8];
+	struct canary_log_reader r;
+	size_t used;
+
+	canary_log_reader_init(&r);
+	r.common_log = true;
+
+	assert(canary_log_reader_read(&r, log, sizeof(log) - 1u, frames, 8u,
+				      &used) == 2u);
+	assert(r._total_errors == 5u);
+	assert(r._estate == CANARY_LOG_READER_STATE_PARSE_ID);
+	assert(r._eflags == CANARY_LOG_READER_EFLAG_INCOMPLETE);
+
+	assert(frames[0].timestamp_us == 1000000u);
+	assert((frames[0].id == 0x209u) && (frames[0].len == 2u));
+	assert((frames[0].data[0] == 0x01u) && (frames[0].data[1] == 0x02u));
+	assert((frames[1].id == 0xABu) && (frames[1].flags == 0x80u));
+	assert(frames[1].len == 0u);
+
+	/* Last line is left for the next chunk */
+	assert(used == (sizeof(log) - 1u - strlen("0003.000000 0 00000209 "
+						  "00 1 FF")));
+}
+
+/* 32 bit timer wraps are unwrapped, 64 bit timestamps are kept */
+void canary_test_timeline(void)
+{
+	const char log[] =
+		"4294.900000 00000209 00 1 00\n"
+		"4294.967295 00000209 00 1 00\n"
+		"4294.967290 00000209 00 1 00\n"  /* small step back, no wrap */
+		"0000.000010 00000209 00 1 00\n"  /* wrap */
+		"3000.000000 00000209 00 1 00\n"
+		"0000.000001 00000209 00 1 00\n"  /* wrap */
+		"43200.000000 00000209 00 1 00\n"; /* 12 hours, 64 bit */
+
+	struct canary_log_reader_frame frames[8];
+	struct canary_log_reader r;
+	const uint64_t wrap = CANARY_LOG_READER_WRAP_US;
+	size_t used;
+	size_t k;
+
+	canary_log_reader_init(&r);
+	assert(canary_log_reader_read(&r, log, sizeof(log) - 1u, frames, 8u,
+				      &used) == 7u);
+
+	assert(frames[1].timestamp_us == 4294967295u);
+	assert(frames[2].timestamp_us == 4294967290u);
+	assert(frames[3].timestamp_us == (wrap + 10u));
+	assert(frames[4].timestamp_us == (wrap + 3000000000u));
+	assert(frames[5].timestamp_us == ((2u * wrap) + 1u));
+	assert(frames[6].timestamp_us == ((uint64_t)43200u * 1000000u));
+
+	/* putc gives the same timeline */
+	canary_log_reader_init(&r);
+	for (k = 0u; k < (sizeof(log) - 1u); k++) {
+		if (canary_log_reader_putc(&r, log[k]) ==
+		    CANARY_LOG_READER_EVENT_FRAME_READY) {
+			assert(r._frame.timestamp_us ==
+			       frames[r._total_frames - 1u].timestamp_us);
+		}
+	}
+
+	assert(r._total_frames == 7u);
+}
+
+/* Rejected lines must not move the timeline */
+void canary_test_timeline_errors(void)
+{
+	const char log[] =
+		"4294.900000 00000209 00 1 00\n"
+		"0000.000005 00000209 00 9 00\n" /* len > 8, not a wrap */
+		"0000.0000x5 00000209 00 1 00\n" /* not a digit */
+		"4294.967290 00000209 00 1 00\n";
+
+	struct canary_log_reader_frame frames[4];
+	struct canary_log_reader r;
+	size_t used;
+	size_t k;
+
+	canary_log_reader_init(&r);
+	assert(canary_log_reader_read(&r, log, sizeof(log) - 1u, frames, 4u,
+				      &used) == 2u);
+	assert(r._total_errors == 2u);
+	assert(frames[1].timestamp_us == 4294967290u);
+
+	canary_log_reader_init(&r);
+	for (k = 0u; k < (sizeof(log) - 1u); k++) {
+		(void)canary_log_reader_putc(&r, log[k]);
+	}
+
+	assert(r._total_frames == 2u);
+	assert(r._total_errors == 2u);
+	assert(r._frame.timestamp_us == 4294967290u);
+}
+
 int main()
 {
 	int c;
@@ -55,5 +228,10 @@ int main()
 
 	assert(c_inst._total_frames == 3898);
 
+	canary_test_bulk();
+	canary_test_bulk_errors();
+	canary_test_timeline();
+	canary_test_timeline_errors();
+
 	return 0;
 }
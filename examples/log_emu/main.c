@@ -1,16 +1,19 @@
+/* clock_gettime */
+#define _POSIX_C_SOURCE 199309L
+
 #include "canary_log_reader.h"
-#include "delta_time.h"
+#include "can_capture.h"
+#include "can_capture_index.h"
+#include "savvy_log_reader.h"
 #include "tg3spmc.h"
 #include "tg3spmc.logger.h"
 
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 
-#define SYS_TIMESTAMP_US (clock() / (CLOCKS_PER_SEC / 1000000.0f))
-#define SYS_TIMESTAMP_MS (clock() / (CLOCKS_PER_SEC / 1000.0f))
-
 void canary_print_header()
 {
 	printf(";CANARY V2.3\n;TIME_us.d  ID       FL L DATA\n");
@@ -19,11 +22,11 @@ void canary_print_header()
 void canary_print_frame(struct canary_log_reader *self)
 {
 	int i;
-			
-	printf("%011u %08X %02X %i",
-	       self->_frame.timestamp_us, self->_frame.id,
+
+	printf("%011lu %08X %02X %i",
+	       (unsigned long)self->_frame.timestamp_us, self->_frame.id,
 	       self->_frame.flags, self->_frame.len);
-	       
+
 	for (i = 0; i < self->_frame.len; i++)
 		printf(" %02X", self->_frame.data[i]);
 	printf("\n");
@@ -33,15 +36,59 @@ void canary_print_frame(struct canary_log_reader *self)
 struct tg3spmc mod1;
 struct tg3spmc_config config;
 
-/* For timing purposes */
-struct delta_time dt;
+/* Controller time, taken from log timestamps (milliseconds). 64 bit, as
+ * multi-hour logs don't fit into 32 bit microseconds. */
+uint64_t sim_time_ms;
+
+/* Wall clock at replay start (microseconds, monotonic) */
+uint64_t wall_start_us;
+
+/* Monotonic wall clock (microseconds), integer arithmetic only */
+uint64_t sys_timestamp_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000u) +
+	       ((uint64_t)ts.tv_nsec / 1000u);
+}
 
 /* Buffer for log */
 char log_buf[1024];
 
+/* Flight recorder, frozen on the first fault, dumped with `-d <path>` */
+#define RECORDER_DEPTH 1024u
+
+struct tg3spmc_recorder_entry rec_entries[RECORDER_DEPTH];
+struct tg3spmc_recorder rec;
+const char *dump_path = NULL;
+
+void dump_recorder(void)
+{
+	char     line[TG3SPMC_RECORDER_LINE_MAX];
+	uint32_t k;
+	FILE    *f = fopen(dump_path, "w");
+
+	if (f == NULL) {
+		return;
+	}
+
+	for (k = 0u; k < tg3spmc_recorder_lines(&rec); k++) {
+		if (tg3spmc_recorder_export(&rec, k, line, sizeof(line))) {
+			fputs(line, f);
+		}
+	}
+
+	fclose(f);
+
+	fprintf(stderr, "FLIGHT_RECORDER: %lu entries dumped to %s\n",
+		(unsigned long)rec._len, dump_path);
+}
+
 void setup()
 {
-	delta_time_init(&dt);
+	sim_time_ms = 0u;
 
 	/* Tesla module config */
 	config.rated_voltage_ac_V = 240.0f;
@@ -51,32 +98,37 @@ void setup()
 	/* Init module 1 (0, *1, 2) */
 	tg3spmc_init(&mod1, 1u);
 	tg3spmc_set_config(&mod1, config);
+	tg3spmc_recorder_init(&rec, rec_entries, RECORDER_DEPTH);
 }
 
-void loop()
+void loop(uint32_t delta_time_ms)
 {
 	/* Log timer */
 	static uint32_t log_timer_ms = 0;
 
+	/* Time since power on, until charger start is requested */
+	static uint32_t power_timer_ms = 0;
+	static bool     powered = false;
+
 	/* Module event */
 	enum tg3spmc_event ev;
 
-	/* General purpose CAN frame */
-	struct tg3spmc_frame f;
+	/* Sent CAN frames */
+	struct tg3spmc_frame f[3];
+	uint8_t n;
+	uint8_t k;
 
-	/* Measure delta time from past loop cycle (milliseconds) */
-	uint32_t delta_time_ms = delta_time_update_ms(&dt, SYS_TIMESTAMP_MS);
+	sim_time_ms += delta_time_ms;
 
 	ev = tg3spmc_step(&mod1, delta_time_ms);
+	tg3spmc_recorder_step(&rec, &mod1, delta_time_ms, ev);
 
-	if (tg3spmc_get_tx_frame(&mod1, &f)) {
-		/*simple_twai_send(&stw1, &f);*/
+	n = tg3spmc_get_tx_frames(&mod1, f, 3u);
+	for (k = 0u; k < n; k++) {
+		/*simple_twai_send(&stw1, &f[k]);*/
+		tg3spmc_recorder_tx(&rec, &mod1, &f[k]);
 	}
 
-	/*if (simple_twai_recv(&stw1, &f)) {
-		tg3spmc_put_rx_frame(&mod1, &f);
-	}*/
-
 	/*digitalWrite(MOD1_PWRON_PIN, tg3spmc_get_pwron_pin_state(&mod1));
 	digitalWrite(MOD1_CHGEN_PIN, tg3spmc_get_chgen_pin_state(&mod1));*/
 
@@ -88,12 +140,31 @@ void loop()
 	if (ev == TG3SPMC_EVENT_FAULT) {
 		printf(", CAUSE: %s",
 		       tg3spmc_get_fault_cause_name(mod1.fault_cause));
+
+		/* Only the first fault, recorder stays frozen after */
+		if (dump_path != NULL) {
+			dump_recorder();
+			dump_path = NULL;
+		}
 	}
 
 	if (ev != 0) {
 		printf("\n");
 	}
 
+	if (ev == TG3SPMC_EVENT_POWER_ON) {
+		power_timer_ms = 0u;
+		powered = false;
+	}
+
+	/* Readiness detection releases hold-start before the hold time */
+	power_timer_ms += delta_time_ms;
+	if (!powered && (mod1._state == _TG3SPMC_STATE_RUNNING) &&
+	    !mod1._hold_start) {
+		printf("TIME_TO_FIRST_POWER: %ums\n", (unsigned)power_timer_ms);
+		powered = true;
+	}
+
 	log_timer_ms += delta_time_ms;
 	if (log_timer_ms >= 500u) {
 		log_timer_ms -= 500u;
@@ -108,61 +179,444 @@ void loop()
 	}
 }
 
-int main()
+/* Brings controller time to the given log time. Controller is stepped
+ * only at its own deadlines in between, so the result doesn't depend on
+ * how fast the log is replayed. */
+void advance(uint64_t time_ms)
 {
-	int c;
-	struct canary_log_reader c_inst;
-	uint32_t last_msg_time_us = 0u;
+	uint32_t deadline;
+
+	while (time_ms > sim_time_ms) {
+		deadline = tg3spmc_next_deadline_ms(&mod1);
+
+		if (deadline > (time_ms - sim_time_ms)) {
+			deadline = (uint32_t)(time_ms - sim_time_ms);
+		}
+
+		loop(deadline);
+	}
+}
+
+/*****************************************************************************/
+/* Index of binary capture, kept next to it as "<capture>.idx" */
+#define IDX_MAX_CHECKPOINTS 1024u
+#define IDX_MAX_OCCURRENCES (256u * 1024u)
+
+struct can_capture_index idx;
+struct can_capture_checkpoint idx_checkpoints[IDX_MAX_CHECKPOINTS];
+struct can_capture_occurrence idx_occurrences[IDX_MAX_OCCURRENCES];
+
+/* Saved index is a raw dump, valid only on the same machine and build
+ * (struct size is stored to catch layout changes) */
+void save_index(const char *idx_path)
+{
+	uint32_t size = (uint32_t)sizeof(idx);
+	FILE *f = fopen(idx_path, "wb");
+
+	if (f == NULL) {
+		return;
+	}
+
+	fwrite(&size, sizeof(size), 1u, f);
+	fwrite(&idx, sizeof(idx), 1u, f);
+	fwrite(idx_checkpoints, sizeof(idx_checkpoints[0]),
+	       idx.checkpoints_len, f);
+	fwrite(idx_occurrences, sizeof(idx_occurrences[0]),
+	       idx.occurrences_len, f);
+	fclose(f);
+}
+
+bool load_index(const char *idx_path, long capture_size)
+{
+	static struct can_capture_index saved;
+	uint32_t size = 0u;
+	FILE *f = fopen(idx_path, "rb");
+	bool  ok;
+
+	if (f == NULL) {
+		return false;
+	}
+
+	ok = (fread(&size, sizeof(size), 1u, f) == 1u) &&
+	     (size == (uint32_t)sizeof(saved)) &&
+	     (fread(&saved, sizeof(saved), 1u, f) == 1u) &&
+	     (saved.checkpoints_max == IDX_MAX_CHECKPOINTS) &&
+	     (saved.occurrences_max == IDX_MAX_OCCURRENCES) &&
+	     (saved.checkpoints_len <= IDX_MAX_CHECKPOINTS) &&
+	     (saved.occurrences_len <= IDX_MAX_OCCURRENCES) &&
+	     ((long)saved._offset <= capture_size) &&
+	     (fread(idx_checkpoints, sizeof(idx_checkpoints[0]),
+		    saved.checkpoints_len, f) == saved.checkpoints_len) &&
+	     (fread(idx_occurrences, sizeof(idx_occurrences[0]),
+		    saved.occurrences_len, f) == saved.occurrences_len);
+
+	fclose(f);
+
+	if (ok) {
+		saved.checkpoints = idx_checkpoints;
+		saved.occurrences = idx_occurrences;
+		idx = saved;
+	}
+
+	return ok;
+}
+
+/* Builds the capture index, or extends the saved one with bytes appended
+ * to the capture since (capture may still be growing) */
+void index_capture(const char *path, FILE *file)
+{
+	static uint8_t chunk[4096];
+	char   idx_path[256];
+	size_t len = 0u;
+	size_t used;
+	long   capture_size;
+
+	sprintf(idx_path, "%.250s.idx", path);
+
+	fseek(file, 0, SEEK_END);
+	capture_size = ftell(file);
+
+	if (!load_index(idx_path, capture_size)) {
+		can_capture_index_init(&idx, 1000000u,
+				       idx_checkpoints, IDX_MAX_CHECKPOINTS,
+				       idx_occurrences, IDX_MAX_OCCURRENCES);
+	}
+
+	fprintf(stderr, "INDEX: %lu of %ld bytes already indexed\n",
+		(unsigned long)idx._offset, capture_size);
+
+	fseek(file, (long)idx._offset, SEEK_SET);
 
-	FILE *file = fopen("common_20251029_154131_tesla_bcb"
+	do {
+		len += fread(&chunk[len], 1u, sizeof(chunk) - len, file);
+
+		used = can_capture_index_update(&idx, chunk, len);
+		len -= used;
+		memmove(chunk, &chunk[used], len);
+	} while (!feof(file) && (idx._scan._eflags == 0u));
+
+	save_index(idx_path);
+}
+
+/* Time of the first module 1 fault: fault flag in AC params (0x209), or
+ * AC params missing for longer than RX timeout. Only AC params records
+ * are read from the capture. */
+bool find_fault(FILE *file, uint64_t *fault_us)
+{
+	const uint64_t timeout_us = TG3SPMC_CONST_CAN_RX_TIMEOUT_MS * 1000u;
+	const struct can_capture_occurrence *o;
+	struct canary_log_reader_frame f;
+	struct tg3spmc_frame tf;
+	uint8_t  rec[CAN_CAPTURE_RECORD_MAX];
+	uint64_t last_us;
+	size_t   n;
+
+	o = can_capture_index_first(&idx, 0x209u);
+	if (o == NULL) {
+		return false;
+	}
+
+	for (last_us = o->timestamp_us; o != NULL;
+	     o = can_capture_index_next(&idx, o)) {
+		if ((o->timestamp_us - last_us) > timeout_us) {
+			*fault_us = last_us + timeout_us;
+			return true;
+		}
+
+		last_us = o->timestamp_us;
+
+		fseek(file, (long)o->offset, SEEK_SET);
+		n = fread(rec, 1u, sizeof(rec), file);
+
+		if (!can_capture_index_decode(&idx, o, rec, n, &f)) {
+			continue;
+		}
+
+		tf.id  = f.id;
+		tf.len = f.len;
+		memcpy(tf.data, f.data, sizeof(tf.data));
+
+		if (tg3spmc_frame_has_fault(1u, &tf)) {
+			*fault_us = o->timestamp_us;
+			return true;
+		}
+	}
+
+	/* Module went silent until the end of capture */
+	if ((idx._scan._timestamp_us - last_us) > timeout_us) {
+		*fault_us = last_us + timeout_us;
+		return true;
+	}
+
+	return false;
+}
+
+/* Per message reception statistics of the module */
+void print_rx_health(void)
+{
+	const uint32_t base_ids[9] = {
+		0x207u, 0x217u, 0x227u, 0x237u, 0x247u,
+		0x347u, 0x467u, 0x537u, 0x717u
+	};
+
+	struct tg3spmc_rx_health h;
+	uint8_t k;
+
+	for (k = 0u; k < 9u; k++) {
+		if (!tg3spmc_get_rx_health(&mod1, base_ids[k], &h) ||
+		    (h.periods == 0u)) {
+			continue;
+		}
+
+		printf("RX_HEALTH 0x%03X: %5lu periods, %4lu missed, "
+		       "jitter %+5ld/%+5ld/%+5ld ms (min/mean/max)%s\n",
+		       (unsigned)(base_ids[k] + (mod1._id *
+					       _TG3SPM_MODULE_ID_SPACING)),
+		       (unsigned long)h.periods, (unsigned long)h.missed,
+		       (long)h.jitter_min_ms,
+		       (long)(h.jitter_sum_ms / (int32_t)h.periods),
+		       (long)h.jitter_max_ms, h.stale ? ", STALE" : "");
+	}
+}
+
+/* Feeds a single logged frame to the controller at its log time */
+void replay_frame(const struct canary_log_reader_frame *frame, bool realtime)
+{
+	struct tg3spmc_frame f;
+
+	while (realtime &&
+	       ((sys_timestamp_us() - wall_start_us) < frame->timestamp_us)) {
+	}
+
+	advance(frame->timestamp_us / 1000u);
+
+	f.id = frame->id;
+	f.len = frame->len;
+	memcpy(f.data, frame->data, f.len);
+
+	tg3spmc_put_rx_frame(&mod1, &f);
+	tg3spmc_recorder_rx(&rec, &mod1, &f);
+	loop(0u);
+}
+
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-r] [-f <seconds>] [-d <path>] [log]\n"
+		"  -r            wait for wall clock before every frame\n"
+		"  -f <seconds>  replay from this long before the first fault\n"
+		"                (binary capture only)\n"
+		"  -d <path>     dump the flight recorder to path\n",
+		name);
+}
+
+int main(int argc, char **argv)
+{
+	static char buf[4096];
+	struct canary_log_reader_frame frames[64];
+	struct canary_log_reader c_inst;
+	struct savvy_log_reader s_inst;
+	struct can_capture cap;
+	size_t len = 0u;
+	size_t used;
+	size_t n;
+	size_t k;
+	size_t total_frames;
+	size_t total_errors;
+	int    arg = 1;
+
+	/* Text line longer than buf is dropped up to its newline */
+	bool        skip_line = false;
+	const char *nl;
+
+	/* Wait for wall clock before every frame (old behaviour) */
+	bool realtime = false;
+
+	/* Start replay this long before the first fault (binary only) */
+	bool     before_fault = false;
+	uint64_t before_fault_us = 0u;
+	uint64_t fault_us;
+
+	/* Frames before this time are skipped */
+	uint64_t start_us = 0u;
+
+	/* Binary capture (can_capture.h), SavvyCAN export or canary common
+	 * log */
+	bool binary;
+	bool savvy;
+
+	const char *path = "common_20251029_154131_tesla_bcb"
 			   "_start_and_230_ac_387_DC_working_4A"
-			   "_but_unstable_as_hell.txt", "r");
+			   "_but_unstable_as_hell.txt";
+
+	uint64_t elapsed_us;
+
+	FILE *file;
+
+	for (; (argc > arg) && (argv[arg][0] == '-'); arg++) {
+		if (strcmp(argv[arg], "-r") == 0) {
+			realtime = true;
+		} else if ((strcmp(argv[arg], "-f") == 0) &&
+			   (argc > (arg + 1))) {
+			arg++;
+			before_fault = true;
+			before_fault_us = (uint64_t)atol(argv[arg]) * 1000000u;
+		} else if ((strcmp(argv[arg], "-d") == 0) &&
+			   (argc > (arg + 1))) {
+			arg++;
+			dump_path = argv[arg];
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
 
+	if (argc > arg) {
+		path = argv[arg];
+	}
+
+	file = fopen(path, "rb");
 	assert(file);
-	
+
 	canary_log_reader_init(&c_inst);
 	c_inst.common_log = true;
+	savvy_log_reader_init(&s_inst);
+	can_capture_init(&cap);
 
 	canary_print_header();
 
 	/* Setup tesla module */
 	setup();
-	
-	c = getc(file);
-	while (!feof(file)) {
-		/* Loop tesla module */
-		loop();
+	loop(0u);
 
-		if (SYS_TIMESTAMP_US <= last_msg_time_us) {
-			continue;
-		}
+	wall_start_us = sys_timestamp_us();
+
+	len = fread(buf, 1u, sizeof(buf), file);
+	binary = can_capture_is_capture((const uint8_t *)buf, len);
+	savvy  = !binary && savvy_log_reader_is_savvy(buf, len);
 
-		enum canary_log_reader_event ev =
-					    canary_log_reader_putc(&c_inst, c);
-		if (ev ==
-		    CANARY_LOG_READER_EVENT_FRAME_READY) {
-			struct tg3spmc_frame f;
+	if (binary && before_fault) {
+		index_capture(path, file);
 
-			/* canary_print_frame(&c_inst); */
+		if (find_fault(file, &fault_us)) {
+			start_us = (fault_us > before_fault_us) ?
+				   (fault_us - before_fault_us) : 0u;
+			printf("FIRST_FAULT: %luus, REPLAY_FROM: %luus\n",
+			       (unsigned long)fault_us,
+			       (unsigned long)start_us);
+		}
 
-			f.id = c_inst._frame.id;
-			f.len = c_inst._frame.len;
-			memcpy(f.data, c_inst._frame.data, f.len);
+		/* Continue from the checkpoint, controller starts there */
+		fseek(file, (long)can_capture_index_seek(&idx, start_us, &cap),
+		      SEEK_SET);
+		len = 0u;
+		sim_time_ms = start_us / 1000u;
+	}
 
-			tg3spmc_put_rx_frame(&mod1, &f);
+	do {
+		len += fread(&buf[len], 1u, sizeof(buf) - len, file);
 
-			last_msg_time_us = c_inst._frame.timestamp_us;
+		/* Rest of the dropped line ends at the next newline */
+		if (skip_line) {
+			nl = (const char *)memchr(buf, '\n', len);
+			used = (nl == NULL) ? len : ((size_t)(nl - buf) + 1u);
+			skip_line = (nl == NULL);
+			len -= used;
+			memmove(buf, &buf[used], len);
 		}
 
-		if (ev == CANARY_LOG_READER_EVENT_ERROR) {
-			printf("err, state: %i, flags: %i\n",
-				c_inst._estate, c_inst._eflags); fflush(0);
+		/* Last text line may have no newline */
+		if (!binary && feof(file) && (len > 0u) &&
+		    (len < sizeof(buf)) && (buf[len - 1u] != '\n')) {
+			buf[len] = '\n';
+			len++;
 		}
 
-		c = getc(file);
+		do {
+			if (binary) {
+				n = can_capture_read(&cap,
+					(const uint8_t *)buf, len, frames,
+					sizeof(frames) / sizeof(frames[0]),
+					&used);
+			} else if (savvy) {
+				n = savvy_log_reader_read(&s_inst, buf, len,
+					frames,
+					sizeof(frames) / sizeof(frames[0]),
+					&used);
+			} else {
+				n = canary_log_reader_read(&c_inst, buf, len,
+					frames,
+					sizeof(frames) / sizeof(frames[0]),
+					&used);
+			}
+
+			for (k = 0u; k < n; k++) {
+				if (frames[k].timestamp_us < start_us) {
+					continue;
+				}
+
+				/* canary_print_frame(&c_inst); */
+				replay_frame(&frames[k], realtime);
+			}
+
+			/* Incomplete line goes with the next chunk */
+			len -= used;
+			memmove(buf, &buf[used], len);
+		} while (n > 0u);
+
+		/* Full buffer without a newline can't make progress, the line
+		 * is counted as corrupt and dropped */
+		if (!binary && (len == sizeof(buf))) {
+			len = 0u;
+			skip_line = true;
+
+			if (savvy) {
+				s_inst._total_errors++;
+				s_inst._eflags |= (uint8_t)
+					CANARY_LOG_READER_EFLAG_OVERFLOW;
+			} else {
+				c_inst._total_errors++;
+				c_inst._eflags |= (uint8_t)
+					CANARY_LOG_READER_EFLAG_OVERFLOW;
+			}
+		}
+	} while (!feof(file) && (cap._eflags == 0u));
+
+	if (binary) {
+		total_frames = cap._total_frames;
+		total_errors = 0u;
+	} else if (savvy) {
+		total_frames = s_inst._total_frames;
+		total_errors = s_inst._total_errors;
+		c_inst._estate = s_inst._estate;
+		c_inst._eflags = s_inst._eflags;
+	} else {
+		total_frames = c_inst._total_frames;
+		total_errors = c_inst._total_errors;
+	}
+
+	if (total_errors > 0u) {
+		printf("errors: %u, last state: %i, flags: %i\n",
+		       (unsigned)total_errors, c_inst._estate,
+		       c_inst._eflags);
 	}
 
-	printf("FINISHED, TOTAL_FRAMES: %u\n", (unsigned)c_inst._total_frames);
+	if (cap._eflags != 0u) {
+		printf("capture error, flags: %i\n", cap._eflags);
+	}
+
+	printf("FINISHED, TOTAL_FRAMES: %u\n", (unsigned)total_frames);
+
+	print_rx_health();
+
+	/* Goes to stderr, so stdout stays comparable between modes */
+	elapsed_us = sys_timestamp_us() - wall_start_us;
+	fprintf(stderr, "REPLAY: %s, simulated %lu.%03us, %.0f frames/s\n",
+		realtime ? "realtime" : "virtual clock",
+		(unsigned long)(sim_time_ms / 1000u),
+		(unsigned)(sim_time_ms % 1000u),
+		(elapsed_us > 0u) ?
+		((double)total_frames * 1e6 / (double)elapsed_us) : 0.0);
 
 	return 0;
 }
@@ -0,0 +1,5 @@
+gcc -I../canary_log_reader savvy_log_reader.test.c -Wall -Wextra -g \
+    -std=c89 -pedantic -o savvy_log_reader_test
+./savvy_log_reader_test
+
+rm savvy_log_reader_test
@@ -0,0 +1,247 @@
+#ifndef   SAVVY_LOG_READER_H
+#define   SAVVY_LOG_READER_H
+
+#include "canary_log_reader.h"
+
+/******************************************************************************
+ * SAVVY
+ *
+ * Reader for SavvyCAN exports, one frame per line:
+ *
+ *   0000.041687 000005E9 8 00 3F 07 01 00 00 00 01
+ *   (timestamp s.us, ID, len, data...)
+ *
+ * Same interface as canary_log_reader: events, error flags, _estate with
+ * the failed field (enum canary_log_reader_state) and frames of type
+ * canary_log_reader_frame, so both go through the same replay path.
+ * Memory use is constant, a single line is buffered for putc.
+ *****************************************************************************/
+/* Longest valid line is 47 characters (8 data bytes, CRLF) */
+#define SAVVY_LOG_READER_LINE_MAX 64u
+
+struct savvy_log_reader {
+	uint8_t _eflags;
+	uint8_t _estate; /* Last error state. */
+
+	/* putc line buffer */
+	char    _line[SAVVY_LOG_READER_LINE_MAX];
+	uint8_t _len;
+
+	/* Rest of overlong line is dropped */
+	bool    _skip;
+
+	size_t _total_frames;
+	size_t _total_errors;
+
+	/* Timeline unwrapping, see _canary_log_reader_unwrap */
+	uint64_t _wrap_us;
+	uint64_t _last_us;
+
+	struct canary_log_reader_frame _frame;
+};
+
+void savvy_log_reader_init(struct savvy_log_reader *self)
+{
+	self->_eflags = 0u;
+	self->_estate = 0u;
+
+	self->_len  = 0u;
+	self->_skip = false;
+
+	self->_total_frames = 0u;
+	self->_total_errors = 0u;
+
+	self->_wrap_us = 0u;
+	self->_last_us = 0u;
+
+	self->_frame.timestamp_us = 0u;
+}
+
+/******************************************************************************
+ * SAVVY PRIVATE
+ *****************************************************************************/
+/* Field layout of a single line, data field repeats `len` times.
+ * Timestamp dot is skipped by the scanner, so it is read in us. */
+const struct _canary_log_reader_field _savvy_log_reader_fields[] = {
+	{ CANARY_LOG_READER_STATE_PARSE_TIMESTAMP, 10u, 10u,
+	  CANARY_LOG_READER_TIMESTAMP_MAX_LEN },
+	{ CANARY_LOG_READER_STATE_PARSE_ID,        16u,  8u,  8u },
+	{ CANARY_LOG_READER_STATE_PARSE_LEN,       10u,  1u,  1u },
+	{ CANARY_LOG_READER_STATE_PARSE_DATA,      16u,  2u,  2u }
+};
+
+/* Empty line, CRLF included */
+bool _savvy_log_reader_is_empty(const char *s, const char *end)
+{
+	return (s == end) || ((*s == '\r') && ((s + 1) == end));
+}
+
+/* Parses a single line (without newline) straight into frame.
+ * On error, sets _estate and _eflags to the failed field and its flags. */
+bool _savvy_log_reader_parse_line(struct savvy_log_reader *self,
+				  const char *s, const char *end,
+				  struct canary_log_reader_frame *frame)
+{
+	const struct _canary_log_reader_field *field =
+						   _savvy_log_reader_fields;
+	uint64_t v;
+	uint8_t  eflags = 0u;
+	uint8_t  estate = 0u;
+	uint8_t  i      = 0u;
+
+	frame->len   = 0u;
+	frame->flags = 0u;
+
+	while ((eflags == 0u) &&
+	       ((field->state != CANARY_LOG_READER_STATE_PARSE_DATA) ||
+		(i < frame->len))) {
+		estate = field->state;
+		eflags = _canary_log_reader_scan_field(&s, end, field, &v);
+
+		switch (field->state) {
+		case CANARY_LOG_READER_STATE_PARSE_TIMESTAMP:
+			frame->timestamp_us = v;
+			break;
+
+		case CANARY_LOG_READER_STATE_PARSE_ID:
+			frame->id = (uint32_t)v;
+			break;
+
+		case CANARY_LOG_READER_STATE_PARSE_LEN:
+			if (v > 8u) {
+				eflags |= CANARY_LOG_READER_EFLAG_OVERFLOW;
+			} else {
+				frame->len = (uint8_t)v;
+			}
+
+			break;
+
+		default:
+			frame->data[i] = (uint8_t)v;
+			i++;
+			break;
+		}
+
+		if (field->state != CANARY_LOG_READER_STATE_PARSE_DATA) {
+			field++;
+		}
+	}
+
+	/* Anything but whitespace after data is more than `len` bytes */
+	while ((eflags == 0u) && (s < end)) {
+		if (_canary_log_reader_chr_table[(uint8_t)*s] !=
+		    (uint8_t)_CANARY_LOG_READER_CHR_SPACE) {
+			eflags |= CANARY_LOG_READER_EFLAG_OVERFLOW;
+		}
+
+		s++;
+	}
+
+	if (eflags != 0u) {
+		self->_estate = estate;
+		self->_eflags = eflags;
+	} else {
+		frame->timestamp_us = _canary_log_reader_unwrap(
+			&self->_wrap_us, &self->_last_us, frame->timestamp_us);
+	}
+
+	return (eflags == 0u);
+}
+
+/******************************************************************************
+ * SAVVY PUBLIC
+ *****************************************************************************/
+/* Parses one character at a time. Line is parsed at newline, frame is then
+ * available in _frame. */
+enum canary_log_reader_event savvy_log_reader_putc(
+				   struct savvy_log_reader *self, const char c)
+{
+	enum canary_log_reader_event ev = CANARY_LOG_READER_EVENT_NONE;
+
+	self->_eflags = 0u;
+
+	if (c != '\n') {
+		if (self->_len < SAVVY_LOG_READER_LINE_MAX) {
+			self->_line[self->_len] = c;
+			self->_len++;
+		} else if (!self->_skip) {
+			self->_skip   = true;
+			self->_estate = CANARY_LOG_READER_STATE_SKIP_LINE;
+			self->_eflags = CANARY_LOG_READER_EFLAG_OVERFLOW;
+
+			ev = CANARY_LOG_READER_EVENT_ERROR;
+			self->_total_errors++;
+		} else {
+			/* Already reported */
+		}
+	} else if (self->_skip || _savvy_log_reader_is_empty(self->_line,
+					       &self->_line[self->_len])) {
+	} else if (_savvy_log_reader_parse_line(self, self->_line,
+				&self->_line[self->_len], &self->_frame)) {
+		ev = CANARY_LOG_READER_EVENT_FRAME_READY;
+		self->_total_frames++;
+	} else {
+		ev = CANARY_LOG_READER_EVENT_ERROR;
+		self->_total_errors++;
+	}
+
+	if (c == '\n') {
+		self->_len  = 0u;
+		self->_skip = false;
+	}
+
+	return ev;
+}
+
+/* Parses whole lines out of `buf` straight into `frames` (up to
+ * `max_frames`), same as canary_log_reader_read. Empty lines are skipped,
+ * lines with errors are counted in _total_errors. Unused tail (incomplete
+ * line, see `consumed`) must be passed again with the next chunk.
+ *
+ * Returns the number of frames written. */
+size_t savvy_log_reader_read(struct savvy_log_reader *self,
+			     const char *buf, size_t size,
+			     struct canary_log_reader_frame *frames,
+			     size_t max_frames, size_t *consumed)
+{
+	const char *s   = buf;
+	const char *end = buf + size;
+	const char *nl;
+	size_t n = 0u;
+
+	while (n < max_frames) {
+		nl = (const char *)memchr(s, '\n', (size_t)(end - s));
+		if (nl == NULL) {
+			break;
+		}
+
+		if (_savvy_log_reader_is_empty(s, nl)) {
+		} else if (_savvy_log_reader_parse_line(self, s, nl,
+							&frames[n])) {
+			n++;
+			self->_total_frames++;
+		} else {
+			self->_total_errors++;
+		}
+
+		s = nl + 1;
+	}
+
+	*consumed = (size_t)(s - buf);
+
+	return n;
+}
+
+/* True if the first line of buffer is a valid SavvyCAN frame */
+bool savvy_log_reader_is_savvy(const char *buf, size_t size)
+{
+	struct savvy_log_reader r;
+	struct canary_log_reader_frame f;
+	const char *nl = (const char *)memchr(buf, '\n', size);
+
+	savvy_log_reader_init(&r);
+
+	return (nl != NULL) && _savvy_log_reader_parse_line(&r, buf, nl, &f);
+}
+
+#endif /* SAVVY_LOG_READER_H */
@@ -0,0 +1,155 @@
+#include "savvy_log_reader.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SAVVY_FILE "../../../savvyCAN/" \
+		   "charging__237_VAC_4A__387_VDC__unknown_fault_at_end.csv"
+
+struct canary_log_reader_frame ref[16384];
+
+/* putc reference, returns number of frames */
+size_t savvy_load_putc(void)
+{
+	struct savvy_log_reader r;
+	FILE *file = fopen(SAVVY_FILE, "r");
+	int   c;
+
+	assert(file);
+
+	savvy_log_reader_init(&r);
+	c = getc(file);
+	while (c != EOF) {
+		if (savvy_log_reader_putc(&r, (char)c) ==
+		    CANARY_LOG_READER_EVENT_FRAME_READY) {
+			ref[r._total_frames - 1u] = r._frame;
+		}
+
+		c = getc(file);
+	}
+
+	fclose(file);
+	assert(r._total_errors == 0u);
+
+	return r._total_frames;
+}
+
+/* Bulk reader must produce the same frames as putc,
+ * regardless of how the file is split into chunks */
+void savvy_test_bulk(size_t n_ref)
+{
+	struct canary_log_reader_frame frames[7];
+	struct savvy_log_reader r;
+	char   buf[100];
+	size_t len = 0u;
+	size_t used;
+	size_t total = 0u;
+	size_t n;
+	size_t k;
+
+	FILE *file = fopen(SAVVY_FILE, "r");
+
+	assert(file);
+
+	savvy_log_reader_init(&r);
+
+	do {
+		len += fread(&buf[len], 1u, sizeof(buf) - len, file);
+
+		do {
+			n = savvy_log_reader_read(&r, buf, len, frames, 7u,
+						  &used);
+
+			for (k = 0u; k < n; k++, total++) {
+				assert(frames[k].timestamp_us ==
+				       ref[total].timestamp_us);
+				assert(frames[k].id  == ref[total].id);
+				assert(frames[k].len == ref[total].len);
+				assert(memcmp(frames[k].data, ref[total].data,
+					      frames[k].len) == 0);
+			}
+
+			len -= used;
+			memmove(buf, &buf[used], len);
+		} while (n > 0u);
+	} while (!feof(file));
+
+	fclose(file);
+
+	assert(total == n_ref);
+	assert(r._total_errors == 0u);
+}
+
+void savvy_test_errors(void)
+{
+	const char *log =
+		"0000.041687 000005E9 8 00 3F 07 01 00 00 00 01\n"
+		"\r\n"
+		"0000.169487 00000219 9 00 00 01 00 73 02 00 00 00\n"
+		"0000.259696 00000209 8 00 A0 00 39 00 06 04\n"
+		"0000.259927 00000229 2 20 90 D1\n"
+		"0000.260173 0239 8 47 41 00 17 00 00 00 00\n"
+		"0000.260173 00000239 2 47 41\r\n";
+	struct canary_log_reader_frame frames[8];
+	struct savvy_log_reader r;
+	size_t used;
+	size_t k;
+
+	savvy_log_reader_init(&r);
+	assert(savvy_log_reader_read(&r, log, strlen(log), frames, 8u,
+				     &used) == 2u);
+	assert(used == strlen(log));
+	assert(r._total_errors == 4u);
+
+	/* Last error was short ID */
+	assert(r._estate == CANARY_LOG_READER_STATE_PARSE_ID);
+	assert(r._eflags == CANARY_LOG_READER_EFLAG_INCOMPLETE);
+
+	assert(frames[0].timestamp_us == 41687u);
+	assert(frames[0].id == 0x5E9u);
+	assert(frames[0].data[7] == 0x01u);
+	assert(frames[1].timestamp_us == 260173u);
+	assert(frames[1].len == 2u);
+
+	/* putc reports the same */
+	savvy_log_reader_init(&r);
+	for (k = 0u; log[k] != '\0'; k++) {
+		(void)savvy_log_reader_putc(&r, log[k]);
+	}
+
+	assert(r._total_frames == 2u);
+	assert(r._total_errors == 4u);
+
+	/* Overlong line is a single error */
+	savvy_log_reader_init(&r);
+	for (k = 0u; k < 200u; k++) {
+		(void)savvy_log_reader_putc(&r, '0');
+	}
+
+	assert(savvy_log_reader_putc(&r, '\n') ==
+	       CANARY_LOG_READER_EVENT_NONE);
+	assert(r._total_errors == 1u);
+
+	/* Canary logs are not SavvyCAN */
+	assert(savvy_log_reader_is_savvy(log, strlen(log)));
+	assert(!savvy_log_reader_is_savvy(
+		"0000.000000 0 00000351 80 6 10 33 71 17 47 88\n", 46u));
+	assert(!savvy_log_reader_is_savvy(
+		"0000.000000 081E56F4 04 4 F1 F0 F0 FC\n", 38u));
+}
+
+int main()
+{
+	size_t n_ref = savvy_load_putc();
+
+	printf("savvyCAN log: %lu frames\n", (unsigned long)n_ref);
+	assert(n_ref == 14554u);
+
+	savvy_test_bulk(n_ref);
+	savvy_test_errors();
+
+	printf("FINISHED\n");
+
+	return 0;
+}
@@ -0,0 +1,838 @@
+/* Monte-Carlo scenario runner: controller against simulated module
+ * (tg3spmc.sim.h), many independent sessions on a pool of threads.
+ *
+ * Every scenario is drawn from its own seed (base seed and index hashed
+ * together, see seed_of): setpoints, grid and battery voltages, ambient
+ * temperature, host wake latency (step jitter), random and burst RX frame
+ * drops, and one module fault of random kind, time and length. A session
+ * runs 60s of virtual time with disturbances, then settles for 20s without
+ * them. Scenario passes if the module charges at the end, every controller
+ * fault was recovered, and the injected fault got the controller reaction
+ * it calls for (see reaction_expected).
+ *
+ * POOL: every worker owns a range of scenario indexes (one 64 bit word,
+ *      begin << 32 | end). The owner takes from the front, idle workers
+ *      steal the back half of a victim range, both by compare and swap.
+ * STATS: workers count into local stats and add them to shared stats
+ *      with atomic adds every STATS_FLUSH scenarios, nothing is locked.
+ *
+ * Scenarios are run with 1, 2, 4 ... threads, stats of every run must
+ * match the single thread run exactly. `-r index` replays one scenario
+ * and prints what happened. */
+
+/* Threads, sysconf and clock_gettime are POSIX, not C89 */
+#define _POSIX_C_SOURCE 200112L
+
+#include "tg3spmc.h"
+#include "tg3spmc.sim.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_WORKERS 64u
+
+/* Virtual time with disturbances, then without (milliseconds) */
+#define SESSION_MS 60000u
+#define SETTLE_MS  20000u
+
+/* Histogram bucket width and count (100ms up to 30s) */
+#define HIST_BUCKET_MS 100u
+#define HIST_BUCKETS   300u
+
+/* Local stats are added to shared stats every this many scenarios */
+#define STATS_FLUSH 256u
+
+/* Fault kinds, FAULT_KINDS is "no fault" */
+#define FAULT_KINDS 6u
+
+#define TIME_NONE 0xFFFFFFFFu
+
+/* Reaction to a fault is checked until it clears and this long after:
+ * host wake latency (50ms) and a module message period, with slack */
+#define REACTION_MARGIN_MS 200u
+
+/* No RX drops this long before a fault, until its reaction is checked, so
+ * a message missed before the fault can't time out first */
+#define QUIET_MS 500u
+
+/* Single message timeout (milliseconds) */
+#define MSG_TIMEOUT_MS \
+	(TG3SPMC_CONST_MSG_TIMEOUT_PERIODS * TG3SPMC_SIM_MSG_PERIOD_MS)
+
+/* Expected reactions besides fault causes (TG3SPMC_FAULT_CAUSE_NONE: no
+ * fault at all) */
+#define REACTION_DERATE    0x10u
+#define REACTION_UNCHECKED 0xFFu
+
+/* Poor cooling derates a module running at high current in a hot place,
+ * held long enough to heat it up */
+#define OVERTEMP_CURRENT_A   12.0f
+#define OVERTEMP_AMBIENT_C   60u
+#define OVERTEMP_HOLD_MIN_MS 30000u
+
+/* Compare and swap of a range word */
+#define RANGE_CAS(p, expected, desired) \
+	__atomic_compare_exchange_n((p), (expected), (desired), 0, \
+				    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define STATS_ADD(p, v) \
+	((void)__atomic_fetch_add((p), (v), __ATOMIC_RELAXED))
+
+const uint8_t faults[FAULT_KINDS] = {
+	TG3SPMC_SIM_FAULT_FLAG,
+	TG3SPMC_SIM_FAULT_BUS_OFF,
+	TG3SPMC_SIM_FAULT_MSG_SILENT,
+	TG3SPMC_SIM_FAULT_AC_LOSS,
+	TG3SPMC_SIM_FAULT_OVERTEMP,
+	TG3SPMC_SIM_FAULT_RESET
+};
+
+const char *fault_names[FAULT_KINDS + 1u] = {
+	"FLAG", "BUS_OFF", "MSG_SILENT", "AC_LOSS", "OVERTEMP", "RESET",
+	"NONE"
+};
+
+const char *event_names[6u] = {
+	"NONE", "CONFIG_INVALID", "POWER_ON", "CHARGE_ENABLED", "FAULT",
+	"RECOVERY"
+};
+
+const char *cause_names[4u] = {
+	"NONE", "RX_TIMEOUT", "FAULT_FLAG", "MSG_TIMEOUT"
+};
+
+struct scenario {
+	uint32_t rng;
+
+	struct tg3spmc_config config;
+	float grid_voltage_V;
+	float battery_voltage_V;
+	float ambient_C;
+	bool  msg_timeout_fault;
+
+	uint32_t jitter_ms;      /* Host wakes up to this late */
+	uint32_t drop_per_mille; /* Random RX frame drops */
+	uint32_t dropout_at_ms;  /* Burst of RX drops */
+	uint32_t dropout_ms;
+
+	uint8_t  fault;          /* Index in faults, FAULT_KINDS: none */
+	uint32_t fault_at_ms;
+	uint32_t fault_ms;
+};
+
+struct stats {
+	uint32_t scenarios;
+	uint32_t failed;
+	uint32_t reactions;                   /* Checked fault reactions */
+	uint32_t events[6u];
+	uint32_t causes[4u];
+	uint32_t charge_hist[HIST_BUCKETS];   /* Power on to charging */
+	uint32_t recovery_hist[HIST_BUCKETS]; /* Fault to charging again */
+	uint32_t charge_max_ms;
+	uint32_t recovery_max_ms;
+};
+
+struct worker {
+	uint64_t range;
+	uint32_t stolen;
+	struct stats local;
+	pthread_t thread;
+};
+
+struct worker workers[MAX_WORKERS];
+uint32_t n_workers;
+
+/* Shared stats, lowest failed scenario index */
+struct stats shared;
+uint32_t first_failed;
+
+uint32_t base_seed = 1u;
+
+/******************************************************************************
+ * SCENARIO
+ *****************************************************************************/
+/* Scrambles base seed and index into a seed: murmur3 finalizer of
+ * base_seed ^ (index * 0x9E3779B9), never 0 */
+uint32_t seed_of(uint32_t index)
+{
+	uint32_t h = base_seed ^ (index * 0x9E3779B9u);
+
+	h ^= h >> 16u;
+	h *= 0x85EBCA6Bu;
+	h ^= h >> 13u;
+	h *= 0xC2B2AE35u;
+	h ^= h >> 16u;
+
+	return (h == 0u) ? 1u : h;
+}
+
+/* xorshift32 */
+uint32_t random_u32(struct scenario *s)
+{
+	s->rng ^= s->rng << 13u;
+	s->rng ^= s->rng >> 17u;
+	s->rng ^= s->rng << 5u;
+
+	return s->rng;
+}
+
+/* Uniform in [lo, hi] */
+uint32_t random_in(struct scenario *s, uint32_t lo, uint32_t hi)
+{
+	return lo + (random_u32(s) % (hi - lo + 1u));
+}
+
+void scenario_make(struct scenario *s, uint32_t index)
+{
+	s->rng = seed_of(index);
+
+	s->config.rated_voltage_ac_V = 240.0f;
+	s->config.voltage_dc_V       = (float)random_in(s, 380u, 400u);
+	s->config.current_ac_A       = (float)random_in(s, 10u, 160u) / 10.0f;
+	s->grid_voltage_V            = (float)random_in(s, 200u, 250u);
+	s->battery_voltage_V         = s->config.voltage_dc_V -
+				       (float)random_in(s, 3u, 20u);
+	s->ambient_C                 = (float)random_in(s, 0u, 40u);
+	s->msg_timeout_fault         = (random_u32(s) & 1u) != 0u;
+
+	s->jitter_ms      = random_in(s, 0u, 50u);
+	s->drop_per_mille = random_in(s, 0u, 50u);
+	s->dropout_at_ms  = random_in(s, 0u, SESSION_MS);
+	s->dropout_ms     = random_in(s, 0u, 1500u);
+
+	s->fault       = (uint8_t)random_in(s, 0u, FAULT_KINDS);
+	s->fault_at_ms = random_in(s, 0u, 40000u);
+	s->fault_ms    = random_in(s, 100u, 5000u);
+
+	/* Derating takes tens of seconds of heating at high current */
+	if ((s->fault < FAULT_KINDS) &&
+	    (faults[s->fault] == TG3SPMC_SIM_FAULT_OVERTEMP)) {
+		if (s->config.current_ac_A < OVERTEMP_CURRENT_A) {
+			s->config.current_ac_A = OVERTEMP_CURRENT_A;
+		}
+
+		s->ambient_C   = (float)random_in(s, OVERTEMP_AMBIENT_C,
+						  OVERTEMP_AMBIENT_C + 8u);
+		s->fault_at_ms = random_in(s, 0u, SESSION_MS -
+					   (OVERTEMP_HOLD_MIN_MS + 10000u));
+		s->fault_ms    = random_in(s, OVERTEMP_HOLD_MIN_MS,
+					   OVERTEMP_HOLD_MIN_MS + 10000u);
+	}
+}
+
+/* Controller reaction the fault of a scenario calls for, as it is
+ * injected: fault cause (TG3SPMC_FAULT_CAUSE_NONE: no fault at all) or
+ * REACTION_DERATE. REACTION_UNCHECKED unless the controller runs and the
+ * module charges (messages not seen yet never time out), or if the fault
+ * is held about as long as the timeout it may trigger. */
+uint8_t reaction_expected(const struct scenario *s, struct tg3spmc *mod,
+			  struct tg3spmc_sim *sim)
+{
+	uint8_t  fault = faults[s->fault];
+	uint8_t  cause = (uint8_t)TG3SPMC_FAULT_CAUSE_RX_TIMEOUT;
+	uint32_t timeout_ms = TG3SPMC_CONST_CAN_RX_TIMEOUT_MS;
+	uint8_t  r = REACTION_UNCHECKED;
+
+	/* A single silent message times out first */
+	if (s->msg_timeout_fault) {
+		cause      = (uint8_t)TG3SPMC_FAULT_CAUSE_MSG_TIMEOUT;
+		timeout_ms = MSG_TIMEOUT_MS;
+	}
+
+	if ((mod->_state != (uint8_t)_TG3SPMC_STATE_RUNNING) ||
+	    !tg3spmc_sim_is_charging(sim)) {
+		/* Nothing to react with */
+	} else if (fault == TG3SPMC_SIM_FAULT_FLAG) {
+		r = (uint8_t)TG3SPMC_FAULT_CAUSE_FAULT_FLAG;
+	} else if ((fault == TG3SPMC_SIM_FAULT_BUS_OFF) ||
+		   ((fault == TG3SPMC_SIM_FAULT_MSG_SILENT) &&
+		    s->msg_timeout_fault)) {
+		/* Silence starts up to a period before the fault */
+		if (s->fault_ms >= (timeout_ms + REACTION_MARGIN_MS)) {
+			r = cause;
+		} else if ((s->fault_ms + TG3SPMC_SIM_MSG_PERIOD_MS +
+			    REACTION_MARGIN_MS) < timeout_ms) {
+			r = (uint8_t)TG3SPMC_FAULT_CAUSE_NONE;
+		} else {
+			/* Too close to the timeout */
+		}
+	} else if (fault == TG3SPMC_SIM_FAULT_OVERTEMP) {
+		r = REACTION_DERATE;
+	} else if ((fault == TG3SPMC_SIM_FAULT_RESET) &&
+		   s->msg_timeout_fault) {
+		/* Reboot silences the module for about a message timeout */
+	} else {
+		/* Silent sensors (timeout off), grid loss, reboot */
+		r = (uint8_t)TG3SPMC_FAULT_CAUSE_NONE;
+	}
+
+	return r;
+}
+
+const char *reaction_name(uint8_t r)
+{
+	const char *name = "unchecked";
+
+	if (r < 4u) {
+		name = cause_names[r];
+	} else if (r == REACTION_DERATE) {
+		name = "DERATE";
+	} else {
+		/* Unchecked */
+	}
+
+	return name;
+}
+
+void hist_add(uint32_t *hist, uint32_t *max_ms, uint32_t t_ms)
+{
+	uint32_t k = t_ms / HIST_BUCKET_MS;
+
+	hist[(k < HIST_BUCKETS) ? k : (HIST_BUCKETS - 1u)]++;
+	*max_ms = (t_ms > *max_ms) ? t_ms : *max_ms;
+}
+
+uint32_t min_u32(uint32_t a, uint32_t b)
+{
+	return (a < b) ? a : b;
+}
+
+/* Controller frames and pins to the module */
+void host_tx(struct tg3spmc *mod, struct tg3spmc_sim *sim)
+{
+	struct tg3spmc_frame f;
+
+	tg3spmc_sim_set_pins(sim, tg3spmc_get_pwron_pin_state(mod),
+			     tg3spmc_get_chgen_pin_state(mod));
+	while (tg3spmc_get_tx_frame(mod, &f)) {
+		(void)tg3spmc_sim_put_rx_frame(sim, &f);
+	}
+
+	tg3spmc_sim_step(sim, 0u);
+}
+
+/* Host wakes on its deadline or on frame arrival, always up to jitter_ms
+ * late. Module moves on its own deadlines, fault and drops follow the
+ * scenario. Returns true if the scenario passed. */
+bool scenario_run(struct scenario *s, struct stats *st, bool verbose)
+{
+	struct tg3spmc mod;
+	struct tg3spmc_sim sim;
+	struct tg3spmc_frame f;
+	enum tg3spmc_event ev;
+	uint32_t end_ms = SESSION_MS + SETTLE_MS;
+	uint32_t fault_end_ms = s->fault_at_ms + s->fault_ms;
+	uint32_t react_end_ms = fault_end_ms + REACTION_MARGIN_MS;
+	uint32_t now = 0u;
+	uint32_t host_ms = 0u;
+	uint32_t last_ms = 0u;
+	uint32_t next;
+	uint32_t fault_ms = TIME_NONE;
+	uint32_t counts[6u] = {0u, 0u, 0u, 0u, 0u, 0u};
+	bool charging = false;
+	bool charged = false;
+	bool derated = false;
+	bool disturbed;
+	bool quiet;
+	bool edge;
+	bool ok;
+	uint8_t react = REACTION_UNCHECKED;
+	uint8_t reacted = (uint8_t)TG3SPMC_FAULT_CAUSE_NONE;
+	uint8_t k;
+	struct tg3spmc_vars v;
+
+	tg3spmc_init(&mod, 1u);
+	tg3spmc_set_config(&mod, s->config);
+	tg3spmc_set_msg_timeout_fault(&mod, s->msg_timeout_fault);
+	tg3spmc_sim_init(&sim, 1u);
+	sim.grid_voltage_V    = s->grid_voltage_V;
+	sim.battery_voltage_V = s->battery_voltage_V;
+	sim.ambient_C         = s->ambient_C;
+	sim.temp_C            = s->ambient_C;
+
+	while (now < end_ms) {
+		next = min_u32(host_ms, end_ms);
+		next = min_u32(next, now + min_u32(
+			       tg3spmc_sim_next_deadline_ms(&sim), end_ms));
+		if ((s->fault < FAULT_KINDS) && (now < s->fault_at_ms)) {
+			next = min_u32(next, s->fault_at_ms);
+		} else if ((s->fault < FAULT_KINDS) && (now < fault_end_ms)) {
+			next = min_u32(next, fault_end_ms);
+		}
+
+		tg3spmc_sim_step(&sim, next - now);
+		now = next;
+		disturbed = (now < SESSION_MS);
+		quiet = (s->fault < FAULT_KINDS) &&
+			((now + QUIET_MS) >= s->fault_at_ms) &&
+			(now < react_end_ms);
+
+		edge = (s->fault < FAULT_KINDS) &&
+		       ((now == s->fault_at_ms) || (now == fault_end_ms));
+		if (edge && (now == s->fault_at_ms)) {
+			react = reaction_expected(s, &mod, &sim);
+			tg3spmc_sim_inject(&sim, faults[s->fault]);
+		} else if (edge) {
+			/* Derated limit, as read by the controller */
+			derated = tg3spmc_read_vars(&mod, &v) &&
+				  (v.current_limit_due_temp_A <
+				   (TG3SPMC_SIM_CURRENT_LIMIT_A - 0.2f));
+			tg3spmc_sim_clear(&sim, faults[s->fault]);
+		}
+
+		if (verbose && edge) {
+			printf("%6ums MODULE fault %s %s", now,
+			       fault_names[s->fault], (now == s->fault_at_ms) ?
+			       "injected" : "cleared");
+			if (now == s->fault_at_ms) {
+				printf(", reaction expected %s",
+				       reaction_name(react));
+			}
+
+			printf("\n");
+		}
+
+		/* Module frames, host wakes up on arrival */
+		while (tg3spmc_sim_get_tx_frame(&sim, &f)) {
+			bool dropped = disturbed && !quiet &&
+				(((now >= s->dropout_at_ms) &&
+				  (now < (s->dropout_at_ms + s->dropout_ms))) ||
+				 ((random_u32(s) % 1000u) < s->drop_per_mille));
+
+			if (!dropped) {
+				(void)tg3spmc_put_rx_frame(&mod, &f);
+				host_ms = min_u32(host_ms, now +
+					  (disturbed ? random_in(s, 0u,
+						       s->jitter_ms) : 0u));
+			}
+		}
+
+		if (now == host_ms) {
+			ev = tg3spmc_step(&mod, now - last_ms);
+			last_ms = now;
+			host_tx(&mod, &sim);
+
+			counts[ev]++;
+			if ((ev == TG3SPMC_EVENT_FAULT) &&
+			    (fault_ms == TIME_NONE)) {
+				fault_ms = now;
+			}
+
+			if (ev == TG3SPMC_EVENT_FAULT) {
+				st->causes[mod.fault_cause & 3u]++;
+			}
+
+			/* First fault since the injected one */
+			if ((ev == TG3SPMC_EVENT_FAULT) &&
+			    (s->fault < FAULT_KINDS) &&
+			    (now >= s->fault_at_ms) && (now <= react_end_ms) &&
+			    (reacted == (uint8_t)TG3SPMC_FAULT_CAUSE_NONE)) {
+				reacted = mod.fault_cause;
+			}
+
+			if (verbose && (ev != TG3SPMC_EVENT_NONE)) {
+				printf("%6ums EVENT %s%s%s\n", now,
+				       event_names[ev],
+				       (ev == TG3SPMC_EVENT_FAULT) ?
+				       ", CAUSE " : "",
+				       (ev == TG3SPMC_EVENT_FAULT) ?
+				       cause_names[mod.fault_cause & 3u] : "");
+			}
+
+			host_ms = now + min_u32(tg3spmc_next_deadline_ms(&mod),
+						1000u) +
+				  (disturbed ? random_in(s, 0u, s->jitter_ms) :
+				   0u);
+		}
+
+		/* Charging (again) */
+		if (tg3spmc_sim_is_charging(&sim) != charging) {
+			charging = !charging;
+
+			if (charging && !charged) {
+				charged = true;
+				hist_add(st->charge_hist, &st->charge_max_ms,
+					 now);
+			}
+
+			if (charging && (fault_ms != TIME_NONE)) {
+				hist_add(st->recovery_hist,
+					 &st->recovery_max_ms, now - fault_ms);
+				fault_ms = TIME_NONE;
+			}
+
+			if (verbose) {
+				printf("%6ums MODULE %s\n", now,
+				       charging ? "charging" : "stopped");
+			}
+		}
+	}
+
+	ok = charging && (counts[TG3SPMC_EVENT_CONFIG_INVALID] == 0u) &&
+	     (counts[TG3SPMC_EVENT_FAULT] == counts[TG3SPMC_EVENT_RECOVERY]);
+
+	/* Derating goes on without fault */
+	if (react == REACTION_DERATE) {
+		ok = ok && derated &&
+		     (reacted == (uint8_t)TG3SPMC_FAULT_CAUSE_NONE);
+	} else if (react != REACTION_UNCHECKED) {
+		ok = ok && (reacted == react);
+	} else {
+		/* Not checked */
+	}
+
+	st->reactions += (react != REACTION_UNCHECKED) ? 1u : 0u;
+
+	if (verbose && (react != REACTION_UNCHECKED)) {
+		printf("reaction: expected %s, got %s%s\n",
+		       reaction_name(react), cause_names[reacted & 3u],
+		       derated ? ", derated" : "");
+	}
+
+	for (k = 1u; k < 6u; k++) {
+		st->events[k] += counts[k];
+	}
+
+	st->scenarios++;
+	st->failed += ok ? 0u : 1u;
+
+	return ok;
+}
+
+void scenario_print(struct scenario *s, uint32_t index)
+{
+	printf("scenario %u (seed 0x%08X): %.0fV %.1fA, grid %.0fV, "
+	       "battery %.0fV, %.0fC, msg timeout fault %s\n", index,
+	       seed_of(index), (double)s->config.voltage_dc_V,
+	       (double)s->config.current_ac_A, (double)s->grid_voltage_V,
+	       (double)s->battery_voltage_V, (double)s->ambient_C,
+	       s->msg_timeout_fault ? "on" : "off");
+	printf("  jitter %ums, drops %u/1000, dropout %ums at %ums, "
+	       "fault %s for %ums at %ums\n", s->jitter_ms, s->drop_per_mille,
+	       s->dropout_ms, s->dropout_at_ms, fault_names[s->fault],
+	       s->fault_ms, s->fault_at_ms);
+}
+
+/******************************************************************************
+ * POOL
+ *****************************************************************************/
+uint64_t range_pack(uint32_t begin, uint32_t end)
+{
+	return ((uint64_t)begin << 32u) | (uint64_t)end;
+}
+
+/* Owner takes from the front */
+bool range_pop(struct worker *w, uint32_t *index)
+{
+	uint64_t r = TG3SPMC_LOAD_ACQUIRE(&w->range);
+	uint32_t begin = (uint32_t)(r >> 32u);
+	uint32_t end   = (uint32_t)r;
+	bool taken = false;
+
+	while ((begin < end) && !taken) {
+		taken = RANGE_CAS(&w->range, &r, range_pack(begin + 1u, end));
+		*index = begin;
+		begin = (uint32_t)(r >> 32u);
+		end   = (uint32_t)r;
+	}
+
+	return taken;
+}
+
+/* Thief takes the back half of a victim range, its own range is empty */
+bool range_steal(struct worker *thief, struct worker *victim)
+{
+	uint64_t r = TG3SPMC_LOAD_ACQUIRE(&victim->range);
+	uint32_t begin = (uint32_t)(r >> 32u);
+	uint32_t end   = (uint32_t)r;
+	uint32_t half  = 0u;
+	bool taken = false;
+
+	while ((begin < end) && !taken) {
+		half  = ((end - begin) + 1u) / 2u;
+		taken = RANGE_CAS(&victim->range, &r,
+				  range_pack(begin, end - half));
+		if (!taken) {
+			begin = (uint32_t)(r >> 32u);
+			end   = (uint32_t)r;
+		}
+	}
+
+	if (taken) {
+		TG3SPMC_STORE_RELEASE(&thief->range,
+				      range_pack(end - half, end));
+		thief->stolen += half;
+	}
+
+	return taken;
+}
+
+void stats_flush(struct stats *local)
+{
+	uint32_t k;
+
+	STATS_ADD(&shared.scenarios, local->scenarios);
+	STATS_ADD(&shared.failed, local->failed);
+	STATS_ADD(&shared.reactions, local->reactions);
+	for (k = 0u; k < 6u; k++) {
+		STATS_ADD(&shared.events[k], local->events[k]);
+	}
+
+	for (k = 0u; k < 4u; k++) {
+		STATS_ADD(&shared.causes[k], local->causes[k]);
+	}
+
+	for (k = 0u; k < HIST_BUCKETS; k++) {
+		if (local->charge_hist[k] > 0u) {
+			STATS_ADD(&shared.charge_hist[k],
+				  local->charge_hist[k]);
+		}
+
+		if (local->recovery_hist[k] > 0u) {
+			STATS_ADD(&shared.recovery_hist[k],
+				  local->recovery_hist[k]);
+		}
+	}
+
+	/* Atomic max */
+	k = TG3SPMC_LOAD_ACQUIRE(&shared.charge_max_ms);
+	while ((local->charge_max_ms > k) &&
+	       !__atomic_compare_exchange_n(&shared.charge_max_ms, &k,
+					    local->charge_max_ms, 0,
+					    __ATOMIC_ACQ_REL,
+					    __ATOMIC_ACQUIRE)) {
+	}
+
+	k = TG3SPMC_LOAD_ACQUIRE(&shared.recovery_max_ms);
+	while ((local->recovery_max_ms > k) &&
+	       !__atomic_compare_exchange_n(&shared.recovery_max_ms, &k,
+					    local->recovery_max_ms, 0,
+					    __ATOMIC_ACQ_REL,
+					    __ATOMIC_ACQUIRE)) {
+	}
+
+	memset(local, 0, sizeof(*local));
+}
+
+/* Lowest failed index, so failures are the same on every run */
+void failed_add(uint32_t index)
+{
+	uint32_t k = TG3SPMC_LOAD_ACQUIRE(&first_failed);
+
+	while ((index < k) &&
+	       !__atomic_compare_exchange_n(&first_failed, &k, index, 0,
+					    __ATOMIC_ACQ_REL,
+					    __ATOMIC_ACQUIRE)) {
+	}
+}
+
+void *worker_run(void *arg)
+{
+	struct worker *w = (struct worker *)arg;
+	struct worker *victim;
+	uint32_t self = (uint32_t)(w - workers);
+	struct scenario s;
+	uint32_t index;
+	uint32_t k;
+	bool busy = true;
+
+	while (busy) {
+		while (range_pop(w, &index)) {
+			scenario_make(&s, index);
+			if (!scenario_run(&s, &w->local, false)) {
+				failed_add(index);
+			}
+
+			if (w->local.scenarios >= STATS_FLUSH) {
+				stats_flush(&w->local);
+			}
+		}
+
+		/* Own range is empty, steal from the others */
+		busy = false;
+		for (k = 1u; (k < n_workers) && !busy; k++) {
+			victim = &workers[(self + k) % n_workers];
+			busy = range_steal(w, victim);
+		}
+	}
+
+	stats_flush(&w->local);
+
+	return NULL;
+}
+
+double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+/* Runs scenarios 0..n-1 on threads, returns wall time (seconds) */
+double pool_run(uint32_t n, uint32_t threads, uint32_t *stolen)
+{
+	uint32_t k;
+	double t0;
+
+	memset(&shared, 0, sizeof(shared));
+	first_failed = TIME_NONE;
+	n_workers = threads;
+	*stolen = 0u;
+
+	/* Even split, stealing balances the rest */
+	for (k = 0u; k < threads; k++) {
+		memset(&workers[k], 0, sizeof(workers[k]));
+		workers[k].range = range_pack((uint32_t)(((uint64_t)n * k) /
+							 threads),
+					      (uint32_t)(((uint64_t)n *
+							  (k + 1u)) / threads));
+	}
+
+	t0 = now_s();
+	for (k = 0u; k < threads; k++) {
+		if (pthread_create(&workers[k].thread, NULL, worker_run,
+				   &workers[k]) != 0) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+
+	for (k = 0u; k < threads; k++) {
+		(void)pthread_join(workers[k].thread, NULL);
+		*stolen += workers[k].stolen;
+	}
+
+	return now_s() - t0;
+}
+
+/******************************************************************************
+ * REPORT
+ *****************************************************************************/
+/* Upper bound of the bucket holding quantile q (milliseconds) */
+uint32_t hist_quantile(const uint32_t *hist, double q)
+{
+	uint32_t total = 0u;
+	uint32_t sum = 0u;
+	uint32_t k;
+
+	for (k = 0u; k < HIST_BUCKETS; k++) {
+		total += hist[k];
+	}
+
+	for (k = 0u; (k < (HIST_BUCKETS - 1u)) &&
+		    ((double)(sum + hist[k]) < (q * (double)total)); k++) {
+		sum += hist[k];
+	}
+
+	return (k + 1u) * HIST_BUCKET_MS;
+}
+
+void hist_print(const char *name, const uint32_t *hist, uint32_t max_ms)
+{
+	printf("%-16s p50 %5ums  p90 %5ums  p99 %5ums  max %5ums\n", name,
+	       hist_quantile(hist, 0.5), hist_quantile(hist, 0.9),
+	       hist_quantile(hist, 0.99), max_ms);
+}
+
+void report(struct stats *st)
+{
+	uint32_t k;
+
+	printf("\n%u scenarios, %u failed", st->scenarios, st->failed);
+	if (st->failed > 0u) {
+		printf(" (first: -s %u -r %u)", base_seed, first_failed);
+	}
+
+	printf(", %u fault reactions checked", st->reactions);
+
+	printf("\nevents:");
+	for (k = 1u; k < 6u; k++) {
+		printf(" %s %u", event_names[k], st->events[k]);
+	}
+
+	printf("\nfault causes:");
+	for (k = 1u; k < 4u; k++) {
+		printf(" %s %u", cause_names[k], st->causes[k]);
+	}
+
+	printf("\n");
+	hist_print("time to charge", st->charge_hist, st->charge_max_ms);
+	hist_print("fault recovery", st->recovery_hist, st->recovery_max_ms);
+}
+
+void usage(void)
+{
+	printf("Usage: monte_carlo [-n scenarios] [-j max_threads] "
+	       "[-s seed] [-r index]\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct stats reference;
+	struct scenario s;
+	uint32_t n = 100000u;
+	uint32_t max_threads = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+	uint32_t replay = TIME_NONE;
+	uint32_t threads;
+	uint32_t stolen;
+	double   t;
+	double   t1 = 0.0;
+	bool     same = true;
+	int      opt;
+
+	while ((opt = getopt(argc, argv, "n:j:s:r:")) != -1) {
+		switch (opt) {
+		case 'n': n = (uint32_t)atol(optarg); break;
+		case 'j': max_threads = (uint32_t)atol(optarg); break;
+		case 's': base_seed = (uint32_t)atol(optarg); break;
+		case 'r': replay = (uint32_t)atol(optarg); break;
+		default: usage(); return 1;
+		}
+	}
+
+	max_threads = (max_threads < 1u) ? 1u : max_threads;
+	max_threads = (max_threads > MAX_WORKERS) ? MAX_WORKERS : max_threads;
+
+	if (replay != TIME_NONE) {
+		memset(&shared, 0, sizeof(shared));
+		scenario_make(&s, replay);
+		scenario_print(&s, replay);
+
+		return scenario_run(&s, &shared, true) ? 0 : 1;
+	}
+
+	printf("threads | scenarios/s | speedup | stolen\n");
+
+	threads = 1u;
+	while (threads <= max_threads) {
+		t = pool_run(n, threads, &stolen);
+		t1 = (threads == 1u) ? t : t1;
+
+		printf("%7u | %11.0f | %6.2fx | %u\n", threads,
+		       (double)n / t, t1 / t, stolen);
+
+		/* Same scenarios, same stats on any number of threads */
+		if (threads == 1u) {
+			reference = shared;
+		} else if (memcmp(&reference, &shared, sizeof(shared)) != 0) {
+			same = false;
+		}
+
+		/* 1, 2, 4 ... and max */
+		threads = (threads == max_threads) ? (max_threads + 1u) :
+			  min_u32(threads * 2u, max_threads);
+	}
+
+	report(&shared);
+
+	if (!same) {
+		printf("stats differ between thread counts\n");
+	}
+
+	return (same && (shared.failed == 0u)) ? 0 : 1;
+}
@@ -0,0 +1,231 @@
+/* Soak test: controller against simulated module (tg3spmc.sim.h).
+ *
+ * Every cycle powers the module up, waits for charging, injects a fault
+ * (kinds rotate), checks the reaction of the controller, clears the fault,
+ * waits for charging again and powers the module off. Setpoints, grid and
+ * battery voltages change every cycle (fixed seed, runs are repeatable).
+ *
+ * Time is virtual, reported rate is cycles per minute of wall time. */
+
+/* getopt and clock_gettime are POSIX, not C89 */
+#define _POSIX_C_SOURCE 200112L
+
+#include "tg3spmc.h"
+#include "tg3spmc.sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Longest way to charging: boot, soft start, relay and current ramp */
+#define CHARGE_WAIT_MS 20000u
+
+/* Virtual time a fault is held */
+#define FAULT_HOLD_MS  3000u
+
+/* Longest way to derating with poor cooling (AC current set high enough to
+ * get there), held until the controller reads a lower limit */
+#define OVERTEMP_HOLD_MS    120000u
+#define OVERTEMP_CURRENT_A  12.0f
+
+#define FAULT_KINDS 6u
+
+struct tg3spmc mod;
+struct tg3spmc_sim sim;
+
+const enum tg3spmc_sim_fault faults[FAULT_KINDS] = {
+	TG3SPMC_SIM_FAULT_FLAG,
+	TG3SPMC_SIM_FAULT_BUS_OFF,
+	TG3SPMC_SIM_FAULT_MSG_SILENT,
+	TG3SPMC_SIM_FAULT_AC_LOSS,
+	TG3SPMC_SIM_FAULT_OVERTEMP,
+	TG3SPMC_SIM_FAULT_RESET
+};
+
+const char *fault_names[FAULT_KINDS] = {
+	"FLAG", "BUS_OFF", "MSG_SILENT", "AC_LOSS", "OVERTEMP", "RESET"
+};
+
+/* Controller fault cause expected for each kind, NONE: no fault */
+const uint8_t fault_causes[FAULT_KINDS] = {
+	TG3SPMC_FAULT_CAUSE_FAULT_FLAG,
+	TG3SPMC_FAULT_CAUSE_RX_TIMEOUT,
+	TG3SPMC_FAULT_CAUSE_MSG_TIMEOUT,
+	TG3SPMC_FAULT_CAUSE_NONE,
+	TG3SPMC_FAULT_CAUSE_NONE,
+	TG3SPMC_FAULT_CAUSE_NONE
+};
+
+uint32_t seed = 12345u;
+uint64_t virtual_ms;
+uint32_t charge_ms_max;
+
+double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+/* Uniform in [lo, hi) */
+float random_in(float lo, float hi)
+{
+	seed = (seed * 1103515245u) + 12345u;
+
+	return lo + ((hi - lo) * (float)(seed >> 8u) / 16777216.0f);
+}
+
+uint8_t run(uint32_t duration_ms)
+{
+	virtual_ms += duration_ms;
+
+	return tg3spmc_sim_run(&sim, &mod, duration_ms);
+}
+
+/* Returns true once the controller reads the current limit derated,
+ * controller events are added to ev */
+bool wait_derating(uint8_t *ev)
+{
+	struct tg3spmc_vars v;
+	uint32_t t = 0u;
+	bool derated = false;
+
+	while (!derated && (t < OVERTEMP_HOLD_MS)) {
+		*ev |= run(1000u);
+		t += 1000u;
+
+		/* Below the cool limit by more than a raw step (0.234375A) */
+		derated = tg3spmc_read_vars(&mod, &v) &&
+			  (v.current_limit_due_temp_A <
+			   (TG3SPMC_SIM_CURRENT_LIMIT_A - 0.2f));
+	}
+
+	return derated;
+}
+
+/* Returns false if charging is not reached in time or controller fails */
+bool wait_charging(void)
+{
+	uint32_t t = 0u;
+	uint8_t ev = 0u;
+
+	while (!tg3spmc_sim_is_charging(&sim) && (t < CHARGE_WAIT_MS)) {
+		ev |= run(100u);
+		t += 100u;
+	}
+
+	charge_ms_max = (t > charge_ms_max) ? t : charge_ms_max;
+
+	return tg3spmc_sim_is_charging(&sim) &&
+	       ((ev & (1u << TG3SPMC_EVENT_FAULT)) == 0u);
+}
+
+bool cycle(uint32_t n)
+{
+	struct tg3spmc_config config;
+	uint8_t k = (uint8_t)(n % FAULT_KINDS);
+	uint8_t ev;
+	bool ok;
+
+	config.rated_voltage_ac_V = 240.0f;
+	config.voltage_dc_V       = random_in(380.0f, 400.0f);
+	config.current_ac_A       = random_in(1.0f, 16.0f);
+
+	sim.grid_voltage_V    = random_in(200.0f, 250.0f);
+	sim.battery_voltage_V = config.voltage_dc_V - random_in(3.0f, 20.0f);
+
+	/* Low currents never heat the module up to derating */
+	if ((faults[k] == TG3SPMC_SIM_FAULT_OVERTEMP) &&
+	    (config.current_ac_A < OVERTEMP_CURRENT_A)) {
+		config.current_ac_A = OVERTEMP_CURRENT_A;
+	}
+
+	tg3spmc_init(&mod, sim._id);
+	tg3spmc_set_config(&mod, config);
+	tg3spmc_set_msg_timeout_fault(&mod, faults[k] ==
+				      TG3SPMC_SIM_FAULT_MSG_SILENT);
+
+	ok = wait_charging();
+
+	tg3spmc_sim_inject(&sim, faults[k]);
+	if (faults[k] == TG3SPMC_SIM_FAULT_OVERTEMP) {
+		ev = 0u;
+		ok = wait_derating(&ev) && ok;
+	} else {
+		ev = run(FAULT_HOLD_MS);
+	}
+	tg3spmc_sim_clear(&sim, faults[k]);
+
+	if (fault_causes[k] == TG3SPMC_FAULT_CAUSE_NONE) {
+		ok = ok && ((ev & (1u << TG3SPMC_EVENT_FAULT)) == 0u);
+	} else {
+		ok = ok && ((ev & (1u << TG3SPMC_EVENT_FAULT)) != 0u) &&
+		     (mod.fault_cause == fault_causes[k]);
+	}
+
+	ok = ok && wait_charging();
+
+	/* Power off, module must go quiet */
+	tg3spmc_init(&mod, sim._id);
+	(void)run(1000u);
+	ok = ok && (tg3spmc_sim_next_deadline_ms(&sim) ==
+		    TG3SPMC_DEADLINE_NONE);
+
+	/* Every module frame reached the controller */
+	ok = ok && (tg3spmc_sim_get_tx_drops(&sim) == 0u);
+
+	if (!ok) {
+		printf("cycle %u: %s failed, state %u, fault cause %u, "
+		       "%u frames dropped\n", n, fault_names[k], sim._state,
+		       mod.fault_cause,
+		       (unsigned)tg3spmc_sim_get_tx_drops(&sim));
+	}
+
+	return ok;
+}
+
+void usage(void)
+{
+	printf("Usage: sim [-n cycles] [-m module_id]\n");
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t cycles = 1000u;
+	uint32_t failed = 0u;
+	uint32_t n;
+	uint8_t  id = 1u;
+	double   t0;
+	double   t;
+	int      opt;
+
+	while ((opt = getopt(argc, argv, "n:m:")) != -1) {
+		switch (opt) {
+		case 'n': cycles = (uint32_t)atol(optarg); break;
+		case 'm': id = (uint8_t)atoi(optarg); break;
+		default: usage(); return 1;
+		}
+	}
+
+	tg3spmc_sim_init(&sim, id);
+
+	t0 = now_s();
+	for (n = 0u; n < cycles; n++) {
+		if (!cycle(n)) {
+			failed++;
+		}
+	}
+
+	t = now_s() - t0;
+
+	printf("sim: %u cycles (%u failed), %.1f virtual hours in %.2fs\n",
+	       cycles, failed, (double)virtual_ms / 3.6e6, t);
+	printf("sim: %.0f cycles/min, %.0fx real time, longest way to "
+	       "charging %ums\n", (double)cycles * 60.0 / t,
+	       (double)virtual_ms / (t * 1000.0), charge_ms_max);
+
+	return (failed == 0u) ? 0 : 1;
+}
@@ -26,6 +26,9 @@
 
 #include "tg3spmc.h"
 #include "tg3spmc.logger.h"
+#include "tg3spmc.sim.h"
+
+#include <string.h>
 
 struct tg3spmc_frame test_frames[] = {
 	{0x207, 8, {0x00, 0x00, 0x00, 0x00, 0xC8, 0x00, 0x04, 0x00}},
@@ -98,6 +101,129 @@ void tg3spmc_test_tx(struct tg3spmc *self)
 	assert(tg3spmc_get_tx_frame(self, &f) == false);
 }
 
+void tg3spmc_test_batch(struct tg3spmc *self)
+{
+	struct tg3spmc_frame out[4];
+	const struct tg3spmc_frame *view;
+
+	assert(tg3spmc_view_tx_frames(self, &view) == 0u);
+	assert(tg3spmc_step(self, 0) == TG3SPMC_EVENT_NONE);
+
+	/* Zero-copy view, frames stay queued until released */
+	assert(tg3spmc_view_tx_frames(self, &view) == 3u);
+	assert(view[0].id == 0x42Cu);
+	assert(view[1].id == 0x45Cu);
+	assert(view[2].id == 0x368u);
+	assert(tg3spmc_view_tx_frames(self, &view) == 3u);
+
+	/* Batch copy keeps tg3spmc_get_tx_frame order */
+	assert(tg3spmc_get_tx_frames(self, out, 2u) == 2u);
+	assert(out[0].id == 0x368u);
+	assert(out[1].id == 0x45Cu);
+	assert(tg3spmc_get_tx_frames(self, out, 4u) == 1u);
+	assert(out[0].id == 0x42Cu);
+	assert(tg3spmc_get_tx_frames(self, out, 4u) == 0u);
+
+	assert(tg3spmc_step(self, 0) == TG3SPMC_EVENT_NONE);
+	tg3spmc_release_tx_frames(self);
+	assert(tg3spmc_view_tx_frames(self, &view) == 0u);
+
+	/* Whole RX array is consumed per call */
+	assert(tg3spmc_put_rx_frames(self, test_frames, 5u) == 5u);
+	assert(self->_io.rx.recv_flags == ((1u << _TG3SPM_MSG_COUNT) - 1u));
+}
+
+/* Cached TX frames must follow config changes and hold release */
+void tg3spmc_test_tx_cache(struct tg3spmc *self)
+{
+	struct tg3spmc saved_state = *self;
+	struct tg3spmc_frame ref[3];
+	struct tg3spmc_frame out[3];
+	struct tg3spmc_config config = self->_config;
+	uint8_t k;
+
+	/* Setpoint change */
+#if defined(TG3SPMC_FIXED_POINT)
+	config.voltage_dc_mV = 400000u;
+#else
+	config.voltage_dc_V = 400.0f;
+#endif
+	tg3spmc_set_config(self, config);
+	assert(tg3spmc_step(self, 0) == TG3SPMC_EVENT_NONE);
+	assert(tg3spmc_get_tx_frames(self, out, 3u) == 3u);
+	assert(out[1].id == 0x45Cu);
+	assert((out[1].data[0] == 0x40u) && (out[1].data[1] == 0x9Cu));
+	assert(out[1].data[3] == 0x0Eu);
+
+	/* Hold release, frames queued after that must be started */
+	tg3spmc_put_rx_frames(self, test_frames, 5u);
+	assert(tg3spmc_step(self, TG3SPMC_CONST_HOLD_START_TIME_MS / 2u) ==
+	       TG3SPMC_EVENT_NONE);
+	tg3spmc_put_rx_frames(self, test_frames, 5u);
+	assert(tg3spmc_step(self, TG3SPMC_CONST_HOLD_START_TIME_MS / 2u + 1u)
+	       == TG3SPMC_EVENT_NONE);
+	assert(tg3spmc_get_tx_frames(self, out, 3u) == 3u);
+	assert(out[1].data[3] == 0x2Eu);
+	assert(out[2].data[1] == 0xBBu);
+
+	/* Cached frames are the same as encoded from scratch */
+	_tg3spmc_encode_frame_h42C(self, &ref[0]);
+	_tg3spmc_encode_frame_h45C(self, &ref[1]);
+	_tg3spmc_encode_frame_h368(self, &ref[2]);
+	for (k = 0u; k < 3u; k++) {
+		assert(ref[k].id  == self->_io.tx.frames[k].id);
+		assert(ref[k].len == self->_io.tx.frames[k].len);
+		assert(memcmp(ref[k].data, self->_io.tx.frames[k].data, 8u)
+		       == 0);
+	}
+
+	*self = saved_state;
+}
+
+/* Hold must be released by module readiness, not only by hold time */
+void tg3spmc_test_readiness(struct tg3spmc *self)
+{
+	struct tg3spmc_frame f[5];
+	struct tg3spmc_frame out[3];
+
+	memcpy(f, test_frames, sizeof(f));
+	f[0].data[1] = 0xEBu; /* 235VAC, charge disallowed */
+
+	/* Module talks, but has not seen initial setup yet */
+	f[1].data[0] = 0x01u; /* chgen pin feedback */
+	tg3spmc_put_rx_frames(self, f, 5u);
+	assert(tg3spmc_step(self, 0u) == TG3SPMC_EVENT_NONE);
+	assert(self->_hold_start == true);
+
+	/* Setup is queued, but not sent yet */
+	tg3spmc_put_rx_frames(self, f, 5u);
+	assert(self->_setup_status == false);
+	assert(tg3spmc_get_tx_frames(self, out, 3u) == 3u);
+	assert(out[1].data[3] == 0x0Eu);
+
+	/* First status after the send may predate the setup */
+	tg3spmc_put_rx_frames(self, f, 5u);
+	assert(tg3spmc_step(self, 0u) == TG3SPMC_EVENT_NONE);
+	assert(self->_hold_start == true);
+
+	/* No chgen pin feedback after setup */
+	f[1].data[0] = 0x00u;
+	tg3spmc_put_rx_frames(self, f, 5u);
+	assert(tg3spmc_step(self, 10u) == TG3SPMC_EVENT_NONE);
+	assert(self->_hold_start == true);
+	assert(self->_setup_acked == true);
+
+	/* Feedback after setup, next frames are started */
+	f[1].data[0] = 0x01u;
+	tg3spmc_put_rx_frames(self, f, 5u);
+	assert(tg3spmc_step(self, 0u) == TG3SPMC_EVENT_NONE);
+	assert(self->_hold_start == false);
+	assert(tg3spmc_step(self, TG3SPMC_CONST_CAN_TX_PERIOD_MS) ==
+	       TG3SPMC_EVENT_NONE);
+	assert(tg3spmc_get_tx_frames(self, out, 3u) == 3u);
+	assert(out[1].data[3] == 0x2Eu);
+}
+
 void tg3spmc_test_read_vars(struct tg3spmc *self)
 {
 	struct tg3spmc_frame invalid = { 0x555u, 8u,
@@ -106,9 +232,16 @@ void tg3spmc_test_read_vars(struct tg3spmc *self)
 	};
 
 	struct tg3spmc_vars v;
+	uint32_t seq;
 
-	/* Before RX */
+	/* Before RX (invalidates what was published before a recovery) */
 	assert(tg3spmc_read_vars(self, &v) == false);
+	assert(tg3spmc_view_vars(self) == NULL);
+	tg3spmc_publish_vars(self);
+	seq = self->_snapshot.seq;
+	tg3spmc_publish_vars(self);
+	assert(self->_snapshot.seq == seq);
+	assert(tg3spmc_snapshot_vars(self, &v) == false);
 
 	/* After invalid RX */
 	tg3spmc_put_rx_frame(self, &invalid);
@@ -123,6 +256,137 @@ void tg3spmc_test_read_vars(struct tg3spmc *self)
 	assert(tg3spmc_read_vars(self, &v) == true);
 }
 
+void tg3spmc_test_lazy_decode(struct tg3spmc *self)
+{
+	struct tg3spmc_vars v;
+
+	/* Frames must be stored raw, without decoding */
+	tg3spmc_put_rx_frame(self, &test_frames[7]);
+	assert(self->_io.rx.dirty_flags == (1u << _TG3SPM_MSG_DC_PARAMS));
+#if defined(TG3SPMC_FIXED_POINT)
+	assert(self->_vars.voltage_dc_mV > 0u);
+#else
+	assert(self->_vars.voltage_dc_V > 0.0f);
+#endif
+
+	/* Only dirty messages are decoded on read */
+	assert(tg3spmc_read_vars(self, &v) == true);
+	assert(self->_io.rx.dirty_flags == 0u);
+#if defined(TG3SPMC_FIXED_POINT)
+	assert(v.voltage_dc_mV == 0u);
+#else
+	assert(v.voltage_dc_V == 0.0f);
+#endif
+
+	tg3spmc_put_rx_frame(self, &test_frames[2]);
+	assert(tg3spmc_read_vars(self, &v) == true);
+#if defined(TG3SPMC_FIXED_POINT)
+	assert(v.voltage_dc_mV > 347000u);
+#else
+	assert(v.voltage_dc_V > 347.0f);
+#endif
+}
+
+void tg3spmc_test_vars_changed(struct tg3spmc *self)
+{
+	const uint16_t dc_status = TG3SPMC_VAR_FLAG_STATUS |
+				   TG3SPMC_VAR_FLAG_VOLTAGE_DC |
+				   TG3SPMC_VAR_FLAG_CURRENT_DC;
+	const struct tg3spmc_vars *view;
+	struct tg3spmc_vars v;
+
+	/* Everything was just read */
+	assert(tg3spmc_vars_changed(self) == 0u);
+
+	/* Same values are not a change */
+	tg3spmc_put_rx_frame(self, &test_frames[5]);
+	tg3spmc_put_rx_frame(self, &test_frames[8]);
+	tg3spmc_put_rx_frame(self, &test_frames[9]);
+	assert(tg3spmc_vars_changed(self) == 0u);
+
+	tg3spmc_put_rx_frame(self, &test_frames[6]);
+	tg3spmc_put_rx_frame(self, &test_frames[7]);
+	assert(tg3spmc_vars_changed(self) == dc_status);
+
+	/* View is not a copy, changes are kept until release */
+	view = tg3spmc_view_vars(self);
+	assert(view == &self->_vars);
+	assert(view->status == 0x02u);
+	assert(tg3spmc_vars_changed(self) == dc_status);
+	tg3spmc_release_vars(self);
+	assert(tg3spmc_vars_changed(self) == 0u);
+
+	/* Changes accumulate over decodes until read */
+	tg3spmc_put_rx_frame(self, &test_frames[1]);
+	assert(tg3spmc_view_vars(self)->status == 0x00u);
+	tg3spmc_put_rx_frame(self, &test_frames[2]);
+	assert(tg3spmc_vars_changed(self) == dc_status);
+	assert(tg3spmc_read_vars(self, &v) == true);
+	assert(tg3spmc_vars_changed(self) == 0u);
+}
+
+/* Published snapshot is a copy of vars, republished on change only */
+void tg3spmc_test_snapshot(struct tg3spmc *self)
+{
+	struct tg3spmc_vars v;
+	struct tg3spmc_vars snap;
+	uint32_t seq;
+
+	assert(tg3spmc_snapshot_vars(self, &snap) ==
+	       (self->_snapshot.valid != 0u));
+	assert(tg3spmc_read_vars(self, &v) == true);
+
+	tg3spmc_publish_vars(self);
+	assert(tg3spmc_snapshot_vars(self, &snap) == true);
+	assert(memcmp(&snap, &v, sizeof(v)) == 0);
+
+	/* Same values are not published again */
+	seq = self->_snapshot.seq;
+	tg3spmc_put_rx_frame(self, &test_frames[2]);
+	tg3spmc_publish_vars(self);
+	assert(self->_snapshot.seq == seq);
+
+	/* Decoded by the publication, not by the reader */
+	tg3spmc_put_rx_frame(self, &test_frames[7]);
+	assert(tg3spmc_snapshot_vars(self, &snap) == true);
+	assert(memcmp(&snap, &v, sizeof(v)) == 0);
+
+	tg3spmc_publish_vars(self);
+	assert(self->_snapshot.seq == (seq + 2u));
+	assert(tg3spmc_snapshot_vars(self, &snap) == true);
+	assert(tg3spmc_read_vars(self, &v) == true);
+	assert(memcmp(&snap, &v, sizeof(v)) == 0);
+}
+
+/* Snapshot is invalidated once the module goes silent (state modified) */
+void tg3spmc_test_snapshot_silent(struct tg3spmc *self)
+{
+	struct tg3spmc_vars v;
+	struct tg3spmc_vars snap;
+	uint32_t seq;
+
+	tg3spmc_publish_vars(self);
+	assert(tg3spmc_snapshot_vars(self, &snap) == true);
+	seq = self->_snapshot.seq;
+
+	/* Silent module is published as invalid, once */
+	assert(tg3spmc_step(self, TG3SPMC_CONST_CAN_RX_TIMEOUT_MS) ==
+	       TG3SPMC_EVENT_FAULT);
+	tg3spmc_publish_vars(self);
+	assert(self->_snapshot.seq == (seq + 2u));
+	assert(tg3spmc_snapshot_vars(self, &snap) == false);
+	tg3spmc_publish_vars(self);
+	assert(self->_snapshot.seq == (seq + 2u));
+
+	/* Valid again as soon as the module talks */
+	tg3spmc_put_rx_frames(self, test_frames, 5u);
+	tg3spmc_publish_vars(self);
+	assert(self->_snapshot.seq == (seq + 4u));
+	assert(tg3spmc_snapshot_vars(self, &snap) == true);
+	assert(tg3spmc_read_vars(self, &v) == true);
+	assert(memcmp(&snap, &v, sizeof(v)) == 0);
+}
+
 /* Normal initial state test, should also pass after error recovery */
 void tg3spmc_test_normal_init(struct tg3spmc *self)
 {
@@ -136,11 +400,29 @@ void tg3spmc_test_normal_init(struct tg3spmc *self)
 	tg3spmc_set_broadcast(self, false);
 	tg3spmc_test_tx_no_broadcast(self);
 
+	*self = saved_state; /* Load saved state */
+	tg3spmc_set_broadcast(self, true);
+	tg3spmc_test_batch(self);
+
+	*self = saved_state; /* Load saved state */
+	tg3spmc_set_broadcast(self, true);
+	tg3spmc_test_tx_cache(self);
+
+	*self = saved_state; /* Load saved state */
+	tg3spmc_test_readiness(self);
+
 	*self = saved_state; /* Load saved state */
 	tg3spmc_set_broadcast(self, true);
 	tg3spmc_test_tx(self);
 
 	tg3spmc_test_read_vars(self);
+	tg3spmc_test_lazy_decode(self);
+	tg3spmc_test_vars_changed(self);
+	tg3spmc_test_snapshot(self);
+
+	saved_state = *self; /* Save state */
+	tg3spmc_test_snapshot_silent(self);
+	*self = saved_state; /* Load saved state */
 }
 
 void tg3spmc_test_rx_timeout(struct tg3spmc *self)
@@ -173,26 +455,955 @@ void tg3spmc_test_mod_fault(struct tg3spmc *self)
 	assert(tg3spmc_step(self, 0u) == TG3SPMC_EVENT_NONE);
 }
 
+/* Host loop steps every `period` ms, fault frame lands in between and is
+ * put with its RX time. Returns time from fault frame to pin drop, as seen
+ * by the host (ms) */
+uint32_t tg3spmc_test_fault_latency(struct tg3spmc *self, bool fast,
+				    uint32_t period, uint32_t arrival)
+{
+	struct tg3spmc_frame f = test_frames[0];
+	uint32_t uptime = self->_uptime_ms;
+	uint32_t t;
+
+	tg3spmc_set_fast_fault(self, fast);
+	f.data[2] = 0xFF; /* put fault artifically */
+
+	for (t = 1u; t < (arrival + (2u * period)); t++) {
+		if (t == arrival) {
+			tg3spmc_put_rx_frame_at(self, &f, uptime + t);
+		}
+
+		if ((t % period) == 0u) {
+			tg3spmc_step(self, period);
+		}
+
+		if (!tg3spmc_get_pwron_pin_state(self) &&
+		    !tg3spmc_get_chgen_pin_state(self)) {
+			break;
+		}
+	}
+
+	assert(t >= arrival);
+	/* Drop time is exact: RX time (fast) or step time */
+	assert(self->fault_time_ms == (uptime + t));
+
+	return t - arrival;
+}
+
+void tg3spmc_test_fast_fault(struct tg3spmc *self)
+{
+	struct tg3spmc saved_state = *self;
+	struct tg3spmc_frame f = test_frames[0];
+
+	/* Frame level check needs no instance */
+	f.data[2] = 0xFF; /* put fault artifically */
+	assert(tg3spmc_frame_has_fault(0u, &f));
+	assert(!tg3spmc_frame_has_fault(1u, &f));
+	assert(!tg3spmc_frame_has_fault(0u, &test_frames[0]));
+	assert(!tg3spmc_frame_has_fault(0u, &test_frames[1]));
+
+	/* Default: pins wait for the next step */
+	assert(tg3spmc_test_fault_latency(self, false, 50u, 120u) == 30u);
+	assert(self->_state == _TG3SPMC_STATE_FAULT);
+
+	/* Fast: pins drop inside tg3spmc_put_rx_frame */
+	*self = saved_state;
+	assert(tg3spmc_test_fault_latency(self, true, 50u, 120u) == 0u);
+	assert(self->fault_time_ms == (saved_state._uptime_ms + 120u));
+	assert(self->_state == _TG3SPMC_STATE_RUNNING);
+	assert(tg3spmc_step(self, 0u) == TG3SPMC_EVENT_FAULT);
+	assert(self->fault_cause == TG3SPMC_FAULT_CAUSE_FAULT_FLAG);
+
+	/* Clean frame before the step must not hide the latched fault */
+	*self = saved_state;
+	assert(tg3spmc_test_fault_latency(self, true, 50u, 120u) == 0u);
+	tg3spmc_put_rx_frame(self, &test_frames[0]);
+	assert(tg3spmc_step(self, 0u) == TG3SPMC_EVENT_FAULT);
+	assert(self->fault_cause == TG3SPMC_FAULT_CAUSE_FAULT_FLAG);
+	assert(tg3spmc_get_pwron_pin_state(self) == false);
+	assert(tg3spmc_get_chgen_pin_state(self) == false);
+
+	/* Valid frames must not trip the fast path */
+	*self = saved_state;
+	tg3spmc_set_fast_fault(self, true);
+	tg3spmc_put_rx_frame(self, &test_frames[0]);
+	assert(tg3spmc_get_chgen_pin_state(self) == true);
+
+	*self = saved_state;
+}
+
+void tg3spmc_test_dispatch(void)
+{
+	struct tg3spmc_dispatch d;
+	struct tg3spmc mods[3];
+	struct tg3spmc_frame f = test_frames[1]; /* 0x217 status */
+	uint8_t m;
+
+	tg3spmc_dispatch_init(&d);
+
+	for (m = 0u; m < 3u; m++) {
+		tg3spmc_init(&mods[m], m);
+		tg3spmc_dispatch_attach(&d, &mods[m]);
+	}
+
+	/* Foreign and extended IDs are rejected */
+	f.id = 0x351u;
+	assert(tg3spmc_dispatch_put_rx_frame(&d, &f) == false);
+	f.id = 0x10000217u;
+	assert(tg3spmc_dispatch_put_rx_frame(&d, &f) == false);
+	f.id = 0x218u;
+	assert(tg3spmc_dispatch_put_rx_frame(&d, &f) == false);
+
+	/* Frame is routed only to the owning module */
+	f.id = 0x217u + 2u;
+	assert(tg3spmc_dispatch_put_rx_frame(&d, &f) == true);
+	assert(mods[0]._io.rx.recv_flags == 0u);
+	assert(mods[1]._io.rx.recv_flags == (1u << _TG3SPM_MSG_STATUS));
+	assert(mods[2]._io.rx.recv_flags == 0u);
+
+	/* Side channels are accepted, but not stored */
+	f.id = 0x717u + 4u;
+	assert(tg3spmc_dispatch_put_rx_frame(&d, &f) == true);
+	assert(mods[2]._io.rx.recv_flags == 0u);
+}
+
+void tg3spmc_test_charger(struct tg3spmc_config config)
+{
+	struct tg3spmc_charger c;
+	struct tg3spmc_frame out[8];
+	struct tg3spmc_vars vars[3];
+	enum tg3spmc_event ev[3];
+	uint8_t n;
+	uint8_t k;
+
+	/* Modules 1 and 2 only */
+	tg3spmc_charger_init(&c, 0x06u);
+	tg3spmc_charger_set_config(&c, config);
+
+	tg3spmc_charger_step(&c, 0u, ev);
+	assert(ev[0] == TG3SPMC_EVENT_NONE);
+	assert(ev[1] == TG3SPMC_EVENT_POWER_ON);
+	assert(ev[2] == TG3SPMC_EVENT_POWER_ON);
+
+	tg3spmc_charger_step(&c, TG3SPMC_CONST_BOOT_TIME_MS, ev);
+	assert(ev[1] == TG3SPMC_EVENT_CHARGE_ENABLED);
+	assert(ev[2] == TG3SPMC_EVENT_CHARGE_ENABLED);
+
+	/* One 0x42C per module, broadcast frames only once */
+	tg3spmc_charger_step(&c, 0u, ev);
+	n = tg3spmc_charger_get_tx_frames(&c, out, 8u);
+	assert(n == 4u);
+	assert(out[0].id == 0x43Cu);
+	assert(out[1].id == 0x44Cu);
+	assert(out[2].id == 0x45Cu);
+	assert(out[3].id == 0x368u);
+	assert(tg3spmc_charger_get_tx_frames(&c, out, 8u) == 0u);
+
+	/* Frames are routed to the owning module only */
+	for (k = 0u; k < 5u; k++) {
+		out[k] = test_frames[k];
+		out[k].id += 4u;
+	}
+	assert(tg3spmc_charger_put_rx_frames(&c, out, 5u) == 5u);
+	assert(tg3spmc_charger_read_vars(&c, vars) == 0x04u);
+	assert(vars[2].temp1_C == 20);
+}
+
+/* Module 0 goes silent and faults, modules 1 and 2 keep running: broadcast
+ * moves to module 1 and is still sent once per period */
+void tg3spmc_test_charger_failover(struct tg3spmc_config config)
+{
+	struct tg3spmc_charger c;
+	struct tg3spmc_frame rx[10];
+	struct tg3spmc_frame out[8];
+	enum tg3spmc_event ev[3];
+	uint32_t fault_ms = 0u;
+	uint32_t t;
+	uint8_t n_42C = 0u;
+	uint8_t n_43C = 0u;
+	uint8_t n_45C = 0u;
+	uint8_t n_368 = 0u;
+	uint8_t n;
+	uint8_t k;
+
+	for (k = 0u; k < 5u; k++) {
+		rx[k]      = test_frames[k];
+		rx[k].id  += 2u;
+		rx[k + 5u] = test_frames[k];
+		rx[k + 5u].id += 4u;
+	}
+
+	tg3spmc_charger_init(&c, 0x07u);
+	tg3spmc_charger_set_config(&c, config);
+
+	tg3spmc_charger_step(&c, 0u, ev);
+	tg3spmc_charger_step(&c, TG3SPMC_CONST_BOOT_TIME_MS, ev);
+	assert(ev[0] == TG3SPMC_EVENT_CHARGE_ENABLED);
+	assert(ev[1] == TG3SPMC_EVENT_CHARGE_ENABLED);
+	assert(ev[2] == TG3SPMC_EVENT_CHARGE_ENABLED);
+	(void)tg3spmc_charger_get_tx_frames(&c, out, 8u);
+
+	for (t = 10u; t <= 2000u; t += 10u) {
+		if ((t % 100u) == 0u) {
+			assert(tg3spmc_charger_put_rx_frames(&c, rx, 10u) ==
+			       10u);
+		}
+
+		tg3spmc_charger_step(&c, 10u, ev);
+		assert(ev[1] != TG3SPMC_EVENT_FAULT);
+		assert(ev[2] != TG3SPMC_EVENT_FAULT);
+
+		if (ev[0] == TG3SPMC_EVENT_FAULT) {
+			assert(fault_ms == 0u);
+			fault_ms = t;
+		}
+
+		n = tg3spmc_charger_get_tx_frames(&c, out, 8u);
+
+		/* Module 0 stays in FAULT for the recovery time */
+		if ((fault_ms == 0u) || (t <= fault_ms) ||
+		    (t >= fault_ms + TG3SPMC_CONST_FAULT_RECOVERY_TIME_MS)) {
+			continue;
+		}
+
+		for (k = 0u; k < n; k++) {
+			n_42C += (uint8_t)(out[k].id == 0x42Cu);
+			n_43C += (uint8_t)(out[k].id == 0x43Cu);
+			n_45C += (uint8_t)(out[k].id == 0x45Cu);
+			n_368 += (uint8_t)(out[k].id == 0x368u);
+		}
+	}
+
+	assert(fault_ms >= TG3SPMC_CONST_CAN_RX_TIMEOUT_MS);
+	assert(c._modules[0].fault_cause == TG3SPMC_FAULT_CAUSE_RX_TIMEOUT);
+
+	assert(n_42C == 0u);
+	assert(n_43C >= 10u);
+	assert(n_45C == n_43C);
+	assert(n_368 == n_43C);
+}
+
+/* RX schedule for deadline test: frames every 100ms within two windows,
+ * fault flag at 8000ms. Returns true if frames arrive at `t`. */
+bool tg3spmc_test_deadline_rx(uint32_t t, struct tg3spmc_frame *f)
+{
+	bool arrives = ((t % 100u) == 0u) &&
+		       (((t >= 1500u) && (t <= 4000u)) ||
+			((t >= 7500u) && (t <= 9000u)));
+
+	memcpy(f, test_frames, sizeof(struct tg3spmc_frame) * 5u);
+
+	if (t == 8000u) {
+		f[0].data[2] = 0x04u;
+	}
+
+	return arrives;
+}
+
+/* TX sets sent by a host, in order */
+struct tg3spmc_test_tx_log {
+	struct tg3spmc_frame frames[192u][3u];
+	uint32_t ms[192u];
+	uint8_t  len[192u];
+	uint32_t n;
+};
+
+/* Host sends due frames after every step */
+void tg3spmc_test_deadline_tx(struct tg3spmc *self, uint32_t t,
+			      struct tg3spmc_test_tx_log *log)
+{
+	uint8_t n = tg3spmc_get_tx_frames(self, log->frames[log->n], 3u);
+
+	if (n > 0u) {
+		assert(log->n < 192u);
+		log->ms[log->n]  = t;
+		log->len[log->n] = n;
+		log->n++;
+	}
+}
+
+/* Host sleeping until tg3spmc_next_deadline_ms (or frame arrival) must
+ * behave exactly as a host polling tg3spmc_step every millisecond */
+void tg3spmc_test_next_deadline(struct tg3spmc_config config)
+{
+	static struct tg3spmc_test_tx_log tx_poll;
+	static struct tg3spmc_test_tx_log tx_tickless;
+	struct tg3spmc poll;
+	struct tg3spmc tickless;
+	struct tg3spmc_frame rx[5];
+	uint32_t ev_poll[32];
+	uint32_t ev_tickless[32];
+	uint8_t  n_poll = 0u;
+	uint8_t  n_tickless = 0u;
+	uint32_t t;
+	uint32_t next = 0u;
+	uint32_t last = 0u;
+	uint32_t steps = 0u;
+	uint32_t deadline;
+	uint8_t  k;
+	enum tg3spmc_event ev;
+
+	tg3spmc_init(&poll, 0u);
+	tg3spmc_init(&tickless, 0u);
+	tg3spmc_set_config(&poll, config);
+	tg3spmc_set_config(&tickless, config);
+	tx_poll.n = 0u;
+	tx_tickless.n = 0u;
+
+	for (t = 0u; t <= 12500u; t++) {
+		bool arrives = tg3spmc_test_deadline_rx(t, rx);
+
+		/* Reference: busy polling host. Time is advanced first, then
+		 * frames are delivered and evaluated by zero time steps */
+		for (k = 0u; k < 5u; k++) {
+			if ((k == 1u) && arrives) {
+				tg3spmc_put_rx_frames(&poll, rx, 5u);
+			}
+
+			ev = tg3spmc_step(&poll, ((k == 0u) && (t > 0u)) ?
+					  1u : 0u);
+			tg3spmc_test_deadline_tx(&poll, t, &tx_poll);
+			if (ev != TG3SPMC_EVENT_NONE) {
+				assert(n_poll < 32u);
+				ev_poll[n_poll++] = (t << 4u) | ev;
+			}
+		}
+
+		/* Tickless host: wake on deadline or frame arrival only */
+		if (arrives || (t == next)) {
+			deadline = 0u;
+			for (k = 0u; (k < (arrives ? 2u : 1u)) ||
+				     (deadline == 0u); k++) {
+				if ((k == 1u) && arrives) {
+					tg3spmc_put_rx_frames(&tickless, rx,
+							      5u);
+				}
+
+				ev = tg3spmc_step(&tickless, t - last);
+				last = t;
+				steps++;
+				tg3spmc_test_deadline_tx(&tickless, t,
+							 &tx_tickless);
+
+				if (ev != TG3SPMC_EVENT_NONE) {
+					assert(n_tickless < 32u);
+					ev_tickless[n_tickless++] =
+						(t << 4u) | ev;
+				}
+
+				deadline = tg3spmc_next_deadline_ms(&tickless);
+			}
+
+			assert(deadline != TG3SPMC_DEADLINE_NONE);
+			next = t + deadline;
+		}
+	}
+
+	/* Same events, at the same time (4 boots, 3 faults, 3 recoveries):
+	 * RX timeout at 5000, fault flag at 8000, RX timeout at 11000 */
+	assert(n_poll == n_tickless);
+	assert(n_poll == 13u);
+	assert(memcmp(ev_poll, ev_tickless, sizeof(ev_poll[0]) * n_poll) == 0);
+
+	/* Same frames, in the same order. TX timer runs from power on, so
+	 * RUNNING starts with a catch-up burst of TX sets: tickless host
+	 * sends it at once (deadline 0), polling host one set per step, up
+	 * to 2ms later. Any other set goes out at the same time. */
+	assert(tx_poll.n == tx_tickless.n);
+	for (k = 0u; k < tx_poll.n; k++) {
+		assert(tx_poll.len[k] == tx_tickless.len[k]);
+		assert(memcmp(tx_poll.frames[k], tx_tickless.frames[k],
+			      sizeof(tx_poll.frames[k][0]) * tx_poll.len[k])
+		       == 0);
+		assert(tx_poll.ms[k] >= tx_tickless.ms[k]);
+		assert(tx_poll.ms[k] <= (tx_tickless.ms[k] + 2u));
+		if (((k == 0u) || (tx_tickless.ms[k - 1u] != tx_tickless.ms[k]))
+		    && (((k + 1u) == tx_poll.n) ||
+			(tx_tickless.ms[k + 1u] != tx_tickless.ms[k]))) {
+			assert(tx_poll.ms[k] == tx_tickless.ms[k]);
+		}
+	}
+
+	/* And host was sleeping most of the time */
+	assert(steps < (12500u / 20u));
+}
+
+void tg3spmc_test_can_filters(void)
+{
+	struct tg3spmc_can_filter f[_TG3SPMC_FILTER_MAX_IDS];
+	uint32_t ids[_TG3SPMC_FILTER_MAX_IDS];
+	uint8_t  n_ids;
+	uint8_t  n;
+	uint8_t  m;
+	uint8_t  k;
+	uint8_t  i;
+	bool     accepted;
+
+	/* Single mask for module 1: 0x209..0x249 varies in bits 4-6 only */
+	n = tg3spmc_build_can_filters(0x02u, false, f, 1u);
+	assert(n == 1u);
+	assert((f[0].id == 0x209u) && (f[0].mask == 0x78Fu));
+	assert(tg3spmc_can_filters_false_accepts(f, n, 0x02u, false) == 3u);
+
+	/* Enough filters give exact match */
+	n = tg3spmc_build_can_filters(0x07u, true, f,
+				      _TG3SPMC_FILTER_MAX_IDS);
+	assert(n == _TG3SPMC_FILTER_MAX_IDS);
+	assert(tg3spmc_can_filters_false_accepts(f, n, 0x07u, true) == 0u);
+
+	/* Every used ID must be accepted with any filter count */
+	n_ids = _tg3spmc_filter_collect_ids(0x07u, true, ids);
+	for (m = 1u; m <= 4u; m++) {
+		n = tg3spmc_build_can_filters(0x07u, true, f, m);
+		assert(n <= m);
+
+		for (i = 0u; i < n_ids; i++) {
+			accepted = false;
+
+			for (k = 0u; k < n; k++) {
+				accepted = accepted ||
+				    ((ids[i] & f[k].mask) == (f[k].id & f[k].mask));
+			}
+
+			assert(accepted);
+		}
+	}
+}
+
+#if defined(TG3SPMC_FIXED_POINT)
+/* Float config is rounded to mV/mA, never converted out of range */
+void tg3spmc_test_config_float(void)
+{
+	struct tg3spmc mod;
+	struct tg3spmc_config_float c;
+
+	tg3spmc_init(&mod, 0u);
+
+	c.rated_voltage_ac_V = 240.0004f;
+	c.voltage_dc_V       = 390.0006f;
+	c.current_ac_A       = -4.0f;
+	tg3spmc_set_config_float(&mod, c);
+	assert(mod._config.rated_voltage_ac_mV == 240000u);
+	assert(mod._config.voltage_dc_mV == 390001u);
+	assert(mod._config.current_ac_mA == 0u);
+
+	c.current_ac_A = 1e12f;
+	tg3spmc_set_config_float(&mod, c);
+	assert(mod._config.current_ac_mA == 0xFFFFFFFFu);
+
+	/* Negative voltage is below minimum, enforced by set_config */
+	c.voltage_dc_V = -390.0f;
+	tg3spmc_set_config_float(&mod, c);
+	assert(mod._config.voltage_dc_mV == TG3SPMC_CONST_MIN_DC_VOLTAGE_MV);
+
+	/* Text log rounds tenths, as %5.1f does in float build */
+	assert(_tg3spmc_log_deci(1949u) == 19u);
+	assert(_tg3spmc_log_deci(1950u) == 20u);
+}
+
+/* Fixed point decoders must stay within documented error bound [0, 1) */
+void tg3spmc_test_fixed_point_error_bound(void)
+{
+	struct tg3spmc_vars v;
+	uint8_t d[8] = { 0u, 0u, 0u, 0u, 0u, 0u, 0u, 0u };
+	uint32_t raw;
+	double ref;
+
+	/* Decoders compare with previous values */
+	memset(&v, 0, sizeof(v));
+
+	for (raw = 0u; raw <= 0xFFFFu; raw++) {
+		d[2] = (uint8_t)(raw & 0xFFu);
+		d[3] = (uint8_t)(raw >> 8u);
+		d[4] = d[2];
+		d[5] = d[3];
+		(void)_tg3spm_decode_dc_params(&v, d);
+
+		ref = raw * 700000.0 / 0xFFFF;
+		assert(((ref - v.voltage_dc_mV) >= 0.0) &&
+		       ((ref - v.voltage_dc_mV) <  1.0));
+
+		ref = raw * 50000.0 / 0xFFFF;
+		assert(((ref - v.current_dc_mA) >= 0.0) &&
+		       ((ref - v.current_dc_mA) <  1.0));
+	}
+
+	for (raw = 0u; raw <= 0x3FFu; raw++) {
+		d[5] = (uint8_t)(raw & 0xFFu);
+		d[6] = (uint8_t)(raw >> 8u);
+		(void)_tg3spm_decode_ac_params(&v, d);
+
+		ref = 70.710678118 * (raw >> 1u);
+		assert(((ref - v.current_ac_mA) >= 0.0) &&
+		       ((ref - v.current_ac_mA) <  1.0));
+	}
+
+	for (raw = 0u; raw <= 0xFFu; raw++) {
+		d[0] = (uint8_t)raw;
+		(void)_tg3spm_decode_limits(&v, d);
+
+		ref = 234.375 * raw;
+		assert(((ref - v.current_limit_due_temp_mA) >= 0.0) &&
+		       ((ref - v.current_limit_due_temp_mA) <  1.0));
+	}
+}
+#endif
+
+/* Feeds all module 0 messages but `skip` (index in test_frames) */
+void tg3spmc_test_rx_period(struct tg3spmc *self, uint32_t delta_ms,
+			    uint8_t skip, enum tg3spmc_event ev)
+{
+	uint8_t k;
+
+	assert(tg3spmc_step(self, delta_ms) == ev);
+
+	for (k = 0u; k < 5u; k++) {
+		if (k != skip) {
+			tg3spmc_put_rx_frame(self, &test_frames[k]);
+		}
+	}
+
+	assert(tg3spmc_step(self, 0u) == TG3SPMC_EVENT_NONE);
+}
+
+/* Per message statistics, a single silent message is caught early */
+void tg3spmc_test_rx_health(struct tg3spmc *self)
+{
+	struct tg3spmc saved_state;
+	struct tg3spmc_rx_health h;
+	uint32_t last_ms;
+	uint8_t k;
+
+	assert(!tg3spmc_get_rx_health(self, 0x100u, &h));
+
+	/* Periods of 103 and 98ms, 0x227 is lost once */
+	_tg3spmc_reader_init(&self->_io.rx);
+	for (k = 0u; k < 10u; k++) {
+		tg3spmc_test_rx_period(self, ((k % 2u) != 0u) ? 103u : 98u,
+				       (k == 5u) ? 2u : 0xFFu,
+				       TG3SPMC_EVENT_NONE);
+	}
+
+	assert(tg3spmc_get_rx_health(self, 0x207u, &h));
+	assert(h.periods == 9u);
+	assert(h.period_ms == 103u);
+	assert(h.jitter_min_ms == -2);
+	assert(h.jitter_max_ms == 3);
+	assert(h.jitter_sum_ms == 7);
+	assert(h.missed == 0u);
+	assert(!h.stale);
+
+	assert(tg3spmc_get_rx_health(self, 0x227u, &h));
+	assert(h.periods == 8u);
+	assert(h.missed == 1u);
+	assert(h.jitter_max_ms == 3);
+	assert(!h.stale);
+
+	/* Side channel was never received */
+	assert(tg3spmc_get_rx_health(self, 0x717u, &h));
+	assert((h.periods == 0u) && !h.stale);
+
+	saved_state = *self;
+
+	/* 0x227 goes silent, global RX timeout does not see it */
+	for (k = 0u; k < 12u; k++) {
+		tg3spmc_test_rx_period(self, 100u, 2u, TG3SPMC_EVENT_NONE);
+	}
+
+	assert(tg3spmc_get_rx_health(self, 0x227u, &h));
+	assert(h.stale);
+
+	/* Per message timeout faults after 3 periods */
+	*self = saved_state;
+	tg3spmc_set_msg_timeout_fault(self, true);
+	assert(tg3spmc_get_rx_health(self, 0x227u, &h));
+	last_ms = h.last_ms;
+
+	for (k = 0u; k < 3u; k++) {
+		tg3spmc_test_rx_period(self, 100u, 2u, TG3SPMC_EVENT_NONE);
+	}
+
+	assert(tg3spmc_get_rx_health(self, 0x227u, &h));
+	assert(!h.stale);
+	assert(tg3spmc_next_deadline_ms(self) <=
+	       ((last_ms + 301u) - self->_uptime_ms));
+
+	assert(tg3spmc_step(self, (last_ms + 301u) - self->_uptime_ms) ==
+	       TG3SPMC_EVENT_FAULT);
+	assert(self->fault_cause == TG3SPMC_FAULT_CAUSE_MSG_TIMEOUT);
+	assert(tg3spmc_get_rx_health(self, 0x227u, &h));
+	assert(h.stale);
+
+	*self = saved_state;
+}
+
+/* ISR queues, single threaded (see examples/isr_queue for stress test) */
+void tg3spmc_test_queues(struct tg3spmc *self)
+{
+	struct tg3spmc saved_state = *self;
+	struct tg3spmc_queue q;
+	struct tg3spmc_frame f;
+	struct tg3spmc_frame foreign = test_frames[0];
+	uint32_t k;
+
+	/* Order and index wrap */
+	tg3spmc_queue_init(&q);
+	for (k = 0u; k < 300u; k++) {
+		f.id = k;
+		assert(tg3spmc_queue_put(&q, &f));
+		assert(tg3spmc_queue_get(&q, &f) && (f.id == k));
+	}
+
+	/* Overflow */
+	for (k = 0u; k <= TG3SPMC_QUEUE_SIZE; k++) {
+		f.id = k;
+		assert(tg3spmc_queue_put(&q, &f) == (k < TG3SPMC_QUEUE_SIZE));
+	}
+
+	assert(tg3spmc_queue_drops(&q) == 1u);
+
+	for (k = 0u; k < TG3SPMC_QUEUE_SIZE; k++) {
+		assert(tg3spmc_queue_get(&q, &f) && (f.id == k));
+	}
+
+	assert(tg3spmc_queue_is_empty(&q));
+	assert(!tg3spmc_queue_get(&q, &f));
+
+	/* Frames of other modules are not queued */
+	foreign.id = 0x209u;
+	assert(tg3spmc_isr_put_rx_frame(self, &foreign));
+	assert(tg3spmc_queue_is_empty(&self->_rx_queue));
+
+	/* Module frames are consumed by the step */
+	assert(tg3spmc_step(self, 50u) == TG3SPMC_EVENT_NONE);
+	for (k = 0u; k < 5u; k++) {
+		assert(tg3spmc_isr_put_rx_frame(self, &test_frames[k]));
+	}
+
+	assert(self->_io.rx.timer_ms == 50u);
+	assert(tg3spmc_next_deadline_ms(self) == 0u);
+	assert(tg3spmc_step(self, 0u) == TG3SPMC_EVENT_NONE);
+	assert(self->_io.rx.timer_ms == 0u);
+	assert(tg3spmc_next_deadline_ms(self) > 0u);
+
+	for (k = 0u; k < (TG3SPMC_QUEUE_SIZE + 2u); k++) {
+		assert(tg3spmc_isr_put_rx_frame(self, &test_frames[k % 5u]) ==
+		       (k < TG3SPMC_QUEUE_SIZE));
+	}
+
+	assert(tg3spmc_get_rx_drops(self) == 2u);
+	assert(tg3spmc_step(self, 0u) == TG3SPMC_EVENT_NONE);
+	assert(tg3spmc_queue_is_empty(&self->_rx_queue));
+
+	/* Due frames go to TX queue, in tg3spmc_get_tx_frame order */
+	tg3spmc_set_tx_queue(self, true);
+	assert(tg3spmc_step(self, TG3SPMC_CONST_CAN_TX_PERIOD_MS) ==
+	       TG3SPMC_EVENT_NONE);
+	assert(!tg3spmc_get_tx_frame(self, &f));
+
+	assert(tg3spmc_isr_get_tx_frame(self, &f) && (f.id == 0x368u));
+	assert(tg3spmc_isr_get_tx_frame(self, &f) && (f.id == 0x45Cu));
+	assert(tg3spmc_isr_get_tx_frame(self, &f) && (f.id == 0x42Cu));
+	assert(!tg3spmc_isr_get_tx_frame(self, &f));
+
+	/* TX context is late by 3 periods */
+	for (k = 0u; k < 3u; k++) {
+		assert(tg3spmc_step(self, TG3SPMC_CONST_CAN_TX_PERIOD_MS) ==
+		       TG3SPMC_EVENT_NONE);
+	}
+
+	assert(tg3spmc_get_tx_drops(self) == ((TG3SPMC_QUEUE_SIZE < 9u) ?
+	       (9u - TG3SPMC_QUEUE_SIZE) : 0u));
+
+	*self = saved_state;
+}
+
+/* Decoded telemetry must read the same as the text log */
+void tg3spmc_test_telemetry(struct tg3spmc *self)
+{
+	struct tg3spmc_telemetry t;
+	struct tg3spmc_telemetry_record r;
+	uint8_t rec[TG3SPMC_TELEMETRY_SIZE];
+	char text[1024];
+	char decoded[1024];
+
+	assert(_tg3spmc_telemetry_crc((const uint8_t *)"123456789", 9u) ==
+	       0x29B1u);
+
+	tg3spmc_telemetry_init(&t);
+	assert(!tg3spmc_telemetry_encode(&t, self, rec, sizeof(rec) - 1u));
+
+	assert(tg3spmc_telemetry_encode(&t, self, rec, sizeof(rec)));
+	assert(tg3spmc_telemetry_decode(rec, &r));
+	assert(r.seq == 0u);
+	assert(tg3spmc_telemetry_format(&r, decoded, sizeof(decoded)));
+	assert(tg3spmc_log(self, text, sizeof(text)));
+	assert(strcmp(text, decoded) == 0);
+
+	/* Sequence number goes up */
+	assert(tg3spmc_telemetry_encode(&t, self, rec, sizeof(rec)));
+	assert(tg3spmc_telemetry_decode(rec, &r));
+	assert(r.seq == 1u);
+
+	/* Any corrupted byte is rejected */
+	rec[9] ^= 0x01u;
+	assert(!tg3spmc_telemetry_decode(rec, &r));
+	rec[9] ^= 0x01u;
+	rec[0] = 0x00u;
+	assert(!tg3spmc_telemetry_decode(rec, &r));
+
+	assert(!tg3spmc_telemetry_format(&r, decoded, 10u));
+}
+
+/* Recorder keeps the last entries, freezes on fault, exports canary log */
+void tg3spmc_test_recorder(struct tg3spmc *self)
+{
+	struct tg3spmc saved_state = *self;
+	struct tg3spmc_recorder_entry entries[8];
+	struct tg3spmc_recorder rec;
+	struct tg3spmc_frame f;
+	enum tg3spmc_event ev;
+	char line[TG3SPMC_RECORDER_LINE_MAX];
+	uint32_t lines;
+	uint8_t k;
+
+	tg3spmc_recorder_init(&rec, entries, 8u);
+
+	/* Module was already running when recorder started */
+	ev = tg3spmc_step(self, 10u);
+	tg3spmc_recorder_step(&rec, self, 10u, ev);
+	assert(rec._len == 2u);
+	assert(entries[1].kind == (uint8_t)TG3SPMC_RECORDER_KIND_STATE);
+	assert(entries[1].data[1] == (uint8_t)_TG3SPMC_STATE_RUNNING);
+
+	/* Steps in a row share a single entry, zero steps are skipped */
+	for (k = 1u; k <= 3u; k++) {
+		ev = tg3spmc_step(self, k);
+		tg3spmc_recorder_step(&rec, self, k, ev);
+	}
+
+	tg3spmc_recorder_step(&rec, self, 0u, TG3SPMC_EVENT_NONE);
+	assert(rec._len == 3u);
+	assert(entries[2].id == 6u);
+	assert(_tg3spmc_telemetry_get16(&entries[2].data[0]) == 3u);
+	assert(_tg3spmc_recorder_step_max(&entries[2]) == 3u);
+
+	/* Ring wraps, oldest entries are overwritten */
+	for (k = 0u; k < 5u; k++) {
+		tg3spmc_put_rx_frame(self, &test_frames[k]);
+		tg3spmc_recorder_rx(&rec, self, &test_frames[k]);
+	}
+
+	ev = tg3spmc_step(self, TG3SPMC_CONST_CAN_TX_PERIOD_MS);
+	tg3spmc_recorder_step(&rec, self, TG3SPMC_CONST_CAN_TX_PERIOD_MS, ev);
+	while (tg3spmc_get_tx_frame(self, &f)) {
+		tg3spmc_recorder_tx(&rec, self, &f);
+	}
+
+	assert(rec._len == 8u);
+
+	/* Fault freezes recorder */
+	f = test_frames[0];
+	f.data[2] = 0xFF; /* put fault artifically */
+	tg3spmc_put_rx_frame(self, &f);
+	tg3spmc_recorder_rx(&rec, self, &f);
+	ev = tg3spmc_step(self, 0u);
+	tg3spmc_recorder_step(&rec, self, 0u, ev);
+	assert(ev == TG3SPMC_EVENT_FAULT);
+	assert(rec.frozen);
+
+	tg3spmc_recorder_rx(&rec, self, &test_frames[1]);
+	tg3spmc_recorder_step(&rec, self, 1u, TG3SPMC_EVENT_NONE);
+
+	/* Export, fault frame and transition are the last lines */
+	lines = tg3spmc_recorder_lines(&rec);
+	assert(lines == (TG3SPMC_RECORDER_HEADER_LINES + 8u));
+
+	assert(tg3spmc_recorder_export(&rec, 0u, line, sizeof(line)));
+	assert(strcmp(line, ";CANARY V2.3\n") == 0);
+
+	assert(tg3spmc_recorder_export(&rec, 3u, line, sizeof(line)));
+	assert(strcmp(line, "0000.000000 0 00000237 00 8 "
+			    "3C 41 00 00 00 00 00 00\n") == 0);
+
+	assert(tg3spmc_recorder_export(&rec, 5u, line, sizeof(line)));
+	assert(strcmp(line, ";0000.090000 STEP 90ms, 1 steps, "
+			    "max 90ms\n") == 0);
+
+	/* Sent frames go to bus 1 */
+	assert(tg3spmc_recorder_export(&rec, 8u, line, sizeof(line)));
+	assert(strcmp(line, "0000.090000 1 0000042C 00 8 "
+			    "42 BB 00 00 FE 00 00 00\n") == 0);
+
+	assert(tg3spmc_recorder_export(&rec, lines - 2u, line, sizeof(line)));
+	assert(strcmp(line, "0000.090000 0 00000207 00 8 "
+			    "00 00 FF 00 C8 00 04 00\n") == 0);
+
+	assert(tg3spmc_recorder_export(&rec, lines - 1u, line, sizeof(line)));
+	assert(strcmp(line, ";0000.090000 STATE 0x02 -> 0x03, "
+			    "EVENT FAULT, CAUSE FAULT_FLAG\n") == 0);
+
+	assert(!tg3spmc_recorder_export(&rec, lines, line, sizeof(line)));
+	assert(!tg3spmc_recorder_export(&rec, lines - 2u, line, 20u));
+
+	/* Rearm starts over */
+	tg3spmc_recorder_rearm(&rec);
+	assert(!rec.frozen);
+	assert(tg3spmc_recorder_lines(&rec) == TG3SPMC_RECORDER_HEADER_LINES);
+
+	*self = saved_state;
+}
+
+/* Controller against simulated module: charge, every injectable fault and
+ * the way back to charging */
+void tg3spmc_test_sim(void)
+{
+	struct tg3spmc mod;
+	struct tg3spmc_sim sim;
+	struct tg3spmc_vars v;
+#if defined(TG3SPMC_FIXED_POINT)
+	struct tg3spmc_config_float config;
+#else
+	struct tg3spmc_config config;
+#endif
+	uint8_t ev;
+
+	config.rated_voltage_ac_V = 240.0f;
+	config.voltage_dc_V       = 390.0f;
+	config.current_ac_A       = 4.0f;
+
+	tg3spmc_init(&mod, 2u);
+#if defined(TG3SPMC_FIXED_POINT)
+	tg3spmc_set_config_float(&mod, config);
+#else
+	tg3spmc_set_config(&mod, config);
+#endif
+	tg3spmc_sim_init(&sim, 2u);
+
+	/* Soft start, DC relay and current ramp take about 8s */
+	ev = tg3spmc_sim_run(&sim, &mod, 10000u);
+	assert(ev == ((1u << TG3SPMC_EVENT_POWER_ON) |
+		      (1u << TG3SPMC_EVENT_CHARGE_ENABLED)));
+	assert(tg3spmc_sim_is_charging(&sim));
+	assert(sim.set_current_ac_A > 3.99f);
+	assert(sim.set_current_ac_A < 4.01f);
+	assert(sim.current_ac_A > 3.99f);
+	assert(sim.current_dc_A > 1.8f);
+	assert(tg3spmc_read_vars(&mod, &v));
+	assert(v.status == 0x41u);
+
+	/* Fault flag, recovery, charging again */
+	tg3spmc_sim_inject(&sim, TG3SPMC_SIM_FAULT_FLAG);
+	ev = tg3spmc_sim_run(&sim, &mod, 200u);
+	assert(ev == (1u << TG3SPMC_EVENT_FAULT));
+	assert(mod.fault_cause == TG3SPMC_FAULT_CAUSE_FAULT_FLAG);
+	assert(!tg3spmc_sim_is_charging(&sim));
+	ev = tg3spmc_sim_run(&sim, &mod, 12000u);
+	assert((ev & (1u << TG3SPMC_EVENT_RECOVERY)) != 0u);
+	assert((ev & (1u << TG3SPMC_EVENT_FAULT)) == 0u);
+	assert(tg3spmc_sim_is_charging(&sim));
+
+	/* Silent bus */
+	tg3spmc_sim_inject(&sim, TG3SPMC_SIM_FAULT_BUS_OFF);
+	ev = tg3spmc_sim_run(&sim, &mod, 1100u);
+	assert(ev == (1u << TG3SPMC_EVENT_FAULT));
+	assert(mod.fault_cause == TG3SPMC_FAULT_CAUSE_RX_TIMEOUT);
+	tg3spmc_sim_clear(&sim, TG3SPMC_SIM_FAULT_BUS_OFF);
+	ev = tg3spmc_sim_run(&sim, &mod, 12000u);
+	assert((ev & (1u << TG3SPMC_EVENT_FAULT)) == 0u);
+	assert(tg3spmc_sim_is_charging(&sim));
+
+	/* Single silent message */
+	tg3spmc_set_msg_timeout_fault(&mod, true);
+	tg3spmc_sim_inject(&sim, TG3SPMC_SIM_FAULT_MSG_SILENT);
+	ev = tg3spmc_sim_run(&sim, &mod, 1000u);
+	assert(ev == (1u << TG3SPMC_EVENT_FAULT));
+	assert(mod.fault_cause == TG3SPMC_FAULT_CAUSE_MSG_TIMEOUT);
+	tg3spmc_sim_clear(&sim, TG3SPMC_SIM_FAULT_MSG_SILENT);
+	ev = tg3spmc_sim_run(&sim, &mod, 12000u);
+	assert((ev & (1u << TG3SPMC_EVENT_FAULT)) == 0u);
+	assert(tg3spmc_sim_is_charging(&sim));
+
+	/* Grid loss stops charging without fault, return restarts it */
+	tg3spmc_sim_inject(&sim, TG3SPMC_SIM_FAULT_AC_LOSS);
+	ev = tg3spmc_sim_run(&sim, &mod, 3000u);
+	assert((ev & (1u << TG3SPMC_EVENT_FAULT)) == 0u);
+	assert(!tg3spmc_sim_is_charging(&sim));
+	assert(sim.current_ac_A < 0.01f);
+	tg3spmc_sim_clear(&sim, TG3SPMC_SIM_FAULT_AC_LOSS);
+	ev = tg3spmc_sim_run(&sim, &mod, 12000u);
+	assert((ev & (1u << TG3SPMC_EVENT_FAULT)) == 0u);
+	assert(tg3spmc_sim_is_charging(&sim));
+
+	/* Module reboots on its own, as seen in captures */
+	tg3spmc_sim_inject(&sim, TG3SPMC_SIM_FAULT_RESET);
+	ev = tg3spmc_sim_run(&sim, &mod, 1000u);
+	assert(!tg3spmc_sim_is_charging(&sim));
+	ev |= tg3spmc_sim_run(&sim, &mod, 12000u);
+	assert((ev & (1u << TG3SPMC_EVENT_FAULT)) == 0u);
+	assert(tg3spmc_sim_is_charging(&sim));
+
+	/* Poor cooling: module derates, controller keeps charging */
+	tg3spmc_sim_inject(&sim, TG3SPMC_SIM_FAULT_OVERTEMP);
+	ev = tg3spmc_sim_run(&sim, &mod, 300000u);
+	assert(ev == 0u);
+	assert(tg3spmc_sim_is_charging(&sim));
+	assert(sim.temp_C > 70.0f);
+	assert(sim.current_ac_A < 3.0f);
+	assert(sim.current_ac_A > 0.5f);
+
+	/* Frames not taken in time are counted (5 per period, 8 slots) */
+	assert(tg3spmc_sim_get_tx_drops(&sim) == 0u);
+	tg3spmc_sim_step(&sim, TG3SPMC_SIM_MSG_PERIOD_MS);
+	tg3spmc_sim_step(&sim, TG3SPMC_SIM_MSG_PERIOD_MS);
+	assert(tg3spmc_sim_get_tx_drops(&sim) == 2u);
+
+	/* Power off */
+	tg3spmc_init(&mod, 2u);
+	ev = tg3spmc_sim_run(&sim, &mod, 1000u);
+	assert(!tg3spmc_sim_is_charging(&sim));
+	assert(tg3spmc_sim_next_deadline_ms(&sim) == TG3SPMC_DEADLINE_NONE);
+}
+
 /* TODO test message periods */
 
 int main()
 {
 	char buf[1024];
 	struct tg3spmc mod;
+#if defined(TG3SPMC_FIXED_POINT)
+	struct tg3spmc_config_float config;
+#else
 	struct tg3spmc_config config;
+#endif
 
 	config.rated_voltage_ac_V = 240.0f;
 	config.voltage_dc_V       = 380;
 	config.current_ac_A       = 0.0f;
 
+	tg3spmc_test_dispatch();
+	tg3spmc_test_can_filters();
+
 	/* Init module 0 */
 	tg3spmc_init(&mod, 0u);
 	tg3spmc_test_config_invalid(&mod);
+#if defined(TG3SPMC_FIXED_POINT)
+	tg3spmc_test_fixed_point_error_bound();
+	tg3spmc_test_config_float();
+	tg3spmc_set_config_float(&mod, config);
+#else
 	tg3spmc_set_config(&mod, config);
+#endif
+	tg3spmc_test_charger(mod._config);
+	tg3spmc_test_charger_failover(mod._config);
+	tg3spmc_test_next_deadline(mod._config);
 	tg3spmc_test_normal_init(&mod);
 
 	tg3spmc_test_rx_timeout(&mod);
 	tg3spmc_test_mod_fault(&mod);
+	tg3spmc_test_fast_fault(&mod);
+	tg3spmc_test_rx_health(&mod);
+	tg3spmc_test_queues(&mod);
 
 	tg3spmc_log(&mod, buf, 1024);
 	printf("%s\n\n", buf);
@@ -213,5 +1424,9 @@ int main()
 	tg3spmc_log(&mod, buf, 1024);
 	printf("%s\n", buf);
 
+	tg3spmc_test_telemetry(&mod);
+	tg3spmc_test_recorder(&mod);
+	tg3spmc_test_sim();
+
 	return 0;
 }
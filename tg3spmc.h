@@ -29,9 +29,32 @@
  * This file implements logic to control single phase module within Tesla GEN3
  * Battery Controller Board (BCB). The implementation is completely hardware
  * agnostic and requires external wraping layer to interract with a hardware.
+ *
+ * Define `TG3SPMC_FIXED_POINT` before including this file to build the
+ * library with integer only arithmetic (for MCUs without hardware FPU).
+ * In this mode tg3spmc_config and tg3spmc_vars use scaled integer units
+ * (mV, mA) and the float API is available via tg3spmc_set_config_float
+ * and tg3spmc_read_vars_float.
+ *
+ * Fixed point error bound (compared to float build):
+ * - decoded voltage_dc_mV, current_dc_mA, current_ac_mA and
+ *   current_limit_due_temp_mA are truncated, error is within [0, 1) mV/mA;
+ * - encoded 0x42C/0x45C raw setpoints are exact for setpoints given in
+ *   whole mV/mA (float build may differ by 1 LSB due to float rounding).
+ *
+ * The API is not reentrant, except for frame queues: CAN ISR (or task) may
+ * receive with tg3spmc_isr_put_rx_frame and send with
+ * tg3spmc_isr_get_tx_frame while the rest runs in the main loop; and for
+ * variables published by tg3spmc_publish_vars, which may be read by any
+ * number of tasks with tg3spmc_snapshot_vars.
  */
+#ifndef TG3SPMC_H
+#define TG3SPMC_H
+
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 #include <assert.h>
 
 /** Period of CAN message transmission. (milliseconds) */
@@ -40,6 +63,9 @@
 /** How long should we wait before setting RX timeout? (milliseconds) */
 #define TG3SPMC_CONST_CAN_RX_TIMEOUT_MS 1000u
 
+/** Message is taken as silent after this many of its periods */
+#define TG3SPMC_CONST_MSG_TIMEOUT_PERIODS 3u
+
 /** Fault recovery time (milliseconds) */
 #define TG3SPMC_CONST_FAULT_RECOVERY_TIME_MS 1000u
 
@@ -48,9 +74,19 @@
  * (Proven experimentally) */
 #define TG3SPMC_CONST_BOOT_TIME_MS 1000u
 
+/** Time to hold charger start after entering RUNNING state (milliseconds).
+ * Necessary to pass initial setup to the charger */
+#define TG3SPMC_CONST_HOLD_START_TIME_MS 1000u
+
+/** Returned by tg3spmc_next_deadline_ms if there's nothing to wait for */
+#define TG3SPMC_DEADLINE_NONE 0xFFFFFFFFu
+
 /** Minimum alloved DC voltage in volts */
 #define TG3SPMC_CONST_MIN_DC_VOLTAGE_V 250.0f
 
+/** Minimum alloved DC voltage in millivolts (fixed point build) */
+#define TG3SPMC_CONST_MIN_DC_VOLTAGE_MV 250000u
+
 
 /******************************************************************************
  * TG3SPMC GENERIC
@@ -73,7 +109,8 @@ struct tg3spmc_frame {
 enum tg3spmc_fault_cause {
 	TG3SPMC_FAULT_CAUSE_NONE,       /**< No fault */
 	TG3SPMC_FAULT_CAUSE_RX_TIMEOUT, /**< Fault caused by RX timeout */
-	TG3SPMC_FAULT_CAUSE_FAULT_FLAG  /**< Fault caused by module flag */
+	TG3SPMC_FAULT_CAUSE_FAULT_FLAG, /**< Fault caused by module flag */
+	TG3SPMC_FAULT_CAUSE_MSG_TIMEOUT /**< Fault caused by silent message */
 };
 
 /******************************************************************************
@@ -84,12 +121,129 @@ enum tg3spmc_fault_cause {
  */
 enum _tg3spm_frame_base_id {
 	_TG3SPM_FRAME_BASE_ID_AC_PARAMS = 0x207u,
-	_TG3SPM_FRAME_BASE_ID_DC_PARAMS = 0x217u,
-	_TG3SPM_FRAME_BASE_ID_STATUS    = 0x227u,
+	_TG3SPM_FRAME_BASE_ID_STATUS    = 0x217u,
+	_TG3SPM_FRAME_BASE_ID_DC_PARAMS = 0x227u,
 	_TG3SPM_FRAME_BASE_ID_SENSORS   = 0x237u,
 	_TG3SPM_FRAME_BASE_ID_LIMITS    = 0x247u
 };
 
+/**
+ * @brief Index of decodable single phase module message.
+ *
+ * Used to address raw payload storage and received/dirty bit flags.
+ */
+enum _tg3spm_msg {
+	_TG3SPM_MSG_AC_PARAMS, /**< 0x207 */
+	_TG3SPM_MSG_STATUS,    /**< 0x217 */
+	_TG3SPM_MSG_DC_PARAMS, /**< 0x227 */
+	_TG3SPM_MSG_SENSORS,   /**< 0x237 */
+	_TG3SPM_MSG_LIMITS,    /**< 0x247 */
+
+	_TG3SPM_MSG_COUNT,     /**< Number of decodable messages */
+
+	/* Known side channels (not decoded) */
+	_TG3SPM_MSG_H347 = _TG3SPM_MSG_COUNT, /**< 0x347 */
+	_TG3SPM_MSG_H467,                     /**< 0x467 */
+	_TG3SPM_MSG_H537,                     /**< 0x537 */
+	_TG3SPM_MSG_H717,                     /**< 0x717 */
+
+	_TG3SPM_MSG_TOTAL,     /**< Number of all known messages */
+
+	_TG3SPM_MSG_NONE = 0xFu /**< Not a single phase module message */
+};
+
+/** Spacing between IDs of the same message for different modules */
+#define _TG3SPM_MODULE_ID_SPACING 2u
+
+/**
+ * @brief Maps message base ID into message index.
+ * @param base_id Frame ID with module offset removed.
+ * @return Message index (enum _tg3spm_msg) or _TG3SPM_MSG_NONE.
+ */
+uint8_t _tg3spm_msg_from_base_id(uint32_t base_id)
+{
+	uint8_t msg;
+
+	/* Generic for all three modules. */
+	switch (base_id) {
+	case _TG3SPM_FRAME_BASE_ID_AC_PARAMS:
+		msg = _TG3SPM_MSG_AC_PARAMS;
+		break;
+
+	case _TG3SPM_FRAME_BASE_ID_STATUS:
+		msg = _TG3SPM_MSG_STATUS;
+		break;
+
+	case _TG3SPM_FRAME_BASE_ID_DC_PARAMS:
+		msg = _TG3SPM_MSG_DC_PARAMS;
+		break;
+
+	case _TG3SPM_FRAME_BASE_ID_SENSORS:
+		msg = _TG3SPM_MSG_SENSORS;
+		break;
+
+	case _TG3SPM_FRAME_BASE_ID_LIMITS:
+		msg = _TG3SPM_MSG_LIMITS;
+		break;
+
+	case 0x347u:
+		/* 1000ms period
+		 * byte[2] goes 0x80 shortly when there's
+		 * some distruption in AC supply
+		 * (lose or bad connection to AC socket (sparks)) */
+		msg = _TG3SPM_MSG_H347;
+		break;
+
+	case 0x467u:
+		/* 100ms period
+		 * byte[0], byte[1] goes 7E 09 (24300 decimal in little endian)
+		 * It slowly increases to that value after start, approx 5s */
+		msg = _TG3SPM_MSG_H467;
+		break;
+
+	case 0x537u:
+		/* 900ms period
+		 * Probably fragmented CAN message
+		 * byte[0] is an index of fragment
+		 * Range: 0x0A - 0x14
+		 * Observed sequence: 0A 0B 0D 0E 0F 10 11 12 13 14
+		 * */
+		msg = _TG3SPM_MSG_H537;
+		break;
+
+	case 0x717u:
+		/* 100ms period
+		 * Probably fragmented CAN message
+		 * byte[0] is an index of fragment (range: 0x01 - 0x1C)
+		 * Observed sequence: 01 02 04 05 06 07 08 09 0A 0B 0C 0E 0F
+		 * 		      10 11 12 13 14 16 17 18 19 1A 1B 1C
+		 */
+		msg = _TG3SPM_MSG_H717;
+		break;
+
+	default:
+		msg = _TG3SPM_MSG_NONE;
+		break;
+	}
+
+	return msg;
+}
+
+/**
+ * @brief Nominal transmission period of a message (observed on logs).
+ * @param msg Message index (enum _tg3spm_msg), below _TG3SPM_MSG_TOTAL.
+ * @return Period (milliseconds).
+ */
+uint32_t _tg3spm_msg_period_ms(uint8_t msg)
+{
+	static const uint16_t period_ms[_TG3SPM_MSG_TOTAL] = {
+		100u, 100u, 100u, 100u, 100u, /* 0x207 - 0x247 */
+		1000u, 100u, 900u, 100u       /* 0x347 0x467 0x537 0x717 */
+	};
+
+	return period_ms[msg];
+}
+
 /** Enum for 6bit flags inside ac_params */
 enum _tg3spm_field_ac_params_flags0 {
 	_TG3SPM_FIELD_AC_PARAMS_FLAGS0_UNKNOWN1          = 1u,
@@ -125,14 +279,34 @@ enum _tg3spm_field_status_flags {
 /******************************************************************************
  * TG3SPMC PRIVATE WRITER
  *****************************************************************************/
+/** Writer frame slots, frames are kept pre-encoded between periods */
+enum _tg3spmc_writer_frame {
+	_TG3SPMC_WRITER_FRAME_H42C, /**< Module specific control */
+	_TG3SPMC_WRITER_FRAME_H45C, /**< Broadcast */
+	_TG3SPMC_WRITER_FRAME_H368  /**< Static broadcast */
+};
+
+/** Pre-encoded frame fields invalidated by config or state transition */
+enum _tg3spmc_writer_dirty {
+	_TG3SPMC_WRITER_DIRTY_SETPOINT = 1u, /**< Voltage/current setpoint */
+	_TG3SPMC_WRITER_DIRTY_CONTROL  = 2u  /**< State-dependent bytes */
+};
+
 /**
  * @brief Structure for writing CAN frames to the single phase module.
  */
 struct _tg3spmc_writer
 {
-	/** Array to hold frames to be sent (max 3 at a time). */
+	/** Array to hold frames to be sent (max 3 at a time).
+	 *  Frames stay encoded, only dirty fields are re-encoded. */
 	struct tg3spmc_frame frames[3];
 
+	/** Fields to be re-encoded before next transmission (bits flagged) */
+	uint8_t dirty;
+
+	/** Control bytes are currently encoded for started charger */
+	bool started;
+
 	/** The number of valid frames currently in the array. */
 	uint8_t count;
 
@@ -157,6 +331,9 @@ void _tg3spmc_writer_init(struct _tg3spmc_writer *self)
 {
 	self->count = 0u;
 
+	self->dirty   = 0u;
+	self->started = false;
+
 	self->enable_broadcast = true;
 
 	self->timer_ms = 0u;
@@ -167,6 +344,27 @@ void _tg3spmc_writer_init(struct _tg3spmc_writer *self)
 /******************************************************************************
  * TG3SPMC PRIVATE READER CLASS
  *****************************************************************************/
+/**
+ * @brief Reception statistics of a single message.
+ *
+ * Jitter is the observed period minus the nearest multiple of the nominal
+ * period, periods longer than 1.5 nominal periods count as missed ones.
+ * Mean jitter is jitter_sum_ms / periods.
+ */
+struct tg3spmc_rx_health {
+	uint32_t last_ms;       /**< Uptime of the last arrival (ms). */
+	uint32_t period_ms;     /**< Last observed period (ms). */
+	int32_t  jitter_min_ms; /**< Min jitter (ms). */
+	int32_t  jitter_max_ms; /**< Max jitter (ms). */
+	int32_t  jitter_sum_ms; /**< Sum of jitter (ms). */
+	uint32_t periods;       /**< Number of observed periods. */
+	uint32_t missed;        /**< Number of missed periods. */
+
+	/** Silent for longer than TG3SPMC_CONST_MSG_TIMEOUT_PERIODS periods,
+	 *  evaluated by tg3spmc_get_rx_health. */
+	bool stale;
+};
+
 /**
  * @brief Structure for handling received CAN frames from the module.
  */
@@ -178,6 +376,19 @@ struct _tg3spmc_reader
 	/** Received frames (bits flagged) */
 	uint8_t recv_flags;
 
+	/** Frames received, but not yet decoded (bits flagged) */
+	uint8_t dirty_flags;
+
+	/** Raw payloads of the last received frames (per base ID) */
+	uint8_t raw[_TG3SPM_MSG_COUNT][8];
+
+	/** Reception statistics (per base ID, side channels included) */
+	struct tg3spmc_rx_health health[_TG3SPM_MSG_TOTAL];
+
+	/** Messages received since RUNNING state entry (bits flagged),
+	 *  only these are checked for per message timeout */
+	uint16_t seen_flags;
+
 	/** Flag indicating if new frames have been received in the step. */
 	bool has_frames;
 };
@@ -188,15 +399,247 @@ struct _tg3spmc_reader
  */
 void _tg3spmc_reader_init(struct _tg3spmc_reader *self)
 {
-	/* TODO implement properly */
+	uint8_t m;
+	uint8_t b;
+
 	self->timer_ms = 0u;
 
-	self->recv_flags = 0u;
+	self->recv_flags  = 0u;
+	self->dirty_flags = 0u;
+
+	for (m = 0u; m < (uint8_t)_TG3SPM_MSG_COUNT; m++) {
+		for (b = 0u; b < 8u; b++) {
+			self->raw[m][b] = 0u;
+		}
+	}
+
+	for (m = 0u; m < (uint8_t)_TG3SPM_MSG_TOTAL; m++) {
+		self->health[m].last_ms       = 0u;
+		self->health[m].period_ms     = 0u;
+		self->health[m].jitter_min_ms = 0;
+		self->health[m].jitter_max_ms = 0;
+		self->health[m].jitter_sum_ms = 0;
+		self->health[m].periods       = 0u;
+		self->health[m].missed        = 0u;
+		self->health[m].stale         = false;
+	}
+
+	self->seen_flags = 0u;
 
 	self->has_frames = false;
 }
 
-/* TODO add more methods, more separation of concerns */
+/**
+ * @brief Stores raw payload of the received message without decoding.
+ *
+ * Payload is marked dirty and will be decoded on demand.
+ * @param self Pointer to the tg3spmc_reader instance.
+ * @param msg  Message index (enum _tg3spm_msg).
+ * @param f    Pointer to the received CAN frame.
+ */
+void _tg3spmc_reader_store(struct _tg3spmc_reader *self, uint8_t msg,
+			   const struct tg3spmc_frame *f)
+{
+	uint8_t *raw = self->raw[msg];
+
+	raw[0] = f->data[0];
+	raw[1] = f->data[1];
+	raw[2] = f->data[2];
+	raw[3] = f->data[3];
+	raw[4] = f->data[4];
+	raw[5] = f->data[5];
+	raw[6] = f->data[6];
+	raw[7] = f->data[7];
+
+	self->recv_flags  |= (uint8_t)(1u << msg);
+	self->dirty_flags |= (uint8_t)(1u << msg);
+}
+
+/**
+ * @brief Updates reception statistics of the received message.
+ *
+ * Constant time, division is only taken when periods were missed.
+ * @param self Pointer to the tg3spmc_reader instance.
+ * @param msg  Message index (enum _tg3spm_msg), below _TG3SPM_MSG_TOTAL.
+ * @param now_ms Current uptime (milliseconds).
+ */
+void _tg3spmc_reader_track(struct _tg3spmc_reader *self, uint8_t msg,
+			   uint32_t now_ms)
+{
+	struct tg3spmc_rx_health *h = &self->health[msg];
+
+	uint32_t nominal_ms = _tg3spm_msg_period_ms(msg);
+	uint32_t period_ms  = now_ms - h->last_ms;
+	uint32_t n = 1u; /* Nominal periods in observed one */
+	int32_t  jitter_ms;
+
+	if ((self->seen_flags & (1u << msg)) != 0u) {
+		if (period_ms >= (nominal_ms + (nominal_ms / 2u))) {
+			n = (period_ms + (nominal_ms / 2u)) / nominal_ms;
+			h->missed += n - 1u;
+		}
+
+		jitter_ms = (int32_t)period_ms - (int32_t)(n * nominal_ms);
+
+		if ((h->periods == 0u) || (jitter_ms < h->jitter_min_ms)) {
+			h->jitter_min_ms = jitter_ms;
+		}
+
+		if ((h->periods == 0u) || (jitter_ms > h->jitter_max_ms)) {
+			h->jitter_max_ms = jitter_ms;
+		}
+
+		h->jitter_sum_ms += jitter_ms;
+		h->period_ms      = period_ms;
+		h->periods++;
+	}
+
+	h->last_ms = now_ms;
+	self->seen_flags |= (uint16_t)(1u << msg);
+}
+
+/**
+ * @brief Tells which seen messages are silent for too long.
+ * @param self Pointer to the tg3spmc_reader instance.
+ * @param now_ms Current uptime (milliseconds).
+ * @return Silent messages (bits flagged).
+ */
+uint16_t _tg3spmc_reader_stale_flags(const struct _tg3spmc_reader *self,
+				     uint32_t now_ms)
+{
+	uint16_t stale = 0u;
+	uint8_t  m;
+
+	for (m = 0u; m < (uint8_t)_TG3SPM_MSG_TOTAL; m++) {
+		if (((self->seen_flags & (1u << m)) != 0u) &&
+		    ((now_ms - self->health[m].last_ms) >
+		     (TG3SPMC_CONST_MSG_TIMEOUT_PERIODS *
+		      _tg3spm_msg_period_ms(m)))) {
+			stale |= (uint16_t)(1u << m);
+		}
+	}
+
+	return stale;
+}
+
+/******************************************************************************
+ * TG3SPMC FRAME QUEUE
+ *****************************************************************************/
+/** Capacity of frame queues (frames), power of two up to 128.
+ *  May be defined before including this file. */
+#ifndef TG3SPMC_QUEUE_SIZE
+#define TG3SPMC_QUEUE_SIZE 8u
+#endif
+
+/** Memory access shared between contexts (frame queues, vars snapshot).
+ *  GCC/Clang atomics by default, define both before including this file
+ *  for other compilers. */
+#ifndef TG3SPMC_LOAD_ACQUIRE
+#define TG3SPMC_LOAD_ACQUIRE(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define TG3SPMC_STORE_RELEASE(p, v) __atomic_store_n((p), (v), \
+						     __ATOMIC_RELEASE)
+#endif
+
+/**
+ * @brief Fixed capacity single producer, single consumer frame queue.
+ *
+ * Lock-free: producer (e.g. CAN ISR) and consumer (e.g. main loop) may run
+ * concurrently, as long as each side has a single context. Indexes are
+ * free running, so all TG3SPMC_QUEUE_SIZE slots are used.
+ */
+struct tg3spmc_queue {
+	/** Queued frames. */
+	struct tg3spmc_frame frames[TG3SPMC_QUEUE_SIZE];
+
+	/** Next slot to write, written by producer only. */
+	uint8_t head;
+
+	/** Next slot to read, written by consumer only. */
+	uint8_t tail;
+
+	/** Frames rejected because the queue was full (producer only). */
+	uint32_t drops;
+};
+
+/**
+ * @brief Initializes the frame queue (before producer/consumer start).
+ * @param self Pointer to the tg3spmc_queue instance.
+ */
+void tg3spmc_queue_init(struct tg3spmc_queue *self)
+{
+	/* Free running uint8_t indexes must wrap at a multiple of size */
+	assert((TG3SPMC_QUEUE_SIZE & (TG3SPMC_QUEUE_SIZE - 1u)) == 0u);
+	assert((TG3SPMC_QUEUE_SIZE > 0u) && (TG3SPMC_QUEUE_SIZE <= 128u));
+
+	self->head  = 0u;
+	self->tail  = 0u;
+	self->drops = 0u;
+}
+
+/**
+ * @brief Puts a frame into the queue (producer side).
+ * @param self Pointer to the tg3spmc_queue instance.
+ * @param f Frame to be copied into the queue.
+ * @return False if the queue is full (frame is dropped and counted).
+ */
+bool tg3spmc_queue_put(struct tg3spmc_queue *self,
+		       const struct tg3spmc_frame *f)
+{
+	uint8_t head = self->head;
+	uint8_t tail = TG3SPMC_LOAD_ACQUIRE(&self->tail);
+	bool    put  = false;
+
+	if ((uint8_t)(head - tail) < TG3SPMC_QUEUE_SIZE) {
+		self->frames[head & (TG3SPMC_QUEUE_SIZE - 1u)] = *f;
+		TG3SPMC_STORE_RELEASE(&self->head, (uint8_t)(head + 1u));
+		put = true;
+	} else {
+		TG3SPMC_STORE_RELEASE(&self->drops, self->drops + 1u);
+	}
+
+	return put;
+}
+
+/**
+ * @brief Takes the oldest frame out of the queue (consumer side).
+ * @param self Pointer to the tg3spmc_queue instance.
+ * @param[out] f Frame where the queued frame will be copied.
+ * @return False if the queue is empty.
+ */
+bool tg3spmc_queue_get(struct tg3spmc_queue *self, struct tg3spmc_frame *f)
+{
+	uint8_t tail = self->tail;
+	uint8_t head = TG3SPMC_LOAD_ACQUIRE(&self->head);
+	bool    got  = false;
+
+	if (head != tail) {
+		*f = self->frames[tail & (TG3SPMC_QUEUE_SIZE - 1u)];
+		TG3SPMC_STORE_RELEASE(&self->tail, (uint8_t)(tail + 1u));
+		got = true;
+	}
+
+	return got;
+}
+
+/**
+ * @brief Tells if the queue is empty (consumer side).
+ * @param self Pointer to the tg3spmc_queue instance.
+ * @return True if there are no queued frames.
+ */
+bool tg3spmc_queue_is_empty(struct tg3spmc_queue *self)
+{
+	return TG3SPMC_LOAD_ACQUIRE(&self->head) == self->tail;
+}
+
+/**
+ * @brief Number of frames dropped by the producer so far (any context).
+ * @param self Pointer to the tg3spmc_queue instance.
+ * @return Dropped frames.
+ */
+uint32_t tg3spmc_queue_drops(struct tg3spmc_queue *self)
+{
+	return TG3SPMC_LOAD_ACQUIRE(&self->drops);
+}
 
 /******************************************************************************
  * TG3SPMC CLASS
@@ -270,6 +713,18 @@ struct _tg3spmc_io { /* TODO rename to virtual_io or vio */
  * Must be set after initialization. Valid settings trigger transition
  * from CONFIG state.
  */
+#if defined(TG3SPMC_FIXED_POINT)
+struct tg3spmc_config {
+	/** Target DC output voltage for the charger (mV). */
+	uint32_t voltage_dc_mV;
+
+	/** Target AC input current for the charger (mA). */
+	uint32_t current_ac_mA;
+
+	/** Rated AC input voltage (mV) (e.g., 240VAC for EU/UK). */
+	uint32_t rated_voltage_ac_mV;
+};
+#else
 struct tg3spmc_config {
 	/** Target DC output voltage for the charger (V). */
 	float voltage_dc_V;
@@ -280,12 +735,25 @@ struct tg3spmc_config {
 	/** Rated AC input voltage (e.g., 240VAC for EU/UK, 110VAC for US). */
 	float rated_voltage_ac_V;
 };
+#endif
 
 /**
  * @brief Read-only variables representing the module's current status,
  * measurements, and health.
  */
 struct tg3spmc_vars {
+#if defined(TG3SPMC_FIXED_POINT)
+	uint32_t voltage_dc_mV; /**< Measured DC output voltage (mV). */
+	uint8_t  voltage_ac_V;  /**< Measured AC input voltage (V). */
+	uint16_t current_dc_mA; /**< Measured DC output current (mA). */
+	uint16_t current_ac_mA; /**< Measured AC input current (mA). */
+
+	/** Target inlet coolant temperature (C). */
+	int16_t inlet_target_temp_C;
+
+	/** Current limit imposed due to temperature (mA). */
+	uint16_t current_limit_due_temp_mA;
+#else
 	float   voltage_dc_V; /**< Measured DC output voltage (V). */
 	uint8_t voltage_ac_V; /**< Measured AC input voltage (V). */
 	float   current_dc_A; /**< Measured DC output current (A). */
@@ -296,6 +764,7 @@ struct tg3spmc_vars {
 
 	/** Current limit imposed due to temperature (A). */
 	float   current_limit_due_temp_A;
+#endif
 
 	/** Temperature sensor 1 reading (C). */
 	int16_t temp1_C;
@@ -313,6 +782,149 @@ struct tg3spmc_vars {
 	uint8_t status;
 };
 
+#if defined(TG3SPMC_FIXED_POINT)
+/**
+ * @brief Float representation of tg3spmc_config (fixed point build).
+ * @see tg3spmc_set_config_float
+ */
+struct tg3spmc_config_float {
+	float voltage_dc_V;       /**< Target DC output voltage (V). */
+	float current_ac_A;       /**< Target AC input current (A). */
+	float rated_voltage_ac_V; /**< Rated AC input voltage (V). */
+};
+
+/**
+ * @brief Float representation of tg3spmc_vars (fixed point build).
+ * @see tg3spmc_read_vars_float
+ */
+struct tg3spmc_vars_float {
+	float   voltage_dc_V; /**< Measured DC output voltage (V). */
+	uint8_t voltage_ac_V; /**< Measured AC input voltage (V). */
+	float   current_dc_A; /**< Measured DC output current (A). */
+	float   current_ac_A; /**< Measured AC input current (A). */
+
+	/** Target inlet coolant temperature (C). */
+	int16_t inlet_target_temp_C;
+
+	/** Current limit imposed due to temperature (A). */
+	float   current_limit_due_temp_A;
+
+	int16_t temp1_C; /**< Temperature sensor 1 reading (C). */
+	int16_t temp2_C; /**< Temperature sensor 2 reading (C). */
+
+	bool ac_present; /**< Flag: true if AC voltage is present. */
+	bool en_present; /**< Flag: true if module reports it's enabled. */
+	bool fault;      /**< Flag: true if the module reports a fault. */
+
+	uint8_t status;  /**< Raw status byte. */
+};
+#endif
+
+/**
+ * @brief Bit flags of tg3spmc_vars fields, used to tell which of them
+ * changed.
+ * @see tg3spmc_vars_changed
+ */
+enum tg3spmc_var_flag {
+	TG3SPMC_VAR_FLAG_VOLTAGE_DC        = 1u,    /**< voltage_dc */
+	TG3SPMC_VAR_FLAG_VOLTAGE_AC        = 2u,    /**< voltage_ac_V */
+	TG3SPMC_VAR_FLAG_CURRENT_DC        = 4u,    /**< current_dc */
+	TG3SPMC_VAR_FLAG_CURRENT_AC        = 8u,    /**< current_ac */
+	TG3SPMC_VAR_FLAG_INLET_TARGET_TEMP = 16u,   /**< inlet_target_temp_C */
+	TG3SPMC_VAR_FLAG_CURRENT_LIMIT     = 32u,   /**< current_limit... */
+	TG3SPMC_VAR_FLAG_TEMP1             = 64u,   /**< temp1_C */
+	TG3SPMC_VAR_FLAG_TEMP2             = 128u,  /**< temp2_C */
+	TG3SPMC_VAR_FLAG_AC_PRESENT        = 256u,  /**< ac_present */
+	TG3SPMC_VAR_FLAG_EN_PRESENT        = 512u,  /**< en_present */
+	TG3SPMC_VAR_FLAG_FAULT             = 1024u, /**< fault */
+	TG3SPMC_VAR_FLAG_STATUS            = 2048u  /**< status */
+};
+
+/** Size of tg3spmc_vars in 32 bit words */
+#define _TG3SPMC_SNAPSHOT_WORDS ((sizeof(struct tg3spmc_vars) + 3u) / 4u)
+
+/**
+ * @brief Copy of tg3spmc_vars published for concurrent readers (seqlock).
+ *
+ * Sequence is odd while the writer updates the copy. Readers retry until
+ * they see the same even sequence before and after copying, so the writer
+ * never waits for them. Words are stored with release and loaded with
+ * acquire ordering: a reader that sees any new word also sees the odd
+ * sequence, and copies may overlap with the update without data races.
+ */
+struct _tg3spmc_snapshot {
+	/** Publication sequence (0 if nothing published yet). */
+	uint32_t seq;
+
+	/** Published variables are valid (0 once the module went silent). */
+	uint32_t valid;
+
+	/** Published variables, as 32 bit words. */
+	uint32_t words[_TG3SPMC_SNAPSHOT_WORDS];
+};
+
+/**
+ * @brief Writes a new publication (single writer context).
+ * @param self Pointer to the snapshot.
+ * @param v Variables to be published, NULL publishes zeroed invalid ones.
+ */
+void _tg3spmc_snapshot_write(struct _tg3spmc_snapshot *self,
+			     const struct tg3spmc_vars *v)
+{
+	uint32_t words[_TG3SPMC_SNAPSHOT_WORDS];
+	uint32_t seq = self->seq;
+	uint8_t  k;
+
+	memset(words, 0, sizeof(words));
+
+	if (v != NULL) {
+		memcpy(words, v, sizeof(*v));
+	}
+
+	TG3SPMC_STORE_RELEASE(&self->seq, seq + 1u);
+	TG3SPMC_STORE_RELEASE(&self->valid, (v != NULL) ? 1u : 0u);
+
+	for (k = 0u; k < _TG3SPMC_SNAPSHOT_WORDS; k++) {
+		TG3SPMC_STORE_RELEASE(&self->words[k], words[k]);
+	}
+
+	TG3SPMC_STORE_RELEASE(&self->seq, seq + 2u);
+}
+
+/**
+ * @brief Copies the last publication (any context, any number of readers).
+ * @param self Pointer to the snapshot.
+ * @param[out] v Where published variables will be copied.
+ * @return False if nothing valid is published (v is left untouched).
+ */
+bool _tg3spmc_snapshot_read(struct _tg3spmc_snapshot *self,
+			    struct tg3spmc_vars *v)
+{
+	uint32_t words[_TG3SPMC_SNAPSHOT_WORDS];
+	uint32_t seq0;
+	uint32_t seq1;
+	uint32_t valid;
+	uint8_t  k;
+
+	/* Retry while the writer is (or was) in the middle of an update */
+	do {
+		seq0  = TG3SPMC_LOAD_ACQUIRE(&self->seq);
+		valid = TG3SPMC_LOAD_ACQUIRE(&self->valid);
+
+		for (k = 0u; k < _TG3SPMC_SNAPSHOT_WORDS; k++) {
+			words[k] = TG3SPMC_LOAD_ACQUIRE(&self->words[k]);
+		}
+
+		seq1 = TG3SPMC_LOAD_ACQUIRE(&self->seq);
+	} while (((seq0 & 1u) != 0u) || (seq0 != seq1));
+
+	if (valid != 0u) {
+		memcpy(v, words, sizeof(*v));
+	}
+
+	return valid != 0u;
+}
+
 /**
  * @brief Main structure for the single phase module logical representation.
  *
@@ -332,170 +944,481 @@ struct tg3spmc
 	/** Stores fault cause in case of fault event */
 	uint8_t fault_cause;
 
+	/** Uptime at which the pins were dropped on the last fault (ms). */
+	uint32_t fault_time_ms;
+
+	/** Sum of all step deltas since init (ms), wraps at 2^32. */
+	uint32_t _uptime_ms;
+
+	/** Drop the pins from the RX path as soon as a fault is decoded. */
+	bool _fast_fault;
+
+	/** Fault cause latched by the fast RX path, consumed by the next step
+	 *  in RUNNING state (enum tg3spmc_fault_cause). */
+	uint8_t _pending_fault;
+
+	/** Fault if a single decodable message goes silent. */
+	bool _msg_timeout_fault;
+
 	/** Hold charger start when in RUNNING state.
 	 *  Necessary to pass initial setup to the charger */
 	bool _hold_start;
 
+	/** Initial setup frames were taken for sending in RUNNING state. */
+	bool _setup_sent;
+
+	/** Status (0x217) was received after the initial setup was sent.
+	 *  It may have left the module before the setup arrived. */
+	bool _setup_status;
+
+	/** Next status (0x217) after that, it answers the initial setup. */
+	bool _setup_acked;
+
 	/** Input/Output hardware interface structure. */
 	struct _tg3spmc_io     _io;
 	/** Configuration settings structure. */
 	struct  tg3spmc_config _config;
 	/** Read-only module variables and measurements. */
 	struct  tg3spmc_vars   _vars;
+
+	/** Variables changed since the last release (tg3spmc_var_flag). */
+	uint16_t _vars_changed;
+
+	/** Frames received in ISR context, drained by tg3spmc_step. */
+	struct tg3spmc_queue _rx_queue;
+
+	/** Frames to be sent from ISR context, filled by tg3spmc_step. */
+	struct tg3spmc_queue _tx_queue;
+
+	/** Due TX frames go to _tx_queue instead of tg3spmc_get_tx_frame. */
+	bool _tx_queued;
+
+	/** Variables published for concurrent readers. */
+	struct _tg3spmc_snapshot _snapshot;
+
+	/** Variables changed since the last publication. */
+	bool _snapshot_dirty;
 };
 
 /******************************************************************************
- * TG3SPMC PRIVATE METHODS
+ * TG3SPM PRIVATE DECODERS
  *****************************************************************************/
 /**
- * @brief Decodes a single CAN frame received from the module.
- *
- * It uses the module's ID to calculate the message base ID.
- * @param self Pointer to the tg3spmc instance.
- * @param f Pointer to the received CAN frame.
+ * @brief Decodes fault flag out of raw 0x207 (AC params) payload.
+ * @param d Raw payload (8 bytes).
+ * @return True if the module reports a fault.
  */
-void _tg3spmc_decode_frame(struct tg3spmc *self, struct tg3spmc_frame *f)
+bool _tg3spm_decode_ac_params_fault(const uint8_t *d)
 {
-	/* TODO move this into _tg3spmc_reader section, do not decode.
-	 * move decoding into _tg3spm section and put into separate methods.
-	 * Provide decoding only when required explicitly (lazy decoding) */
-	struct  tg3spmc_vars *v = &self->_vars;
-	struct _tg3spmc_io   *i = &self->_io;
+	/* SG_ fault_flag : 18|1@1+ (1,0) [0|1] "" Vector__XXX */
+	return ((d[2] & 0x04u) != 0u) ? true : false;
+}
 
-	/* Tells us if we received a valid frame after all */
-	bool valid_frame = true;
+/**
+ * @brief Decodes charge disallowed flag out of raw 0x207 (AC params) payload.
+ * @param d Raw payload (8 bytes).
+ * @return True if the module does not allow to charge.
+ */
+bool _tg3spm_decode_ac_params_charge_disallowed(const uint8_t *d)
+{
+	/* SG_ flag_charge_disallowed : 50|1@1+ (1,0) [0|1] "" Vector__XXX */
+	return (((d[6] >> 2u) &
+		 (uint8_t)_TG3SPM_FIELD_AC_PARAMS_FLAGS1_CHARGE_DISALLOWED) !=
+		0u) ? true : false;
+}
 
-	uint32_t base_id;
+/**
+ * @brief Decodes AC presence out of raw 0x207 (AC params) payload.
+ * @param d Raw payload (8 bytes).
+ * @return True if AC voltage is present on the module input.
+ */
+bool _tg3spm_decode_ac_params_ac_present(const uint8_t *d)
+{
+	/* SG_ voltage_V : 8|8@1+ (1,0) [0|1] "" Vector__XXX */
+	return (d[1] > 70u) ? true : false;
+}
 
-	/* Use current module ID to calculate base ID */
-	base_id = f->id - (self->_id * 2u);
+/**
+ * @brief Decodes raw 0x207 (AC params) payload.
+ * @param v Pointer to the variables to be updated.
+ * @param d Raw payload (8 bytes).
+ * @return Changed variables (enum tg3spmc_var_flag bits).
+ */
+uint16_t _tg3spm_decode_ac_params(struct tg3spmc_vars *v, const uint8_t *d)
+{
+	uint16_t changed = 0u;
+	bool     flag;
+#if defined(TG3SPMC_FIXED_POINT)
+	uint32_t raw_current;
+	uint16_t current_ac_mA;
+#else
+	float    current_ac_A;
+#endif
+
+	/* SG_ voltage_V : 8|8@1+ (1,0) [0|1] "" Vector__XXX */
+	changed |= (v->voltage_ac_V != d[1]) ? TG3SPMC_VAR_FLAG_VOLTAGE_AC :
+						0u;
+	v->voltage_ac_V = d[1];
+
+	flag = _tg3spm_decode_ac_params_ac_present(d);
+	changed |= (v->ac_present != flag) ? TG3SPMC_VAR_FLAG_AC_PRESENT : 0u;
+	v->ac_present = flag;
+
+	/* SG_ peak_current_A : 41|9@1+ (0.1,0) [0|1] "" Vector__XXX */
+	/* (peak_current_A * 10) */
+#if defined(TG3SPMC_FIXED_POINT)
+	/* raw * 70.710678 (100/sqrt(2)), split to fit into 32 bits */
+	raw_current = (((d[6] & 0x0003u) << 8u) | d[5]) >> 1u;
+
+	current_ac_mA = (uint16_t)((raw_current * 70u) +
+				   ((raw_current * 710678u) / 1000000u));
+	changed |= (v->current_ac_mA != current_ac_mA) ?
+		   TG3SPMC_VAR_FLAG_CURRENT_AC : 0u;
+	v->current_ac_mA = current_ac_mA;
+#else
+	current_ac_A = 0.070710678118f * /* 0.1/sqrt(2) */
+		((((d[6] & 0x0003u) << 8u) | d[5]) >> 1u);
+	changed |= (v->current_ac_A != current_ac_A) ?
+		   TG3SPMC_VAR_FLAG_CURRENT_AC : 0u;
+	v->current_ac_A = current_ac_A;
+#endif
+
+	/* TODO rename */
+	/* SG_ precharge_en : 17|1@1+ (1,0) [0|1] "" Vector__XXX */
+	flag = ((d[2] & 0x02u) != 0u) ? true : false;
+	changed |= (v->en_present != flag) ? TG3SPMC_VAR_FLAG_EN_PRESENT : 0u;
+	v->en_present = flag;
+
+	flag = _tg3spm_decode_ac_params_fault(d);
+	changed |= (v->fault != flag) ? TG3SPMC_VAR_FLAG_FAULT : 0u;
+	v->fault = flag;
+
+	return changed;
+}
 
-	/* Generic for all three modules. */
-	switch (base_id) {
-	case 0x207u: /* AC_vars */
-		/* SG_ voltage_V : 8|8@1+ (1,0) [0|1] "" Vector__XXX */
-		v->voltage_ac_V = f->data[1];
-		v->ac_present = (v->voltage_ac_V > 70u)      ? true : false;
+/**
+ * @brief Decodes raw 0x217 (Status) payload.
+ * @param v Pointer to the variables to be updated.
+ * @param d Raw payload (8 bytes).
+ * @return Changed variables (enum tg3spmc_var_flag bits).
+ */
+uint16_t _tg3spm_decode_status(struct tg3spmc_vars *v, const uint8_t *d)
+{
+	uint16_t changed = (v->status != d[0]) ? TG3SPMC_VAR_FLAG_STATUS : 0u;
 
-		/* SG_ peak_current_A : 41|9@1+ (0.1,0) [0|1] "" Vector__XXX */
-		/* (peak_current_A * 10) */
-		v->current_ac_A = 0.070710678118f * /* 0.1/sqrt(2) */
-			((((f->data[6] & 0x0003u) << 8u) | f->data[5]) >> 1u);
+	/* Status Message: Raw status byte. */
+	v->status = d[0];
 
-   		/* TODO rename */
-		/* SG_ precharge_en : 17|1@1+ (1,0) [0|1] "" Vector__XXX */
-   		v->en_present = ((f->data[2] & 0x02u) != 0u) ? true : false;
+	return changed;
+}
 
-		/* SG_ fault_flag : 18|1@1+ (1,0) [0|1] "" Vector__XXX */
-		v->fault = ((f->data[2] & 0x04u) != 0u) ? true : false;
+/**
+ * @brief Decodes raw 0x227 (DC params) payload.
+ * @param v Pointer to the variables to be updated.
+ * @param d Raw payload (8 bytes).
+ * @return Changed variables (enum tg3spmc_var_flag bits).
+ */
+uint16_t _tg3spm_decode_dc_params(struct tg3spmc_vars *v, const uint8_t *d)
+{
+	uint16_t changed = 0u;
+
+	/* I highly doubt that they transmit actual ADC data,
+	 * But these scalars seems to be close to real measurements. */
+#if defined(TG3SPMC_FIXED_POINT)
+	uint32_t raw_voltage = ((uint32_t)d[3] << 8u) | d[2];
+	uint32_t raw_current = ((uint32_t)d[5] << 8u) | d[4];
+	uint32_t voltage_dc_mV;
+	uint16_t current_dc_mA;
+
+	/* raw * 700000 / 0xFFFF, split to fit into 32 bits:
+	 * 700000 = 10 * 0xFFFF + 44650 */
+	voltage_dc_mV = (raw_voltage * 10u) +
+			((raw_voltage * 44650u) / 0xFFFFu);
+
+	current_dc_mA = (uint16_t)((raw_current * 50000u) / 0xFFFFu);
+
+	changed |= (v->voltage_dc_mV != voltage_dc_mV) ?
+		   TG3SPMC_VAR_FLAG_VOLTAGE_DC : 0u;
+	changed |= (v->current_dc_mA != current_dc_mA) ?
+		   TG3SPMC_VAR_FLAG_CURRENT_DC : 0u;
+
+	v->voltage_dc_mV = voltage_dc_mV;
+	v->current_dc_mA = current_dc_mA;
+#else
+	float voltage_dc_V = ((d[3] << 8u) | d[2]) * 700.0f/0xFFFF;
+	/*mul = 0.01068131532768749523155565728237*/
+
+	float current_dc_A = ((d[5] << 8u) | d[4]) * 50.0f/0xFFFF;
+	/*mul = 0.000762951094834821087968261234455*/
+
+	changed |= (v->voltage_dc_V != voltage_dc_V) ?
+		   TG3SPMC_VAR_FLAG_VOLTAGE_DC : 0u;
+	changed |= (v->current_dc_A != current_dc_A) ?
+		   TG3SPMC_VAR_FLAG_CURRENT_DC : 0u;
+
+	v->voltage_dc_V = voltage_dc_V;
+	v->current_dc_A = current_dc_A;
+#endif
+
+	return changed;
+}
 
-		i->rx.recv_flags |= (1u << 0u);
-		break;
-	case 0x217u: /* Status */
-		/* Status Message: Raw status byte. */
-		v->status = f->data[0];
+/**
+ * @brief Decodes raw 0x237 (Sensors) payload.
+ * @param v Pointer to the variables to be updated.
+ * @param d Raw payload (8 bytes).
+ * @return Changed variables (enum tg3spmc_var_flag bits).
+ */
+uint16_t _tg3spm_decode_sensors(struct tg3spmc_vars *v, const uint8_t *d)
+{
+	uint16_t changed = 0u;
 
-		i->rx.recv_flags |= (1u << 1u);
-		break;
-	case 0x227u: /* DC_vars */
-		/* I highly doubt that they transmit actual ADC data,
-		 * But these scalars seems to be close to real measurements. */
-		v->voltage_dc_V =
-			((f->data[3] << 8u) | f->data[2]) * 700.0f/0xFFFF;
-		/*mul = 0.01068131532768749523155565728237*/
-
-		v->current_dc_A =
-			((f->data[5] << 8u) | f->data[4]) * 50.0f/0xFFFF;
-		/*mul = 0.000762951094834821087968261234455*/
-
-		i->rx.recv_flags |= (1u << 2u);
-		break;
-	case 0x237u:
-		/* Temp Msg 1: Temp sensor readings and target temp. */
-		v->temp1_C = (int16_t)f->data[0] - 40;
-		v->temp2_C = (int16_t)f->data[1] - 40;
-		v->inlet_target_temp_C = (int16_t)f->data[5] - 40;
+	/* Temp Msg 1: Temp sensor readings and target temp. */
+	int16_t temp1_C = (int16_t)d[0] - 40;
+	int16_t temp2_C = (int16_t)d[1] - 40;
+	int16_t inlet_target_temp_C = (int16_t)d[5] - 40;
 
-		i->rx.recv_flags |= (1u << 3u);
-		break;
-	case 0x247u:
-		/* 15/64, close to 1/4 */
-		/* Temp Msg 2: Current limit due to temperature. */
-		v->current_limit_due_temp_A = f->data[0] * 0.234375;
+	changed |= (v->temp1_C != temp1_C) ? TG3SPMC_VAR_FLAG_TEMP1 : 0u;
+	changed |= (v->temp2_C != temp2_C) ? TG3SPMC_VAR_FLAG_TEMP2 : 0u;
+	changed |= (v->inlet_target_temp_C != inlet_target_temp_C) ?
+		   TG3SPMC_VAR_FLAG_INLET_TARGET_TEMP : 0u;
 
-		i->rx.recv_flags |= (1u << 4u);
-		break;
+	v->temp1_C = temp1_C;
+	v->temp2_C = temp2_C;
+	v->inlet_target_temp_C = inlet_target_temp_C;
 
-	case 0x347u:
-		/* 1000ms period
-		 * byte[2] goes 0x80 shortly when there's
-		 * some distruption in AC supply
-		 * (lose or bad connection to AC socket (sparks)) */
-		break;
+	return changed;
+}
 
-	case 0x467u:
-		/* 100ms period
-		 * byte[0], byte[1] goes 7E 09 (24300 decimal in little endian)
-		 * It slowly increases to that value after start, approx 5s */
-		break;
+/**
+ * @brief Decodes raw 0x247 (Limits) payload.
+ * @param v Pointer to the variables to be updated.
+ * @param d Raw payload (8 bytes).
+ * @return Changed variables (enum tg3spmc_var_flag bits).
+ */
+uint16_t _tg3spm_decode_limits(struct tg3spmc_vars *v, const uint8_t *d)
+{
+	uint16_t changed;
 
-	case 0x537u:
-		/* 900ms period
-		 * Probably fragmented CAN message
-		 * byte[0] is an index of fragment
-		 * Range: 0x0A - 0x14
-		 * Observed sequence: 0A 0B 0D 0E 0F 10 11 12 13 14
-		 * */
-		break;
+	/* 15/64, close to 1/4 */
+	/* Temp Msg 2: Current limit due to temperature. */
+#if defined(TG3SPMC_FIXED_POINT)
+	uint16_t limit_mA = (uint16_t)(((uint32_t)d[0] * 1875u) / 8u);
 
-	case 0x717u:
-		/* 100ms period
-		 * Probably fragmented CAN message
-		 * byte[0] is an index of fragment (range: 0x01 - 0x1C)
-		 * Observed sequence: 01 02 04 05 06 07 08 09 0A 0B 0C 0E 0F
-		 * 		      10 11 12 13 14 16 17 18 19 1A 1B 1C
-		 */
-		break;
+	changed = (v->current_limit_due_temp_mA != limit_mA) ?
+		  TG3SPMC_VAR_FLAG_CURRENT_LIMIT : 0u;
+	v->current_limit_due_temp_mA = limit_mA;
+#else
+	float limit_A = d[0] * 0.234375;
 
-	default:
-		valid_frame = false;
-		break;
+	changed = (v->current_limit_due_temp_A != limit_A) ?
+		  TG3SPMC_VAR_FLAG_CURRENT_LIMIT : 0u;
+	v->current_limit_due_temp_A = limit_A;
+#endif
+
+	return changed;
+}
+
+/******************************************************************************
+ * TG3SPMC PRIVATE METHODS
+ *****************************************************************************/
+/**
+ * @brief Disables module power and charge, recording when it happened.
+ *
+ * The timestamp is only taken on the first drop, so the step path does not
+ * overwrite the time recorded by the fast RX path.
+ * @param self   Pointer to the tg3spmc instance.
+ * @param now_ms Time of the drop on the uptime clock (ms).
+ */
+void _tg3spmc_drop_pins(struct tg3spmc *self, uint32_t now_ms)
+{
+	struct _tg3spmc_io *i = &self->_io;
+
+	if (i->pwron_out || i->chgen_out) {
+		self->fault_time_ms = now_ms;
+	}
+
+	i->pwron_out = false;
+	i->chgen_out = false;
+}
+
+/**
+ * @brief Consumes a single CAN message received from the module.
+ *
+ * Messages are not decoded here, only their raw payload is stored (lazy
+ * decoding). See _tg3spmc_sync_vars.
+ * @param self Pointer to the tg3spmc instance.
+ * @param msg Message index (enum _tg3spm_msg), already resolved from ID.
+ * @param f Pointer to the received CAN frame.
+ * @param now_ms Reception time on the uptime clock (ms), stamps fast drop.
+ */
+void _tg3spmc_consume_msg(struct tg3spmc *self, uint8_t msg,
+			  const struct tg3spmc_frame *f, uint32_t now_ms)
+{
+	struct _tg3spmc_io *i = &self->_io;
+
+	if (msg < (uint8_t)_TG3SPM_MSG_COUNT) {
+		_tg3spmc_reader_store(&i->rx, msg, f);
 	}
 
-	if (valid_frame && (i->rx.recv_flags == ((1u << 5u) - 1u))) {
+	if (msg < (uint8_t)_TG3SPM_MSG_TOTAL) {
+		_tg3spmc_reader_track(&i->rx, msg, self->_uptime_ms);
+	}
+
+	/* Side channels are valid frames, but carry nothing to decode */
+	if ((msg < (uint8_t)_TG3SPM_MSG_TOTAL) &&
+	    (i->rx.recv_flags == ((1u << _TG3SPM_MSG_COUNT) - 1u))) {
 		i->rx.has_frames = true;
 		i->rx.timer_ms   = 0u;
 	}
+
+	/* Module has answered to the initial setup. First status after the
+	 * send may be older than the setup, so the next one is awaited. */
+	if ((msg == (uint8_t)_TG3SPM_MSG_STATUS) && self->_setup_sent) {
+		self->_setup_acked  = self->_setup_status;
+		self->_setup_status = true;
+	}
+
+	/* Fast path: don't wait for the next step to cut the pins.
+	 * Fault is latched, so the FSM goes through FAULT on the next step
+	 * even if a clean frame overwrites the raw payload before that. */
+	if (self->_fast_fault &&
+	    (msg == (uint8_t)_TG3SPM_MSG_AC_PARAMS) &&
+	    (self->_state == (uint8_t)_TG3SPMC_STATE_RUNNING) &&
+	    i->rx.has_frames &&
+	    _tg3spm_decode_ac_params_fault(i->rx.raw[_TG3SPM_MSG_AC_PARAMS])) {
+		self->_pending_fault = (uint8_t)TG3SPMC_FAULT_CAUSE_FAULT_FLAG;
+		_tg3spmc_drop_pins(self, now_ms);
+	}
 }
 
 /**
- * @brief Encodes the 0x45C (Broadcast) CAN frame.
- * It contains the target DC voltage setting.
+ * @brief Consumes a single CAN frame received from the module.
  *
- * @warning This message is non-local and should only be sent by one instance.
+ * It uses the module's ID to calculate the message base ID.
+ * @param self Pointer to the tg3spmc instance.
+ * @param f Pointer to the received CAN frame.
+ * @param now_ms Reception time on the uptime clock (ms).
+ */
+void _tg3spmc_consume_frame(struct tg3spmc *self,
+			    const struct tg3spmc_frame *f, uint32_t now_ms)
+{
+	/* Use current module ID to calculate base ID */
+	uint32_t base_id = f->id - (self->_id * _TG3SPM_MODULE_ID_SPACING);
+
+	_tg3spmc_consume_msg(self, _tg3spm_msg_from_base_id(base_id), f,
+			     now_ms);
+}
+
+/**
+ * @brief Decodes all messages received since the last call (lazy decoding).
+ *
+ * Only messages marked dirty are decoded, then dirty flags are cleared.
+ * @param self Pointer to the tg3spmc instance.
+ */
+void _tg3spmc_sync_vars(struct tg3spmc *self)
+{
+	struct _tg3spmc_reader *r = &self->_io.rx;
+	struct  tg3spmc_vars   *v = &self->_vars;
+
+	uint8_t  dirty = r->dirty_flags;
+	uint16_t changed = 0u;
+
+	if ((dirty & (1u << _TG3SPM_MSG_AC_PARAMS)) != 0u) {
+		changed |= _tg3spm_decode_ac_params(v,
+					r->raw[_TG3SPM_MSG_AC_PARAMS]);
+	}
+
+	if ((dirty & (1u << _TG3SPM_MSG_STATUS)) != 0u) {
+		changed |= _tg3spm_decode_status(v,
+					r->raw[_TG3SPM_MSG_STATUS]);
+	}
+
+	if ((dirty & (1u << _TG3SPM_MSG_DC_PARAMS)) != 0u) {
+		changed |= _tg3spm_decode_dc_params(v,
+					r->raw[_TG3SPM_MSG_DC_PARAMS]);
+	}
+
+	if ((dirty & (1u << _TG3SPM_MSG_SENSORS)) != 0u) {
+		changed |= _tg3spm_decode_sensors(v,
+					r->raw[_TG3SPM_MSG_SENSORS]);
+	}
+
+	if ((dirty & (1u << _TG3SPM_MSG_LIMITS)) != 0u) {
+		changed |= _tg3spm_decode_limits(v,
+					r->raw[_TG3SPM_MSG_LIMITS]);
+	}
+
+	r->dirty_flags = 0u;
+	self->_vars_changed |= changed;
+
+	if (changed != 0u) {
+		self->_snapshot_dirty = true;
+	}
+}
+
+/**
+ * @brief Tells if state-dependent control bytes must request power output.
+ * @param self Pointer to the tg3spmc instance.
+ */
+bool _tg3spmc_is_started(struct tg3spmc *self)
+{
+	return (self->_state == (uint8_t)_TG3SPMC_STATE_RUNNING) &&
+	       !self->_hold_start;
+}
+
+/**
+ * @brief Encodes setpoint field of the 0x45C frame (target DC voltage).
  * @param self Pointer to the tg3spmc instance.
  * @param f Pointer to the CAN frame to be populated.
  */
-void _tg3spmc_encode_frame_h45C(struct tg3spmc *self,
-				struct tg3spmc_frame *f)
+void _tg3spmc_encode_h45C_setpoint(struct tg3spmc *self,
+				   struct tg3spmc_frame *f)
 {
-	/* TODO return frame instead of writing by reference */
 	struct tg3spmc_config *s = &self->_config;
 
+#if defined(TG3SPMC_FIXED_POINT)
+	uint16_t raw_set_voltage_dc_V = (uint16_t)(s->voltage_dc_mV / 10u);
+#else
 	uint16_t raw_set_voltage_dc_V = s->voltage_dc_V * 100.0f;
-
-	f->id  = 0x45C;
-	f->len = 8;
+#endif
 
 	f->data[0] = (raw_set_voltage_dc_V & 0x00FFu) >> 0u;
 	f->data[1] = (raw_set_voltage_dc_V & 0xFF00u) >> 8u;
+}
 
-	if (self->_state == (uint8_t)_TG3SPMC_STATE_RUNNING &&
-	    !self->_hold_start) {
+/**
+ * @brief Encodes state-dependent control field of the 0x45C frame.
+ * @param self Pointer to the tg3spmc instance.
+ * @param f Pointer to the CAN frame to be populated.
+ */
+void _tg3spmc_encode_h45C_control(struct tg3spmc *self,
+				  struct tg3spmc_frame *f)
+{
+	if (_tg3spmc_is_started(self)) {
 		f->data[3] = 0x2E; /* State-dependent control byte */
 	} else {
 		f->data[3] = 0x0E; /* State-dependent control byte */
 	}
+}
+
+/**
+ * @brief Encodes the 0x45C (Broadcast) CAN frame.
+ * It contains the target DC voltage setting.
+ *
+ * @warning This message is non-local and should only be sent by one instance.
+ * @param self Pointer to the tg3spmc instance.
+ * @param f Pointer to the CAN frame to be populated.
+ */
+void _tg3spmc_encode_frame_h45C(struct tg3spmc *self,
+				struct tg3spmc_frame *f)
+{
+	/* TODO return frame instead of writing by reference */
+	f->id  = 0x45C;
+	f->len = 8;
+
+	_tg3spmc_encode_h45C_setpoint(self, f);
+	_tg3spmc_encode_h45C_control(self, f);
 
 	/* Unknown, static data */
 	f->data[2] = 0x14;
@@ -506,36 +1429,67 @@ void _tg3spmc_encode_frame_h45C(struct tg3spmc *self,
 }
 
 /**
- * @brief Encodes the 0x42C (+ID) CAN frame for module-specific control.
- *
- * This message contains the target AC current setting.
+ * @brief Encodes setpoint field of the 0x42C frame (target AC current).
  * @param self Pointer to the tg3spmc instance.
  * @param f Pointer to the CAN frame to be populated.
  */
-void _tg3spmc_encode_frame_h42C(struct tg3spmc *self,
-				struct tg3spmc_frame *f)
+void _tg3spmc_encode_h42C_setpoint(struct tg3spmc *self,
+				   struct tg3spmc_frame *f)
 {
-	/* TODO return frame instead of writing by reference */
 	struct tg3spmc_config *s = &self->_config;
 
+#if defined(TG3SPMC_FIXED_POINT)
+	uint16_t raw_set_current_ac_A = (uint16_t)
+					((s->current_ac_mA * 3u) / 2u);
+#else
 	uint16_t raw_set_current_ac_A = s->current_ac_A * 1500.0f;
-
-	/* Use specific module ID */
-	f->id  = 0x42Cu + (self->_id * 0x10u);
-	f->len = 8;
+#endif
 
 	f->data[2] = (raw_set_current_ac_A & 0x00FFu) >> 0u;
 	f->data[3] = (raw_set_current_ac_A & 0xFF00u) >> 8u;
+}
+
+/**
+ * @brief Encodes state-dependent control fields of the 0x42C frame.
+ * @param self Pointer to the tg3spmc instance.
+ * @param f Pointer to the CAN frame to be populated.
+ */
+void _tg3spmc_encode_h42C_control(struct tg3spmc *self,
+				  struct tg3spmc_frame *f)
+{
+	struct tg3spmc_config *s = &self->_config;
 
-	if (self->_state == (uint8_t)_TG3SPMC_STATE_RUNNING &&
-	    !self->_hold_start) {
+	if (_tg3spmc_is_started(self)) {
 		f->data[1] = 0xBB; /* State-dependent control byte */
 		/* FE - normal operation. FF - clear faults. */
 		f->data[4] = 0xFE;
 	} else {
+#if defined(TG3SPMC_FIXED_POINT)
+		f->data[1] = (uint8_t)(s->rated_voltage_ac_mV / 1200u);
+#else
 		f->data[1] = s->rated_voltage_ac_V / 1.2f;
+#endif
 		f->data[4] = 0x64; /* State-dependent control byte */
 	}
+}
+
+/**
+ * @brief Encodes the 0x42C (+ID) CAN frame for module-specific control.
+ *
+ * This message contains the target AC current setting.
+ * @param self Pointer to the tg3spmc instance.
+ * @param f Pointer to the CAN frame to be populated.
+ */
+void _tg3spmc_encode_frame_h42C(struct tg3spmc *self,
+				struct tg3spmc_frame *f)
+{
+	/* TODO return frame instead of writing by reference */
+	/* Use specific module ID */
+	f->id  = 0x42Cu + (self->_id * 0x10u);
+	f->len = 8;
+
+	_tg3spmc_encode_h42C_setpoint(self, f);
+	_tg3spmc_encode_h42C_control(self, f);
 
 	/* Unknown, static data */
 	f->data[0] = 0x42;
@@ -571,69 +1525,245 @@ void _tg3spmc_encode_frame_h368(struct tg3spmc *self,
 	f->data[7] = 0xff;
 }
 
+/**
+ * @brief Encodes all writer frames from scratch.
+ *
+ * Called once on init, afterwards only dirty fields are re-encoded.
+ * @param self Pointer to the tg3spmc instance.
+ */
+void _tg3spmc_writer_encode_all(struct tg3spmc *self)
+{
+	struct _tg3spmc_writer *w = &self->_io.tx;
+
+	_tg3spmc_encode_frame_h42C(self,
+				   &w->frames[_TG3SPMC_WRITER_FRAME_H42C]);
+	_tg3spmc_encode_frame_h45C(self,
+				   &w->frames[_TG3SPMC_WRITER_FRAME_H45C]);
+	_tg3spmc_encode_frame_h368(self,
+				   &w->frames[_TG3SPMC_WRITER_FRAME_H368]);
+
+	w->started = _tg3spmc_is_started(self);
+	w->dirty   = 0u;
+}
+
 /**
  * @brief Queues tx messages for send.
  * User is responsible for further processing of these
+ *
+ * Frames are kept pre-encoded, only fields invalidated by a config change
+ * or a control state transition are re-encoded. 0x368 is never re-encoded.
  * @param self Pointer to the tg3spmc instance.
  */
 void _tg3spmc_queue_tx(struct tg3spmc *self)
 {
 	struct _tg3spmc_io *i = &self->_io;
 
-	/* TODO implement _tg3spmc_writer_put_frame instead */
-	_tg3spmc_encode_frame_h42C(self, &i->tx.frames[0]);
+	struct tg3spmc_frame *h42C =
+				&i->tx.frames[_TG3SPMC_WRITER_FRAME_H42C];
+	struct tg3spmc_frame *h45C =
+				&i->tx.frames[_TG3SPMC_WRITER_FRAME_H45C];
+
+	bool started = _tg3spmc_is_started(self);
+
+	if (started != i->tx.started) {
+		i->tx.started = started;
+		i->tx.dirty  |= (uint8_t)_TG3SPMC_WRITER_DIRTY_CONTROL;
+	}
+
+	if ((i->tx.dirty & (uint8_t)_TG3SPMC_WRITER_DIRTY_SETPOINT) != 0u) {
+		_tg3spmc_encode_h42C_setpoint(self, h42C);
+		_tg3spmc_encode_h45C_setpoint(self, h45C);
+	}
+
+	if ((i->tx.dirty & (uint8_t)_TG3SPMC_WRITER_DIRTY_CONTROL) != 0u) {
+		_tg3spmc_encode_h42C_control(self, h42C);
+		_tg3spmc_encode_h45C_control(self, h45C);
+	}
+
+	i->tx.dirty = 0u;
 
+	/* TODO implement _tg3spmc_writer_put_frame instead */
 	if (i->tx.enable_broadcast) {
 		i->tx.count = 3u;
-		_tg3spmc_encode_frame_h45C(self, &i->tx.frames[1]);
-		_tg3spmc_encode_frame_h368(self, &i->tx.frames[2]);
 	} else {
 		i->tx.count = 1u;
 	}
 }
 
 /**
- * @brief This function will try to catch common error during charging.
- * Timeouts, module errors, etc.
+ * @brief Records that the queued TX frames were taken for sending.
  *
- * It must immediately go into error recovery state, after detection.
- * 
+ * Called when the last queued frame leaves the writer. Frames queued in
+ * RUNNING state carry the initial setup.
  * @param self Pointer to the tg3spmc instance.
  */
-bool _tg3spmc_detected_errors_during_charge(struct tg3spmc *self)
+void _tg3spmc_tx_taken(struct tg3spmc *self)
 {
-	struct _tg3spmc_io   *i = &self->_io;
-	struct  tg3spmc_vars *v = &self->_vars;
-
-	bool fault = false;
-
-	if (i->rx.timer_ms >= TG3SPMC_CONST_CAN_RX_TIMEOUT_MS) {
-		self->fault_cause = TG3SPMC_FAULT_CAUSE_RX_TIMEOUT;
-		i->rx.has_frames = false;
-		fault = true;
-	}
-
-	if ((i->rx.has_frames) && (v->fault == true)) {
-		self->fault_cause = TG3SPMC_FAULT_CAUSE_FAULT_FLAG;
-		fault = true;
+	if (self->_state == (uint8_t)_TG3SPMC_STATE_RUNNING) {
+		self->_setup_sent = true;
 	}
-
-	return fault;
 }
 
-/******************************************************************************
- * TG3SPMC PUBLIC
- *****************************************************************************/
 /**
- * @brief Initializes the single phase module controller instance.
+ * @brief Validates configuration before leaving CONFIG state.
  * @param self Pointer to the tg3spmc instance.
- * @param id The module's unique ID (0, 1, or 2).
+ * @return True if configuration is valid.
  */
-void tg3spmc_init(struct tg3spmc *self, uint8_t id)
+bool _tg3spmc_config_is_valid(struct tg3spmc *self)
 {
-	struct _tg3spmc_io     *i = &self->_io;
-	struct  tg3spmc_config *s = &self->_config;
-	struct  tg3spmc_vars   *v = &self->_vars;
+	struct tg3spmc_config *s = &self->_config;
+
+#if defined(TG3SPMC_FIXED_POINT)
+	return ((s->rated_voltage_ac_mV > 0u) &&
+		(s->voltage_dc_mV >= TG3SPMC_CONST_MIN_DC_VOLTAGE_MV));
+#else
+	return ((s->rated_voltage_ac_V > 0.0f) &&
+		(s->voltage_dc_V >= TG3SPMC_CONST_MIN_DC_VOLTAGE_V));
+#endif
+}
+
+/**
+ * @brief Remaining time until timer reaches its limit (0 if reached).
+ * @param timer_ms Current timer value (milliseconds).
+ * @param limit_ms Timer limit (milliseconds).
+ */
+uint32_t _tg3spmc_time_left_ms(uint32_t timer_ms, uint32_t limit_ms)
+{
+	return (timer_ms < limit_ms) ? (limit_ms - timer_ms) : 0u;
+}
+
+/**
+ * @brief Time until the first of seen 0x207-0x247 messages goes silent.
+ * @param self Pointer to the tg3spmc instance.
+ * @return Time left (milliseconds), TG3SPMC_DEADLINE_NONE if none seen.
+ */
+uint32_t _tg3spmc_msg_time_left_ms(struct tg3spmc *self)
+{
+	struct _tg3spmc_reader *r = &self->_io.rx;
+
+	uint32_t left_ms = TG3SPMC_DEADLINE_NONE;
+	uint32_t t;
+	uint8_t  m;
+
+	for (m = 0u; m < (uint8_t)_TG3SPM_MSG_COUNT; m++) {
+		if ((r->seen_flags & (1u << m)) == 0u) {
+			continue;
+		}
+
+		/* Silent once past the timeout */
+		t = _tg3spmc_time_left_ms(
+			self->_uptime_ms - r->health[m].last_ms,
+			(TG3SPMC_CONST_MSG_TIMEOUT_PERIODS *
+			 _tg3spm_msg_period_ms(m)) + 1u);
+		if (t < left_ms) {
+			left_ms = t;
+		}
+	}
+
+	return left_ms;
+}
+
+/**
+ * @brief Checks if the module is ready to leave hold-start.
+ *
+ * Logs show chgen pin feedback (0x217) about 10ms after chgen pin is
+ * enabled. Once it's reported for the initial setup, the module is ready.
+ * charge_disallowed only clears after start is requested, so both AC
+ * flags are used the other way: either one tells that the module is
+ * already past its setup (e.g. controller restarted, module did not).
+ * @param self Pointer to the tg3spmc instance.
+ * @return True if hold-start may be released.
+ */
+bool _tg3spmc_module_is_ready(struct tg3spmc *self)
+{
+	struct _tg3spmc_io *i = &self->_io;
+
+	const uint8_t *ac = i->rx.raw[_TG3SPM_MSG_AC_PARAMS];
+	const uint8_t *st = i->rx.raw[_TG3SPM_MSG_STATUS];
+
+	bool ready = false;
+
+	if (i->rx.has_frames && _tg3spm_decode_ac_params_ac_present(ac) &&
+	    !_tg3spm_decode_ac_params_fault(ac)) {
+		/* SG_ flag_chgen_pin : 0|1@1+ (1,0) [0|1] "" Vector__XXX */
+		ready = self->_setup_acked &&
+			((st[0] & _TG3SPM_FIELD_STATUS_FLAGS_CHGEN_PIN_ON) !=
+			 0u);
+
+		/* SG_ flag_softstart_allowed : 17|1@1+ (1,0) [0|1] "" */
+		if ((ac[2] & _TG3SPM_FIELD_AC_PARAMS_FLAGS0_SOFTSTART_ALLOWED)
+		    != 0u) {
+			ready = true;
+		}
+
+		if (!_tg3spm_decode_ac_params_charge_disallowed(ac)) {
+			ready = true;
+		}
+	}
+
+	return ready;
+}
+
+/**
+ * @brief This function will try to catch common error during charging.
+ * Timeouts, module errors, etc.
+ *
+ * It must immediately go into error recovery state, after detection.
+ * 
+ * @param self Pointer to the tg3spmc instance.
+ */
+bool _tg3spmc_detected_errors_during_charge(struct tg3spmc *self)
+{
+	struct _tg3spmc_io *i = &self->_io;
+
+	bool fault = false;
+
+	if (i->rx.timer_ms >= TG3SPMC_CONST_CAN_RX_TIMEOUT_MS) {
+		self->fault_cause = TG3SPMC_FAULT_CAUSE_RX_TIMEOUT;
+		i->rx.has_frames = false;
+		fault = true;
+	}
+
+	/* A single decodable message went silent, others still talk */
+	if (!fault && self->_msg_timeout_fault &&
+	    ((_tg3spmc_reader_stale_flags(&i->rx, self->_uptime_ms) &
+	      ((1u << _TG3SPM_MSG_COUNT) - 1u)) != 0u)) {
+		self->fault_cause = TG3SPMC_FAULT_CAUSE_MSG_TIMEOUT;
+		i->rx.has_frames = false;
+		fault = true;
+	}
+
+	/* Fault flag is checked directly on raw payload,
+	 * so there's no need to decode everything else */
+	if ((i->rx.has_frames) &&
+	    _tg3spm_decode_ac_params_fault(i->rx.raw[_TG3SPM_MSG_AC_PARAMS])) {
+		self->fault_cause = TG3SPMC_FAULT_CAUSE_FAULT_FLAG;
+		fault = true;
+	}
+
+	/* Fault latched by the fast RX path, payload may be clean by now */
+	if (!fault &&
+	    (self->_pending_fault != (uint8_t)TG3SPMC_FAULT_CAUSE_NONE)) {
+		self->fault_cause = self->_pending_fault;
+		fault = true;
+	}
+
+	return fault;
+}
+
+/******************************************************************************
+ * TG3SPMC PUBLIC
+ *****************************************************************************/
+/**
+ * @brief Initializes the single phase module controller instance.
+ * @param self Pointer to the tg3spmc instance.
+ * @param id The module's unique ID (0, 1, or 2).
+ */
+void tg3spmc_init(struct tg3spmc *self, uint8_t id)
+{
+	struct _tg3spmc_io     *i = &self->_io;
+	struct  tg3spmc_config *s = &self->_config;
+	struct  tg3spmc_vars   *v = &self->_vars;
 
 	/* Base */
 	self->_id = id;
@@ -645,8 +1775,16 @@ void tg3spmc_init(struct tg3spmc *self, uint8_t id)
 	self->_timer_ms = 0u;
 
 	self->fault_cause = 0u;
+	self->fault_time_ms = 0u;
+	self->_uptime_ms = 0u;
+	self->_fast_fault = false;
+	self->_pending_fault = (uint8_t)TG3SPMC_FAULT_CAUSE_NONE;
+	self->_msg_timeout_fault = false;
 
-	self->_hold_start = true;
+	self->_hold_start  = true;
+	self->_setup_sent   = false;
+	self->_setup_status = false;
+	self->_setup_acked  = false;
 
 	/* IO */
 	i->pwron_out = false;
@@ -654,6 +1792,21 @@ void tg3spmc_init(struct tg3spmc *self, uint8_t id)
 	_tg3spmc_writer_init(&i->tx);
 	_tg3spmc_reader_init(&i->rx);
 
+#if defined(TG3SPMC_FIXED_POINT)
+	/* Settings */
+	s->voltage_dc_mV = 0u;
+	s->current_ac_mA = 0u;
+	s->rated_voltage_ac_mV = 0u;
+
+	/* Vars */
+	v->voltage_dc_mV = 0u;
+	v->voltage_ac_V  = 0u;
+	v->current_dc_mA = 0u;
+	v->current_ac_mA = 0u;
+
+	v->inlet_target_temp_C       = 0;
+	v->current_limit_due_temp_mA = 0u;
+#else
 	/* Settings */
 	s->voltage_dc_V = 0.0f;
 	s->current_ac_A = 0.0f;
@@ -667,6 +1820,7 @@ void tg3spmc_init(struct tg3spmc *self, uint8_t id)
 
 	v->inlet_target_temp_C      = 0;
 	v->current_limit_due_temp_A = 0.0f;
+#endif
 
 	v->temp1_C = 0;
 	v->temp2_C = 0;
@@ -676,6 +1830,22 @@ void tg3spmc_init(struct tg3spmc *self, uint8_t id)
 	v->fault = false;
 
 	v->status = 0u;
+
+	self->_vars_changed = 0u;
+
+	/* Queues */
+	tg3spmc_queue_init(&self->_rx_queue);
+	tg3spmc_queue_init(&self->_tx_queue);
+	self->_tx_queued = false;
+
+	/* Snapshot */
+	self->_snapshot.seq   = 0u;
+	self->_snapshot.valid = 0u;
+	self->_snapshot_dirty = false;
+	memset(self->_snapshot.words, 0, sizeof(self->_snapshot.words));
+
+	/* Pre-encode TX frames */
+	_tg3spmc_writer_encode_all(self);
 }
 
 /**
@@ -689,13 +1859,24 @@ void tg3spmc_set_config(struct tg3spmc *self,
 			struct tg3spmc_config config)
 {
 	struct tg3spmc_config *s = &self->_config;
+	struct _tg3spmc_io    *i = &self->_io;
 
 	*s = config;
 
+	/* Config is used by setpoint and control fields of TX frames */
+	i->tx.dirty |= (uint8_t)(_TG3SPMC_WRITER_DIRTY_SETPOINT |
+				 _TG3SPMC_WRITER_DIRTY_CONTROL);
+
 	/** Enforce valid values */
+#if defined(TG3SPMC_FIXED_POINT)
+	if (config.voltage_dc_mV < TG3SPMC_CONST_MIN_DC_VOLTAGE_MV) {
+		s->voltage_dc_mV = TG3SPMC_CONST_MIN_DC_VOLTAGE_MV;
+	}
+#else
 	if (config.voltage_dc_V < TG3SPMC_CONST_MIN_DC_VOLTAGE_V) {
 		s->voltage_dc_V = TG3SPMC_CONST_MIN_DC_VOLTAGE_V;
 	}
+#endif
 }
 
 /**
@@ -751,11 +1932,101 @@ bool tg3spmc_get_tx_frame(struct tg3spmc *self, struct tg3spmc_frame *f)
 		*f = i->tx.frames[i->tx.count];
 
 		frame_available = true;
+
+		if (i->tx.count == 0u) {
+			_tg3spmc_tx_taken(self);
+		}
 	}
 
 	return frame_available;
 }
 
+/**
+ * @brief Retrieves up to `max` queued TX frames for immediate sending.
+ *
+ * Frames are copied in the same order as repeated calls of
+ * tg3spmc_get_tx_frame would return them.
+ *
+ * @param self Pointer to the tg3spmc instance.
+ * @param[out] out Array where frames will be copied.
+ * @param max Capacity of `out` array.
+ * @return Number of copied frames (0 if no TX frames available).
+ *
+ * @note **Side effects:** this function will pop copied frames.
+ */
+uint8_t tg3spmc_get_tx_frames(struct tg3spmc *self,
+			      struct tg3spmc_frame *out, uint8_t max)
+{
+	struct _tg3spmc_io *i = &self->_io;
+
+	uint8_t n = 0u;
+
+	while ((i->tx.count > 0u) && (n < max)) {
+		i->tx.count--;
+
+		out[n] = i->tx.frames[i->tx.count];
+		n++;
+	}
+
+	if ((n > 0u) && (i->tx.count == 0u)) {
+		_tg3spmc_tx_taken(self);
+	}
+
+	return n;
+}
+
+/**
+ * @brief Gives read-only view of all queued TX frames (zero-copy).
+ *
+ * Frames are viewed in queue array order (reversed compared to
+ * tg3spmc_get_tx_frame). The view stays valid until the next
+ * tg3spmc_step or tg3spmc_release_tx_frames call.
+ *
+ * @param self Pointer to the tg3spmc instance.
+ * @param[out] frames Pointer to the first queued frame.
+ * @return Number of queued frames (0 if no TX frames available).
+ */
+uint8_t tg3spmc_view_tx_frames(struct tg3spmc *self,
+			       const struct tg3spmc_frame **frames)
+{
+	struct _tg3spmc_io *i = &self->_io;
+
+	*frames = i->tx.frames;
+
+	return i->tx.count;
+}
+
+/**
+ * @brief Pops all queued TX frames after they were sent from the view.
+ * @param self Pointer to the tg3spmc instance.
+ * @see tg3spmc_view_tx_frames
+ */
+void tg3spmc_release_tx_frames(struct tg3spmc *self)
+{
+	struct _tg3spmc_io *i = &self->_io;
+
+	if (i->tx.count > 0u) {
+		_tg3spmc_tx_taken(self);
+	}
+
+	i->tx.count = 0u;
+}
+
+/**
+ * @brief Takes the next frame to be sent from ISR or CAN task context.
+ *
+ * Requires TX queue to be enabled (tg3spmc_set_tx_queue). May run
+ * concurrently with the rest of the API (single consumer context only).
+ *
+ * @param self Pointer to the tg3spmc instance.
+ * @param[out] f Pointer to the frame where data will be copied.
+ * @return **True** if frame was copied, **false** if TX queue is empty.
+ */
+bool tg3spmc_isr_get_tx_frame(struct tg3spmc *self, struct tg3spmc_frame *f)
+{
+	return tg3spmc_queue_get(&self->_tx_queue, f);
+}
+
 /**
  * @brief Processes and consumes a received (RX) frame.
  *
@@ -769,15 +2040,88 @@ bool tg3spmc_get_tx_frame(struct tg3spmc *self, struct tg3spmc_frame *f)
 bool tg3spmc_put_rx_frame(struct tg3spmc *self,
 			  struct tg3spmc_frame *f)
 {
-	_tg3spmc_decode_frame(self, f);
+	_tg3spmc_consume_frame(self, f, self->_uptime_ms);
+
+	/* There's no internal limits. Frames will be consumed always. */
+	return true;
+}
+
+/**
+ * @brief Processes and consumes a received (RX) frame, with its RX time.
+ *
+ * Same as tg3spmc_put_rx_frame, but a fault caught by the fast fault path
+ * (tg3spmc_set_fast_fault) stamps fault_time_ms with `now_ms`, instead of
+ * the time of the last step.
+ *
+ * @param self   Pointer to the tg3spmc instance.
+ * @param f      A pointer to the received frame.
+ * @param now_ms Reception time on the uptime clock: sum of step deltas,
+ *               plus time elapsed since the last step (ms).
+ * @return Returns true if frame was consumed successfully.
+ */
+bool tg3spmc_put_rx_frame_at(struct tg3spmc *self,
+			     struct tg3spmc_frame *f, uint32_t now_ms)
+{
+	_tg3spmc_consume_frame(self, f, now_ms);
 
 	/* There's no internal limits. Frames will be consumed always. */
 	return true;
 }
 
+/**
+ * @brief Processes and consumes an array of received (RX) frames.
+ *
+ * Same as tg3spmc_put_rx_frame, but drains whole hardware FIFO per call.
+ *
+ * @param self   Pointer to the tg3spmc instance.
+ * @param frames Array of received frames.
+ * @param n      Number of frames in the array.
+ * @return Returns number of consumed frames (always n).
+ */
+size_t tg3spmc_put_rx_frames(struct tg3spmc *self,
+			     const struct tg3spmc_frame *frames, size_t n)
+{
+	size_t k;
+
+	for (k = 0u; k < n; k++) {
+		_tg3spmc_consume_frame(self, &frames[k], self->_uptime_ms);
+	}
+
+	/* There's no internal limits. Frames will be consumed always. */
+	return n;
+}
+
+/**
+ * @brief Queues a received (RX) frame from ISR or CAN task context.
+ *
+ * Unlike tg3spmc_put_rx_frame, this may run concurrently with the rest of
+ * the API (single producer context only). Frames of other modules and
+ * unknown IDs are ignored right away, module frames are queued and
+ * consumed by the next tg3spmc_step, in order of arrival.
+ *
+ * @param self Pointer to the tg3spmc instance.
+ * @param f    A pointer to the received frame.
+ * @return False if the frame was dropped because the RX queue is full.
+ * @see tg3spmc_get_rx_drops
+ */
+bool tg3spmc_isr_put_rx_frame(struct tg3spmc *self,
+			      const struct tg3spmc_frame *f)
+{
+	uint32_t base_id = f->id - (self->_id * _TG3SPM_MODULE_ID_SPACING);
+	bool     put = true;
+
+	if (_tg3spm_msg_from_base_id(base_id) != (uint8_t)_TG3SPM_MSG_NONE) {
+		put = tg3spmc_queue_put(&self->_rx_queue, f);
+	}
+
+	return put;
+}
+
 /**
  * @brief Reads charger variables.
  *
+ * Only messages received since the previous read are decoded.
+ *
  * @param self Pointer to the tg3spmc instance.
  * @param _v   A pointer to the object where read variables will be stored.
  * @return Returns true if charge variables has been read successfully.
@@ -790,7 +2134,9 @@ bool tg3spmc_read_vars(struct tg3spmc *self, struct tg3spmc_vars *_v)
 	bool vars_been_read = false;
 
 	if (i->rx.has_frames) {
+		_tg3spmc_sync_vars(self);
 		*_v = *v;
+		self->_vars_changed = 0u;
 		vars_been_read = true;
 	}
 
@@ -798,70 +2144,384 @@ bool tg3spmc_read_vars(struct tg3spmc *self, struct tg3spmc_vars *_v)
 }
 
 /**
- * @brief Set broadcast (either true or false).
+ * @brief Gives read-only view of charger variables (zero-copy).
  *
- * @param self Pointer to the tg3spmc instance.
- * @param enabled set broadcast enabled/disabled.
- * @note Broadcast is enabled by default.
+ * Same as tg3spmc_read_vars, but nothing is copied and changed flags are
+ * kept until tg3spmc_release_vars. The view stays valid until the next
+ * tg3spmc_put_rx_frame, tg3spmc_step or read call.
  *
- * If there are multiple instances of tg3spmc is running, it's advised to
- * have only one broadcast message enabled. This behaviour may be changed
- * or enhanced in the future.
+ * @param self Pointer to the tg3spmc instance.
+ * @return Pointer to the variables, NULL if they can't be read yet.
  */
-void tg3spmc_set_broadcast(struct tg3spmc *self, bool enabled)
+const struct tg3spmc_vars *tg3spmc_view_vars(struct tg3spmc *self)
 {
-	struct _tg3spmc_io *i = &self->_io;
+	const struct tg3spmc_vars *v = NULL;
 
-	i->tx.enable_broadcast = enabled;
+	if (self->_io.rx.has_frames) {
+		_tg3spmc_sync_vars(self);
+		v = &self->_vars;
+	}
+
+	return v;
 }
 
 /**
- * @brief Performs a single step of the module controller's state machine.
+ * @brief Tells which variables changed since the last read or release.
+ *
+ * Changes are tracked on decode, per field: a field counts as changed if
+ * its decoded value differs from the previous one.
+ *
  * @param self Pointer to the tg3spmc instance.
- * @param delta_time_ms Time elapsed since the last step (milliseconds).
- * @return An event (enum tg3spmc_event) indicating any state change.
+ * @return Changed variables (enum tg3spmc_var_flag bits).
  */
-enum tg3spmc_event tg3spmc_step(struct tg3spmc *self,
-				      uint32_t delta_time_ms)
+uint16_t tg3spmc_vars_changed(struct tg3spmc *self)
 {
-	struct  tg3spmc_config *s = &self->_config;
-	struct _tg3spmc_io     *i = &self->_io;
-
-	enum tg3spmc_event ev = TG3SPMC_EVENT_NONE;
+	_tg3spmc_sync_vars(self);
 
-	/* TODO, make postconditions and preconditions clear enough.
-	 * FSM must follow Design-By-Contract approach */
-	switch (self->_state) {
-	case _TG3SPMC_STATE_CONFIG:
-		/* Validate config before proceed to the next state */
-		if ((s->rated_voltage_ac_V <= 0.0f) ||
-		    (s->voltage_dc_V < TG3SPMC_CONST_MIN_DC_VOLTAGE_V)) {
-			ev = TG3SPMC_EVENT_CONFIG_INVALID;
-			break;
-		}
+	return self->_vars_changed;
+}
 
-		self->_state = _TG3SPMC_STATE_BOOT;
-		ev = TG3SPMC_EVENT_POWER_ON;
+/**
+ * @brief Clears changed flags after variables were used from the view.
+ * @param self Pointer to the tg3spmc instance.
+ * @see tg3spmc_view_vars
+ */
+void tg3spmc_release_vars(struct tg3spmc *self)
+{
+	self->_vars_changed = 0u;
+}
 
-		/* Power on module */
-		i->pwron_out = true;
+/**
+ * @brief Publishes variables for concurrent readers (tg3spmc_snapshot_vars).
+ *
+ * Must be called from the same context as the rest of the API (e.g. after
+ * tg3spmc_step), never blocks. Nothing is published before the module
+ * variables can be read, or if none of them changed since the last
+ * publication. Once they can't be read anymore (e.g. RX timeout, fault
+ * recovery), zeroed invalid variables are published, so readers don't
+ * keep the last values of a silent module.
+ *
+ * @param self Pointer to the tg3spmc instance.
+ */
+void tg3spmc_publish_vars(struct tg3spmc *self)
+{
+	/* Sequence and validity are written by this context only */
+	if (self->_io.rx.has_frames) {
+		_tg3spmc_sync_vars(self);
+
+		if ((self->_snapshot.valid == 0u) || self->_snapshot_dirty) {
+			_tg3spmc_snapshot_write(&self->_snapshot,
+						&self->_vars);
+			self->_snapshot_dirty = false;
+		}
+	} else if (self->_snapshot.valid != 0u) {
+		_tg3spmc_snapshot_write(&self->_snapshot, NULL);
+	}
+}
 
-		/* _TG3SPMC_STATE_BOOT init */
-		self->_timer_ms = 0u;
-		i->tx.timer_ms  = 0u;
+/**
+ * @brief Reads the last published variables, from any context.
+ *
+ * Any number of readers may run concurrently with each other and with
+ * tg3spmc_publish_vars, without locks. The copy is always consistent (all
+ * fields come from the same publication).
+ *
+ * @param self Pointer to the tg3spmc instance.
+ * @param[out] v A pointer to the object where variables will be stored.
+ * @return False if nothing has been published yet, or if the module went
+ * silent since the last valid publication.
+ */
+bool tg3spmc_snapshot_vars(struct tg3spmc *self, struct tg3spmc_vars *v)
+{
+	return _tg3spmc_snapshot_read(&self->_snapshot, v);
+}
 
-		break;
+#if defined(TG3SPMC_FIXED_POINT)
+/**
+ * @brief Converts floating point units into milli units.
+ *
+ * Rounded to nearest. Negative values (and NaN) give 0, values beyond the
+ * 32 bit range saturate, so the conversion is always defined.
+ * @param v Value in units (V, A).
+ * @return Value in milli units (mV, mA).
+ */
+uint32_t _tg3spmc_float_to_milli(float v)
+{
+	float m = (v * 1000.0f) + 0.5f;
 
-	/* Keep little delay before transmission and charging start */
-	case _TG3SPMC_STATE_BOOT:
-		self->_timer_ms += delta_time_ms;
+	uint32_t milli = 0u;
 
-		/* Increment TX timer */
-		i->tx.timer_ms += delta_time_ms;
+	/* Largest float below 2^32 */
+	if (m >= 4294967040.0f) {
+		milli = 0xFFFFFFFFu;
+	} else if (m >= 1.0f) {
+		milli = (uint32_t)m;
+	} else {
+		/* Negative, zero or NaN */
+	}
 
-		if (self->_timer_ms < TG3SPMC_CONST_BOOT_TIME_MS) {
-			break;
-		}
+	return milli;
+}
+
+/**
+ * @brief Sets the configuration parameters given in floating point units.
+ *
+ * Thin wrapper over tg3spmc_set_config for fixed point build.
+ * Values are rounded to whole mV/mA, negative values give 0 and values out
+ * of the 32 bit range saturate (see _tg3spmc_float_to_milli).
+ * @param self Pointer to the tg3spmc instance.
+ * @param config The new configuration structure to apply.
+ */
+void tg3spmc_set_config_float(struct tg3spmc *self,
+			      struct tg3spmc_config_float config)
+{
+	struct tg3spmc_config c;
+
+	c.voltage_dc_mV       = _tg3spmc_float_to_milli(config.voltage_dc_V);
+	c.current_ac_mA       = _tg3spmc_float_to_milli(config.current_ac_A);
+	c.rated_voltage_ac_mV = _tg3spmc_float_to_milli(
+					config.rated_voltage_ac_V);
+
+	tg3spmc_set_config(self, c);
+}
+
+/**
+ * @brief Reads charger variables converted into floating point units.
+ *
+ * Thin wrapper over tg3spmc_read_vars for fixed point build.
+ * @param self Pointer to the tg3spmc instance.
+ * @param _v   A pointer to the object where read variables will be stored.
+ * @return Returns true if charge variables has been read successfully.
+ */
+bool tg3spmc_read_vars_float(struct tg3spmc *self,
+			     struct tg3spmc_vars_float *_v)
+{
+	struct tg3spmc_vars v;
+
+	bool vars_been_read = tg3spmc_read_vars(self, &v);
+
+	if (vars_been_read) {
+		_v->voltage_dc_V = (float)v.voltage_dc_mV / 1000.0f;
+		_v->voltage_ac_V = v.voltage_ac_V;
+		_v->current_dc_A = (float)v.current_dc_mA / 1000.0f;
+		_v->current_ac_A = (float)v.current_ac_mA / 1000.0f;
+
+		_v->inlet_target_temp_C      = v.inlet_target_temp_C;
+		_v->current_limit_due_temp_A =
+			(float)v.current_limit_due_temp_mA / 1000.0f;
+
+		_v->temp1_C = v.temp1_C;
+		_v->temp2_C = v.temp2_C;
+
+		_v->ac_present = v.ac_present;
+		_v->en_present = v.en_present;
+		_v->fault      = v.fault;
+
+		_v->status = v.status;
+	}
+
+	return vars_been_read;
+}
+#endif
+
+/**
+ * @brief Set broadcast (either true or false).
+ *
+ * @param self Pointer to the tg3spmc instance.
+ * @param enabled set broadcast enabled/disabled.
+ * @note Broadcast is enabled by default.
+ *
+ * If there are multiple instances of tg3spmc is running, it's advised to
+ * have only one broadcast message enabled. This behaviour may be changed
+ * or enhanced in the future.
+ */
+void tg3spmc_set_broadcast(struct tg3spmc *self, bool enabled)
+{
+	struct _tg3spmc_io *i = &self->_io;
+
+	i->tx.enable_broadcast = enabled;
+}
+
+/**
+ * @brief Set fast fault reaction (either true or false).
+ *
+ * @param self Pointer to the tg3spmc instance.
+ * @param enabled set fast fault reaction enabled/disabled.
+ * @note Fast fault reaction is disabled by default.
+ *
+ * When enabled, a fault flag received in RUNNING state drops pwron_out and
+ * chgen_out inside tg3spmc_put_rx_frame(), instead of waiting for the next
+ * tg3spmc_step(). Pins must then be written to hardware right after putting
+ * frames, not only after stepping. fault_time_ms holds the drop time: the
+ * RX time given to tg3spmc_put_rx_frame_at(), otherwise the time of the
+ * last step (step resolution).
+ * The fault is latched, so the next tg3spmc_step() enters FAULT even if a
+ * clean 0x207 frame was put in between.
+ */
+void tg3spmc_set_fast_fault(struct tg3spmc *self, bool enabled)
+{
+	self->_fast_fault = enabled;
+}
+
+/**
+ * @brief Set per message timeout fault (either true or false).
+ *
+ * @param self Pointer to the tg3spmc instance.
+ * @param enabled set per message timeout fault enabled/disabled.
+ * @note Per message timeout fault is disabled by default.
+ *
+ * When enabled, any of 0x207-0x247 messages silent for longer than
+ * TG3SPMC_CONST_MSG_TIMEOUT_PERIODS of its periods in RUNNING state is a
+ * fault (TG3SPMC_FAULT_CAUSE_MSG_TIMEOUT), without waiting for the global
+ * RX timeout. tg3spmc_next_deadline_ms includes these timeouts.
+ */
+void tg3spmc_set_msg_timeout_fault(struct tg3spmc *self, bool enabled)
+{
+	self->_msg_timeout_fault = enabled;
+}
+
+/**
+ * @brief Set TX queue (either true or false).
+ *
+ * @param self Pointer to the tg3spmc instance.
+ * @param enabled set TX queue enabled/disabled.
+ * @note TX queue is disabled by default.
+ *
+ * When enabled, tg3spmc_step moves due TX frames into the TX queue, to be
+ * sent by tg3spmc_isr_get_tx_frame from ISR or CAN task context, and
+ * tg3spmc_get_tx_frame has nothing to return. Frames that don't fit are
+ * dropped and counted (tg3spmc_get_tx_drops).
+ */
+void tg3spmc_set_tx_queue(struct tg3spmc *self, bool enabled)
+{
+	self->_tx_queued = enabled;
+}
+
+/**
+ * @brief Number of RX frames dropped because the RX queue was full.
+ * @param self Pointer to the tg3spmc instance.
+ * @return Dropped frames since init (any context).
+ * @see tg3spmc_isr_put_rx_frame
+ */
+uint32_t tg3spmc_get_rx_drops(struct tg3spmc *self)
+{
+	return tg3spmc_queue_drops(&self->_rx_queue);
+}
+
+/**
+ * @brief Number of TX frames dropped because the TX queue was full.
+ * @param self Pointer to the tg3spmc instance.
+ * @return Dropped frames since init (any context).
+ * @see tg3spmc_set_tx_queue
+ */
+uint32_t tg3spmc_get_tx_drops(struct tg3spmc *self)
+{
+	return tg3spmc_queue_drops(&self->_tx_queue);
+}
+
+/**
+ * @brief Reads reception statistics of a message.
+ *
+ * Statistics are kept for 0x207-0x247 and known side channels (0x347,
+ * 0x467, 0x537, 0x717) in every state, regardless of timeout settings.
+ *
+ * @param self    Pointer to the tg3spmc instance.
+ * @param base_id Message ID of module 0 (e.g. 0x207).
+ * @param h       A pointer to the object where statistics will be stored.
+ * @return Returns false if base_id is not a known message.
+ */
+bool tg3spmc_get_rx_health(struct tg3spmc *self, uint32_t base_id,
+			   struct tg3spmc_rx_health *h)
+{
+	struct _tg3spmc_reader *r = &self->_io.rx;
+
+	uint8_t msg = _tg3spm_msg_from_base_id(base_id);
+	bool    known = (msg < (uint8_t)_TG3SPM_MSG_TOTAL);
+
+	if (known) {
+		*h = r->health[msg];
+		h->stale = ((_tg3spmc_reader_stale_flags(r, self->_uptime_ms) &
+			     (1u << msg)) != 0u);
+	}
+
+	return known;
+}
+
+/**
+ * @brief Tells if a single frame reports the module fault flag.
+ *
+ * Needs no controller instance, e.g. for scanning logs or captures.
+ * @param id Module ID (0, 1, or 2).
+ * @param f  Pointer to the CAN frame.
+ * @return True if f is AC params (0x207 + ID) with the fault flag set.
+ */
+bool tg3spmc_frame_has_fault(uint8_t id, const struct tg3spmc_frame *f)
+{
+	uint32_t base_id = f->id - (id * _TG3SPM_MODULE_ID_SPACING);
+
+	return (base_id == (uint32_t)_TG3SPM_FRAME_BASE_ID_AC_PARAMS) &&
+	       _tg3spm_decode_ac_params_fault(f->data);
+}
+
+/**
+ * @brief Performs a single step of the module controller's state machine.
+ * @param self Pointer to the tg3spmc instance.
+ * @param delta_time_ms Time elapsed since the last step (milliseconds).
+ * @return An event (enum tg3spmc_event) indicating any state change.
+ */
+enum tg3spmc_event tg3spmc_step(struct tg3spmc *self,
+				      uint32_t delta_time_ms)
+{
+	struct _tg3spmc_io *i = &self->_io;
+	struct tg3spmc_frame f;
+
+	enum tg3spmc_event ev = TG3SPMC_EVENT_NONE;
+
+	self->_uptime_ms += delta_time_ms;
+
+	/* Frames queued from ISR context arrived during delta_time_ms */
+	while (tg3spmc_queue_get(&self->_rx_queue, &f)) {
+		_tg3spmc_consume_frame(self, &f, self->_uptime_ms);
+	}
+
+	/* TODO, make postconditions and preconditions clear enough.
+	 * FSM must follow Design-By-Contract approach */
+	switch (self->_state) {
+	case _TG3SPMC_STATE_CONFIG:
+		/* Validate config before proceed to the next state */
+		if (!_tg3spmc_config_is_valid(self)) {
+			ev = TG3SPMC_EVENT_CONFIG_INVALID;
+			break;
+		}
+
+		self->_state = _TG3SPMC_STATE_BOOT;
+		ev = TG3SPMC_EVENT_POWER_ON;
+
+		/* Power on module */
+		i->pwron_out = true;
+
+		/* _TG3SPMC_STATE_BOOT init, only frames received after power
+		 * on tell that the module has booted */
+		self->_timer_ms = 0u;
+		i->tx.timer_ms  = 0u;
+		i->rx.has_frames = false;
+		i->rx.recv_flags = 0u;
+		i->rx.seen_flags = 0u;
+
+		break;
+
+	/* Keep little delay before transmission and charging start */
+	case _TG3SPMC_STATE_BOOT:
+		self->_timer_ms += delta_time_ms;
+
+		/* Increment TX timer */
+		i->tx.timer_ms += delta_time_ms;
+
+		/* Module that talks is booted, boot time is an upper bound */
+		if ((self->_timer_ms < TG3SPMC_CONST_BOOT_TIME_MS) &&
+		    !i->rx.has_frames) {
+			break;
+		}
 
 		ev = TG3SPMC_EVENT_CHARGE_ENABLED;
 		self->_state = _TG3SPMC_STATE_RUNNING;
@@ -872,8 +2532,13 @@ enum tg3spmc_event tg3spmc_step(struct tg3spmc *self,
 		/* _TG3SPMC_STATE_RUNNING init */
 		i->rx.timer_ms    = 0u;
 		i->rx.has_frames  = false;
-		self->_timer_ms   = 0u;
-		self->_hold_start = true;
+		i->rx.seen_flags  = 0u;
+		self->_timer_ms    = 0u;
+		self->_hold_start  = true;
+		self->_setup_sent   = false;
+		self->_setup_status = false;
+		self->_setup_acked  = false;
+		self->_pending_fault = (uint8_t)TG3SPMC_FAULT_CAUSE_NONE;
 
 		break;
 
@@ -881,10 +2546,10 @@ enum tg3spmc_event tg3spmc_step(struct tg3spmc *self,
 	case _TG3SPMC_STATE_RUNNING:
 		self->_timer_ms += delta_time_ms;
 
-		/* Wait 1000ms before setting initial setup flag to false
-		 * TODO we must somehow detect that charger mode is ready to
-		 * provide output. TODO no magic numbers */
-		if (self->_timer_ms > 1000u) {
+		/* Release initial setup flag as soon as the module is ready,
+		 * hold time is an upper bound */
+		if ((self->_timer_ms > TG3SPMC_CONST_HOLD_START_TIME_MS) ||
+		    _tg3spmc_module_is_ready(self)) {
 			self->_hold_start = false;
 		}
 
@@ -902,12 +2567,13 @@ enum tg3spmc_event tg3spmc_step(struct tg3spmc *self,
 			ev = TG3SPMC_EVENT_FAULT;
 
 			/* Disable module power and charge */
-			i->pwron_out = false;
-			i->chgen_out = false;
+			_tg3spmc_drop_pins(self, self->_uptime_ms);
 
 			/* TG3SPMC_EVENT_FAULT init */
 			i->tx.count     = 0u;
 			self->_timer_ms = 0u;
+			self->_pending_fault =
+				(uint8_t)TG3SPMC_FAULT_CAUSE_NONE;
 		}
 
 		break;
@@ -935,5 +2601,713 @@ enum tg3spmc_event tg3spmc_step(struct tg3spmc *self,
 		break;
 	}
 
+	/* Hand due frames over to TX context, same order as get_tx_frame.
+	 * TX context can't be asked, so handed over counts as taken. */
+	while (self->_tx_queued && (i->tx.count > 0u)) {
+		i->tx.count--;
+		(void)tg3spmc_queue_put(&self->_tx_queue,
+					&i->tx.frames[i->tx.count]);
+
+		if (i->tx.count == 0u) {
+			_tg3spmc_tx_taken(self);
+		}
+	}
+
 	return ev;
 }
+
+
+/**
+ * @brief Time until the state machine must be stepped again.
+ *
+ * Allows the host to sleep instead of polling tg3spmc_step. The host must
+ * call tg3spmc_step (with the real elapsed time) when the deadline expires,
+ * or earlier: after RX frames arrive, or after the configuration changes.
+ * On frame arrival, advance time first, then put frames and step with zero
+ * delta, so frames are evaluated without adding pre-arrival time to the RX
+ * timeout. The deadline covers TX period, RX timeout, boot completion,
+ * fault recovery and hold-start release. TX timer runs from power on, so
+ * the deadline stays 0 on entering RUNNING until the TX sets due since
+ * power on are queued (one per step), as a polling host would.
+ *
+ * @param self Pointer to the tg3spmc instance.
+ * @return Time until the next deadline (milliseconds), 0 if tg3spmc_step
+ *         must be called right away or TG3SPMC_DEADLINE_NONE if the state
+ *         machine waits for external input only (invalid config).
+ */
+uint32_t tg3spmc_next_deadline_ms(struct tg3spmc *self)
+{
+	struct _tg3spmc_io *i = &self->_io;
+
+	uint32_t deadline_ms = TG3SPMC_DEADLINE_NONE;
+	uint32_t t;
+
+	switch (self->_state) {
+	case _TG3SPMC_STATE_CONFIG:
+		if (_tg3spmc_config_is_valid(self)) {
+			deadline_ms = 0u;
+		}
+
+		break;
+
+	case _TG3SPMC_STATE_BOOT:
+		/* Talking module ends boot on the next step */
+		deadline_ms = i->rx.has_frames ? 0u :
+			_tg3spmc_time_left_ms(self->_timer_ms,
+					      TG3SPMC_CONST_BOOT_TIME_MS);
+		break;
+
+	case _TG3SPMC_STATE_RUNNING:
+		deadline_ms = _tg3spmc_time_left_ms(i->tx.timer_ms,
+					       TG3SPMC_CONST_CAN_TX_PERIOD_MS);
+
+		t = _tg3spmc_time_left_ms(i->rx.timer_ms,
+					  TG3SPMC_CONST_CAN_RX_TIMEOUT_MS);
+		if (t < deadline_ms) {
+			deadline_ms = t;
+		}
+
+		if (self->_msg_timeout_fault) {
+			t = _tg3spmc_msg_time_left_ms(self);
+			if (t < deadline_ms) {
+				deadline_ms = t;
+			}
+		}
+
+		/* Hold is released once timer goes past the hold time */
+		if (self->_hold_start) {
+			t = _tg3spmc_time_left_ms(self->_timer_ms,
+				TG3SPMC_CONST_HOLD_START_TIME_MS + 1u);
+			if (t < deadline_ms) {
+				deadline_ms = t;
+			}
+		}
+
+		break;
+
+	case _TG3SPMC_STATE_FAULT:
+		deadline_ms = _tg3spmc_time_left_ms(self->_timer_ms,
+					TG3SPMC_CONST_FAULT_RECOVERY_TIME_MS);
+		break;
+
+	default:
+		assert(0);
+		break;
+	}
+
+	/* Frames queued from ISR context wait for the step */
+	if (!tg3spmc_queue_is_empty(&self->_rx_queue)) {
+		deadline_ms = 0u;
+	}
+
+	return deadline_ms;
+}
+
+/******************************************************************************
+ * TG3SPMC DISPATCH
+ *****************************************************************************/
+/** Size of standard (11 bit) CAN ID space */
+#define TG3SPMC_DISPATCH_ID_SPACE 2048u
+
+/** Dispatch table entry for IDs that belong to none of the modules */
+#define _TG3SPMC_DISPATCH_REJECT 0xFFu
+
+/**
+ * @brief Precomputed CAN ID router for all module instances on a bus.
+ *
+ * Maps any standard CAN ID into (module instance, message) pair in constant
+ * time by direct indexing. Foreign IDs are rejected by the same single
+ * lookup, so mixed traffic buses cost one table read per foreign frame.
+ */
+struct tg3spmc_dispatch {
+	/** Entry: (module ID << 4) | message index, or reject */
+	uint8_t _table[TG3SPMC_DISPATCH_ID_SPACE];
+
+	/** Attached module instances (indexed by module ID) */
+	struct tg3spmc *_modules[3];
+};
+
+/**
+ * @brief Initializes dispatch table, all IDs are rejected.
+ * @param self Pointer to the tg3spmc_dispatch instance.
+ */
+void tg3spmc_dispatch_init(struct tg3spmc_dispatch *self)
+{
+	uint32_t id;
+
+	for (id = 0u; id < TG3SPMC_DISPATCH_ID_SPACE; id++) {
+		self->_table[id] = _TG3SPMC_DISPATCH_REJECT;
+	}
+
+	self->_modules[0] = NULL;
+	self->_modules[1] = NULL;
+	self->_modules[2] = NULL;
+}
+
+/**
+ * @brief Attaches module instance, so that its frames are routed to it.
+ *
+ * Must be called after tg3spmc_init of the module. Only one instance per
+ * module ID may be attached.
+ * @param self Pointer to the tg3spmc_dispatch instance.
+ * @param mod  Pointer to the initialized tg3spmc instance.
+ */
+void tg3spmc_dispatch_attach(struct tg3spmc_dispatch *self,
+			     struct tg3spmc *mod)
+{
+	uint32_t base_id;
+	uint32_t offset = mod->_id * _TG3SPM_MODULE_ID_SPACING;
+	uint8_t  msg;
+
+	assert(mod->_id < 3u);
+	assert(self->_modules[mod->_id] == NULL);
+
+	self->_modules[mod->_id] = mod;
+
+	/* Known messages are only those with base IDs in 0x207..0x717 */
+	for (base_id = 0x207u; base_id <= 0x717u; base_id += 0x10u) {
+		msg = _tg3spm_msg_from_base_id(base_id);
+
+		if (msg != (uint8_t)_TG3SPM_MSG_NONE) {
+			self->_table[base_id + offset] =
+				(uint8_t)((mod->_id << 4u) | msg);
+		}
+	}
+}
+
+/**
+ * @brief Routes received (RX) frame to the owning module in constant time.
+ *
+ * All frames from the bus may be passed here, foreign frames are rejected.
+ * @param self Pointer to the tg3spmc_dispatch instance.
+ * @param f    A pointer to the received frame.
+ * @return Returns true if frame belongs to one of attached modules.
+ */
+bool tg3spmc_dispatch_put_rx_frame(struct tg3spmc_dispatch *self,
+				   const struct tg3spmc_frame *f)
+{
+	struct tg3spmc *mod;
+
+	bool consumed = false;
+	uint8_t entry = _TG3SPMC_DISPATCH_REJECT;
+
+	if (f->id < TG3SPMC_DISPATCH_ID_SPACE) {
+		entry = self->_table[f->id];
+	}
+
+	if (entry != _TG3SPMC_DISPATCH_REJECT) {
+		mod = self->_modules[entry >> 4u];
+		_tg3spmc_consume_msg(mod, entry & 0x0Fu, f, mod->_uptime_ms);
+		consumed = true;
+	}
+
+	return consumed;
+}
+
+/**
+ * @brief Routes an array of received (RX) frames to the owning modules.
+ * @param self   Pointer to the tg3spmc_dispatch instance.
+ * @param frames Array of received frames.
+ * @param n      Number of frames in the array.
+ * @return Returns number of frames that belong to attached modules.
+ */
+size_t tg3spmc_dispatch_put_rx_frames(struct tg3spmc_dispatch *self,
+				      const struct tg3spmc_frame *frames,
+				      size_t n)
+{
+	size_t k;
+	size_t consumed = 0u;
+
+	for (k = 0u; k < n; k++) {
+		if (tg3spmc_dispatch_put_rx_frame(self, &frames[k])) {
+			consumed++;
+		}
+	}
+
+	return consumed;
+}
+
+/******************************************************************************
+ * TG3SPMC CHARGER
+ *****************************************************************************/
+/** Charger TX slot of the shared 0x45C frame (slots 0-2 are modules) */
+#define _TG3SPMC_CHARGER_SLOT_H45C 3u
+
+/** Charger TX slot of the shared 0x368 frame */
+#define _TG3SPMC_CHARGER_SLOT_H368 4u
+
+/**
+ * @brief Charger (BCB) aggregate of up to three single phase modules.
+ *
+ * Owns modules 0-2, steps them at once, routes RX frames directly to the
+ * owning module and builds shared broadcast frames (0x45C, 0x368) once per
+ * period instead of once per module. Broadcast follows the lowest running
+ * module, so it goes on while any module runs.
+ */
+struct tg3spmc_charger {
+	/** Modules, indexed by module ID */
+	struct tg3spmc _modules[3];
+
+	/** Present modules (bits flagged by module ID) */
+	uint8_t _mask;
+
+	/** RX router for all present modules */
+	struct tg3spmc_dispatch _dispatch;
+
+	/** TX slots: 0x42C(+ID) per module, shared 0x45C and 0x368 */
+	struct tg3spmc_frame _frames[5];
+
+	/** Slots waiting to be sent (bits flagged) */
+	uint8_t _pending;
+};
+
+/**
+ * @brief Initializes the charger and its modules.
+ * @param self Pointer to the tg3spmc_charger instance.
+ * @param module_mask Present modules, bits flagged by ID (0x07 for all).
+ */
+void tg3spmc_charger_init(struct tg3spmc_charger *self, uint8_t module_mask)
+{
+	uint8_t m;
+
+	assert((module_mask > 0u) && (module_mask < 8u));
+
+	self->_mask    = module_mask;
+	self->_pending = 0u;
+
+	tg3spmc_dispatch_init(&self->_dispatch);
+
+	for (m = 0u; m < 3u; m++) {
+		tg3spmc_init(&self->_modules[m], m);
+
+		if ((module_mask & (1u << m)) == 0u) {
+			continue;
+		}
+
+		/* Charger sends broadcast frames by itself */
+		tg3spmc_set_broadcast(&self->_modules[m], false);
+		tg3spmc_dispatch_attach(&self->_dispatch, &self->_modules[m]);
+	}
+}
+
+/**
+ * @brief Gets module instance (for pins, fault cause, etc).
+ * @param self Pointer to the tg3spmc_charger instance.
+ * @param id Module ID (0, 1, or 2).
+ * @return Pointer to the module instance.
+ */
+struct tg3spmc *tg3spmc_charger_get_module(struct tg3spmc_charger *self,
+					   uint8_t id)
+{
+	assert(id < 3u);
+
+	return &self->_modules[id];
+}
+
+/**
+ * @brief Sets the same configuration for all present modules.
+ * @param self Pointer to the tg3spmc_charger instance.
+ * @param config The new configuration structure to apply.
+ */
+void tg3spmc_charger_set_config(struct tg3spmc_charger *self,
+				struct tg3spmc_config config)
+{
+	uint8_t m;
+
+	for (m = 0u; m < 3u; m++) {
+		if ((self->_mask & (1u << m)) != 0u) {
+			tg3spmc_set_config(&self->_modules[m], config);
+		}
+	}
+}
+
+/**
+ * @brief Routes received (RX) frame straight to the owning module.
+ * @param self Pointer to the tg3spmc_charger instance.
+ * @param f    A pointer to the received frame.
+ * @return Returns true if frame belongs to one of present modules.
+ */
+bool tg3spmc_charger_put_rx_frame(struct tg3spmc_charger *self,
+				  const struct tg3spmc_frame *f)
+{
+	return tg3spmc_dispatch_put_rx_frame(&self->_dispatch, f);
+}
+
+/**
+ * @brief Routes an array of received (RX) frames to the owning modules.
+ * @param self   Pointer to the tg3spmc_charger instance.
+ * @param frames Array of received frames.
+ * @param n      Number of frames in the array.
+ * @return Returns number of frames that belong to present modules.
+ */
+size_t tg3spmc_charger_put_rx_frames(struct tg3spmc_charger *self,
+				     const struct tg3spmc_frame *frames,
+				     size_t n)
+{
+	return tg3spmc_dispatch_put_rx_frames(&self->_dispatch, frames, n);
+}
+
+/**
+ * @brief Performs a single step of every present module.
+ *
+ * Queued module frames are collected into charger TX slots. Shared
+ * broadcast frames are taken once per period, from the lowest module in
+ * RUNNING state, when it queues its TX. Another running module takes over
+ * as soon as it faults or restarts. A newly queued frame replaces an
+ * unsent frame in the same slot.
+ *
+ * @param self Pointer to the tg3spmc_charger instance.
+ * @param delta_time_ms Time elapsed since the last step (milliseconds).
+ * @param[out] events Events of modules 0-2 (TG3SPMC_EVENT_NONE if absent).
+ */
+void tg3spmc_charger_step(struct tg3spmc_charger *self,
+			  uint32_t delta_time_ms,
+			  enum tg3spmc_event events[3])
+{
+	struct tg3spmc *mod;
+
+	uint8_t m;
+	uint8_t lead = 3u;   /* Lowest running module */
+	uint8_t queued = 0u; /* Modules that queued TX (bits flagged) */
+
+	for (m = 0u; m < 3u; m++) {
+		mod = &self->_modules[m];
+
+		events[m] = TG3SPMC_EVENT_NONE;
+
+		if ((self->_mask & (1u << m)) == 0u) {
+			continue;
+		}
+
+		events[m] = tg3spmc_step(mod, delta_time_ms);
+
+		if ((lead == 3u) &&
+		    (mod->_state == (uint8_t)_TG3SPMC_STATE_RUNNING)) {
+			lead = m;
+		}
+
+		if (tg3spmc_get_tx_frames(mod, &self->_frames[m], 1u) > 0u) {
+			queued |= (uint8_t)(1u << m);
+		}
+	}
+
+	self->_pending |= queued;
+
+	/* Lead module keeps broadcast frames encoded (even with broadcast
+	 * disabled), so they are copied, not re-encoded */
+	if ((lead < 3u) && ((queued & (1u << lead)) != 0u)) {
+		mod = &self->_modules[lead];
+
+		self->_frames[_TG3SPMC_CHARGER_SLOT_H45C] =
+			mod->_io.tx.frames[_TG3SPMC_WRITER_FRAME_H45C];
+		self->_frames[_TG3SPMC_CHARGER_SLOT_H368] =
+			mod->_io.tx.frames[_TG3SPMC_WRITER_FRAME_H368];
+
+		self->_pending |= (uint8_t)
+			((1u << _TG3SPMC_CHARGER_SLOT_H45C) |
+			 (1u << _TG3SPMC_CHARGER_SLOT_H368));
+	}
+}
+
+/**
+ * @brief Time until the charger must be stepped again.
+ * @param self Pointer to the tg3spmc_charger instance.
+ * @return Earliest deadline of present modules (milliseconds).
+ * @see tg3spmc_next_deadline_ms
+ */
+uint32_t tg3spmc_charger_next_deadline_ms(struct tg3spmc_charger *self)
+{
+	uint8_t  m;
+	uint32_t t;
+	uint32_t deadline_ms = TG3SPMC_DEADLINE_NONE;
+
+	for (m = 0u; m < 3u; m++) {
+		if ((self->_mask & (1u << m)) == 0u) {
+			continue;
+		}
+
+		t = tg3spmc_next_deadline_ms(&self->_modules[m]);
+		if (t < deadline_ms) {
+			deadline_ms = t;
+		}
+	}
+
+	return deadline_ms;
+}
+
+/**
+ * @brief Retrieves up to `max` queued TX frames of the whole charger.
+ * @param self Pointer to the tg3spmc_charger instance.
+ * @param[out] out Array where frames will be copied.
+ * @param max Capacity of `out` array.
+ * @return Number of copied frames (0 if no TX frames available).
+ *
+ * @note **Side effects:** this function will pop copied frames.
+ */
+uint8_t tg3spmc_charger_get_tx_frames(struct tg3spmc_charger *self,
+				      struct tg3spmc_frame *out, uint8_t max)
+{
+	uint8_t slot;
+	uint8_t n = 0u;
+
+	for (slot = 0u; (slot < 5u) && (n < max); slot++) {
+		if ((self->_pending & (1u << slot)) != 0u) {
+			self->_pending &= (uint8_t)~(1u << slot);
+
+			out[n] = self->_frames[slot];
+			n++;
+		}
+	}
+
+	return n;
+}
+
+/**
+ * @brief Reads variables of all present modules in one pass.
+ *
+ * Variables are stored contiguously, indexed by module ID.
+ * @param self Pointer to the tg3spmc_charger instance.
+ * @param[out] vars Variables of modules 0-2.
+ * @return Modules which variables has been read (bits flagged by ID).
+ */
+uint8_t tg3spmc_charger_read_vars(struct tg3spmc_charger *self,
+				  struct tg3spmc_vars vars[3])
+{
+	uint8_t m;
+	uint8_t read_mask = 0u;
+
+	for (m = 0u; m < 3u; m++) {
+		if (((self->_mask & (1u << m)) != 0u) &&
+		    tg3spmc_read_vars(&self->_modules[m], &vars[m])) {
+			read_mask |= (uint8_t)(1u << m);
+		}
+	}
+
+	return read_mask;
+}
+
+/******************************************************************************
+ * TG3SPMC CAN FILTER
+ *****************************************************************************/
+/** Max number of IDs that belong to modules (3 modules, all messages) */
+#define _TG3SPMC_FILTER_MAX_IDS (3u * (uint8_t)_TG3SPM_MSG_TOTAL)
+
+/**
+ * @brief Standard CAN ID acceptance filter.
+ *
+ * Frame is accepted if `(frame_id & mask) == (id & mask)`, which is the
+ * SocketCAN `struct can_filter` semantics. Controllers with inverted mask
+ * (1 - don't care, e.g. ESP32 TWAI or SJA1000) must use `~mask`.
+ */
+struct tg3spmc_can_filter {
+	uint32_t id;   /**< Acceptance code (11 bit). */
+	uint32_t mask; /**< Bits that must match (11 bit). */
+};
+
+/**
+ * @brief Collects standard IDs that belong to the given modules.
+ * @param module_mask Modules in use (bits flagged by module ID).
+ * @param side_channels Include 0x347/0x467/0x537/0x717 side channels.
+ * @param[out] ids Array of at least _TG3SPMC_FILTER_MAX_IDS elements.
+ * @return Number of collected IDs.
+ */
+uint8_t _tg3spmc_filter_collect_ids(uint8_t module_mask, bool side_channels,
+				    uint32_t *ids)
+{
+	uint8_t  m;
+	uint8_t  n = 0u;
+	uint8_t  msg;
+	uint32_t base_id;
+
+	for (m = 0u; m < 3u; m++) {
+		if ((module_mask & (1u << m)) == 0u) {
+			continue;
+		}
+
+		for (base_id = 0x207u; base_id <= 0x717u; base_id += 0x10u) {
+			msg = _tg3spm_msg_from_base_id(base_id);
+
+			if ((msg == (uint8_t)_TG3SPM_MSG_NONE) ||
+			    ((msg >= (uint8_t)_TG3SPM_MSG_COUNT) &&
+			     !side_channels)) {
+				continue;
+			}
+
+			ids[n] = base_id + (m * _TG3SPM_MODULE_ID_SPACING);
+			n++;
+		}
+	}
+
+	return n;
+}
+
+/**
+ * @brief Number of IDs accepted by a single filter.
+ * @param f Pointer to the filter.
+ */
+uint32_t _tg3spmc_filter_coverage(const struct tg3spmc_can_filter *f)
+{
+	uint32_t coverage = 1u;
+	uint8_t  bit;
+
+	for (bit = 0u; bit < 11u; bit++) {
+		if ((f->mask & (1u << bit)) == 0u) {
+			coverage *= 2u;
+		}
+	}
+
+	return coverage;
+}
+
+/**
+ * @brief Tightest filter that accepts everything both filters accept.
+ * @param a Pointer to the first filter.
+ * @param b Pointer to the second filter.
+ */
+struct tg3spmc_can_filter _tg3spmc_filter_merge(
+					const struct tg3spmc_can_filter *a,
+					const struct tg3spmc_can_filter *b)
+{
+	struct tg3spmc_can_filter f;
+
+	f.mask = a->mask & b->mask & ~(a->id ^ b->id) & 0x7FFu;
+	f.id   = a->id & f.mask;
+
+	return f;
+}
+
+/**
+ * @brief Computes acceptance filters for frames of the given modules.
+ *
+ * Starts with one exact filter per ID, then greedily merges the pair of
+ * filters that adds the least number of accepted IDs, until at most `max`
+ * filters remain. Use max = 1 for single mask controllers, 2 for dual mask
+ * and up to _TG3SPMC_FILTER_MAX_IDS for SocketCAN filter arrays (exact).
+ * Intended to be called once, when configuring CAN hardware.
+ *
+ * @param module_mask Modules in use (bits flagged by module ID).
+ * @param side_channels Include 0x347/0x467/0x537/0x717 side channels.
+ * @param[out] filters Array of filters to be populated.
+ * @param max Capacity of `filters` array (at least 1).
+ * @return Number of populated filters.
+ */
+uint8_t tg3spmc_build_can_filters(uint8_t module_mask, bool side_channels,
+				  struct tg3spmc_can_filter *filters,
+				  uint8_t max)
+{
+	struct tg3spmc_can_filter f[_TG3SPMC_FILTER_MAX_IDS];
+	struct tg3spmc_can_filter merged;
+	uint32_t ids[_TG3SPMC_FILTER_MAX_IDS];
+	uint32_t cost;
+	uint32_t best_cost;
+	uint8_t  best_a = 0u;
+	uint8_t  best_b = 0u;
+	uint8_t  n;
+	uint8_t  a;
+	uint8_t  b;
+
+	assert(max > 0u);
+
+	n = _tg3spmc_filter_collect_ids(module_mask, side_channels, ids);
+
+	for (a = 0u; a < n; a++) {
+		f[a].id   = ids[a];
+		f[a].mask = 0x7FFu;
+	}
+
+	while (n > max) {
+		best_cost = 0xFFFFFFFFu;
+
+		for (a = 0u; a < n; a++) {
+			for (b = a + 1u; b < n; b++) {
+				merged = _tg3spmc_filter_merge(&f[a], &f[b]);
+				cost   = _tg3spmc_filter_coverage(&merged) -
+					 _tg3spmc_filter_coverage(&f[a]);
+
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_a = a;
+					best_b = b;
+				}
+			}
+		}
+
+		f[best_a] = _tg3spmc_filter_merge(&f[best_a], &f[best_b]);
+
+		/* Drop filters covered by the merged one (best_b included) */
+		for (b = 0u; b < n; ) {
+			merged = _tg3spmc_filter_merge(&f[best_a], &f[b]);
+
+			if ((b != best_a) && (merged.mask == f[best_a].mask)) {
+				n--;
+				f[b] = f[n];
+
+				if (best_a == n) {
+					best_a = b;
+				}
+			} else {
+				b++;
+			}
+		}
+	}
+
+	for (a = 0u; a < n; a++) {
+		filters[a] = f[a];
+	}
+
+	return n;
+}
+
+/**
+ * @brief Counts standard IDs accepted by filters, but not used by modules.
+ *
+ * Expected false-accept rate for uniformly distributed foreign traffic is
+ * `false_accepts / (2048 - used IDs)`.
+ *
+ * @param filters Array of filters.
+ * @param n Number of filters.
+ * @param module_mask Modules in use (bits flagged by module ID).
+ * @param side_channels Whether side channels are considered used IDs.
+ * @return Number of falsely accepted standard IDs.
+ */
+uint32_t tg3spmc_can_filters_false_accepts(
+				const struct tg3spmc_can_filter *filters,
+				uint8_t n, uint8_t module_mask,
+				bool side_channels)
+{
+	uint32_t ids[_TG3SPMC_FILTER_MAX_IDS];
+	uint32_t id;
+	uint32_t false_accepts = 0u;
+	uint8_t  used;
+	uint8_t  k;
+	bool     accepted;
+	bool     wanted;
+
+	used = _tg3spmc_filter_collect_ids(module_mask, side_channels, ids);
+
+	for (id = 0u; id < TG3SPMC_DISPATCH_ID_SPACE; id++) {
+		accepted = false;
+		wanted   = false;
+
+		for (k = 0u; k < n; k++) {
+			if ((id & filters[k].mask) ==
+			    (filters[k].id & filters[k].mask)) {
+				accepted = true;
+			}
+		}
+
+		for (k = 0u; k < used; k++) {
+			if (ids[k] == id) {
+				wanted = true;
+			}
+		}
+
+		if (accepted && !wanted) {
+			false_accepts++;
+		}
+	}
+
+	return false_accepts;
+}
+
+#endif /* TG3SPMC_H */
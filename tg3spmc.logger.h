@@ -51,19 +51,39 @@ const char *tg3spmc_get_fault_cause_name(uint8_t code)
 {
 	const char *name = "UNKNOWN";
 
-	const char *names[3u] = {
+	const char *names[4u] = {
 		"NONE",
 		"RX_TIMEOUT",
 		"FAULT_FLAG",
+		"MSG_TIMEOUT"
 	};
 
-	if (code < 3u) {
+	if (code < 4u) {
 		name = names[code];
 	}
 
 	return name;
 }
 
+/* Text log layout, shared by tg3spmc_log and tg3spmc_telemetry_format.
+ * Fixed point lines print values in tenths, no float formatting. */
+#define _TG3SPMC_LOG_LINE1 \
+	"|ID:%u       |Pwr:%-3s  |Chg:%-3s    |State:0x%02X |\n"
+#define _TG3SPMC_LOG_LINE2_FIXED \
+	"|V-DC:%3lu.%1luV|V-AC:%3uV|I-DC:%3u.%1uA|I-AC:%3u.%1uA|\n"
+#define _TG3SPMC_LOG_LINE3_FIXED \
+	"|T1:%+5dC  |T2:%+5dC|Tgt:%+5dC |Lim:%3u.%1uA |\n"
+#define _TG3SPMC_LOG_LINE4 \
+	"|AC:%c       |EN:%c     |FLT:%c      |Status:0x%02X|"
+
+#if defined(TG3SPMC_FIXED_POINT)
+/* Milli units to tenths, rounded (same as %5.1f of the float build) */
+uint32_t _tg3spmc_log_deci(uint32_t milli)
+{
+	return (milli / 100u) + (((milli % 100u) >= 50u) ? 1u : 0u);
+}
+#endif
+
 /*
  * @brief Logs the contents of the tg3spmc structure into a buffer with
  * 	visual alignment.
@@ -91,9 +111,16 @@ bool tg3spmc_log(struct tg3spmc *self, char *buf, size_t len)
 	const char *pwron_str = (true == i->pwron_out) ? "ON " : "OFF";
 	const char *chgen_str = (true == i->chgen_out) ? "EN " : "DIS";
 
-	const char ac_pres_char = (true == v->ac_present) ? 'Y' : 'N';
-	const char en_pres_char = (true == v->en_present) ? 'Y' : 'N';
-	const char fault_char   = (true == v->fault) ? 'Y' : 'N';
+	char ac_pres_char;
+	char en_pres_char;
+	char fault_char;
+
+	/* Variables are decoded lazily, bring them up to date */
+	_tg3spmc_sync_vars(self);
+
+	ac_pres_char = (true == v->ac_present) ? 'Y' : 'N';
+	en_pres_char = (true == v->en_present) ? 'Y' : 'N';
+	fault_char   = (true == v->fault) ? 'Y' : 'N';
 
 	/* --- 2. Formatting: Use snprintf for safe, aligned string generation 
 	 * Fixed widths and alignment are used for readability:
@@ -109,13 +136,21 @@ bool tg3spmc_log(struct tg3spmc *self, char *buf, size_t len)
 		buf,
 		len,
 		/* Line 1: Basic Module Info & Controls */
-		"|ID:%u       |Pwr:%-3s  |Chg:%-3s    |State:0x%02X |\n"
+		_TG3SPMC_LOG_LINE1
 		/* Line 2: Voltage/Current DC & AC */
+#if defined(TG3SPMC_FIXED_POINT)
+		_TG3SPMC_LOG_LINE2_FIXED
+#else
 		"|V-DC:%5.1fV|V-AC:%3uV|I-DC:%5.1fA|I-AC:%5.1fA|\n"
+#endif
 		/* Line 3: Temperature Sensors and Limits */
+#if defined(TG3SPMC_FIXED_POINT)
+		_TG3SPMC_LOG_LINE3_FIXED
+#else
 		"|T1:%+5dC  |T2:%+5dC|Tgt:%+5dC |Lim:%5.1fA |\n"
+#endif
 		/* Line 4: Flags and Status (No newline on last line) */
-		"|AC:%c       |EN:%c     |FLT:%c      |Status:0x%02X|",
+		_TG3SPMC_LOG_LINE4,
 		/* --- Arguments for snprintf (with explicit MISRA-C casts) */
 		/* Line 1 */
 		(unsigned int)self->_id,
@@ -124,16 +159,34 @@ bool tg3spmc_log(struct tg3spmc *self, char *buf, size_t len)
 		(unsigned int)self->_state,
 
 		/* Line 2 */
+#if defined(TG3SPMC_FIXED_POINT)
+		/* Integer and tenths parts, no float formatting required */
+		(unsigned long)(_tg3spmc_log_deci(v->voltage_dc_mV) / 10u),
+		(unsigned long)(_tg3spmc_log_deci(v->voltage_dc_mV) % 10u),
+		(unsigned int)v->voltage_ac_V,
+		(unsigned int)(_tg3spmc_log_deci(v->current_dc_mA) / 10u),
+		(unsigned int)(_tg3spmc_log_deci(v->current_dc_mA) % 10u),
+		(unsigned int)(_tg3spmc_log_deci(v->current_ac_mA) / 10u),
+		(unsigned int)(_tg3spmc_log_deci(v->current_ac_mA) % 10u),
+#else
 		(double)v->voltage_dc_V,
 		(unsigned int)v->voltage_ac_V,
 		(double)v->current_dc_A,
 		(double)v->current_ac_A,
+#endif
 
 		/* Line 3 */
 		(int)v->temp1_C,
 		(int)v->temp2_C,
 		(int)v->inlet_target_temp_C,
+#if defined(TG3SPMC_FIXED_POINT)
+		(unsigned int)(_tg3spmc_log_deci(
+				v->current_limit_due_temp_mA) / 10u),
+		(unsigned int)(_tg3spmc_log_deci(
+				v->current_limit_due_temp_mA) % 10u),
+#else
 		(double)v->current_limit_due_temp_A,
+#endif
 
 		/* Line 4 */
 		ac_pres_char,
@@ -160,3 +213,640 @@ bool tg3spmc_log(struct tg3spmc *self, char *buf, size_t len)
 
 	return result;
 }
+
+/******************************************************************************
+ * BINARY TELEMETRY
+ *
+ * Compact replacement for tg3spmc_log on slow links: fixed layout,
+ * little endian, integer-scaled fields, sequence number and CRC.
+ *
+ *   0  sync (0xA5)      8 V-DC (0.1V)      16 T1 (C, signed)
+ *   1  module ID       10 I-DC (0.1A)      18 T2 (C, signed)
+ *   2  sequence        12 I-AC (0.1A)      20 Tgt (C, signed)
+ *   4  state           14 Lim (0.1A)       22 CRC-16/CCITT-FALSE
+ *   5  flags                                  over bytes 0..21
+ *   6  status
+ *   7  V-AC (V)
+ *****************************************************************************/
+/** Size of a single telemetry record (bytes). */
+#define TG3SPMC_TELEMETRY_SIZE 24u
+
+/** First byte of every record. */
+#define TG3SPMC_TELEMETRY_SYNC 0xA5u
+
+/**
+ * @brief Flags byte of a telemetry record.
+ */
+enum tg3spmc_telemetry_flag {
+	TG3SPMC_TELEMETRY_FLAG_PWRON      = 1u,  /**< pwron_out */
+	TG3SPMC_TELEMETRY_FLAG_CHGEN      = 2u,  /**< chgen_out */
+	TG3SPMC_TELEMETRY_FLAG_AC_PRESENT = 4u,  /**< AC present */
+	TG3SPMC_TELEMETRY_FLAG_EN_PRESENT = 8u,  /**< Module enabled */
+	TG3SPMC_TELEMETRY_FLAG_FAULT      = 16u  /**< Module fault */
+};
+
+/**
+ * @brief Telemetry encoder state.
+ */
+struct tg3spmc_telemetry {
+	uint16_t _seq; /**< Sequence number of the next record. */
+};
+
+/**
+ * @brief Decoded telemetry record (host side).
+ */
+struct tg3spmc_telemetry_record {
+	uint8_t  id;     /**< Module ID. */
+	uint16_t seq;    /**< Sequence number, gaps mean lost records. */
+	uint8_t  state;  /**< Controller state. */
+	uint8_t  flags;  /**< See tg3spmc_telemetry_flag. */
+	uint8_t  status; /**< Raw status byte. */
+
+	uint8_t  voltage_ac_V;     /**< Measured AC input voltage (V). */
+	uint16_t voltage_dc_dV;    /**< Measured DC output voltage (0.1V). */
+	uint16_t current_dc_dA;    /**< Measured DC output current (0.1A). */
+	uint16_t current_ac_dA;    /**< Measured AC input current (0.1A). */
+	uint16_t current_limit_dA; /**< Current limit due temp (0.1A). */
+
+	int16_t temp1_C;             /**< Temperature sensor 1 (C). */
+	int16_t temp2_C;             /**< Temperature sensor 2 (C). */
+	int16_t inlet_target_temp_C; /**< Target inlet temperature (C). */
+};
+
+/**
+ * @brief Initializes telemetry encoder.
+ * @param self Pointer to the encoder.
+ */
+void tg3spmc_telemetry_init(struct tg3spmc_telemetry *self)
+{
+	self->_seq = 0u;
+}
+
+/* CRC-16/CCITT-FALSE, nibble table (32 bytes instead of 512) */
+uint16_t _tg3spmc_telemetry_crc(const uint8_t *data, uint8_t len)
+{
+	static const uint16_t table[16u] = {
+		0x0000u, 0x1021u, 0x2042u, 0x3063u,
+		0x4084u, 0x50A5u, 0x60C6u, 0x70E7u,
+		0x8108u, 0x9129u, 0xA14Au, 0xB16Bu,
+		0xC18Cu, 0xD1ADu, 0xE1CEu, 0xF1EFu
+	};
+
+	uint16_t crc = 0xFFFFu;
+	uint8_t  i;
+
+	for (i = 0u; i < len; i++) {
+		crc = (uint16_t)((crc << 4u) ^
+				 table[(crc >> 12u) ^ (data[i] >> 4u)]);
+		crc = (uint16_t)((crc << 4u) ^
+				 table[(crc >> 12u) ^ (data[i] & 0x0Fu)]);
+	}
+
+	return crc;
+}
+
+void _tg3spmc_telemetry_put16(uint8_t *p, uint16_t v)
+{
+	p[0] = (uint8_t)(v & 0xFFu);
+	p[1] = (uint8_t)(v >> 8u);
+}
+
+uint16_t _tg3spmc_telemetry_get16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | ((uint16_t)p[1] << 8u));
+}
+
+#if defined(TG3SPMC_FIXED_POINT)
+/* Milli units to tenths, rounded (same as text log) */
+uint16_t _tg3spmc_telemetry_deci(uint32_t milli)
+{
+	uint32_t d = _tg3spmc_log_deci(milli);
+
+	return (uint16_t)((d > 0xFFFFu) ? 0xFFFFu : d);
+}
+#else
+/* Units to tenths, rounded (same as %5.1f), clamped to 0..0xFFFF */
+uint16_t _tg3spmc_telemetry_deci(float v)
+{
+	float d = (v * 10.0f) + 0.5f;
+
+	d = (d < 0.0f) ? 0.0f : d;
+	d = (d > 65535.0f) ? 65535.0f : d;
+
+	return (uint16_t)d;
+}
+#endif
+
+/**
+ * @brief Encodes module state into a binary telemetry record.
+ *
+ * No formatting. Messages received since the last read are decoded
+ * first (see _tg3spmc_sync_vars), so cost depends on how many of them
+ * are pending, but is bounded by one decode of each message. Every call
+ * takes the next sequence number.
+ *
+ * @param self Pointer to the encoder.
+ * @param mod Pointer to the module.
+ * @param buf Destination buffer.
+ * @param len Size of the destination buffer.
+ * @return bool True if encoded, false if buffer is insufficient.
+ */
+bool tg3spmc_telemetry_encode(struct tg3spmc_telemetry *self,
+			      struct tg3spmc *mod, uint8_t *buf, size_t len)
+{
+	struct _tg3spmc_io   *i = &mod->_io;
+	struct  tg3spmc_vars *v = &mod->_vars;
+
+	bool result = false;
+	uint8_t flags;
+
+	if (len >= TG3SPMC_TELEMETRY_SIZE) {
+		/* Variables are decoded lazily, bring them up to date */
+		_tg3spmc_sync_vars(mod);
+
+		flags = (uint8_t)(
+		    (i->pwron_out  ? TG3SPMC_TELEMETRY_FLAG_PWRON      : 0u) |
+		    (i->chgen_out  ? TG3SPMC_TELEMETRY_FLAG_CHGEN      : 0u) |
+		    (v->ac_present ? TG3SPMC_TELEMETRY_FLAG_AC_PRESENT : 0u) |
+		    (v->en_present ? TG3SPMC_TELEMETRY_FLAG_EN_PRESENT : 0u) |
+		    (v->fault      ? TG3SPMC_TELEMETRY_FLAG_FAULT      : 0u));
+
+		buf[0] = TG3SPMC_TELEMETRY_SYNC;
+		buf[1] = mod->_id;
+		_tg3spmc_telemetry_put16(&buf[2], self->_seq);
+		buf[4] = mod->_state;
+		buf[5] = flags;
+		buf[6] = v->status;
+		buf[7] = v->voltage_ac_V;
+
+#if defined(TG3SPMC_FIXED_POINT)
+		_tg3spmc_telemetry_put16(&buf[8],
+			_tg3spmc_telemetry_deci(v->voltage_dc_mV));
+		_tg3spmc_telemetry_put16(&buf[10],
+			_tg3spmc_telemetry_deci(v->current_dc_mA));
+		_tg3spmc_telemetry_put16(&buf[12],
+			_tg3spmc_telemetry_deci(v->current_ac_mA));
+		_tg3spmc_telemetry_put16(&buf[14],
+			_tg3spmc_telemetry_deci(v->current_limit_due_temp_mA));
+#else
+		_tg3spmc_telemetry_put16(&buf[8],
+			_tg3spmc_telemetry_deci(v->voltage_dc_V));
+		_tg3spmc_telemetry_put16(&buf[10],
+			_tg3spmc_telemetry_deci(v->current_dc_A));
+		_tg3spmc_telemetry_put16(&buf[12],
+			_tg3spmc_telemetry_deci(v->current_ac_A));
+		_tg3spmc_telemetry_put16(&buf[14],
+			_tg3spmc_telemetry_deci(v->current_limit_due_temp_A));
+#endif
+
+		_tg3spmc_telemetry_put16(&buf[16], (uint16_t)v->temp1_C);
+		_tg3spmc_telemetry_put16(&buf[18], (uint16_t)v->temp2_C);
+		_tg3spmc_telemetry_put16(&buf[20],
+					 (uint16_t)v->inlet_target_temp_C);
+
+		_tg3spmc_telemetry_put16(&buf[22], _tg3spmc_telemetry_crc(buf,
+					 TG3SPMC_TELEMETRY_SIZE - 2u));
+
+		self->_seq++;
+		result = true;
+	}
+
+	return result;
+}
+
+/**
+ * @brief Decodes a binary telemetry record (host side).
+ * @param buf Record (TG3SPMC_TELEMETRY_SIZE bytes).
+ * @param r Decoded record.
+ * @return bool True if sync byte and CRC are valid.
+ */
+bool tg3spmc_telemetry_decode(const uint8_t *buf,
+			      struct tg3spmc_telemetry_record *r)
+{
+	bool result = false;
+
+	if ((buf[0] == TG3SPMC_TELEMETRY_SYNC) &&
+	    (_tg3spmc_telemetry_crc(buf, TG3SPMC_TELEMETRY_SIZE - 2u) ==
+	     _tg3spmc_telemetry_get16(&buf[22]))) {
+		r->id     = buf[1];
+		r->seq    = _tg3spmc_telemetry_get16(&buf[2]);
+		r->state  = buf[4];
+		r->flags  = buf[5];
+		r->status = buf[6];
+
+		r->voltage_ac_V     = buf[7];
+		r->voltage_dc_dV    = _tg3spmc_telemetry_get16(&buf[8]);
+		r->current_dc_dA    = _tg3spmc_telemetry_get16(&buf[10]);
+		r->current_ac_dA    = _tg3spmc_telemetry_get16(&buf[12]);
+		r->current_limit_dA = _tg3spmc_telemetry_get16(&buf[14]);
+
+		r->temp1_C = (int16_t)_tg3spmc_telemetry_get16(&buf[16]);
+		r->temp2_C = (int16_t)_tg3spmc_telemetry_get16(&buf[18]);
+		r->inlet_target_temp_C =
+			     (int16_t)_tg3spmc_telemetry_get16(&buf[20]);
+
+		result = true;
+	}
+
+	return result;
+}
+
+/**
+ * @brief Formats decoded record in tg3spmc_log layout (host side).
+ * @param r Decoded record.
+ * @param buf Destination buffer.
+ * @param len Size of the destination buffer.
+ * @return bool True if successful, false if buffer is insufficient.
+ */
+bool tg3spmc_telemetry_format(const struct tg3spmc_telemetry_record *r,
+			      char *buf, size_t len)
+{
+	int32_t required_len = snprintf(
+		buf,
+		len,
+		_TG3SPMC_LOG_LINE1
+		_TG3SPMC_LOG_LINE2_FIXED
+		_TG3SPMC_LOG_LINE3_FIXED
+		_TG3SPMC_LOG_LINE4,
+
+		/* Line 1 */
+		(unsigned int)r->id,
+		((r->flags & TG3SPMC_TELEMETRY_FLAG_PWRON) != 0u) ?
+			"ON " : "OFF",
+		((r->flags & TG3SPMC_TELEMETRY_FLAG_CHGEN) != 0u) ?
+			"EN " : "DIS",
+		(unsigned int)r->state,
+
+		/* Line 2 */
+		(unsigned long)(r->voltage_dc_dV / 10u),
+		(unsigned long)(r->voltage_dc_dV % 10u),
+		(unsigned int)r->voltage_ac_V,
+		(unsigned int)(r->current_dc_dA / 10u),
+		(unsigned int)(r->current_dc_dA % 10u),
+		(unsigned int)(r->current_ac_dA / 10u),
+		(unsigned int)(r->current_ac_dA % 10u),
+
+		/* Line 3 */
+		(int)r->temp1_C,
+		(int)r->temp2_C,
+		(int)r->inlet_target_temp_C,
+		(unsigned int)(r->current_limit_dA / 10u),
+		(unsigned int)(r->current_limit_dA % 10u),
+
+		/* Line 4 */
+		((r->flags & TG3SPMC_TELEMETRY_FLAG_AC_PRESENT) != 0u) ?
+			'Y' : 'N',
+		((r->flags & TG3SPMC_TELEMETRY_FLAG_EN_PRESENT) != 0u) ?
+			'Y' : 'N',
+		((r->flags & TG3SPMC_TELEMETRY_FLAG_FAULT) != 0u) ? 'Y' : 'N',
+		(unsigned int)r->status
+	);
+
+	return (required_len >= 0) && (((size_t)required_len + 1u) <= len);
+}
+
+/******************************************************************************
+ * FLIGHT RECORDER
+ *
+ * Ring of the last RX/TX frames, state transitions and step deltas,
+ * stamped with module uptime. Storage is provided by the caller, each
+ * record is a single entry copy: no formatting, no loops depending on
+ * data, no allocation.
+ *
+ * The ring freezes on TG3SPMC_EVENT_FAULT, so it keeps what the module
+ * said just before the fault. It is exported as a CANARY common log:
+ * frames are replayed by log_emu as is, steps and transitions go to
+ * comment lines. Bus column tells frame direction: 0 for RX (from the
+ * module), 1 for TX (to the module).
+ *
+ * RAM: TG3SPMC_RECORDER_RAM(depth) bytes, 20 bytes per entry on common
+ * 32 and 64 bit targets. With a single module on the bus 256 entries
+ * (~5 KiB) hold ~2 s of history, 1024 entries (~20 KiB) ~5.5 s.
+ *****************************************************************************/
+/** Max length of a single exported line (including terminator). */
+#define TG3SPMC_RECORDER_LINE_MAX 96u
+
+/** Number of header lines in export. */
+#define TG3SPMC_RECORDER_HEADER_LINES 3u
+
+/**
+ * @brief Kind of a flight recorder entry.
+ */
+enum tg3spmc_recorder_kind {
+	TG3SPMC_RECORDER_KIND_RX,   /**< Frame received from the module. */
+	TG3SPMC_RECORDER_KIND_TX,   /**< Frame sent to the module. */
+	TG3SPMC_RECORDER_KIND_STEP, /**< Consecutive step deltas. */
+	TG3SPMC_RECORDER_KIND_STATE /**< State transition or event. */
+};
+
+/**
+ * @brief Single flight recorder entry.
+ */
+struct tg3spmc_recorder_entry {
+	uint32_t time_ms; /**< Module uptime (ms). */
+	uint32_t id;      /**< RX/TX: frame ID. STEP: sum of deltas (ms). */
+	uint8_t  kind;    /**< See tg3spmc_recorder_kind. */
+	uint8_t  len;     /**< RX/TX: frame length. */
+
+	/** RX/TX: payload.
+	 *  STEP: number of steps (0..1), max delta in ms (4..7).
+	 *  STATE: old state, new state, event, fault cause. */
+	uint8_t  data[8u];
+};
+
+/**
+ * @brief Flight recorder state.
+ */
+struct tg3spmc_recorder {
+	struct tg3spmc_recorder_entry *_entries; /**< Caller storage. */
+
+	uint32_t _mask; /**< Depth - 1 (depth is a power of two). */
+	uint32_t _head; /**< Next entry to be written. */
+	uint32_t _len;  /**< Number of valid entries. */
+
+	uint8_t _state; /**< Last seen controller state. */
+
+	/** Set on fault, nothing is recorded until rearmed. */
+	bool frozen;
+};
+
+/** RAM used by a recorder of `depth` entries (bytes). */
+#define TG3SPMC_RECORDER_RAM(depth) \
+	(((depth) * sizeof(struct tg3spmc_recorder_entry)) + \
+	 sizeof(struct tg3spmc_recorder))
+
+/**
+ * @brief Initializes flight recorder, along with the module.
+ * @param self Pointer to the recorder.
+ * @param entries Storage for `depth` entries.
+ * @param depth Number of entries, must be a power of two.
+ */
+void tg3spmc_recorder_init(struct tg3spmc_recorder *self,
+			   struct tg3spmc_recorder_entry *entries,
+			   uint32_t depth)
+{
+	assert((depth > 0u) && ((depth & (depth - 1u)) == 0u));
+
+	self->_entries = entries;
+	self->_mask    = depth - 1u;
+	self->_head    = 0u;
+	self->_len     = 0u;
+	self->_state   = (uint8_t)_TG3SPMC_STATE_CONFIG;
+	self->frozen   = false;
+}
+
+/**
+ * @brief Clears recorded history and resumes recording after a fault.
+ * @param self Pointer to the recorder.
+ */
+void tg3spmc_recorder_rearm(struct tg3spmc_recorder *self)
+{
+	self->_head  = 0u;
+	self->_len   = 0u;
+	self->frozen = false;
+}
+
+/* Max step delta of a STEP entry */
+uint32_t _tg3spmc_recorder_step_max(const struct tg3spmc_recorder_entry *e)
+{
+	return (uint32_t)_tg3spmc_telemetry_get16(&e->data[4]) |
+	       ((uint32_t)_tg3spmc_telemetry_get16(&e->data[6]) << 16u);
+}
+
+void _tg3spmc_recorder_set_step_max(struct tg3spmc_recorder_entry *e,
+				    uint32_t delta_ms)
+{
+	_tg3spmc_telemetry_put16(&e->data[4], (uint16_t)delta_ms);
+	_tg3spmc_telemetry_put16(&e->data[6], (uint16_t)(delta_ms >> 16u));
+}
+
+/* Takes the next entry, oldest one is overwritten when full */
+struct tg3spmc_recorder_entry *_tg3spmc_recorder_push(
+		struct tg3spmc_recorder *self, uint8_t kind, uint32_t time_ms)
+{
+	struct tg3spmc_recorder_entry *e = &self->_entries[self->_head];
+
+	self->_head = (self->_head + 1u) & self->_mask;
+	if (self->_len <= self->_mask) {
+		self->_len++;
+	}
+
+	e->time_ms = time_ms;
+	e->kind    = kind;
+	e->len     = 0u;
+
+	return e;
+}
+
+void _tg3spmc_recorder_frame(struct tg3spmc_recorder *self,
+			     const struct tg3spmc *mod,
+			     const struct tg3spmc_frame *f, uint8_t kind)
+{
+	struct tg3spmc_recorder_entry *e;
+	uint8_t i;
+
+	if (!self->frozen) {
+		e = _tg3spmc_recorder_push(self, kind, mod->_uptime_ms);
+		e->id  = f->id;
+		e->len = f->len;
+
+		/* Whole payload, constant time */
+		for (i = 0u; i < 8u; i++) {
+			e->data[i] = f->data[i];
+		}
+	}
+}
+
+/**
+ * @brief Records a frame passed to tg3spmc_put_rx_frame.
+ * @param self Pointer to the recorder.
+ * @param mod Pointer to the module (time source).
+ * @param f Received frame.
+ */
+void tg3spmc_recorder_rx(struct tg3spmc_recorder *self,
+			 const struct tg3spmc *mod,
+			 const struct tg3spmc_frame *f)
+{
+	_tg3spmc_recorder_frame(self, mod, f,
+				(uint8_t)TG3SPMC_RECORDER_KIND_RX);
+}
+
+/**
+ * @brief Records a frame taken from tg3spmc_get_tx_frame(s).
+ * @param self Pointer to the recorder.
+ * @param mod Pointer to the module (time source).
+ * @param f Sent frame.
+ */
+void tg3spmc_recorder_tx(struct tg3spmc_recorder *self,
+			 const struct tg3spmc *mod,
+			 const struct tg3spmc_frame *f)
+{
+	_tg3spmc_recorder_frame(self, mod, f,
+				(uint8_t)TG3SPMC_RECORDER_KIND_TX);
+}
+
+/**
+ * @brief Records a tg3spmc_step call and its result.
+ *
+ * Consecutive steps with no frames in between share a single entry (sum,
+ * count and max of deltas), zero deltas are not recorded. State changes
+ * and events get their own entry. TG3SPMC_EVENT_FAULT freezes recorder.
+ *
+ * @param self Pointer to the recorder.
+ * @param mod Pointer to the module.
+ * @param delta_ms Delta passed to tg3spmc_step.
+ * @param ev Event returned by tg3spmc_step.
+ */
+void tg3spmc_recorder_step(struct tg3spmc_recorder *self,
+			   const struct tg3spmc *mod, uint32_t delta_ms,
+			   enum tg3spmc_event ev)
+{
+	struct tg3spmc_recorder_entry *e =
+			&self->_entries[(self->_head - 1u) & self->_mask];
+	uint16_t steps;
+
+	if (self->frozen || (delta_ms == 0u)) {
+		/* Nothing to record */
+	} else if ((self->_len > 0u) &&
+		   (e->kind == (uint8_t)TG3SPMC_RECORDER_KIND_STEP)) {
+		steps = _tg3spmc_telemetry_get16(&e->data[0]);
+		if (steps < 0xFFFFu) {
+			_tg3spmc_telemetry_put16(&e->data[0],
+						 (uint16_t)(steps + 1u));
+		}
+
+		if (delta_ms > _tg3spmc_recorder_step_max(e)) {
+			_tg3spmc_recorder_set_step_max(e, delta_ms);
+		}
+
+		e->id     += delta_ms;
+		e->time_ms = mod->_uptime_ms;
+	} else {
+		e = _tg3spmc_recorder_push(self,
+			(uint8_t)TG3SPMC_RECORDER_KIND_STEP, mod->_uptime_ms);
+		e->id = delta_ms;
+		_tg3spmc_telemetry_put16(&e->data[0], 1u);
+		_tg3spmc_recorder_set_step_max(e, delta_ms);
+	}
+
+	if (self->frozen) {
+		/* Nothing to record */
+	} else if ((ev != TG3SPMC_EVENT_NONE) ||
+		   (mod->_state != self->_state)) {
+		e = _tg3spmc_recorder_push(self,
+			(uint8_t)TG3SPMC_RECORDER_KIND_STATE, mod->_uptime_ms);
+		e->id      = 0u;
+		e->data[0] = self->_state;
+		e->data[1] = mod->_state;
+		e->data[2] = (uint8_t)ev;
+		e->data[3] = (ev == TG3SPMC_EVENT_FAULT) ? mod->fault_cause :
+			     (uint8_t)TG3SPMC_FAULT_CAUSE_NONE;
+
+		self->_state = mod->_state;
+	}
+
+	if (ev == TG3SPMC_EVENT_FAULT) {
+		self->frozen = true;
+	}
+}
+
+/**
+ * @brief Number of lines in export (header and entries).
+ * @param self Pointer to the recorder.
+ * @return uint32_t Number of lines.
+ */
+uint32_t tg3spmc_recorder_lines(const struct tg3spmc_recorder *self)
+{
+	return TG3SPMC_RECORDER_HEADER_LINES + self->_len;
+}
+
+/**
+ * @brief Formats a single line of CANARY common log export.
+ *
+ * Lines are numbered from 0 to tg3spmc_recorder_lines() - 1, entries go
+ * oldest first. Time is counted from the oldest entry, its uptime is
+ * in the header. Frames go to bus 0 if received, bus 1 if sent. Should be
+ * called on a frozen recorder.
+ *
+ * @param self Pointer to the recorder.
+ * @param line Line number.
+ * @param buf Destination buffer (TG3SPMC_RECORDER_LINE_MAX is enough).
+ * @param len Size of the destination buffer.
+ * @return bool True if successful, false if there is no such line or
+ * 	buffer is insufficient.
+ */
+bool tg3spmc_recorder_export(const struct tg3spmc_recorder *self,
+			     uint32_t line, char *buf, size_t len)
+{
+	const struct tg3spmc_recorder_entry *first =
+		&self->_entries[(self->_head - self->_len) & self->_mask];
+	const struct tg3spmc_recorder_entry *e;
+
+	int32_t  n = -1;
+	int32_t  k;
+	uint32_t t;
+	uint8_t  i;
+
+	if (line == 0u) {
+		n = snprintf(buf, len, ";CANARY V2.3\n");
+	} else if (line == 1u) {
+		n = snprintf(buf, len, ";TIME_us.d C ID       FL L DATA\n");
+	} else if (line == 2u) {
+		n = snprintf(buf, len, ";TG3SPMC flight recorder, "
+			     "%lu entries, uptime at 0000.000000: %lums\n",
+			     (unsigned long)self->_len,
+			     (unsigned long)((self->_len > 0u) ?
+					     first->time_ms : 0u));
+	} else if ((line - TG3SPMC_RECORDER_HEADER_LINES) < self->_len) {
+		e = &self->_entries[(self->_head - self->_len + line -
+				     TG3SPMC_RECORDER_HEADER_LINES) &
+				    self->_mask];
+		t = e->time_ms - first->time_ms;
+
+		if (e->kind == (uint8_t)TG3SPMC_RECORDER_KIND_STEP) {
+			n = snprintf(buf, len, ";%04lu.%06lu STEP %lums, "
+				     "%u steps, max %lums\n",
+				     (unsigned long)(t / 1000u),
+				     (unsigned long)((t % 1000u) * 1000u),
+				     (unsigned long)e->id,
+				     (unsigned int)
+				     _tg3spmc_telemetry_get16(&e->data[0]),
+				     (unsigned long)
+				     _tg3spmc_recorder_step_max(e));
+		} else if (e->kind == (uint8_t)TG3SPMC_RECORDER_KIND_STATE) {
+			n = snprintf(buf, len, ";%04lu.%06lu STATE 0x%02X -> "
+				     "0x%02X, EVENT %s, CAUSE %s\n",
+				     (unsigned long)(t / 1000u),
+				     (unsigned long)((t % 1000u) * 1000u),
+				     (unsigned int)e->data[0],
+				     (unsigned int)e->data[1],
+				     tg3spmc_get_event_name(e->data[2]),
+				     tg3spmc_get_fault_cause_name(e->data[3]));
+		} else {
+			n = snprintf(buf, len, "%04lu.%06lu %u %08lX 00 %u",
+				     (unsigned long)(t / 1000u),
+				     (unsigned long)((t % 1000u) * 1000u),
+				     (e->kind ==
+				      (uint8_t)TG3SPMC_RECORDER_KIND_TX) ?
+				     1u : 0u,
+				     (unsigned long)e->id,
+				     (unsigned int)e->len);
+
+			for (i = 0u; (i < e->len) && (i < 8u) && (n >= 0) &&
+				     ((size_t)n < len); i++) {
+				k = snprintf(&buf[n], len - (size_t)n,
+					     " %02X", (unsigned int)e->data[i]);
+				n = (k < 0) ? k : (n + k);
+			}
+
+			if ((n >= 0) && ((size_t)n < len)) {
+				k = snprintf(&buf[n], len - (size_t)n, "\n");
+				n = (k < 0) ? k : (n + k);
+			}
+		}
+	} else {
+		/* No such line */
+	}
+
+	return (n >= 0) && (((size_t)n + 1u) <= len);
+}
@@ -0,0 +1,970 @@
+/**
+ * ```LICENSE
+ * Tesla GEN3 Single phase module controller
+ *
+ * Copyright (C) 2025 furdog
+ * https://github.com/furdog/tg3spmc
+ *
+ * Knowledge derived from:
+ * Copyright (C) 2017-2019 T de Bree, D. Maguire, and C. Kidder
+ * https://github.com/damienmaguire/Tesla-charger
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * ```
+ *
+ * @file tg3spmc.sim.h
+ * @brief Virtual single phase module, for closed loop tests of tg3spmc.
+ *
+ * Includes tg3spmc.h (same build options). The simulator takes pin states and
+ * frames sent by the controller (0x42C + ID, 0x45C, 0x368) and answers
+ * with 0x207 - 0x247 (+ID) frames of a module that boots, soft-starts,
+ * charges its DC bus, ramps output current, heats up and derates.
+ *
+ * Timings and values are taken from the captures in examples/log_emu and
+ * savvyCAN (module 1, 235VAC grid, 387VDC battery, 4A AC setpoint). Values
+ * that never changed on captures (temperature derating, command timeout,
+ * open output ramp) are assumptions, they are marked as such.
+ *
+ * Time is virtual: the simulator only moves by tg3spmc_sim_step and tells
+ * when it must be stepped next (tg3spmc_sim_next_deadline_ms), so a
+ * closed loop with the controller runs as fast as the host goes
+ * (tg3spmc_sim_run steps both and exchanges their frames and pins).
+ * Values are not noisy, a run is fully reproducible.
+ */
+#ifndef TG3SPMC_SIM_H
+#define TG3SPMC_SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tg3spmc.h"
+
+/******************************************************************************
+ * CONSTANTS
+ *****************************************************************************/
+/** Period of every module message (milliseconds) */
+#define TG3SPMC_SIM_MSG_PERIOD_MS 100u
+
+/** 0x207, 0x227, 0x237, 0x247 follow 0x217 after this (milliseconds) */
+#define TG3SPMC_SIM_PARAMS_DELAY_MS 90u
+
+/** Silence after power on, before the first 0x217 (milliseconds) */
+#define TG3SPMC_SIM_BOOT_MS 100u
+
+/** AC input voltage rise time constant after boot (milliseconds).
+ * Starts at TG3SPMC_SIM_AC_START of the grid voltage (160V of 235V) */
+#define TG3SPMC_SIM_AC_TAU_MS 150u
+#define TG3SPMC_SIM_AC_START 0.68f
+
+/** AC is present above this voltage (same as the controller decoder) */
+#define TG3SPMC_SIM_AC_PRESENT_V 70.0f
+
+/** Start to unknown_flg5 (0x207 bit 20), milliseconds */
+#define TG3SPMC_SIM_SOFTSTART_FLAG_MS 900u
+
+/** Start to DC relay closed (0x217 0x31 -> 0x41), milliseconds */
+#define TG3SPMC_SIM_SOFTSTART_MS 6000u
+
+/** DC relay closed to current output (0x207 flag_cur_out), milliseconds */
+#define TG3SPMC_SIM_CUR_OUT_MS 1000u
+
+/** AC current ramp after current output starts (A per second) */
+#define TG3SPMC_SIM_CUR_RAMP_A_S 2.9f
+
+/** DC bus voltage while the relay is closed, 0x227 bytes 6-7 (V) */
+#define TG3SPMC_SIM_BUS_V 574.0f
+
+/** DC bus charge and discharge time constants (milliseconds) */
+#define TG3SPMC_SIM_BUS_TAU_MS       100u
+#define TG3SPMC_SIM_BUS_DECAY_TAU_MS 30000u
+
+/** AC to DC efficiency (235V * 4A -> 389V * 1.95A) */
+#define TG3SPMC_SIM_EFFICIENCY 0.82f
+
+/** Battery internal resistance (388.5V at 0A, 389.5V at 2A), ohm */
+#define TG3SPMC_SIM_BATTERY_R 0.5f
+
+/** AC current limit reported while cool, 0x247 byte 0 = 0x66 (A) */
+#define TG3SPMC_SIM_CURRENT_LIMIT_A 23.90625f
+
+/** Peak AC current limit, 0x207 raw value (36.0A) */
+#define TG3SPMC_SIM_PEAK_LIMIT_RAW 360u
+
+/** Power stage heating: time constant (ms) and rise per input watt
+ * (+6C in 80s at 940W, settling ~45C above ambient) */
+#define TG3SPMC_SIM_THERMAL_TAU_MS 600000u
+#define TG3SPMC_SIM_THERMAL_C_W    0.048f
+
+/** Heating multiplier with TG3SPMC_SIM_FAULT_OVERTEMP (cooling lost) */
+#define TG3SPMC_SIM_OVERTEMP_GAIN 4.0f
+
+/** Derating starts and ends at these temperatures, C (assumption) */
+#define TG3SPMC_SIM_DERATE_START_C 70.0f
+#define TG3SPMC_SIM_DERATE_END_C   90.0f
+
+/** Module stops if 0x42C is not received this long, ms (assumption) */
+#define TG3SPMC_SIM_CMD_TIMEOUT_MS 1000u
+
+/** Output voltage ramp with no battery connected, V/s (assumption) */
+#define TG3SPMC_SIM_OPEN_RAMP_V_S 100.0f
+
+/******************************************************************************
+ * FAULTS
+ *****************************************************************************/
+/**
+ * @brief Faults that can be injected into the simulated module.
+ *
+ * FLAG and RESET are one shot. Others last until tg3spmc_sim_clear.
+ */
+enum tg3spmc_sim_fault {
+	/** Module raises 0x207 fault flag and stops, latched until the
+	 *  module is powered off. */
+	TG3SPMC_SIM_FAULT_FLAG       = 1u,
+
+	/** Module goes silent, nothing is sent. */
+	TG3SPMC_SIM_FAULT_BUS_OFF    = 2u,
+
+	/** Only 0x237 (sensors) goes silent. */
+	TG3SPMC_SIM_FAULT_MSG_SILENT = 4u,
+
+	/** AC grid is lost, module stops and restarts once it is back. */
+	TG3SPMC_SIM_FAULT_AC_LOSS    = 8u,
+
+	/** Cooling is lost, module heats up and derates current. */
+	TG3SPMC_SIM_FAULT_OVERTEMP   = 16u,
+
+	/** Module reboots on its own (as seen on the capture at 119.8s). */
+	TG3SPMC_SIM_FAULT_RESET      = 32u
+};
+
+/******************************************************************************
+ * SIMULATOR
+ *****************************************************************************/
+/**
+ * @brief Simulated module state.
+ */
+enum _tg3spmc_sim_state {
+	_TG3SPMC_SIM_STATE_OFF,       /**< pwron pin is low */
+	_TG3SPMC_SIM_STATE_BOOT,      /**< Silent after power on */
+	_TG3SPMC_SIM_STATE_STANDBY,   /**< Talks, waits for start */
+	_TG3SPMC_SIM_STATE_SOFTSTART, /**< AC precharge */
+	_TG3SPMC_SIM_STATE_RELAY,     /**< DC relay closed, bus charged */
+	_TG3SPMC_SIM_STATE_CHARGING   /**< Current output */
+};
+
+/**
+ * @brief Virtual single phase module.
+ */
+struct tg3spmc_sim {
+	/* Environment, may be changed at any time */
+	float grid_voltage_V;    /**< AC grid voltage (RMS). */
+	float battery_voltage_V; /**< Open circuit battery voltage, 0 if no
+				  *   battery (output ramps to setpoint). */
+	float ambient_C;         /**< Ambient (and temp2 sensor) temperature. */
+
+	/* Module physics, as reported on CAN */
+	float voltage_ac_V;    /**< AC input voltage. */
+	float voltage_bus_V;   /**< Internal DC bus (0x227 bytes 0-1). */
+	float voltage_dc_V;    /**< Output voltage. */
+	float current_ac_A;    /**< AC input current (RMS). */
+	float current_dc_A;    /**< Output current. */
+	float temp_C;          /**< Power stage temperature (temp1). */
+	float current_limit_A; /**< AC current limit due to temperature. */
+
+	/* Commands received from the controller */
+	float set_current_ac_A; /**< 0x42C setpoint. */
+	float set_voltage_dc_V; /**< 0x45C setpoint. */
+
+	uint8_t _id;    /**< Module ID (0-2). */
+	uint8_t _state; /**< See _tg3spmc_sim_state. */
+
+	uint8_t _faults;        /**< Injected lasting faults. */
+	bool    _fault_latched; /**< 0x207 fault flag. */
+
+	bool _pwron; /**< pwron pin. */
+	bool _chgen; /**< chgen pin. */
+
+	bool _start_cmd;   /**< 0x42C requests start. */
+	bool _start_bcast; /**< 0x45C requests start. */
+
+	uint8_t _status; /**< Last sent 0x217 status byte. */
+
+	uint32_t _timer_ms;        /**< Time in current state. */
+	uint32_t _cmd_timer_ms;    /**< Time since the last 0x42C. */
+	uint32_t _status_timer_ms; /**< Time since the last 0x217. */
+	uint32_t _params_timer_ms; /**< Time since the last 0x207 - 0x247. */
+
+	/** Frames to be received by the controller. */
+	struct tg3spmc_queue _tx;
+};
+
+/******************************************************************************
+ * SIMULATOR PRIVATE
+ *****************************************************************************/
+/* First order filter, stable for any step */
+float _tg3spmc_sim_filter(float x, float target, uint32_t delta_ms,
+			  uint32_t tau_ms)
+{
+	return x + ((target - x) * (float)delta_ms /
+		    ((float)tau_ms + (float)delta_ms));
+}
+
+/* Scales value into raw unsigned field, clamped */
+uint16_t _tg3spmc_sim_raw(float value, float scale, uint16_t max)
+{
+	float raw = (value * scale) + 0.5f;
+
+	if (raw < 0.0f) {
+		raw = 0.0f;
+	}
+
+	if (raw > (float)max) {
+		raw = (float)max;
+	}
+
+	return (uint16_t)raw;
+}
+
+void _tg3spmc_sim_put16(uint8_t *d, uint16_t raw)
+{
+	d[0] = (uint8_t)(raw & 0x00FFu);
+	d[1] = (uint8_t)(raw >> 8u);
+}
+
+void _tg3spmc_sim_enter(struct tg3spmc_sim *self, uint8_t state)
+{
+	self->_state    = state;
+	self->_timer_ms = 0u;
+}
+
+/* Module starts from scratch, as after power on */
+void _tg3spmc_sim_boot(struct tg3spmc_sim *self)
+{
+	float ac_V = ((self->_faults & (uint8_t)TG3SPMC_SIM_FAULT_AC_LOSS) !=
+		      0u) ? 0.0f : self->grid_voltage_V;
+
+	_tg3spmc_sim_enter(self, (uint8_t)_TG3SPMC_SIM_STATE_BOOT);
+
+	self->voltage_ac_V  = ac_V * TG3SPMC_SIM_AC_START;
+	self->voltage_bus_V = self->voltage_ac_V * 1.414f;
+	self->current_ac_A  = 0.0f;
+	self->current_dc_A  = 0.0f;
+
+	self->_start_cmd   = false;
+	self->_start_bcast = false;
+	self->_status      = 0u;
+}
+
+bool _tg3spmc_sim_start_requested(struct tg3spmc_sim *self)
+{
+	return self->_chgen && self->_start_cmd && self->_start_bcast &&
+	       (self->voltage_ac_V > TG3SPMC_SIM_AC_PRESENT_V) &&
+	       !self->_fault_latched;
+}
+
+void _tg3spmc_sim_update_state(struct tg3spmc_sim *self)
+{
+	bool start = _tg3spmc_sim_start_requested(self);
+
+	switch (self->_state) {
+	case _TG3SPMC_SIM_STATE_BOOT:
+		if (self->_timer_ms >= TG3SPMC_SIM_BOOT_MS) {
+			_tg3spmc_sim_enter(self,
+					   (uint8_t)_TG3SPMC_SIM_STATE_STANDBY);
+
+			/* Status goes right away, params follow */
+			self->_status_timer_ms = TG3SPMC_SIM_MSG_PERIOD_MS;
+			self->_params_timer_ms = TG3SPMC_SIM_MSG_PERIOD_MS -
+						 TG3SPMC_SIM_PARAMS_DELAY_MS;
+		}
+		break;
+
+	case _TG3SPMC_SIM_STATE_STANDBY:
+		if (start) {
+			_tg3spmc_sim_enter(self,
+				(uint8_t)_TG3SPMC_SIM_STATE_SOFTSTART);
+		}
+		break;
+
+	case _TG3SPMC_SIM_STATE_SOFTSTART:
+		if (self->_timer_ms >= TG3SPMC_SIM_SOFTSTART_MS) {
+			_tg3spmc_sim_enter(self,
+					   (uint8_t)_TG3SPMC_SIM_STATE_RELAY);
+		}
+		break;
+
+	case _TG3SPMC_SIM_STATE_RELAY:
+		if (self->_timer_ms >= TG3SPMC_SIM_CUR_OUT_MS) {
+			_tg3spmc_sim_enter(self,
+				(uint8_t)_TG3SPMC_SIM_STATE_CHARGING);
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	/* Stop request, AC loss or fault stops everything at once */
+	if ((self->_state > (uint8_t)_TG3SPMC_SIM_STATE_STANDBY) && !start) {
+		_tg3spmc_sim_enter(self, (uint8_t)_TG3SPMC_SIM_STATE_STANDBY);
+	}
+}
+
+float _tg3spmc_sim_derate(float temp_C)
+{
+	float limit_A = TG3SPMC_SIM_CURRENT_LIMIT_A;
+
+	if (temp_C >= TG3SPMC_SIM_DERATE_END_C) {
+		limit_A = 0.0f;
+	} else if (temp_C > TG3SPMC_SIM_DERATE_START_C) {
+		limit_A *= (TG3SPMC_SIM_DERATE_END_C - temp_C) /
+			   (TG3SPMC_SIM_DERATE_END_C -
+			    TG3SPMC_SIM_DERATE_START_C);
+	} else {
+		/* Full limit */
+	}
+
+	return limit_A;
+}
+
+/* Target AC current of a charging module */
+float _tg3spmc_sim_target_current(struct tg3spmc_sim *self)
+{
+	float target_A = self->set_current_ac_A;
+	float max_A;
+
+	if (target_A > self->current_limit_A) {
+		target_A = self->current_limit_A;
+	}
+
+	/* Constant voltage: output current is limited near the setpoint */
+	if ((self->battery_voltage_V > 0.0f) &&
+	    (self->voltage_ac_V > TG3SPMC_SIM_AC_PRESENT_V)) {
+		max_A = (self->set_voltage_dc_V - self->battery_voltage_V) /
+			TG3SPMC_SIM_BATTERY_R;
+		max_A = max_A * self->battery_voltage_V /
+			(self->voltage_ac_V * TG3SPMC_SIM_EFFICIENCY);
+
+		if (target_A > max_A) {
+			target_A = max_A;
+		}
+	} else {
+		/* Open output or no AC, nothing to charge */
+		target_A = 0.0f;
+	}
+
+	return (target_A > 0.0f) ? target_A : 0.0f;
+}
+
+void _tg3spmc_sim_update_physics(struct tg3spmc_sim *self, uint32_t delta_ms)
+{
+	bool  relay = (self->_state >= (uint8_t)_TG3SPMC_SIM_STATE_RELAY);
+	float ac_V = self->grid_voltage_V;
+	float bus_V = self->voltage_ac_V * 1.414f;
+	float target_A = 0.0f;
+	float target_V;
+	float ramp_V = TG3SPMC_SIM_OPEN_RAMP_V_S * (float)delta_ms / 1000.0f;
+	float gain = 1.0f;
+
+	if ((self->_faults & (uint8_t)TG3SPMC_SIM_FAULT_AC_LOSS) != 0u) {
+		ac_V = 0.0f;
+	}
+
+	if ((self->_faults & (uint8_t)TG3SPMC_SIM_FAULT_OVERTEMP) != 0u) {
+		gain = TG3SPMC_SIM_OVERTEMP_GAIN;
+	}
+
+	/* Unpowered module measures nothing */
+	if (self->_state == (uint8_t)_TG3SPMC_SIM_STATE_OFF) {
+		ac_V  = 0.0f;
+		bus_V = 0.0f;
+	}
+
+	self->voltage_ac_V = _tg3spmc_sim_filter(self->voltage_ac_V, ac_V,
+						 delta_ms,
+						 TG3SPMC_SIM_AC_TAU_MS);
+
+	/* Bus is charged fast by PFC, discharges slowly */
+	bus_V = relay ? TG3SPMC_SIM_BUS_V : bus_V;
+	self->voltage_bus_V = _tg3spmc_sim_filter(self->voltage_bus_V, bus_V,
+		delta_ms, (bus_V > self->voltage_bus_V) ?
+			  TG3SPMC_SIM_BUS_TAU_MS :
+			  TG3SPMC_SIM_BUS_DECAY_TAU_MS);
+
+	self->current_limit_A = _tg3spmc_sim_derate(self->temp_C);
+
+	if (self->_state == (uint8_t)_TG3SPMC_SIM_STATE_CHARGING) {
+		target_A = _tg3spmc_sim_target_current(self);
+	}
+
+	/* Ramps up, drops at once */
+	self->current_ac_A += TG3SPMC_SIM_CUR_RAMP_A_S * (float)delta_ms /
+			      1000.0f;
+	if (self->current_ac_A > target_A) {
+		self->current_ac_A = target_A;
+	}
+
+	if (self->battery_voltage_V > 0.0f) {
+		self->current_dc_A = self->voltage_ac_V * self->current_ac_A *
+				     TG3SPMC_SIM_EFFICIENCY /
+				     self->battery_voltage_V;
+		self->voltage_dc_V = self->battery_voltage_V +
+				     (self->current_dc_A *
+				      TG3SPMC_SIM_BATTERY_R);
+	} else {
+		/* Open output follows setpoint while the relay is closed */
+		self->current_dc_A = 0.0f;
+		target_V = relay ? self->set_voltage_dc_V : 0.0f;
+
+		if (self->voltage_dc_V < (target_V - ramp_V)) {
+			self->voltage_dc_V += ramp_V;
+		} else if (self->voltage_dc_V > (target_V + ramp_V)) {
+			self->voltage_dc_V -= ramp_V;
+		} else {
+			self->voltage_dc_V = target_V;
+		}
+	}
+
+	self->temp_C = _tg3spmc_sim_filter(self->temp_C, self->ambient_C +
+		(self->voltage_ac_V * self->current_ac_A *
+		 TG3SPMC_SIM_THERMAL_C_W * gain), delta_ms,
+		TG3SPMC_SIM_THERMAL_TAU_MS);
+}
+
+uint8_t _tg3spmc_sim_status(struct tg3spmc_sim *self)
+{
+	uint8_t status = 0u;
+
+	if (self->_chgen) {
+		status |= (uint8_t)_TG3SPM_FIELD_STATUS_FLAGS_CHGEN_PIN_ON;
+	}
+
+	if (self->_state == (uint8_t)_TG3SPMC_SIM_STATE_SOFTSTART) {
+		status |= (uint8_t)(_TG3SPM_FIELD_STATUS_FLAGS_UNKNOWN5 |
+				    _TG3SPM_FIELD_STATUS_FLAGS_AC_PRECHARGE_EN);
+	}
+
+	if (self->_state >= (uint8_t)_TG3SPMC_SIM_STATE_RELAY) {
+		status |= (uint8_t)_TG3SPM_FIELD_STATUS_FLAGS_DC_PRECHARGE_EN;
+	}
+
+	return status;
+}
+
+void _tg3spmc_sim_encode_ac_params(struct tg3spmc_sim *self, uint8_t *d)
+{
+	/* 0.1A units of peak current */
+	uint16_t peak = _tg3spmc_sim_raw(self->current_ac_A, 14.142136f,
+					 0x1FFu);
+	uint8_t  flags = 0u;
+
+	if (self->_state >= (uint8_t)_TG3SPMC_SIM_STATE_SOFTSTART) {
+		flags |= (uint8_t)
+			 _TG3SPM_FIELD_AC_PARAMS_FLAGS0_SOFTSTART_ALLOWED;
+	}
+
+	if (((self->_state == (uint8_t)_TG3SPMC_SIM_STATE_SOFTSTART) &&
+	     (self->_timer_ms >= TG3SPMC_SIM_SOFTSTART_FLAG_MS)) ||
+	    (self->_state >= (uint8_t)_TG3SPMC_SIM_STATE_RELAY)) {
+		flags |= (uint8_t)_TG3SPM_FIELD_AC_PARAMS_FLAGS0_UNKNOWN5;
+	}
+
+	if (self->_state == (uint8_t)_TG3SPMC_SIM_STATE_CHARGING) {
+		flags |= (uint8_t)_TG3SPM_FIELD_AC_PARAMS_FLAGS0_CUR_OUT;
+	}
+
+	if (self->_fault_latched) {
+		flags |= (uint8_t)_TG3SPM_FIELD_AC_PARAMS_FLAGS0_FAULT;
+	}
+
+	/* SG_ voltage_V : 8|8@1+ (1,0) */
+	d[1] = (uint8_t)_tg3spmc_sim_raw(self->voltage_ac_V, 1.0f, 0xFFu);
+	d[2] = flags;
+
+	/* SG_ peak_current_limit_A : 32|9@1+ (0.1,0)
+	 * SG_ peak_current_A : 41|9@1+ (0.1,0) */
+	d[4] = (uint8_t)(TG3SPMC_SIM_PEAK_LIMIT_RAW & 0xFFu);
+	d[5] = (uint8_t)((TG3SPMC_SIM_PEAK_LIMIT_RAW >> 8u) |
+			 ((peak & 0x7Fu) << 1u));
+	d[6] = (uint8_t)(peak >> 7u);
+
+	/* SG_ flag_charge_disallowed : 50|1@1+ (1,0) */
+	if (self->_state < (uint8_t)_TG3SPMC_SIM_STATE_SOFTSTART) {
+		d[6] |= (uint8_t)
+			(_TG3SPM_FIELD_AC_PARAMS_FLAGS1_CHARGE_DISALLOWED <<
+			 2u);
+	}
+}
+
+void _tg3spmc_sim_encode_dc_params(struct tg3spmc_sim *self, uint8_t *d)
+{
+	const float v_scale = 65535.0f / 700.0f;
+
+	_tg3spmc_sim_put16(&d[0], _tg3spmc_sim_raw(self->voltage_bus_V,
+						   v_scale, 0xFFFFu));
+	_tg3spmc_sim_put16(&d[2], _tg3spmc_sim_raw(self->voltage_dc_V,
+						   v_scale, 0xFFFFu));
+	_tg3spmc_sim_put16(&d[4], _tg3spmc_sim_raw(self->current_dc_A,
+						   65535.0f / 50.0f,
+						   0xFFFFu));
+	_tg3spmc_sim_put16(&d[6], _tg3spmc_sim_raw(TG3SPMC_SIM_BUS_V,
+						   v_scale, 0xFFFFu));
+}
+
+void _tg3spmc_sim_encode_sensors(struct tg3spmc_sim *self, uint8_t *d)
+{
+	d[0] = (uint8_t)_tg3spmc_sim_raw(self->temp_C + 40.0f, 1.0f, 0xFFu);
+	d[1] = (uint8_t)_tg3spmc_sim_raw(self->ambient_C + 40.0f, 1.0f,
+					 0xFFu);
+
+	/* Unknown, follows AC current: 0x17 idle, 0x3C at 4A */
+	d[3] = (uint8_t)_tg3spmc_sim_raw(23.0f + (self->current_ac_A * 9.25f),
+					 1.0f, 0x3Cu);
+}
+
+void _tg3spmc_sim_encode_limits(struct tg3spmc_sim *self, uint8_t *d)
+{
+	d[0] = (uint8_t)_tg3spmc_sim_raw(self->current_limit_A,
+					 1.0f / 0.234375f, 0xFFu);
+	d[1] = 0x7Du; /* Unknown, static */
+}
+
+void _tg3spmc_sim_send(struct tg3spmc_sim *self, uint32_t base_id)
+{
+	struct tg3spmc_frame f;
+
+	bool silent = ((self->_faults & (uint8_t)TG3SPMC_SIM_FAULT_BUS_OFF) !=
+		       0u);
+
+	if ((base_id == (uint32_t)_TG3SPM_FRAME_BASE_ID_SENSORS) &&
+	    ((self->_faults & (uint8_t)TG3SPMC_SIM_FAULT_MSG_SILENT) != 0u)) {
+		silent = true;
+	}
+
+	f.id  = base_id + (self->_id * _TG3SPM_MODULE_ID_SPACING);
+	f.len = 8u;
+	memset(f.data, 0, sizeof(f.data));
+
+	switch (base_id) {
+	case _TG3SPM_FRAME_BASE_ID_AC_PARAMS:
+		_tg3spmc_sim_encode_ac_params(self, f.data);
+		break;
+
+	case _TG3SPM_FRAME_BASE_ID_STATUS:
+		f.data[0] = self->_status;
+		break;
+
+	case _TG3SPM_FRAME_BASE_ID_DC_PARAMS:
+		_tg3spmc_sim_encode_dc_params(self, f.data);
+		break;
+
+	case _TG3SPM_FRAME_BASE_ID_SENSORS:
+		_tg3spmc_sim_encode_sensors(self, f.data);
+		break;
+
+	default:
+		_tg3spmc_sim_encode_limits(self, f.data);
+		break;
+	}
+
+	if (!silent) {
+		(void)tg3spmc_queue_put(&self->_tx, &f);
+	}
+}
+
+void _tg3spmc_sim_update_frames(struct tg3spmc_sim *self)
+{
+	uint8_t status = _tg3spmc_sim_status(self);
+
+	/* Status is also sent on change (~2ms after start on captures) */
+	if ((status != self->_status) ||
+	    (self->_status_timer_ms >= TG3SPMC_SIM_MSG_PERIOD_MS)) {
+		self->_status = status;
+		self->_status_timer_ms = 0u;
+		_tg3spmc_sim_send(self,
+				  (uint32_t)_TG3SPM_FRAME_BASE_ID_STATUS);
+	}
+
+	if (self->_params_timer_ms >= TG3SPMC_SIM_MSG_PERIOD_MS) {
+		self->_params_timer_ms -= TG3SPMC_SIM_MSG_PERIOD_MS;
+
+		/* Stepped late, don't send a burst */
+		if (self->_params_timer_ms >= TG3SPMC_SIM_MSG_PERIOD_MS) {
+			self->_params_timer_ms = 0u;
+		}
+
+		_tg3spmc_sim_send(self,
+				  (uint32_t)_TG3SPM_FRAME_BASE_ID_AC_PARAMS);
+		_tg3spmc_sim_send(self,
+				  (uint32_t)_TG3SPM_FRAME_BASE_ID_DC_PARAMS);
+		_tg3spmc_sim_send(self,
+				  (uint32_t)_TG3SPM_FRAME_BASE_ID_SENSORS);
+		_tg3spmc_sim_send(self,
+				  (uint32_t)_TG3SPM_FRAME_BASE_ID_LIMITS);
+	}
+}
+
+/******************************************************************************
+ * SIMULATOR PUBLIC
+ *****************************************************************************/
+/**
+ * @brief Initializes the simulated module, powered off.
+ *
+ * Environment defaults to the capture: 235VAC grid, 388.5V battery, 25C.
+ * @param self Pointer to the simulator.
+ * @param id Module ID (0, 1, or 2).
+ */
+void tg3spmc_sim_init(struct tg3spmc_sim *self, uint8_t id)
+{
+	assert(id < 3u);
+
+	self->grid_voltage_V    = 235.0f;
+	self->battery_voltage_V = 388.5f;
+	self->ambient_C         = 25.0f;
+
+	self->voltage_ac_V    = 0.0f;
+	self->voltage_bus_V   = 0.0f;
+	self->voltage_dc_V    = self->battery_voltage_V;
+	self->current_ac_A    = 0.0f;
+	self->current_dc_A    = 0.0f;
+	self->temp_C          = self->ambient_C;
+	self->current_limit_A = TG3SPMC_SIM_CURRENT_LIMIT_A;
+
+	self->set_current_ac_A = 0.0f;
+	self->set_voltage_dc_V = 0.0f;
+
+	self->_id    = id;
+	self->_state = (uint8_t)_TG3SPMC_SIM_STATE_OFF;
+
+	self->_faults        = 0u;
+	self->_fault_latched = false;
+
+	self->_pwron = false;
+	self->_chgen = false;
+
+	self->_start_cmd   = false;
+	self->_start_bcast = false;
+	self->_status      = 0u;
+
+	self->_timer_ms        = 0u;
+	self->_cmd_timer_ms    = 0u;
+	self->_status_timer_ms = 0u;
+	self->_params_timer_ms = 0u;
+
+	tg3spmc_queue_init(&self->_tx);
+}
+
+/**
+ * @brief Sets module input pins, as driven by the controller.
+ *
+ * Call tg3spmc_sim_step (zero delta is fine) afterwards.
+ * @param self Pointer to the simulator.
+ * @param pwron Power on pin.
+ * @param chgen Charge enable pin.
+ */
+void tg3spmc_sim_set_pins(struct tg3spmc_sim *self, bool pwron, bool chgen)
+{
+	if (pwron && !self->_pwron) {
+		_tg3spmc_sim_boot(self);
+	}
+
+	/* Power off clears everything, latched fault included */
+	if (!pwron && self->_pwron) {
+		_tg3spmc_sim_enter(self, (uint8_t)_TG3SPMC_SIM_STATE_OFF);
+		self->_fault_latched = false;
+		self->current_ac_A   = 0.0f;
+		self->current_dc_A   = 0.0f;
+	}
+
+	self->_pwron = pwron;
+	self->_chgen = chgen;
+}
+
+/**
+ * @brief Passes a frame sent by the controller to the module.
+ *
+ * Call tg3spmc_sim_step (zero delta is fine) afterwards.
+ * @param self Pointer to the simulator.
+ * @param f Pointer to the CAN frame.
+ * @return True if the frame is taken by this module.
+ */
+bool tg3spmc_sim_put_rx_frame(struct tg3spmc_sim *self,
+			      const struct tg3spmc_frame *f)
+{
+	bool taken = (self->_state != (uint8_t)_TG3SPMC_SIM_STATE_OFF) &&
+		     (self->_state != (uint8_t)_TG3SPMC_SIM_STATE_BOOT) &&
+		     (f->len == 8u);
+
+	if (!taken) {
+		/* Module does not listen */
+	} else if (f->id == (0x42Cu + (self->_id * 0x10u))) {
+		/* Started: BB .. .. FE, setup/idle: rated/1.2 .. .. 64 */
+		self->_start_cmd = (f->data[1] == 0xBBu) &&
+				   (f->data[4] == 0xFEu);
+		self->set_current_ac_A = (float)(((uint16_t)f->data[3] << 8u) |
+						 f->data[2]) / 1500.0f;
+		self->_cmd_timer_ms = 0u;
+	} else if (f->id == 0x45Cu) {
+		self->_start_bcast = (f->data[3] == 0x2Eu);
+		self->set_voltage_dc_V = (float)(((uint16_t)f->data[1] << 8u) |
+						 f->data[0]) / 100.0f;
+	} else if (f->id == 0x368u) {
+		/* Static, nothing to take */
+	} else {
+		taken = false;
+	}
+
+	return taken;
+}
+
+/**
+ * @brief Injects faults (enum tg3spmc_sim_fault bits).
+ * @param self Pointer to the simulator.
+ * @param faults Faults to be injected.
+ */
+void tg3spmc_sim_inject(struct tg3spmc_sim *self, uint8_t faults)
+{
+	bool on = (self->_state != (uint8_t)_TG3SPMC_SIM_STATE_OFF);
+
+	if (on && ((faults & (uint8_t)TG3SPMC_SIM_FAULT_FLAG) != 0u)) {
+		self->_fault_latched = true;
+	}
+
+	self->_faults |= (uint8_t)(faults &
+				   ~(uint8_t)(TG3SPMC_SIM_FAULT_FLAG |
+					      TG3SPMC_SIM_FAULT_RESET));
+
+	if (on && ((faults & (uint8_t)TG3SPMC_SIM_FAULT_RESET) != 0u)) {
+		_tg3spmc_sim_boot(self);
+	}
+}
+
+/**
+ * @brief Removes lasting faults (enum tg3spmc_sim_fault bits).
+ * @param self Pointer to the simulator.
+ * @param faults Faults to be removed.
+ */
+void tg3spmc_sim_clear(struct tg3spmc_sim *self, uint8_t faults)
+{
+	self->_faults &= (uint8_t)~faults;
+}
+
+/**
+ * @brief Advances the simulated module by the given time.
+ *
+ * Frames produced are taken with tg3spmc_sim_get_tx_frame, they must be
+ * taken after each step (up to 5 frames per step are produced, frames that
+ * don't fit the queue are counted by tg3spmc_sim_get_tx_drops).
+ * @param self Pointer to the simulator.
+ * @param delta_ms Elapsed time (milliseconds).
+ */
+void tg3spmc_sim_step(struct tg3spmc_sim *self, uint32_t delta_ms)
+{
+	bool talks = (self->_state > (uint8_t)_TG3SPMC_SIM_STATE_BOOT);
+
+	self->_timer_ms += delta_ms;
+
+	if (talks) {
+		self->_cmd_timer_ms    += delta_ms;
+		self->_status_timer_ms += delta_ms;
+		self->_params_timer_ms += delta_ms;
+	}
+
+	/* Controller went silent */
+	if (self->_cmd_timer_ms >= TG3SPMC_SIM_CMD_TIMEOUT_MS) {
+		self->_start_cmd   = false;
+		self->_start_bcast = false;
+	}
+
+	_tg3spmc_sim_update_physics(self, delta_ms);
+
+	if (self->_state != (uint8_t)_TG3SPMC_SIM_STATE_OFF) {
+		_tg3spmc_sim_update_state(self);
+	}
+
+	if (self->_state > (uint8_t)_TG3SPMC_SIM_STATE_BOOT) {
+		_tg3spmc_sim_update_frames(self);
+	}
+}
+
+/**
+ * @brief Takes a frame sent by the module (to be passed to the controller).
+ * @param self Pointer to the simulator.
+ * @param f Pointer to the frame to be filled.
+ * @return True if a frame was taken.
+ */
+bool tg3spmc_sim_get_tx_frame(struct tg3spmc_sim *self,
+			      struct tg3spmc_frame *f)
+{
+	return tg3spmc_queue_get(&self->_tx, f);
+}
+
+/**
+ * @brief Number of module frames dropped, not taken in time.
+ * @param self Pointer to the simulator.
+ */
+uint32_t tg3spmc_sim_get_tx_drops(struct tg3spmc_sim *self)
+{
+	return tg3spmc_queue_drops(&self->_tx);
+}
+
+/**
+ * @brief Time until the module must be stepped again.
+ *
+ * Covers frame transmission and state transitions, 0 while produced frames
+ * are not taken. Must also be stepped after pins, received frames or
+ * injected faults change.
+ * @param self Pointer to the simulator.
+ * @return Time (milliseconds) or TG3SPMC_DEADLINE_NONE if powered off.
+ */
+uint32_t tg3spmc_sim_next_deadline_ms(struct tg3spmc_sim *self)
+{
+	uint32_t deadline_ms = TG3SPMC_DEADLINE_NONE;
+	uint32_t t;
+
+	switch (self->_state) {
+	case _TG3SPMC_SIM_STATE_OFF:
+		break;
+
+	case _TG3SPMC_SIM_STATE_BOOT:
+		deadline_ms = _tg3spmc_time_left_ms(self->_timer_ms,
+						    TG3SPMC_SIM_BOOT_MS);
+		break;
+
+	case _TG3SPMC_SIM_STATE_SOFTSTART:
+		deadline_ms = _tg3spmc_time_left_ms(self->_timer_ms,
+			(self->_timer_ms < TG3SPMC_SIM_SOFTSTART_FLAG_MS) ?
+			TG3SPMC_SIM_SOFTSTART_FLAG_MS :
+			TG3SPMC_SIM_SOFTSTART_MS);
+		break;
+
+	case _TG3SPMC_SIM_STATE_RELAY:
+		deadline_ms = _tg3spmc_time_left_ms(self->_timer_ms,
+						    TG3SPMC_SIM_CUR_OUT_MS);
+		break;
+
+	default:
+		break;
+	}
+
+	if (self->_state > (uint8_t)_TG3SPMC_SIM_STATE_BOOT) {
+		t = _tg3spmc_time_left_ms(self->_status_timer_ms,
+					  TG3SPMC_SIM_MSG_PERIOD_MS);
+		deadline_ms = (t < deadline_ms) ? t : deadline_ms;
+
+		t = _tg3spmc_time_left_ms(self->_params_timer_ms,
+					  TG3SPMC_SIM_MSG_PERIOD_MS);
+		deadline_ms = (t < deadline_ms) ? t : deadline_ms;
+
+		if (self->_start_cmd) {
+			t = _tg3spmc_time_left_ms(self->_cmd_timer_ms,
+						  TG3SPMC_SIM_CMD_TIMEOUT_MS);
+			deadline_ms = (t < deadline_ms) ? t : deadline_ms;
+		}
+	}
+
+	/* Frames are waiting to be taken */
+	if (!tg3spmc_queue_is_empty(&self->_tx)) {
+		deadline_ms = 0u;
+	}
+
+	return deadline_ms;
+}
+
+/**
+ * @brief Tells if the module is delivering current (flag_cur_out).
+ * @param self Pointer to the simulator.
+ */
+bool tg3spmc_sim_is_charging(struct tg3spmc_sim *self)
+{
+	return (self->_state == (uint8_t)_TG3SPMC_SIM_STATE_CHARGING);
+}
+
+/******************************************************************************
+ * CLOSED LOOP
+ *****************************************************************************/
+/* Pins and controller frames to the module, module frames to the
+ * controller. Returns events of the controller (bit per event) */
+uint8_t _tg3spmc_sim_exchange(struct tg3spmc_sim *self, struct tg3spmc *mod)
+{
+	struct tg3spmc_frame f;
+	enum tg3spmc_event ev;
+
+	tg3spmc_sim_set_pins(self, tg3spmc_get_pwron_pin_state(mod),
+			     tg3spmc_get_chgen_pin_state(mod));
+	while (tg3spmc_get_tx_frame(mod, &f)) {
+		(void)tg3spmc_sim_put_rx_frame(self, &f);
+	}
+
+	tg3spmc_sim_step(self, 0u);
+
+	while (tg3spmc_sim_get_tx_frame(self, &f)) {
+		(void)tg3spmc_put_rx_frame(mod, &f);
+	}
+
+	ev = tg3spmc_step(mod, 0u);
+
+	/* Pins and frames changed by the last step go out at once */
+	tg3spmc_sim_set_pins(self, tg3spmc_get_pwron_pin_state(mod),
+			     tg3spmc_get_chgen_pin_state(mod));
+	while (tg3spmc_get_tx_frame(mod, &f)) {
+		(void)tg3spmc_sim_put_rx_frame(self, &f);
+	}
+
+	tg3spmc_sim_step(self, 0u);
+
+	return (ev != TG3SPMC_EVENT_NONE) ? (uint8_t)(1u << ev) : 0u;
+}
+
+/**
+ * @brief Runs the controller against the simulated module on virtual time.
+ *
+ * Both are stepped at the earliest of their deadlines, pins and frames are
+ * exchanged after every step. Controller TX queue must not be enabled.
+ * @param self Pointer to the simulator.
+ * @param mod Pointer to the controller, with the same module ID.
+ * @param duration_ms Virtual time to run (milliseconds).
+ * @return Controller events seen during the run (bit per tg3spmc_event).
+ */
+uint8_t tg3spmc_sim_run(struct tg3spmc_sim *self, struct tg3spmc *mod,
+			uint32_t duration_ms)
+{
+	enum tg3spmc_event ev;
+	uint32_t left_ms = duration_ms;
+	uint32_t delta_ms;
+	uint32_t t;
+	uint8_t  events = 0u;
+
+	do {
+		delta_ms = tg3spmc_next_deadline_ms(mod);
+		t = tg3spmc_sim_next_deadline_ms(self);
+		delta_ms = (t < delta_ms) ? t : delta_ms;
+		delta_ms = (left_ms < delta_ms) ? left_ms : delta_ms;
+		left_ms -= delta_ms;
+
+		ev = tg3spmc_step(mod, delta_ms);
+		if (ev != TG3SPMC_EVENT_NONE) {
+			events |= (uint8_t)(1u << ev);
+		}
+
+		tg3spmc_sim_step(self, delta_ms);
+		events |= _tg3spmc_sim_exchange(self, mod);
+	} while (left_ms > 0u);
+
+	return events;
+}
+
+#endif /* TG3SPMC_SIM_H */